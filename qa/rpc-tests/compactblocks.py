@@ -0,0 +1,95 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018-2020 The ROIyalCoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Compact block relay benchmark: three nodes in a line share a memory pool,
+# the first one mines a block over it, and the time until the last one has
+# it is measured with compact blocks on and with -compactblocks=0.
+#
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--txcount", dest="txcount", default=100, type="int",
+                          help="Transactions in each relayed block (default: %default)")
+        parser.add_option("--rounds", dest="rounds", default=5, type="int",
+                          help="Blocks relayed for each setting (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.start_line([])
+        self.nodes[0].setgenerate(True, 110)
+        sync_blocks(self.nodes)
+
+    def start_line(self, extra_args):
+        self.nodes = start_nodes(3, self.options.tmpdir, [extra_args] * 3)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        self.is_network_split = False
+
+    def wait_for_tip(self, node, tip, timeout=60):
+        start = time.time()
+        while node.getbestblockhash() != tip:
+            if time.time() - start > timeout:
+                raise AssertionError("block %s not relayed in %ds" % (tip, timeout))
+            time.sleep(0.01)
+        return time.time() - start
+
+    def check_negotiated(self, fEnabled, timeout=10):
+        # sendcmpct follows the version handshake, give it a moment
+        start = time.time()
+        while True:
+            peers = [peer for node in self.nodes for peer in node.getpeerinfo()]
+            if all(peer['compactblocks'] == fEnabled for peer in peers) or time.time() - start > timeout:
+                break
+            time.sleep(0.1)
+        for peer in peers:
+            assert_equal(peer['compactblocks'], fEnabled)
+            if not fEnabled:
+                assert(not peer['cmpct_hb_to'] and not peer['cmpct_hb_from'])
+
+    def relay_rounds(self):
+        address = self.nodes[2].getnewaddress()
+        elapsed = 0.0
+        for i in range(self.options.rounds):
+            for j in range(self.options.txcount):
+                self.nodes[0].sendtoaddress(address, 0.01)
+            sync_mempools(self.nodes)
+            bytes_before = sum(peer['bytesrecv'] for peer in self.nodes[2].getpeerinfo())
+            start = time.time()
+            self.nodes[0].setgenerate(True, 1)
+            tip = self.nodes[0].getbestblockhash()
+            elapsed += time.time() - start + self.wait_for_tip(self.nodes[2], tip)
+            assert_equal(self.nodes[2].getrawmempool(), [])
+        bytes_after = sum(peer['bytesrecv'] for peer in self.nodes[2].getpeerinfo())
+        return elapsed / self.options.rounds, bytes_after - bytes_before
+
+    def run_test(self):
+        self.check_negotiated(True)
+        latency, nbytes = self.relay_rounds()
+        print("Compact blocks: %.3fs per block over two hops, %d bytes for the last block" % (latency, nbytes))
+
+        # Nodes that just handed over a new tip are asked to push the next ones
+        hb = [peer['cmpct_hb_from'] for peer in self.nodes[2].getpeerinfo()]
+        assert_equal(hb, [True])
+
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+        self.start_line(["-compactblocks=0"])
+        self.check_negotiated(False)
+        latency_full, nbytes_full = self.relay_rounds()
+        print("Full blocks: %.3fs per block over two hops, %d bytes for the last block" % (latency_full, nbytes_full))
+
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[2].getblockcount(), 110 + 2 * self.options.rounds)
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
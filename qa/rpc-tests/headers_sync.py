@@ -0,0 +1,72 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018-2020 The ROIyalCoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Headers-first sync benchmark: one node mines a chain, a set of peers
+# syncs it, then a fresh node connects to all of them and downloads the
+# chain in parallel. Reports how long each stage took and how the blocks
+# were spread over the peers.
+#
+from test_framework import BitcoinTestFramework
+from util import *
+import time
+
+class HeadersSyncTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--blocks", dest="blocks", default=500, type="int",
+                          help="Length of the chain to sync (default: %default)")
+        parser.add_option("--peers", dest="peers", default=3, type="int",
+                          help="Number of synced peers the fresh node downloads from (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, self.options.peers + 1)
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.options.peers, self.options.tmpdir)
+        self.is_network_split = False
+
+    def wait_for_height(self, node, height, timeout=600):
+        start = time.time()
+        while node.getblockcount() < height:
+            if time.time() - start > timeout:
+                raise AssertionError("sync timed out at height %d of %d" % (node.getblockcount(), height))
+            time.sleep(0.1)
+        return time.time() - start
+
+    def run_test(self):
+        nblocks = self.options.blocks
+        npeers = self.options.peers
+
+        start = time.time()
+        self.nodes[0].setgenerate(True, nblocks)
+        print("Mined %d blocks in %.2fs" % (nblocks, time.time() - start))
+
+        # Relay from the miner to the other peers, one hop at a time
+        for i in range(1, npeers):
+            connect_nodes_bi(self.nodes, i - 1, i)
+        start = time.time()
+        sync_blocks(self.nodes)
+        print("Relayed to %d peers in %.2fs" % (npeers - 1, time.time() - start))
+
+        # A fresh node with outbound connections to all peers; every one of
+        # them is a download candidate
+        fresh = start_node(npeers, self.options.tmpdir, ["-debug=net"])
+        self.nodes.append(fresh)
+        start = time.time()
+        for i in range(npeers):
+            connect_nodes(fresh, i)
+        elapsed = self.wait_for_height(fresh, nblocks)
+        assert_equal(fresh.getbestblockhash(), self.nodes[0].getbestblockhash())
+        print("Fresh node synced %d blocks from %d peers in %.2fs (%.1f blocks/s)" %
+              (nblocks, npeers, elapsed, nblocks / max(elapsed, 0.001)))
+
+        for peer in fresh.getpeerinfo():
+            print("  peer %s: %d bytes received, synced_headers=%d synced_blocks=%d" %
+                  (peer['addr'], peer['bytesrecv'], peer.get('synced_headers', -1), peer.get('synced_blocks', -1)))
+
+if __name__ == '__main__':
+    HeadersSyncTest().main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018-2020 The ROIyalCoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Stress the read-only chain calls, which run without cs_main, while the
+# node keeps reorganizing: every answer has to describe one consistent chain.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import random
+import threading
+
+class RPCReadersReorgTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--readers", dest="readers", default=4, type="int",
+                          help="Number of concurrent RPC reader threads (default: %default)")
+        parser.add_option("--reorgs", dest="reorgs", default=50, type="int",
+                          help="Number of reorgs to perform (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = start_nodes(1, self.options.tmpdir, [["-txindex", "-rpcthreads=%d" % (self.options.readers + 1)]])
+        self.is_network_split = False
+
+    def read_loop(self, stop, failures, counts):
+        rpc = AuthServiceProxy(self.nodes[0].url)
+        reads = 0
+        while not stop.is_set():
+            try:
+                info = rpc.getblockchaininfo()
+                assert(info['blocks'] >= 0)
+                height = random.randint(0, info['blocks'])
+                try:
+                    blockhash = rpc.getblockhash(height)
+                except JSONRPCException as e:
+                    # The chain may have become shorter in between
+                    assert_equal(e.error['code'], -8)
+                    continue
+                block = rpc.getblock(blockhash)
+                assert_equal(block['height'], height)
+                assert(block['confirmations'] == -1 or block['confirmations'] >= 1)
+                if 'nextblockhash' in block:
+                    header = rpc.getblockheader(block['nextblockhash'])
+                    assert_equal(header['previousblockhash'], blockhash)
+                tx = rpc.getrawtransaction(block['tx'][0], 1)
+                assert('blockhash' in tx)
+                rpc.gettxout(block['tx'][0], 0)
+                reads += 1
+            except Exception as e:
+                failures.append(repr(e))
+                return
+        counts.append(reads)
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.setgenerate(True, 30)
+
+        stop = threading.Event()
+        failures = []
+        counts = []
+        readers = [threading.Thread(target=self.read_loop, args=(stop, failures, counts))
+                   for i in range(self.options.readers)]
+        for t in readers:
+            t.start()
+
+        for i in range(self.options.reorgs):
+            depth = random.randint(1, 5)
+            forkhash = node.getblockhash(node.getblockcount() - depth + 1)
+            node.invalidateblock(forkhash)
+            if i % 2:
+                # Replace the disconnected blocks with a longer branch
+                node.setgenerate(True, depth + 1)
+            else:
+                node.reconsiderblock(forkhash)
+            if failures:
+                break
+
+        stop.set()
+        for t in readers:
+            t.join()
+
+        if failures:
+            raise AssertionError("reader failed: %s" % failures[0])
+        print("%d reads across %d reorgs" % (sum(counts), self.options.reorgs))
+
+if __name__ == '__main__':
+    RPCReadersReorgTest().main()
@@ -0,0 +1,56 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018-2020 The ROIyalCoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Check the UTXO set statistics kept across blocks, reorgs and restarts
+# against a full count of the coin database.
+#
+from test_framework import BitcoinTestFramework
+from util import *
+
+class UTXOStatsTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = start_nodes(1, self.options.tmpdir)
+        self.is_network_split = False
+
+    def check_verified(self):
+        info = self.nodes[0].gettxoutsetinfo(True)
+        assert(info['verified'])
+        assert_equal(info, dict(self.nodes[0].gettxoutsetinfo(), bytes_serialized=info['bytes_serialized'],
+                                hash_serialized=info['hash_serialized'], verified=True))
+        return self.nodes[0].gettxoutsetinfo()
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.setgenerate(True, 110)
+        stats = self.check_verified()
+        assert_equal(stats['height'], 110)
+
+        # Spend some outputs so the set sees removals as well
+        for i in range(5):
+            node.sendtoaddress(node.getnewaddress(), 1)
+        node.setgenerate(True, 1)
+        stats = self.check_verified()
+
+        # Disconnecting a block restores exactly the previous set
+        tip = node.getbestblockhash()
+        node.invalidateblock(tip)
+        before = self.check_verified()
+        assert(before['muhash'] != stats['muhash'])
+        node.reconsiderblock(tip)
+        assert_equal(self.check_verified(), stats)
+
+        # And the statistics survive a restart
+        stop_node(node, 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir)
+        assert_equal(self.check_verified(), stats)
+
+if __name__ == '__main__':
+    UTXOStatsTest().main()
@@ -64,3 +64,54 @@ bool MemoryPageLocker::Unlock(const void* addr, size_t len)
 LockedPageManager::LockedPageManager() : LockedPageManagerBase<MemoryPageLocker>(GetSystemPageSize())
 {
 }
+
+CNetBufferPool* CNetBufferPool::_instance = NULL;
+boost::once_flag CNetBufferPool::init_flag = BOOST_ONCE_INIT;
+
+/** The size class of a buffer, or 0 for ones too large to pool */
+static size_t GetNetBufferClass(size_t nSize)
+{
+    size_t nBits = CNetBufferPool::MIN_CLASS_BITS;
+    while (nBits <= CNetBufferPool::MAX_CLASS_BITS && ((size_t)1 << nBits) < nSize)
+        nBits++;
+    return nBits <= CNetBufferPool::MAX_CLASS_BITS ? nBits : 0;
+}
+
+void* CNetBufferPool::Allocate(size_t nSize)
+{
+    size_t nClass = GetNetBufferClass(nSize);
+    if (nClass == 0)
+        return ::operator new(nSize);
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!vFree[nClass].empty()) {
+            void* p = vFree[nClass].back();
+            vFree[nClass].pop_back();
+            nCachedBytes -= (size_t)1 << nClass;
+            return p;
+        }
+    }
+    return ::operator new((size_t)1 << nClass);
+}
+
+void CNetBufferPool::Free(void* p, size_t nSize)
+{
+    if (p == NULL)
+        return;
+    size_t nClass = GetNetBufferClass(nSize);
+    if (nClass != 0) {
+        boost::mutex::scoped_lock lock(mutex);
+        if (nCachedBytes + ((size_t)1 << nClass) <= MAX_CACHED_BYTES) {
+            vFree[nClass].push_back(p);
+            nCachedBytes += (size_t)1 << nClass;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+size_t CNetBufferPool::GetCachedBytes()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return nCachedBytes;
+}
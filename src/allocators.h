@@ -9,6 +9,8 @@
 #include <map>
 #include <string.h>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <boost/thread/mutex.hpp>
@@ -258,10 +260,130 @@ struct zero_after_free_allocator : public std::allocator<T> {
     }
 };
 
+/**
+ * Free lists of buffers for public network data, in power of two size classes,
+ * so that the buffers of one message are reused for the next one instead of
+ * going back to the heap. Freed buffers are kept up to MAX_CACHED_BYTES.
+ *
+ * Created on demand and never destroyed: nodes, and the messages they hold,
+ * may be deleted by static destructors that run after it would have been.
+ */
+class CNetBufferPool
+{
+public:
+    static const size_t MIN_CLASS_BITS = 6;   //!< 64 bytes
+    static const size_t MAX_CLASS_BITS = 22;  //!< 4 MiB, twice the largest P2P message
+    static const size_t MAX_CACHED_BYTES = 16 * 1024 * 1024;
+
+    static CNetBufferPool& Instance()
+    {
+        boost::call_once(CNetBufferPool::CreateInstance, CNetBufferPool::init_flag);
+        return *CNetBufferPool::_instance;
+    }
+
+    void* Allocate(size_t nSize);
+    void Free(void* p, size_t nSize);
+
+    //! Bytes sitting in the free lists
+    size_t GetCachedBytes();
+
+private:
+    boost::mutex mutex;
+    std::vector<void*> vFree[MAX_CLASS_BITS + 1];
+    size_t nCachedBytes;
+
+    CNetBufferPool() : nCachedBytes(0) {}
+
+    static void CreateInstance() { CNetBufferPool::_instance = new CNetBufferPool(); }
+
+    static CNetBufferPool* _instance;
+    static boost::once_flag init_flag;
+};
+
+//
+// Allocator of serialized data. Freed memory is cleared by default, since
+// serialized data may hold private keys. Buffers of public P2P messages are
+// taken from CNetBufferPool instead, and go back to it without being cleared.
+//
+template <typename T>
+struct serialize_allocator {
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    // The pool goes along with a buffer when it is moved or swapped, but copies are cleared again
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+    template <typename _Other>
+    struct rebind {
+        typedef serialize_allocator<_Other> other;
+    };
+
+    bool fNetBuffer;
+
+    serialize_allocator() throw() : fNetBuffer(false) {}
+    explicit serialize_allocator(bool fNetBufferIn) throw() : fNetBuffer(fNetBufferIn) {}
+    template <typename U>
+    serialize_allocator(const serialize_allocator<U>& a) throw() : fNetBuffer(a.fNetBuffer)
+    {
+    }
+
+    serialize_allocator select_on_container_copy_construction() const { return serialize_allocator(); }
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        if (fNetBuffer)
+            return static_cast<T*>(CNetBufferPool::Instance().Allocate(sizeof(T) * n));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (fNetBuffer) {
+            CNetBufferPool::Instance().Free(p, sizeof(T) * n);
+            return;
+        }
+        if (p != NULL)
+            OPENSSL_cleanse(p, sizeof(T) * n);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    std::size_t max_size() const throw() { return std::size_t(-1) / sizeof(T); }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const serialize_allocator<T>& a, const serialize_allocator<U>& b)
+{
+    return a.fNetBuffer == b.fNetBuffer;
+}
+
+template <typename T, typename U>
+bool operator!=(const serialize_allocator<T>& a, const serialize_allocator<U>& b)
+{
+    return !(a == b);
+}
+
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
-// Byte-vector that clears its contents before deletion.
-typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
+// Byte-vector that clears its contents before deletion, unless it holds a network message.
+typedef std::vector<char, serialize_allocator<char> > CSerializeData;
 
 #endif // BITCOIN_ALLOCATORS_H
@@ -0,0 +1,123 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <univalue.h>
+
+#include <iostream>
+
+static double gettimedouble(void)
+{
+    return GetTimeMicros() * 0.000001;
+}
+
+std::map<std::string, benchmark::BenchFunction>& benchmark::BenchRunner::benchmarks()
+{
+    static std::map<std::string, benchmark::BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+std::vector<std::string> benchmark::BenchRunner::List()
+{
+    std::vector<std::string> vNames;
+    for (std::map<std::string, BenchFunction>::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it)
+        vNames.push_back(it->first);
+    return vNames;
+}
+
+std::vector<benchmark::Result> benchmark::BenchRunner::RunAll(double elapsedTimeForOne, const std::string& strFilter)
+{
+    std::vector<Result> results;
+    for (std::map<std::string, BenchFunction>::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it) {
+        if (!strFilter.empty() && it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, elapsedTimeForOne);
+        BenchFunction& func = it->second;
+        func(state);
+        results.push_back(state.GetResult());
+    }
+    return results;
+}
+
+bool benchmark::State::KeepRunning()
+{
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    } else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count + 1) % timeCheckCount != 0) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime) / timeCheckCount;
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne * timeCheckCount < maxElapsed / 16) timeCheckCount *= 2;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+    return false;
+}
+
+benchmark::Result benchmark::State::GetResult() const
+{
+    Result result;
+    result.name = name;
+    result.count = count;
+    result.minTime = count ? minTime : 0;
+    result.maxTime = count ? maxTime : 0;
+    result.average = count ? (lastTime - beginTime) / count : 0;
+    return result;
+}
+
+std::string benchmark::FormatCSV(const std::vector<Result>& results)
+{
+    std::string strOut = "#Benchmark,count,min,max,average\n";
+    for (std::vector<Result>::const_iterator it = results.begin(); it != results.end(); ++it)
+        strOut += strprintf("%s,%u,%.15f,%.15f,%.15f\n", it->name, it->count, it->minTime, it->maxTime, it->average);
+    return strOut;
+}
+
+static int64_t ToNanos(double nSeconds)
+{
+    return (int64_t)(nSeconds * 1e9 + 0.5);
+}
+
+std::string benchmark::FormatJSON(const std::vector<Result>& results)
+{
+    UniValue benchmarks(UniValue::VARR);
+    for (std::vector<Result>::const_iterator it = results.begin(); it != results.end(); ++it) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", it->name));
+        entry.push_back(Pair("iterations", it->count));
+        entry.push_back(Pair("min_ns", ToNanos(it->minTime)));
+        entry.push_back(Pair("max_ns", ToNanos(it->maxTime)));
+        entry.push_back(Pair("avg_ns", ToNanos(it->average)));
+        benchmarks.push_back(entry);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("format", 1));
+    result.push_back(Pair("version", FormatFullVersion()));
+    result.push_back(Pair("benchmarks", benchmarks));
+    return result.write(2) + "\n";
+}
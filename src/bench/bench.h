@@ -0,0 +1,104 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ */
+
+namespace benchmark
+{
+/** Timing summary of a single benchmark run. All times are seconds per iteration. */
+struct Result {
+    std::string name;
+    uint64_t count;
+    double minTime;
+    double maxTime;
+    double average;
+};
+
+class State
+{
+    std::string name;
+    double maxElapsed;
+    double beginTime;
+    double lastTime, minTime, maxTime;
+    uint64_t count;
+    uint64_t timeCheckCount;
+
+public:
+    State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0)
+    {
+        minTime = std::numeric_limits<double>::max();
+        maxTime = std::numeric_limits<double>::min();
+        timeCheckCount = 1;
+    }
+    bool KeepRunning();
+    Result GetResult() const;
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+    static std::map<std::string, BenchFunction>& benchmarks();
+
+public:
+    BenchRunner(std::string name, BenchFunction func);
+
+    /** Names of all registered benchmarks, in the order they are run. */
+    static std::vector<std::string> List();
+
+    /**
+     * Run every benchmark whose name contains strFilter (all if empty), spending roughly
+     * elapsedTimeForOne seconds on each. Results are sorted by name so that the output is
+     * directly comparable between runs.
+     */
+    static std::vector<Result> RunAll(double elapsedTimeForOne = 1.0, const std::string& strFilter = "");
+};
+
+/** Render results as "#Benchmark,count,min,max,average" lines. */
+std::string FormatCSV(const std::vector<Result>& results);
+
+/** Render results as a JSON document with a fixed key order and nanosecond timings. */
+std::string FormatJSON(const std::vector<Result>& results);
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
@@ -0,0 +1,60 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "util.h"
+
+#include <fstream>
+#include <iostream>
+
+static const int64_t DEFAULT_BENCH_TIME_MILLIS = 1000;
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_roco [options]\n\n"
+                  << "Options:\n"
+                  << "  -list              List available benchmarks and exit\n"
+                  << "  -filter=<substr>   Only run benchmarks whose name contains <substr>\n"
+                  << "  -time=<ms>         Time spent on each benchmark in milliseconds (default: " << DEFAULT_BENCH_TIME_MILLIS << ")\n"
+                  << "  -json              Print results as JSON instead of CSV\n"
+                  << "  -output=<file>     Write results to <file> instead of stdout\n";
+        return 0;
+    }
+
+    if (GetBoolArg("-list", false)) {
+        std::vector<std::string> vNames = benchmark::BenchRunner::List();
+        for (unsigned int i = 0; i < vNames.size(); i++)
+            std::cout << vNames[i] << "\n";
+        return 0;
+    }
+
+    SetupEnvironment();
+    std::cerr << "Using the '" << SHA256AutoDetect() << "' SHA256 implementation\n";
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::UNITTEST);
+
+    double nElapsed = GetArg("-time", DEFAULT_BENCH_TIME_MILLIS) / 1000.0;
+    std::vector<benchmark::Result> results = benchmark::BenchRunner::RunAll(nElapsed, GetArg("-filter", ""));
+    std::string strOut = GetBoolArg("-json", false) ? benchmark::FormatJSON(results) : benchmark::FormatCSV(results);
+
+    if (mapArgs.count("-output")) {
+        std::ofstream file(mapArgs["-output"].c_str());
+        if (!file) {
+            std::cerr << "Error: cannot open " << mapArgs["-output"] << " for writing\n";
+            return 1;
+        }
+        file << strOut;
+    } else {
+        std::cout << strOut;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "streams.h"
+
+// Build a block close to MAX_BLOCK_SIZE_CURRENT out of ordinary
+// one-input/two-output pay-to-pubkey-hash sized transactions.
+static CBlock CreateLargeBlock()
+{
+    CBlock block;
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.nTime = 1536000000;
+    block.nBits = 0x1e0ffff0;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(coinbase);
+
+    uint256 prevHash = block.vtx[0].GetHash();
+    for (int i = 0; i < 8000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prevHash, 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, (unsigned char)i) << std::vector<unsigned char>(33, 2);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = COIN + i;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+        prevHash = block.vtx.back().GetHash();
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void SerializeLargeBlock(benchmark::State& state)
+{
+    CBlock block = CreateLargeBlock();
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block;
+    }
+}
+
+static void DeserializeLargeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CreateLargeBlock();
+    while (state.KeepRunning()) {
+        CDataStream copy(stream.begin(), stream.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        copy >> block;
+    }
+}
+
+static void BuildMerkleTreeLargeBlock(benchmark::State& state)
+{
+    CBlock block = CreateLargeBlock();
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+// What IncrementExtraNonce does for every extranonce roll while mining.
+static void UpdateMerkleTreeCoinbaseLargeBlock(benchmark::State& state)
+{
+    CBlock block = CreateLargeBlock();
+    CMutableTransaction txCoinbase(block.vtx[0]);
+    while (state.KeepRunning()) {
+        txCoinbase.nLockTime++;
+        block.vtx[0] = txCoinbase;
+        block.UpdateMerkleTreeCoinbase();
+    }
+}
+
+BENCHMARK(SerializeLargeBlock);
+BENCHMARK(DeserializeLargeBlock);
+BENCHMARK(BuildMerkleTreeLargeBlock);
+BENCHMARK(UpdateMerkleTreeCoinbaseLargeBlock);
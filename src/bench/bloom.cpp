@@ -0,0 +1,55 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "bloom.h"
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "utilstrencodings.h"
+
+static const int BLOOM_BENCH_ELEMENTS = 1000;
+
+static void BloomFilterInsertContains(benchmark::State& state)
+{
+    std::vector<uint256> vHashes;
+    for (int n = 0; n < BLOOM_BENCH_ELEMENTS; n++)
+        vHashes.push_back(Hash(BEGIN(n), END(n)));
+
+    while (state.KeepRunning()) {
+        CBloomFilter filter(BLOOM_BENCH_ELEMENTS, 0.0001, 0, BLOOM_UPDATE_ALL);
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            filter.insert(vHashes[i]);
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            assert(filter.contains(vHashes[i]));
+    }
+}
+
+// Matching a transaction against an SPV peer's filter, done for every
+// transaction relayed to or included in a merkleblock for that peer.
+static void BloomFilterIsRelevant(benchmark::State& state)
+{
+    CBloomFilter filter(BLOOM_BENCH_ELEMENTS, 0.0001, 0, BLOOM_UPDATE_NONE);
+    for (int n = 0; n < BLOOM_BENCH_ELEMENTS; n++) {
+        uint160 hash = Hash160(BEGIN(n), END(n));
+        filter.insert(std::vector<unsigned char>(hash.begin(), hash.end()));
+    }
+
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+    tx.vin[1].scriptSig = tx.vin[0].scriptSig;
+    tx.vout.resize(2);
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CTransaction txConst(tx);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            filter.IsRelevantAndUpdate(txConst);
+    }
+}
+
+BENCHMARK(BloomFilterInsertContains);
+BENCHMARK(BloomFilterIsRelevant);
@@ -0,0 +1,75 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+static const int COINS_BENCH_TXS = 10000;
+
+static uint256 BenchTxid(int n)
+{
+    return Hash(BEGIN(n), END(n));
+}
+
+static CCoins BenchCoins(int n)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = n;
+    coins.vout.resize(2);
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = COIN + n;
+        coins.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)n) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return coins;
+}
+
+// Fill a cache that plays the role of pcoinsTip's backing store.
+static void FillBase(CCoinsViewCache& base)
+{
+    for (int n = 0; n < COINS_BENCH_TXS; n++)
+        *base.ModifyCoins(BenchTxid(n)) = BenchCoins(n);
+}
+
+// Cold lookups through a fresh cache layer, as done by CheckInputs when a
+// block is connected against a new view on top of pcoinsTip.
+static void CoinsCacheFetch(benchmark::State& state)
+{
+    CCoinsView empty;
+    CCoinsViewCache base(&empty);
+    FillBase(base);
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&base);
+        for (int n = 0; n < COINS_BENCH_TXS; n++)
+            assert(view.AccessCoins(BenchTxid(n)) != NULL);
+    }
+}
+
+// Spend one output of every coin in a child cache and flush it back into the
+// parent, as ConnectBlock's view does into pcoinsTip.
+static void CoinsCacheFlush(benchmark::State& state)
+{
+    CCoinsView empty;
+    CCoinsViewCache base(&empty);
+    FillBase(base);
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&base);
+        for (int n = 0; n < COINS_BENCH_TXS; n++) {
+            CCoinsModifier coins = view.ModifyCoins(BenchTxid(n));
+            if (coins->IsAvailable(0))
+                coins->Spend(0);
+            else
+                coins->vout[0] = BenchCoins(n).vout[0];
+        }
+        view.Flush();
+    }
+}
+
+BENCHMARK(CoinsCacheFetch);
+BENCHMARK(CoinsCacheFlush);
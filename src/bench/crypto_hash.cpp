@@ -0,0 +1,89 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+/* Number of bytes to hash per iteration */
+static const uint64_t BUFFER_SIZE = 1000 * 1000;
+
+static void SHA256_1M(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(begin_ptr(in), in.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000000; i++) {
+            CSHA256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
+        }
+    }
+}
+
+// One merkle tree node: double-SHA256 of two concatenated 32-byte hashes.
+static void CHash256_64b(benchmark::State& state)
+{
+    uint256 left = uint256S("0x1b");
+    uint256 right = uint256S("0x2c");
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100000; i++) {
+            left = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        }
+    }
+}
+
+// A full merkle level of 1024 pairs, through the multi-lane double-SHA256.
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning())
+        SHA256D64(begin_ptr(out), begin_ptr(in), 1024);
+}
+
+static void HashKeccak256_1M(benchmark::State& state)
+{
+    std::vector<uint8_t> in(BUFFER_SIZE, 0);
+    uint256 hash;
+    while (state.KeepRunning())
+        hash = HashKeccak256(in.begin(), in.end());
+}
+
+// Block identity hash (Keccak-256 over the 80-byte header), as used for every
+// header received, every block index entry and every PoW check.
+static void BlockHeaderGetHash(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    header.hashPrevBlock = uint256S("0x5c0f0ae5a51ee2e74a4beb1bf61b5c9a8eb45dea34e3e4bd9e8cf37e8c5b7013");
+    header.hashMerkleRoot = uint256S("0x3e3e10b7ac3a1b6c2d1a5ccb8a2a49a4f5e7f2a3d4e5f60718293a4b5c6d7e8f");
+    header.nTime = 1536000000;
+    header.nBits = 0x1e0ffff0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 10000; i++) {
+            header.nNonce++;
+            header.GetHash();
+        }
+    }
+}
+
+BENCHMARK(SHA256_1M);
+BENCHMARK(SHA256_32b);
+BENCHMARK(CHash256_64b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(HashKeccak256_1M);
+BENCHMARK(BlockHeaderGetHash);
@@ -0,0 +1,48 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "fakechain.h"
+
+#include "main.h"
+
+CFakeChain::CFakeChain(int nBlocks, unsigned int nStartTime)
+{
+    // Size both vectors up front: every index points into vHashes and at its predecessor.
+    vHashes.resize(nBlocks);
+    vIndex.resize(nBlocks);
+    uint256 hashPrev;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockHeader header;
+        header.hashPrevBlock = hashPrev;
+        header.nTime = nStartTime + i * BLOCK_SPACING;
+        header.nBits = 0x1e0ffff0;
+        header.nNonce = i;
+        vHashes[i] = header.GetHash();
+        hashPrev = vHashes[i];
+
+        CBlockIndex& index = vIndex[i];
+        index = CBlockIndex(CBlock(header));
+        index.phashBlock = &vHashes[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        index.nHeight = i;
+        index.BuildSkip();
+        // Give every tenth block a fresh stake modifier, as the modifier
+        // interval would on a live chain.
+        index.SetStakeModifier(i / 10 + 1, i % 10 == 0);
+        mapBlockIndex.insert(std::make_pair(vHashes[i], &index));
+    }
+    chainActive.SetTip(&vIndex.back());
+}
+
+CFakeChain::~CFakeChain()
+{
+    chainActive.SetTip(NULL);
+    for (unsigned int i = 0; i < vHashes.size(); i++)
+        mapBlockIndex.erase(vHashes[i]);
+}
+
+CBlockHeader CFakeChain::GetHeader(int nHeight) const
+{
+    return vIndex[nHeight].GetBlockHeader();
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_FAKECHAIN_H
+#define BITCOIN_BENCH_FAKECHAIN_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <vector>
+
+/**
+ * An in-memory chain of block index entries installed as chainActive and
+ * registered in mapBlockIndex for the lifetime of the object, so that code
+ * depending on the active chain (stake modifiers, masternode scores) can be
+ * benchmarked without a block database.
+ */
+class CFakeChain
+{
+private:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+public:
+    static const unsigned int BLOCK_SPACING = 60;
+
+    CFakeChain(int nBlocks, unsigned int nStartTime);
+    ~CFakeChain();
+
+    CBlockHeader GetHeader(int nHeight) const;
+    CBlockIndex* operator[](int nHeight) { return &vIndex[nHeight]; }
+};
+
+#endif // BITCOIN_BENCH_FAKECHAIN_H
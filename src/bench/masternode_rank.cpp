@@ -0,0 +1,37 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fakechain.h"
+
+#include "hash.h"
+#include "utilstrencodings.h"
+#include "masternodeman.h"
+
+static const int MASTERNODE_BENCH_COUNT = 5000;
+
+static CTxIn BenchCollateral(int n)
+{
+    return CTxIn(COutPoint(Hash(BEGIN(n), END(n)), n % 4));
+}
+
+// Score and sort the whole list, as done for every mnw vote received and for
+// every payee selection.
+static void MasternodeRankAtScale(benchmark::State& state)
+{
+    CFakeChain chain(200, 1536000000);
+    CMasternodeMan man;
+    for (int n = 0; n < MASTERNODE_BENCH_COUNT; n++) {
+        CMasternode mn;
+        mn.vin = BenchCollateral(n);
+        man.Add(mn);
+    }
+
+    const CTxIn vinLast = BenchCollateral(MASTERNODE_BENCH_COUNT - 1);
+    while (state.KeepRunning()) {
+        assert(man.GetMasternodeRank(vinLast, 100, 0, false) > 0);
+    }
+}
+
+BENCHMARK(MasternodeRankAtScale);
@@ -0,0 +1,51 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+static const int MEMPOOL_BENCH_TXS = 2000;
+
+// Chains of one-input/two-output transactions, each spending the previous
+// one, so that removeForBlock has to walk mapNextTx for every entry.
+static std::vector<CTransaction> CreateMempoolTxs()
+{
+    std::vector<CTransaction> vtx;
+    uint256 hashPrev;
+    for (int n = 0; n < MEMPOOL_BENCH_TXS; n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, n % 10 ? 0 : n);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            tx.vout[i].nValue = COIN;
+        }
+        vtx.push_back(tx);
+        hashPrev = vtx.back().GetHash();
+    }
+    return vtx;
+}
+
+static void MempoolAddRemoveForBlock(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = CreateMempoolTxs();
+    CTxMemPool pool(CFeeRate(0));
+    std::list<CTransaction> conflicts;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            pool.addUnchecked(vtx[i].GetHash(), CTxMemPoolEntry(vtx[i], 1000, 0, 0.0, 1));
+        pool.removeForBlock(vtx, 2, conflicts);
+        assert(pool.size() == 0);
+        conflicts.clear();
+    }
+}
+
+BENCHMARK(MempoolAddRemoveForBlock);
@@ -0,0 +1,58 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fakechain.h"
+
+#include "kernel.h"
+#include "main.h"
+
+static const unsigned int STAKE_BENCH_START_TIME = 1536000000;
+
+// Coin staked from block 10 of a 200 block chain, so that the stake
+// modifier selection interval is covered by the fake chain.
+static void SetupStake(CFakeChain& chain, CBlock& blockFrom, CMutableTransaction& txPrev)
+{
+    blockFrom = CBlock(chain.GetHeader(10));
+    txPrev.vin.resize(1);
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 10000 * COIN;
+    txPrev.vout[0].scriptPubKey = CScript() << OP_TRUE;
+}
+
+// A single kernel check, as done by CheckProofOfStake for every PoS block.
+static void CheckStakeKernelHash_Check(benchmark::State& state)
+{
+    CFakeChain chain(200, STAKE_BENCH_START_TIME);
+    CBlock blockFrom;
+    CMutableTransaction txPrev;
+    SetupStake(chain, blockFrom, txPrev);
+    CTransaction tx(txPrev);
+    COutPoint prevout(tx.GetHash(), 0);
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = chainActive.Tip()->nTime + 60;
+        CheckStakeKernelHash(0x1e0ffff0, blockFrom, tx, prevout, nTimeTx, 0, true, hashProofOfStake);
+    }
+}
+
+// A full hash drift search as done by the staker for each stakeable coin.
+// The target is unreachable, so every iteration walks the whole drift window.
+static void CheckStakeKernelHash_Search(benchmark::State& state)
+{
+    CFakeChain chain(200, STAKE_BENCH_START_TIME);
+    CBlock blockFrom;
+    CMutableTransaction txPrev;
+    SetupStake(chain, blockFrom, txPrev);
+    CTransaction tx(txPrev);
+    COutPoint prevout(tx.GetHash(), 0);
+    uint256 hashProofOfStake;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = chainActive.Tip()->nTime + 60;
+        CheckStakeKernelHash(0x01010000, blockFrom, tx, prevout, nTimeTx, 60, false, hashProofOfStake);
+    }
+}
+
+BENCHMARK(CheckStakeKernelHash_Check);
+BENCHMARK(CheckStakeKernelHash_Search);
@@ -0,0 +1,48 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+// Verify a freshly signed pay-to-pubkey-hash spend through CScriptCheck, the
+// unit of work handed to the script check queue by ConnectBlock. The signature
+// cache is never populated, so every iteration performs a full ECDSA verify.
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vout.resize(1);
+    txFrom.vout[0].nValue = COIN;
+    txFrom.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = COIN;
+    txSpend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CTransaction txPrev(txFrom);
+    assert(SignSignature(keystore, txPrev, txSpend, 0));
+
+    CCoins coins(txPrev, 0);
+    CTransaction tx(txSpend);
+    while (state.KeepRunning()) {
+        CScriptCheck check(coins, tx, 0, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+        assert(check());
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
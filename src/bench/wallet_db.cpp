@@ -0,0 +1,116 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "main.h"
+#include "util.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+#include <boost/filesystem/operations.hpp>
+
+static const int WALLET_BENCH_TXS_PER_BLOCK = 50;
+static const int WALLET_BENCH_LOAD_TXS = 20000;
+
+// The database environment opens in the data directory: unless one is given,
+// use a fresh one so that no real wallet is touched.
+static void SetupBenchDataDir()
+{
+    if (mapArgs.count("-datadir"))
+        return;
+    boost::filesystem::path path = GetTempPath() / strprintf("bench_roco_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(path);
+    mapArgs["-datadir"] = path.string();
+}
+
+static CWalletTx BenchWalletTx(int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(Hash(BEGIN(n), END(n)), 0);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 100 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(Hash160(BEGIN(n), END(n))) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1] = tx.vout[0];
+    CWalletTx wtx(NULL, tx);
+    wtx.nOrderPos = n;
+    return wtx;
+}
+
+// A block's worth of wallet transactions, each written on a handle of its
+// own as AddToWallet does: every write commits and checkpoints alone.
+static void WalletWriteTx_Single(benchmark::State& state)
+{
+    SetupBenchDataDir();
+    const std::string strFile = "bench_write_single.dat";
+    CWalletDB(strFile, "cr+");
+    std::vector<CWalletTx> vWtx;
+    for (int n = 0; n < WALLET_BENCH_TXS_PER_BLOCK; n++)
+        vWtx.push_back(BenchWalletTx(n));
+
+    while (state.KeepRunning()) {
+        for (const CWalletTx& wtx : vWtx)
+            CWalletDB(strFile).WriteTx(wtx.GetHash(), wtx);
+    }
+}
+
+// The same writes grouped in a batch, as the wallet syncs a block
+static void WalletWriteTx_Batch(benchmark::State& state)
+{
+    SetupBenchDataDir();
+    const std::string strFile = "bench_write_batch.dat";
+    CWalletDB(strFile, "cr+");
+    std::vector<CWalletTx> vWtx;
+    for (int n = 0; n < WALLET_BENCH_TXS_PER_BLOCK; n++)
+        vWtx.push_back(BenchWalletTx(n));
+
+    while (state.KeepRunning()) {
+        CDBBatch batch(strFile);
+        for (const CWalletTx& wtx : vWtx)
+            CWalletDB(strFile).WriteTx(wtx.GetHash(), wtx);
+    }
+}
+
+// Read every record of a wallet holding many transactions, as at startup,
+// decoding the transactions on nThreads threads
+static void WalletLoad(benchmark::State& state, int nThreads)
+{
+    SetupBenchDataDir();
+    const std::string strFile = "bench_load.dat";
+    if (!boost::filesystem::exists(GetDataDir() / strFile)) {
+        CWalletDB(strFile, "cr+");
+        CDBBatch batch(strFile);
+        CWalletDB walletdb(strFile);
+        for (int n = 0; n < WALLET_BENCH_LOAD_TXS; n++) {
+            CWalletTx wtx = BenchWalletTx(n);
+            walletdb.WriteTx(wtx.GetHash(), wtx);
+        }
+    }
+
+    int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    nScriptCheckThreads = nThreads;
+    while (state.KeepRunning()) {
+        CWallet wallet(strFile);
+        CWalletDB(strFile).LoadWallet(&wallet);
+        assert(wallet.mapWallet.size() == (size_t)WALLET_BENCH_LOAD_TXS);
+    }
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+}
+
+static void WalletLoad_Single(benchmark::State& state)
+{
+    WalletLoad(state, 1);
+}
+
+static void WalletLoad_Parallel(benchmark::State& state)
+{
+    WalletLoad(state, 4);
+}
+
+BENCHMARK(WalletWriteTx_Single);
+BENCHMARK(WalletWriteTx_Batch);
+BENCHMARK(WalletLoad_Single);
+BENCHMARK(WalletLoad_Parallel);
@@ -0,0 +1,170 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/unordered_map.hpp>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                            header(block.GetBlockHeader()),
+                                                                            vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+
+    // The coinbase and coinstake are never in anyone's memory pool
+    size_t nPrefill = block.IsProofOfStake() ? 2 : 1;
+    nPrefill = std::min(nPrefill, block.vtx.size());
+    prefilledtxn.resize(nPrefill);
+    for (size_t i = 0; i < nPrefill; i++) {
+        prefilledtxn[i].index = i;
+        prefilledtxn[i].tx = block.vtx[i];
+    }
+    shorttxids.reserve(block.vtx.size() - nPrefill);
+    for (size_t i = nPrefill; i < block.vtx.size(); i++)
+        shorttxids.push_back(GetShortID(block.vtx[i].GetHash()));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(key);
+    shorttxidk0 = ReadLE64(key);
+    shorttxidk1 = ReadLE64(key + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffULL;
+}
+
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<const CTransaction*>& vExtraTxn)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_TXN)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn_available.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    txn_available.resize(cmpctblock.BlockTxCount());
+    vHave.assign(txn_available.size(), false);
+
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        const PrefilledTransaction& prefilled = cmpctblock.prefilledtxn[i];
+        if (prefilled.tx.IsNull() || prefilled.index >= txn_available.size())
+            return READ_STATUS_INVALID;
+        txn_available[prefilled.index] = prefilled.tx;
+        vHave[prefilled.index] = true;
+    }
+    nPrefilled = cmpctblock.prefilledtxn.size();
+
+    // Where each short id goes, skipping the positions of prefilled ones
+    boost::unordered_map<uint64_t, uint32_t> mapShortIDs;
+    mapShortIDs.rehash(cmpctblock.shorttxids.size());
+    uint32_t nIndex = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++, nIndex++) {
+        while (vHave[nIndex])
+            nIndex++;
+        mapShortIDs[cmpctblock.shorttxids[i]] = nIndex;
+    }
+    // Two transactions of the block share a short id; cannot tell them apart
+    if (mapShortIDs.size() != cmpctblock.shorttxids.size())
+        return READ_STATUS_FAILED;
+
+    // Positions two candidates matched; left for the peer to send
+    std::vector<bool> vCollided(txn_available.size(), false);
+
+    {
+        LOCK(pool->cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool->mapTx.begin(); it != pool->mapTx.end(); it++) {
+            boost::unordered_map<uint64_t, uint32_t>::const_iterator itID = mapShortIDs.find(cmpctblock.GetShortID(it->first));
+            if (itID == mapShortIDs.end() || vCollided[itID->second])
+                continue;
+            if (!vHave[itID->second]) {
+                txn_available[itID->second] = it->second.GetTx();
+                vHave[itID->second] = true;
+                nMempool++;
+            } else {
+                txn_available[itID->second] = CTransaction();
+                vHave[itID->second] = false;
+                vCollided[itID->second] = true;
+                nMempool--;
+            }
+            if (nMempool == mapShortIDs.size())
+                break;
+        }
+    }
+
+    for (size_t i = 0; i < vExtraTxn.size() && nMempool + nExtra < mapShortIDs.size(); i++) {
+        const CTransaction& tx = *vExtraTxn[i];
+        boost::unordered_map<uint64_t, uint32_t>::const_iterator itID = mapShortIDs.find(cmpctblock.GetShortID(tx.GetHash()));
+        if (itID == mapShortIDs.end() || vCollided[itID->second])
+            continue;
+        if (!vHave[itID->second]) {
+            txn_available[itID->second] = tx;
+            vHave[itID->second] = true;
+            nExtra++;
+        } else if (txn_available[itID->second].GetHash() != tx.GetHash()) {
+            // Found in the pool already, as a different transaction
+            txn_available[itID->second] = CTransaction();
+            vHave[itID->second] = false;
+            vCollided[itID->second] = true;
+            nMempool--;
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n",
+        cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < vHave.size());
+    return vHave[index];
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const
+{
+    assert(!header.IsNull());
+    block = CBlock(header);
+    block.vchBlockSig = vchBlockSig;
+    block.vtx.resize(txn_available.size());
+
+    size_t nTxMissing = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (vHave[i]) {
+            block.vtx[i] = txn_available[i];
+        } else {
+            if (nTxMissing >= vtxMissing.size())
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtxMissing[nTxMissing++];
+        }
+    }
+    if (nTxMissing != vtxMissing.size())
+        return READ_STATUS_INVALID;
+
+    // A transaction from our pool may share its short id with the one that is
+    // in the block; the merkle root is where that shows
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != header.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool, %lu txn from extra pool and %lu txn requested\n",
+        header.GetHash().ToString(), nPrefilled, nMempool, nExtra, vtxMissing.size());
+    return READ_STATUS_OK;
+}
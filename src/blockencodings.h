@@ -0,0 +1,206 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <limits>
+#include <stdint.h>
+#include <vector>
+
+class CTxMemPool;
+
+/** Most transactions a block can hold, none being smaller than 60 bytes */
+static const unsigned int MAX_BLOCK_TXN = MAX_BLOCK_SIZE_CURRENT / 60;
+
+/** Transactions of a block requested by index, after a compact block left them missing */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    //! Ascending absolute indexes; sent as differences to keep them small
+    std::vector<uint32_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        uint64_t nCount = indexes.size();
+        READWRITE(COMPACTSIZE(nCount));
+        if (ser_action.ForRead()) {
+            if (nCount > MAX_BLOCK_TXN)
+                throw std::ios_base::failure("too many indexes requested");
+            indexes.resize(nCount);
+        }
+        uint64_t nPrev = 0;
+        for (uint64_t i = 0; i < nCount; i++) {
+            uint64_t nDiff = i == 0 ? indexes[i] : indexes[i] - nPrev - 1;
+            READWRITE(COMPACTSIZE(nDiff));
+            if (ser_action.ForRead()) {
+                uint64_t nIndex = i == 0 ? nDiff : nPrev + 1 + nDiff;
+                if (nIndex > std::numeric_limits<uint32_t>::max())
+                    throw std::ios_base::failure("index overflowed 32 bits");
+                indexes[i] = nIndex;
+            }
+            nPrev = indexes[i];
+        }
+    }
+};
+
+/** Answer to a BlockTransactionsRequest, the transactions in the order requested */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent in full inside a compact block, with its index in the block */
+struct PrefilledTransaction {
+    uint32_t index;
+    CTransaction tx;
+};
+
+/**
+ * A block as its header and a short id for every transaction, so that a peer
+ * can rebuild it from the transactions it already has.
+ *
+ * Short ids are SipHash-2-4 of the txid truncated to 48 bits, keyed by the
+ * header and a nonce the sender picks for every message; a collision that
+ * happens for one peer is unlikely to happen for another, and cannot be
+ * precomputed. The coinbase and the coinstake, which never sit in a memory
+ * pool, are sent in full. The block signature of a proof-of-stake block
+ * travels along with the header.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+protected:
+    std::vector<uint64_t> shorttxids;
+    //! Ascending by index; sent with the indexes as differences
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    //! Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() : shorttxidk0(0), shorttxidk1(0), nonce(0) {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(header);
+        READWRITE(vchBlockSig);
+        READWRITE(nonce);
+
+        uint64_t nShortIDs = shorttxids.size();
+        READWRITE(COMPACTSIZE(nShortIDs));
+        if (ser_action.ForRead()) {
+            if (nShortIDs > MAX_BLOCK_TXN)
+                throw std::ios_base::failure("too many short ids");
+            shorttxids.resize(nShortIDs);
+        }
+        for (uint64_t i = 0; i < nShortIDs; i++) {
+            uint32_t lsb = shorttxids[i] & 0xffffffff;
+            uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+            READWRITE(lsb);
+            READWRITE(msb);
+            shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+        }
+
+        uint64_t nPrefilled = prefilledtxn.size();
+        READWRITE(COMPACTSIZE(nPrefilled));
+        if (ser_action.ForRead()) {
+            if (nPrefilled > MAX_BLOCK_TXN)
+                throw std::ios_base::failure("too many prefilled transactions");
+            prefilledtxn.resize(nPrefilled);
+        }
+        uint64_t nPrev = 0;
+        for (uint64_t i = 0; i < nPrefilled; i++) {
+            uint64_t nDiff = i == 0 ? prefilledtxn[i].index : prefilledtxn[i].index - nPrev - 1;
+            READWRITE(COMPACTSIZE(nDiff));
+            if (ser_action.ForRead()) {
+                uint64_t nIndex = i == 0 ? nDiff : nPrev + 1 + nDiff;
+                if (nIndex > std::numeric_limits<uint16_t>::max())
+                    throw std::ios_base::failure("prefilled index overflowed 16 bits");
+                prefilledtxn[i].index = nIndex;
+            }
+            READWRITE(prefilledtxn[i].tx);
+            nPrev = prefilledtxn[i].index;
+        }
+
+        if (ser_action.ForRead())
+            FillShortTxIDSelector();
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //! Invalid object, peer is sending bogus data
+    READ_STATUS_FAILED,  //! Failed to process object, e.g. a short id collision; fall back to the full block
+};
+
+/**
+ * A block being rebuilt from a compact block: the transactions found so far,
+ * and which ones still have to be fetched from the peer.
+ */
+class PartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> txn_available;
+    std::vector<bool> vHave;
+    size_t nPrefilled, nMempool, nExtra;
+    CTxMemPool* pool;
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+public:
+    explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : nPrefilled(0), nMempool(0), nExtra(0), pool(poolIn) {}
+
+    /** Fill in what the compact block, the memory pool and vExtraTxn (e.g. orphans) provide */
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<const CTransaction*>& vExtraTxn);
+    bool IsTxAvailable(size_t index) const;
+    /** The complete block, given the missing transactions in index order */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing) const;
+
+    const CBlockHeader& GetHeader() const { return header; }
+    size_t GetTxCount() const { return txn_available.size(); }
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -0,0 +1,179 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+int GetImportThreads()
+{
+    int nThreads = GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    // The thread connecting the blocks gets a core of its own by default
+    if (nThreads == 0)
+        nThreads = (int)boost::thread::hardware_concurrency() - 1;
+    else if (nThreads < 0)
+        nThreads += (int)boost::thread::hardware_concurrency();
+    if (nThreads < 1)
+        nThreads = 1;
+    else if (nThreads > MAX_IMPORT_THREADS)
+        nThreads = MAX_IMPORT_THREADS;
+    return nThreads;
+}
+
+CBlockImportPipeline::CBlockImportPipeline(FILE* fileInIn, int nWorkers) : nNextRead(0), nNextOut(0), fReaderDone(false), fStop(false), fileIn(fileInIn), nBytesRead(0), nChecked(0), nCheckFailed(0)
+{
+    threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this));
+    for (int i = 0; i < std::max(nWorkers, 1); i++)
+        threadGroup.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+    }
+    condReader.notify_all();
+    condWorker.notify_all();
+    threadGroup.join_all();
+}
+
+void CBlockImportPipeline::ThreadRead()
+{
+    RenameThread("roco-loadblk-read");
+
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2 * MAX_BLOCKFILE_SIZE, MAX_BLOCKFILE_SIZE + 8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fStop && nNextRead - nNextOut >= MAX_IMPORT_BLOCKS_IN_FLIGHT)
+                condReader.wait(lock);
+            if (fStop)
+                break;
+        }
+
+        blkdat.SetPos(nRewind);
+        nRewind++;         // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read the raw block, deserialization happens on a worker
+            uint64_t nBlockPos = blkdat.GetPos();
+            std::vector<char> vch(nSize);
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            blkdat.read(&vch[0], nSize);
+            nRewind = blkdat.GetPos();
+
+            boost::unique_lock<boost::mutex> lock(cs);
+            queueRaw.push_back(CRawRecord());
+            queueRaw.back().nSeq = nNextRead++;
+            queueRaw.back().nPos = nBlockPos;
+            queueRaw.back().vch.swap(vch);
+            nBytesRead += nSize;
+            condWorker.notify_one();
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    fReaderDone = true;
+    condWorker.notify_all();
+    condConsumer.notify_all();
+}
+
+void CBlockImportPipeline::ThreadCheck()
+{
+    RenameThread("roco-loadblk-check");
+
+    while (true) {
+        CRawRecord record;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fStop && !fReaderDone && queueRaw.empty())
+                condWorker.wait(lock);
+            if (fStop || queueRaw.empty())
+                return;
+            record.nSeq = queueRaw.front().nSeq;
+            record.nPos = queueRaw.front().nPos;
+            record.vch.swap(queueRaw.front().vch);
+            queueRaw.pop_front();
+        }
+
+        CImportedBlock imported;
+        imported.nPos = record.nPos;
+        try {
+            CDataStream ss(record.vch, SER_DISK, CLIENT_VERSION);
+            ss >> imported.block;
+            imported.fDeserialized = true;
+            imported.hash = imported.block.GetHash();
+            // Why a block fails is logged by the check, here and only here
+            CValidationState state;
+            imported.fChecked = CheckBlockContextFree(imported.block, state, true, true, true);
+        } catch (const std::exception& e) {
+            imported.strError = e.what();
+        }
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (imported.fDeserialized) {
+            if (imported.fChecked)
+                nChecked++;
+            else
+                nCheckFailed++;
+        }
+        std::swap(mapDone[record.nSeq], imported);
+        if (record.nSeq == nNextOut)
+            condConsumer.notify_one();
+    }
+}
+
+bool CBlockImportPipeline::Next(CImportedBlock& blockOut)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        std::map<uint64_t, CImportedBlock>::iterator it = mapDone.find(nNextOut);
+        if (it != mapDone.end()) {
+            std::swap(blockOut, it->second);
+            mapDone.erase(it);
+            nNextOut++;
+            condReader.notify_one();
+            return true;
+        }
+        if (fReaderDone && nNextOut == nNextRead)
+            return false;
+        // interruption point
+        condConsumer.wait(lock);
+    }
+}
+
+unsigned int CBlockImportPipeline::InFlight()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nNextRead - nNextOut;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "primitives/block.h"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Default for -importthreads, 0 = one less than the number of cores */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Maximum number of block deserialization and check threads */
+static const int MAX_IMPORT_THREADS = 8;
+/** Maximum number of blocks read ahead of the one being connected */
+static const unsigned int MAX_IMPORT_BLOCKS_IN_FLIGHT = 128;
+
+/** A block read from an external or blk?????.dat file, in file order */
+struct CImportedBlock {
+    //! Offset of the serialized block within the file
+    unsigned int nPos;
+    //! Whether the raw record could be deserialized at all
+    bool fDeserialized;
+    //! Reason the record could not be deserialized
+    std::string strError;
+    CBlock block;
+    uint256 hash;
+    //! Whether the block passed the context-free checks, signature included
+    bool fChecked;
+
+    CImportedBlock() : nPos(0), fDeserialized(false), fChecked(false) {}
+};
+
+/**
+ * Read-ahead pipeline for LoadExternalBlockFile.
+ *
+ * A reader thread scans the file for message-start markers and slices out
+ * the raw block records; a pool of workers deserializes them and runs the
+ * context-free checks (PoW, merkle root, transactions, block signature) in
+ * parallel; Next() hands the results back in file order so the caller can
+ * connect them under cs_main exactly as the serial loader did.
+ */
+class CBlockImportPipeline
+{
+private:
+    struct CRawRecord {
+        uint64_t nSeq;
+        unsigned int nPos;
+        std::vector<char> vch;
+    };
+
+    boost::mutex cs;
+    //! Reader blocks on this while too many blocks are in flight
+    boost::condition_variable condReader;
+    //! Workers block on this when there are no raw records
+    boost::condition_variable condWorker;
+    //! The consumer blocks on this until the next block in order is done
+    boost::condition_variable condConsumer;
+
+    std::deque<CRawRecord> queueRaw;
+    std::map<uint64_t, CImportedBlock> mapDone;
+    //! Sequence number of the next record the reader produces
+    uint64_t nNextRead;
+    //! Sequence number of the next block Next() returns
+    uint64_t nNextOut;
+    bool fReaderDone;
+    bool fStop;
+
+    FILE* fileIn;
+    boost::thread_group threadGroup;
+
+    void ThreadRead();
+    void ThreadCheck();
+
+public:
+    //! Statistics
+    std::atomic<uint64_t> nBytesRead;
+    std::atomic<uint64_t> nChecked;
+    std::atomic<uint64_t> nCheckFailed;
+
+    /** Takes over fileIn and closes it when the reader is done */
+    CBlockImportPipeline(FILE* fileInIn, int nWorkers);
+    ~CBlockImportPipeline();
+
+    /**
+     * Wait for the next block in file order.
+     * Returns false once the whole file has been consumed.
+     */
+    bool Next(CImportedBlock& blockOut);
+
+    /** Number of blocks read but not yet returned by Next() */
+    unsigned int InFlight();
+};
+
+/** Number of worker threads to use given -importthreads */
+int GetImportThreads();
+
+#endif // BITCOIN_BLOCKIMPORT_H
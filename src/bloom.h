@@ -97,4 +97,40 @@ public:
     void UpdateEmptyFull();
 };
 
+/**
+ * RollingBloomFilter is a probabilistic "keep track of most recently inserted" set,
+ * in fixed memory. It holds the last nElements / 2 to nElements inserted keys, with
+ * at most the given false positive rate.
+ *
+ * Keys are inserted in generations of nElements / 2. Every position of the filter
+ * records in two bits the generation (1, 2 or 3) that last set it, so starting a
+ * new generation wipes the one that used its number before, three generations ago.
+ * The two bits live in a pair of 64-bit words, which makes the wipe a pass of word
+ * operations instead of a bit at a time.
+ *
+ * The hash functions are seeded with a random tweak, so peers cannot work out
+ * keys that collide.
+ */
+class CRollingBloomFilter
+{
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    void insert(const std::vector<unsigned char>& vKey);
+    void insert(const uint256& hash);
+    bool contains(const std::vector<unsigned char>& vKey) const;
+    bool contains(const uint256& hash) const;
+
+    //! Forget everything, and pick a new tweak
+    void reset();
+
+private:
+    int nEntriesPerGeneration;
+    int nEntriesThisGeneration;
+    int nGeneration;
+    std::vector<uint64_t> data;
+    unsigned int nTweak;
+    int nHashFuncs;
+};
+
 #endif // BITCOIN_BLOOM_H
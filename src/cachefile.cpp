@@ -0,0 +1,118 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachefile.h"
+
+#include "chainparams.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <boost/filesystem/operations.hpp>
+
+CCacheFileWriter::CCacheFileWriter(const std::string& strMagicMessage, int nFormat) : ss(SER_DISK, CLIENT_VERSION)
+{
+    ss << strMagicMessage;
+    ss << FLATDATA(Params().MessageStart());
+    ss << nFormat;
+}
+
+void CCacheFileWriter::WriteChunk(uint64_t nItems, const CDataStream& ssChunk)
+{
+    ss << COMPACTSIZE(nItems);
+    ss << COMPACTSIZE((uint64_t)ssChunk.size());
+    ss.write(&ssChunk[0], ssChunk.size());
+    ss << Hash(ssChunk.begin(), ssChunk.end());
+}
+
+bool CCacheFileWriter::Commit(const boost::filesystem::path& path)
+{
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".new";
+
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s : Failed to open file %s", __func__, pathTmp.string());
+    bool fWritten = fwrite(&ss[0], 1, ss.size(), file) == ss.size();
+    if (fWritten)
+        FileCommit(file);
+    fclose(file);
+    if (!fWritten)
+        return error("%s : Failed to write %s", __func__, pathTmp.string());
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s : Rename-into-place of %s failed", __func__, path.string());
+    return true;
+}
+
+CCacheFileReader::ReadResult CCacheFileReader::Open(const boost::filesystem::path& path, const std::string& strMagicMessage, int nFormat)
+{
+    mapping = CMappedFileCache::Map(path.string());
+    if (mapping) {
+        pbegin = mapping->begin();
+        pend = mapping->end();
+    } else {
+        // No mmap here, or an empty file
+        FILE* file = fopen(path.string().c_str(), "rb");
+        if (!file)
+            return FileError;
+        char buf[65536];
+        size_t nRead;
+        while ((nRead = fread(buf, 1, sizeof(buf), file)) > 0)
+            vchFile.insert(vchFile.end(), buf, buf + nRead);
+        fclose(file);
+        pbegin = vchFile.empty() ? NULL : &vchFile[0];
+        pend = pbegin + vchFile.size();
+    }
+    pcur = pbegin;
+
+    try {
+        CSpanReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        std::string strMagicMessageTmp;
+        reader >> strMagicMessageTmp;
+        if (strMagicMessageTmp != strMagicMessage)
+            return IncorrectMagicMessage;
+
+        unsigned char pchMsgTmp[4];
+        reader >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return IncorrectMagicNumber;
+
+        int nFormatTmp;
+        reader >> nFormatTmp;
+        if (nFormatTmp != nFormat)
+            return IncorrectFormat;
+        pcur = pbegin + reader.GetPos();
+    } catch (const std::exception&) {
+        return IncorrectFormat;
+    }
+    return Ok;
+}
+
+CCacheFileReader::ReadResult CCacheFileReader::ReadChunks(std::vector<CChunk>& vChunks)
+{
+    try {
+        CSpanReader reader(pcur, pend, SER_DISK, CLIENT_VERSION);
+        uint64_t nChunks;
+        reader >> COMPACTSIZE(nChunks);
+        for (uint64_t i = 0; i < nChunks; i++) {
+            CChunk chunk;
+            uint64_t nBytes;
+            reader >> COMPACTSIZE(chunk.nItems) >> COMPACTSIZE(nBytes);
+            // Every item takes at least a byte
+            if (chunk.nItems > nBytes || nBytes > reader.size())
+                return IncorrectFormat;
+            chunk.pbegin = pcur + reader.GetPos();
+            chunk.pend = chunk.pbegin + nBytes;
+            reader.ignore(nBytes);
+            reader >> chunk.hash;
+            vChunks.push_back(chunk);
+        }
+        pcur += reader.GetPos();
+    } catch (const std::exception&) {
+        return IncorrectFormat;
+    }
+    return Ok;
+}
@@ -0,0 +1,178 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CACHEFILE_H
+#define BITCOIN_CACHEFILE_H
+
+#include "clientversion.h"
+#include "hash.h"
+#include "mappedfile.h"
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+
+/** Items in each chunk of a cache file section */
+static const unsigned int CACHEFILE_CHUNK_ITEMS = 512;
+
+/**
+ * Cache files such as mncache.dat and mnpayments.dat are laid out as
+ *
+ *   magic message, network magic, format version,
+ *   sections: a chunk count, then per chunk its item count, the size and
+ *             bytes of its serialized items and the hash of those bytes.
+ *
+ * Every chunk carries its own checksum, so a reader can check and decode
+ * the chunks of a section on several threads, straight from a read-only
+ * mapping of the file, without first reading and hashing it as a whole.
+ */
+class CCacheFileWriter
+{
+private:
+    CDataStream ss;
+
+    void WriteChunk(uint64_t nItems, const CDataStream& ssChunk);
+
+public:
+    CCacheFileWriter(const std::string& strMagicMessage, int nFormat);
+
+    template <typename T>
+    void WriteSection(const std::vector<T>& vItems)
+    {
+        uint64_t nChunks = (vItems.size() + CACHEFILE_CHUNK_ITEMS - 1) / CACHEFILE_CHUNK_ITEMS;
+        ss << COMPACTSIZE(nChunks);
+        for (size_t nFirst = 0; nFirst < vItems.size(); nFirst += CACHEFILE_CHUNK_ITEMS) {
+            size_t nEnd = std::min(vItems.size(), nFirst + CACHEFILE_CHUNK_ITEMS);
+            CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+            for (size_t i = nFirst; i < nEnd; i++)
+                ssChunk << vItems[i];
+            WriteChunk(nEnd - nFirst, ssChunk);
+        }
+    }
+
+    /** A section of a single chunk holding obj */
+    template <typename T>
+    void WriteObject(const T& obj)
+    {
+        CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+        ssChunk << obj;
+        ss << COMPACTSIZE((uint64_t)1);
+        WriteChunk(1, ssChunk);
+    }
+
+    /** Write the file next to path and move it over path once complete */
+    bool Commit(const boost::filesystem::path& path);
+};
+
+class CCacheFileReader
+{
+public:
+    enum ReadResult {
+        Ok,
+        FileError,
+        IncorrectHash,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+private:
+    struct CChunk {
+        uint64_t nItems;
+        const char* pbegin;
+        const char* pend;
+        uint256 hash;
+    };
+
+    MappedFileRef mapping;
+    //! The file contents when it could not be mapped
+    std::vector<char> vchFile;
+    const char* pbegin;
+    const char* pend;
+    const char* pcur;
+    int nThreads;
+
+    ReadResult ReadChunks(std::vector<CChunk>& vChunks);
+
+    template <typename T>
+    static void DecodeChunks(const std::vector<CChunk>* pvChunks, std::vector<std::vector<T> >* pvParts, std::vector<char>* pvResult, std::atomic<size_t>* pnNext)
+    {
+        size_t i;
+        while ((i = (*pnNext)++) < pvChunks->size()) {
+            const CChunk& chunk = (*pvChunks)[i];
+            if (Hash(chunk.pbegin, chunk.pend) != chunk.hash) {
+                (*pvResult)[i] = IncorrectHash;
+                continue;
+            }
+            try {
+                CSpanReader reader(chunk.pbegin, chunk.pend, SER_DISK, CLIENT_VERSION);
+                std::vector<T>& vPart = (*pvParts)[i];
+                vPart.resize(chunk.nItems);
+                for (T& item : vPart)
+                    reader >> item;
+                (*pvResult)[i] = reader.empty() ? Ok : IncorrectFormat;
+            } catch (const std::exception&) {
+                (*pvResult)[i] = IncorrectFormat;
+            }
+        }
+    }
+
+public:
+    explicit CCacheFileReader(int nThreadsIn) : pbegin(NULL), pend(NULL), pcur(NULL), nThreads(std::max(nThreadsIn, 1)) {}
+
+    ReadResult Open(const boost::filesystem::path& path, const std::string& strMagicMessage, int nFormat);
+
+    /** Read the next section, its chunks decoded in parallel */
+    template <typename T>
+    ReadResult ReadSection(std::vector<T>& vItems)
+    {
+        std::vector<CChunk> vChunks;
+        ReadResult result = ReadChunks(vChunks);
+        if (result != Ok)
+            return result;
+
+        std::vector<std::vector<T> > vParts(vChunks.size());
+        std::vector<char> vResult(vChunks.size(), Ok);
+        std::atomic<size_t> nNext(0);
+        boost::thread_group helpers;
+        for (int i = 1; i < std::min(nThreads, (int)vChunks.size()); i++)
+            helpers.create_thread(boost::bind(&CCacheFileReader::DecodeChunks<T>, &vChunks, &vParts, &vResult, &nNext));
+        DecodeChunks<T>(&vChunks, &vParts, &vResult, &nNext);
+        helpers.join_all();
+
+        vItems.clear();
+        for (size_t i = 0; i < vChunks.size(); i++) {
+            if (vResult[i] != Ok)
+                return (ReadResult)vResult[i];
+            vItems.insert(vItems.end(), vParts[i].begin(), vParts[i].end());
+        }
+        return Ok;
+    }
+
+    /** Read the next section, written by WriteObject */
+    template <typename T>
+    ReadResult ReadObject(T& obj)
+    {
+        std::vector<T> vItems;
+        ReadResult result = ReadSection(vItems);
+        if (result != Ok)
+            return result;
+        if (vItems.size() != 1)
+            return IncorrectFormat;
+        obj = vItems[0];
+        return Ok;
+    }
+
+    bool AtEnd() const { return pcur == pend; }
+};
+
+#endif // BITCOIN_CACHEFILE_H
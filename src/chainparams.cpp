@@ -158,7 +158,7 @@ public:
         fMineBlocksOnDemand = false;
         fSkipProofOfWorkCheck = true;
         fTestnetToBeDeprecatedFieldRPC = false;
-        fHeadersFirstSyncingActive = false;
+        fHeadersFirstSyncingActive = true;
 
         nPoolMaxTransactions = 3;
         strSporkKey = "04D91E760D4D94DA0C44ED34CDAD5016848286E2196D7D3D1D851E0AF0BF5D10C5FC1A1EB95302233800584972F9023458D7FC06372EF4560EC2C08075632F0DC3";
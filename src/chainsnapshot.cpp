@@ -0,0 +1,180 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainsnapshot.h"
+
+#include "primitives/block.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/thread/mutex.hpp>
+
+namespace
+{
+//! Guards chainSnapshot only; readers hold it just long enough to copy the pointer
+boost::mutex cs_chainSnapshot;
+CChainSnapshotRef chainSnapshot;
+
+// State the next snapshot is built from, guarded by cs_main
+CCoinsViewDB* pcoinsdbview = NULL;
+boost::shared_ptr<const CCoinsView> coinsBasePending;
+std::vector<CChainSnapshot::CoinsLayerRef> vCoinsLayersPending;
+size_t nCoinsPending = 0;
+//! Too many coins changed since the last flush to carry them in layers
+bool fCoinsOverflow = false;
+
+void SetChainSnapshot(const CChainSnapshotRef& snapshot)
+{
+    CChainSnapshotRef old;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_chainSnapshot);
+        old = chainSnapshot;
+        chainSnapshot = snapshot;
+    }
+    // old, and whatever it alone kept alive, is released outside the lock
+}
+} // anon namespace
+
+bool CChainSnapshot::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    if (!coinsBase)
+        return false;
+    for (std::vector<CoinsLayerRef>::const_reverse_iterator it = vCoinsLayers.rbegin(); it != vCoinsLayers.rend(); it++) {
+        CoinsLayer::const_iterator mi = (*it)->find(txid);
+        if (mi != (*it)->end()) {
+            if (mi->second.IsPruned())
+                return false;
+            coins = mi->second;
+            return true;
+        }
+    }
+    return coinsBase->GetCoins(txid, coins);
+}
+
+bool CCoinsViewChainSnapshot::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    return snapshot->GetCoins(txid, coins);
+}
+
+bool CCoinsViewChainSnapshot::HaveCoins(const uint256& txid) const
+{
+    CCoins coins;
+    return snapshot->GetCoins(txid, coins);
+}
+
+uint256 CCoinsViewChainSnapshot::GetBestBlock() const
+{
+    CBlockIndex* pindex = snapshot->Tip();
+    return pindex ? pindex->GetBlockHash() : uint256(0);
+}
+
+CChainSnapshotRef GetChainSnapshot()
+{
+    boost::unique_lock<boost::mutex> lock(cs_chainSnapshot);
+    return chainSnapshot;
+}
+
+void PublishChainSnapshot(const CChain& chain, CBlockIndex* pindexBestHeaderIn)
+{
+    CChainSnapshotRef prev = GetChainSnapshot();
+    boost::shared_ptr<CChainSnapshot> snapshot(new CChainSnapshot());
+    snapshot->nHeight = chain.Height();
+    snapshot->pindexBestHeader = pindexBestHeaderIn;
+
+    // Find the last height both chains agree on; only the chunks from there
+    // on need to be rebuilt, usually just the last one.
+    int nFork = -1;
+    if (prev) {
+        nFork = std::min(prev->nHeight, snapshot->nHeight);
+        while (nFork >= 0 && (*prev)[nFork] != chain[nFork])
+            nFork--;
+    }
+    size_t nKeep = prev ? std::min(prev->vChunks.size(), (size_t)((nFork + 1) / CHAIN_SNAPSHOT_CHUNK_SIZE)) : 0;
+    snapshot->vChunks.reserve(snapshot->nHeight / CHAIN_SNAPSHOT_CHUNK_SIZE + 1);
+    if (prev)
+        snapshot->vChunks.assign(prev->vChunks.begin(), prev->vChunks.begin() + nKeep);
+    for (int nStart = nKeep * CHAIN_SNAPSHOT_CHUNK_SIZE; nStart <= snapshot->nHeight; nStart += CHAIN_SNAPSHOT_CHUNK_SIZE) {
+        int nEnd = std::min(nStart + CHAIN_SNAPSHOT_CHUNK_SIZE - 1, snapshot->nHeight);
+        boost::shared_ptr<CChainSnapshot::Chunk> chunk(new CChainSnapshot::Chunk());
+        chunk->reserve(nEnd - nStart + 1);
+        for (int nHeight = nStart; nHeight <= nEnd; nHeight++)
+            chunk->push_back(chain[nHeight]);
+        snapshot->vChunks.push_back(chunk);
+    }
+
+    if (!fCoinsOverflow) {
+        snapshot->coinsBase = coinsBasePending;
+        snapshot->vCoinsLayers = vCoinsLayersPending;
+    }
+
+    SetChainSnapshot(snapshot);
+}
+
+void ChainSnapshotBlockApplied(const CBlock& block, CCoinsViewCache& view)
+{
+    if (!coinsBasePending || fCoinsOverflow)
+        return;
+
+    boost::shared_ptr<CChainSnapshot::CoinsLayer> layer(new CChainSnapshot::CoinsLayer());
+    for (const CTransaction& tx : block.vtx) {
+        (*layer)[tx.GetHash()];
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin)
+                (*layer)[txin.prevout.hash];
+        }
+    }
+    for (CChainSnapshot::CoinsLayer::iterator it = layer->begin(); it != layer->end(); it++) {
+        const CCoins* coins = view.AccessCoins(it->first);
+        if (coins)
+            it->second = *coins;
+    }
+
+    nCoinsPending += layer->size();
+    if (nCoinsPending > MAX_CHAIN_SNAPSHOT_COINS) {
+        LogPrint("rpc", "%s: %u coins changed since the last flush, snapshots go without coins until the next one\n", __func__, nCoinsPending);
+        fCoinsOverflow = true;
+        vCoinsLayersPending.clear();
+        return;
+    }
+    vCoinsLayersPending.push_back(layer);
+
+    // Keep lookups short by folding the layers into one now and then
+    if (vCoinsLayersPending.size() > MAX_CHAIN_SNAPSHOT_LAYERS) {
+        boost::shared_ptr<CChainSnapshot::CoinsLayer> merged(new CChainSnapshot::CoinsLayer());
+        for (const CChainSnapshot::CoinsLayerRef& ref : vCoinsLayersPending) {
+            for (CChainSnapshot::CoinsLayer::const_iterator it = ref->begin(); it != ref->end(); it++)
+                (*merged)[it->first] = it->second;
+        }
+        nCoinsPending = merged->size();
+        vCoinsLayersPending.assign(1, merged);
+    }
+}
+
+void ChainSnapshotCoinsFlushed()
+{
+    if (!pcoinsdbview)
+        return;
+    coinsBasePending.reset(pcoinsdbview->NewSnapshot());
+    vCoinsLayersPending.clear();
+    nCoinsPending = 0;
+    fCoinsOverflow = false;
+}
+
+void ResetChainSnapshot(CCoinsViewDB* pcoinsdbviewIn)
+{
+    SetChainSnapshot(CChainSnapshotRef());
+    coinsBasePending.reset();
+    vCoinsLayersPending.clear();
+    nCoinsPending = 0;
+    fCoinsOverflow = false;
+    pcoinsdbview = pcoinsdbviewIn;
+    ChainSnapshotCoinsFlushed();
+}
+
+CCoinsViewDBSnapshot* NewCoinsDBSnapshot()
+{
+    if (!pcoinsdbview)
+        return NULL;
+    return pcoinsdbview->NewSnapshot();
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINSNAPSHOT_H
+#define BITCOIN_CHAINSNAPSHOT_H
+
+#include "chain.h"
+#include "coins.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+class CBlock;
+class CCoinsViewDB;
+class CCoinsViewDBSnapshot;
+
+/** Number of block index pointers in one shared piece of the height index */
+static const int CHAIN_SNAPSHOT_CHUNK_SIZE = 4096;
+/** Coin entries kept on top of the last flushed coin database before snapshots go without coins until the next flush */
+static const size_t MAX_CHAIN_SNAPSHOT_COINS = 200000;
+/** Number of per-block coin layers after which they are merged into one */
+static const size_t MAX_CHAIN_SNAPSHOT_LAYERS = 16;
+
+/**
+ * Immutable view of the active chain for readers that do not hold cs_main.
+ *
+ * A new snapshot is published, under cs_main, whenever the tip or the best
+ * header changes; readers grab the current one and keep using it for as long
+ * as they like, seeing one consistent chain even across reorgs.
+ *
+ * The height index is split into fixed size chunks shared between
+ * consecutive snapshots, so extending the tip only copies the last chunk.
+ * Coins are the coin database as of its last flush, read through a LevelDB
+ * snapshot, with the entries touched by every block connected or
+ * disconnected since layered on top of it.
+ *
+ * Block index entries are never freed while the node runs. Their header
+ * fields do not change once created; status and file position fields may be
+ * updated concurrently, word by word.
+ */
+class CChainSnapshot
+{
+public:
+    typedef std::vector<CBlockIndex*> Chunk;
+    typedef boost::shared_ptr<const Chunk> ChunkRef;
+    //! Entries touched by one or more blocks; pruned entries mean "no coins"
+    typedef std::map<uint256, CCoins> CoinsLayer;
+    typedef boost::shared_ptr<const CoinsLayer> CoinsLayerRef;
+
+private:
+    std::vector<ChunkRef> vChunks;
+    int nHeight;
+    CBlockIndex* pindexBestHeader;
+    //! NULL when no coins are available in this snapshot
+    boost::shared_ptr<const CCoinsView> coinsBase;
+    //! Oldest first
+    std::vector<CoinsLayerRef> vCoinsLayers;
+
+    friend void PublishChainSnapshot(const CChain& chain, CBlockIndex* pindexBestHeaderIn);
+
+public:
+    CChainSnapshot() : nHeight(-1), pindexBestHeader(NULL) {}
+
+    /** Height of the tip, -1 for an empty chain */
+    int Height() const { return nHeight; }
+
+    CBlockIndex* operator[](int nHeightIn) const
+    {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return (*vChunks[nHeightIn / CHAIN_SNAPSHOT_CHUNK_SIZE])[nHeightIn % CHAIN_SNAPSHOT_CHUNK_SIZE];
+    }
+
+    CBlockIndex* Tip() const { return (*this)[nHeight]; }
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return pindex && (*this)[pindex->nHeight] == pindex;
+    }
+
+    CBlockIndex* Next(const CBlockIndex* pindex) const
+    {
+        return Contains(pindex) ? (*this)[pindex->nHeight + 1] : NULL;
+    }
+
+    CBlockIndex* BestHeader() const { return pindexBestHeader; }
+
+    /** Whether GetCoins can be used; false until the next flush after a long run of unflushed blocks */
+    bool HaveCoinsView() const { return (bool)coinsBase; }
+
+    /** Unspent outputs of txid at the tip of this snapshot */
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+};
+
+typedef boost::shared_ptr<const CChainSnapshot> CChainSnapshotRef;
+
+/** CCoinsView over a snapshot, to stack a CCoinsViewMemPool on */
+class CCoinsViewChainSnapshot : public CCoinsView
+{
+private:
+    CChainSnapshotRef snapshot;
+
+public:
+    explicit CCoinsViewChainSnapshot(const CChainSnapshotRef& snapshotIn) : snapshot(snapshotIn) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+};
+
+/** The most recently published snapshot, NULL while the block index is not loaded */
+CChainSnapshotRef GetChainSnapshot();
+
+/** Publish chain as the current snapshot. Requires cs_main. */
+void PublishChainSnapshot(const CChain& chain, CBlockIndex* pindexBestHeaderIn);
+
+/** Record the coins touched by block after it was applied to or removed from view. Requires cs_main. */
+void ChainSnapshotBlockApplied(const CBlock& block, CCoinsViewCache& view);
+
+/** The coin database caught up with the coins cache. Requires cs_main. */
+void ChainSnapshotCoinsFlushed();
+
+/**
+ * Set the coin database snapshots are based on and drop the current
+ * snapshot; called with NULL before the database or block index go away.
+ * Requires cs_main.
+ */
+void ResetChainSnapshot(CCoinsViewDB* pcoinsdbviewIn);
+
+/**
+ * The coin database as it is now, to scan without holding cs_main; NULL
+ * without a database. The caller deletes it. Requires cs_main.
+ */
+CCoinsViewDBSnapshot* NewCoinsDBSnapshot();
+
+#endif // BITCOIN_CHAINSNAPSHOT_H
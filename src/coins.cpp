@@ -6,6 +6,8 @@
 #include "coins.h"
 
 #include "random.h"
+#include "streams.h"
+#include "version.h"
 
 #include <assert.h>
 
@@ -58,12 +60,92 @@ bool CCoins::Spend(int nPos)
     return Spend(out, undo);
 }
 
+namespace
+{
+/** Serialized outpoint and output, the element of the set the MuHash covers */
+CDataStream SerializeOutput(const uint256& txid, unsigned int n, const CCoins& coins)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    uint32_t nCode = coins.nHeight * 4 + (coins.fCoinBase ? 1 : 0) + (coins.fCoinStake ? 2 : 0);
+    ss << txid << n << nCode << coins.vout[n];
+    return ss;
+}
+
+int64_t BogoSize(const CTxOut& out)
+{
+    // txid, index, height and flags, amount, script length and the script
+    return 32 + 4 + 4 + 8 + 2 + out.scriptPubKey.size();
+}
+} // anon namespace
+
+void CUTXOStats::AddOutput(const uint256& txid, unsigned int n, const CCoins& coins)
+{
+    const CTxOut& out = coins.vout[n];
+    CDataStream ss(SerializeOutput(txid, n, coins));
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nBogoSize += BogoSize(out);
+    nTotalAmount += out.nValue;
+}
+
+void CUTXOStats::RemoveOutput(const uint256& txid, unsigned int n, const CCoins& coins)
+{
+    const CTxOut& out = coins.vout[n];
+    CDataStream ss(SerializeOutput(txid, n, coins));
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nBogoSize -= BogoSize(out);
+    nTotalAmount -= out.nValue;
+}
+
+void CUTXOStats::AddCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            AddOutput(txid, i, coins);
+    }
+    nTransactions++;
+}
+
+void CUTXOStats::RemoveCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(txid, i, coins);
+    }
+    nTransactions--;
+}
+
+CUTXOStats& CUTXOStats::operator+=(const CUTXOStats& delta)
+{
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nBogoSize += delta.nBogoSize;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+    return *this;
+}
+
+void CUTXOStats::GetStats(CCoinsStats& stats) const
+{
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nBogoSize = nBogoSize;
+    stats.nTotalAmount = nTotalAmount;
+    muhash.Finalize(stats.hashMuHash.begin());
+}
+
 
 bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
-bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta) { return false; }
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
+bool CCoinsView::GetUTXOStats(CUTXOStats& stats) const { return false; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
@@ -71,8 +153,9 @@ bool CCoinsViewBacked::GetCoins(const uint256& txid, CCoins& coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta) { return base->BatchWrite(mapCoins, hashBlock, statsDelta); }
 bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetUTXOStats(CUTXOStats& stats) const { return base->GetUTXOStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -162,7 +245,7 @@ void CCoinsViewCache::SetBestBlock(const uint256& hashBlockIn)
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn)
+bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn, const CUTXOStats& statsDeltaIn)
 {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -196,13 +279,23 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    statsDelta += statsDeltaIn;
+    return true;
+}
+
+bool CCoinsViewCache::GetUTXOStats(CUTXOStats& stats) const
+{
+    if (!base->GetUTXOStats(stats))
+        return false;
+    stats += statsDelta;
     return true;
 }
 
 bool CCoinsViewCache::Flush()
 {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, statsDelta);
     cacheCoins.clear();
+    statsDelta.SetNull();
     return fOk;
 }
 
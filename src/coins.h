@@ -7,6 +7,7 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "crypto/muhash.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -326,8 +327,69 @@ struct CCoinsStats {
     uint64_t nSerializedSize;
     uint256 hashSerialized;
     CAmount nTotalAmount;
+    uint64_t nBogoSize;
+    uint256 hashMuHash;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0), nBogoSize(0), hashMuHash(0) {}
+};
+
+/**
+ * Totals over the unspent outputs, kept up to date as outputs are created and
+ * spent rather than recomputed by scanning the whole set. Also used for the
+ * change a block or a cache applies, which is why the counters are signed.
+ *
+ * The set itself is summarized by a MuHash of its outputs, so the digest does
+ * not depend on the order in which they were added or removed.
+ */
+class CUTXOStats
+{
+public:
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    //! Rough in-memory size of the set, independent of the database format
+    int64_t nBogoSize;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CUTXOStats() { SetNull(); }
+
+    void SetNull()
+    {
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nBogoSize = 0;
+        nTotalAmount = 0;
+        muhash = MuHash3072();
+    }
+
+    void AddOutput(const uint256& txid, unsigned int n, const CCoins& coins);
+    void RemoveOutput(const uint256& txid, unsigned int n, const CCoins& coins);
+    //! All unspent outputs of a transaction at once, counting the transaction
+    void AddCoins(const uint256& txid, const CCoins& coins);
+    void RemoveCoins(const uint256& txid, const CCoins& coins);
+
+    CUTXOStats& operator+=(const CUTXOStats& delta);
+
+    //! Fill in the counters and digest of stats. Computes an inverse, so best
+    //! done on a copy outside of any lock.
+    void GetStats(CCoinsStats& stats) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        unsigned char state[MuHash3072::SERIALIZED_SIZE];
+        if (!ser_action.ForRead())
+            muhash.GetState(state);
+        READWRITE(FLATDATA(state));
+        if (ser_action.ForRead())
+            muhash.SetState(state);
+    }
 };
 
 
@@ -346,12 +408,16 @@ public:
     virtual uint256 GetBestBlock() const;
 
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    //! The passed mapCoins can be modified. statsDelta is what the changes
+    //! do to the UTXO set statistics.
+    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta);
 
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! The incrementally maintained statistics, without scanning the set
+    virtual bool GetUTXOStats(CUTXOStats& stats) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -369,8 +435,9 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetUTXOStats(CUTXOStats& stats) const;
 };
 
 class CCoinsViewCache;
@@ -421,6 +488,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /** Change to the UTXO set statistics not yet pushed to the base */
+    CUTXOStats statsDelta;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -430,7 +500,14 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256& hashBlock);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDeltaIn);
+    bool GetUTXOStats(CUTXOStats& stats) const;
+
+    /**
+     * Whoever adds or spends outputs in this cache records the effect here;
+     * Flush() hands it to the base along with the coins.
+     */
+    CUTXOStats& StatsDelta() { return statsDelta; }
 
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
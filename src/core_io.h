@@ -9,6 +9,7 @@
 #include <vector>
 
 class CBlock;
+class CJSONWriter;
 class CScript;
 class CTransaction;
 class uint256;
@@ -29,5 +30,7 @@ extern void ScriptPubKeyToUniv(const CScript& scriptPubKey,
     UniValue& out,
     bool fIncludeHex);
 extern void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry);
+/** The members TxToUniv() adds for a transaction outside a block, written into an open object */
+extern void TxToJSONWriter(const CTransaction& tx, CJSONWriter& writer);
 
 #endif // BITCOIN_CORE_IO_H
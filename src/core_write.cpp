@@ -5,6 +5,7 @@
 #include "core_io.h"
 
 #include "base58.h"
+#include "jsonwriter.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/standard.h"
@@ -134,3 +135,94 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry)
 
     entry.pushKV("hex", EncodeHexTx(tx)); // the hex-encoded transaction. used the name "hex" to be consistent with the verbose output of "getrawtransaction".
 }
+
+static void ScriptPubKeyToJSONWriter(const CScript& scriptPubKey, CJSONWriter& writer)
+{
+    txnouttype type;
+    vector<CTxDestination> addresses;
+    int nRequired;
+
+    writer.Key("asm");
+    writer.String(scriptPubKey.ToString());
+    writer.Key("hex");
+    writer.Hex(scriptPubKey);
+
+    if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
+        writer.Key("type");
+        writer.String(GetTxnOutputType(type));
+        return;
+    }
+
+    writer.Key("reqSigs");
+    writer.Int(nRequired);
+    writer.Key("type");
+    writer.String(GetTxnOutputType(type));
+
+    writer.Key("addresses");
+    writer.BeginArray();
+    for (const CTxDestination& addr : addresses)
+        writer.String(CBitcoinAddress(addr).ToString());
+    writer.EndArray();
+}
+
+void TxToJSONWriter(const CTransaction& tx, CJSONWriter& writer)
+{
+    // Same fields as TxToUniv() without a block hash, in the same order
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+
+    writer.Key("txid");
+    writer.Hash(tx.GetHash());
+    writer.Key("version");
+    writer.Int(tx.nVersion);
+    writer.Key("size");
+    writer.Int(ssTx.size());
+    writer.Key("locktime");
+    writer.Int(tx.nLockTime);
+
+    writer.Key("vin");
+    writer.BeginArray();
+    for (const CTxIn& txin : tx.vin) {
+        writer.BeginObject();
+        if (tx.IsCoinBase()) {
+            writer.Key("coinbase");
+            writer.Hex(txin.scriptSig);
+        } else {
+            writer.Key("txid");
+            writer.Hash(txin.prevout.hash);
+            writer.Key("vout");
+            writer.Int(txin.prevout.n);
+            writer.Key("scriptSig");
+            writer.BeginObject();
+            writer.Key("asm");
+            writer.String(txin.scriptSig.ToString());
+            writer.Key("hex");
+            writer.Hex(txin.scriptSig);
+            writer.EndObject();
+        }
+        writer.Key("sequence");
+        writer.Int(txin.nSequence);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("vout");
+    writer.BeginArray();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut& txout = tx.vout[i];
+        writer.BeginObject();
+        writer.Key("value");
+        writer.Number(FormatMoney(txout.nValue));
+        writer.Key("n");
+        writer.Int(i);
+        writer.Key("scriptPubKey");
+        writer.BeginObject();
+        ScriptPubKeyToJSONWriter(txout.scriptPubKey, writer);
+        writer.EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("hex");
+    writer.Hex(ssTx);
+}
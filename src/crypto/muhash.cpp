@@ -0,0 +1,182 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+namespace
+{
+/** 2^3072 - MAX_PRIME_DIFF is the modulus */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+} // anon namespace
+
+Num3072::Num3072(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLE32(data + 4 * i);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < (uint32_t)(0 - MAX_PRIME_DIFF))
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != 0xffffffff)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // x - p == x + MAX_PRIME_DIFF - 2^3072, and x < 2^3072
+    uint64_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        carry += limbs[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint32_t t[2 * LIMBS] = {0};
+
+    // Full 6144 bit product, row by row
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t carry = 0;
+        uint64_t x = limbs[i];
+        for (int j = 0; j < LIMBS; j++) {
+            carry += x * a.limbs[j] + t[i + j];
+            t[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        t[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // 2^3072 == MAX_PRIME_DIFF (mod p): fold the high half into the low half
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        carry += (uint64_t)t[i + LIMBS] * MAX_PRIME_DIFF + t[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    // And whatever overflowed that, until nothing does
+    while (carry) {
+        carry *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && carry; i++) {
+            carry += limbs[i];
+            limbs[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p-2), with a table of the first 16 powers for a 4 bit window
+    Num3072 table[16];
+    for (int i = 1; i < 16; i++) {
+        table[i] = table[i - 1];
+        table[i].Multiply(*this);
+    }
+
+    // p - 2 is all ones except for the lowest limb
+    const uint32_t nLowLimb = (uint32_t)(0 - MAX_PRIME_DIFF - 2);
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        uint32_t e = i == 0 ? nLowLimb : 0xffffffff;
+        for (int nShift = 28; nShift >= 0; nShift -= 4) {
+            for (int j = 0; j < 4; j++)
+                result.Multiply(result);
+            result.Multiply(table[(e >> nShift) & 15]);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    Num3072 reduced(*this);
+    if (reduced.IsOverflow())
+        reduced.FullReduce();
+    for (int i = 0; i < LIMBS; i++)
+        WriteLE32(out + 4 * i, reduced.limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+
+    // Stretch the element's hash to 3072 bits
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    for (unsigned char i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; i++)
+        CSHA512().Write(key, sizeof(key)).Write(&i, 1).Finalize(expanded + i * CSHA512::OUTPUT_SIZE);
+    return Num3072(expanded);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[32]) const
+{
+    Num3072 value(numerator);
+    value.Divide(denominator);
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    value.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
+
+void MuHash3072::GetState(unsigned char* out) const
+{
+    numerator.ToBytes(out);
+    denominator.ToBytes(out + Num3072::BYTE_SIZE);
+}
+
+void MuHash3072::SetState(const unsigned char* in)
+{
+    numerator = Num3072(in);
+    denominator = Num3072(in + Num3072::BYTE_SIZE);
+}
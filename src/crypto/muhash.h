@@ -0,0 +1,75 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, not necessarily fully reduced */
+class Num3072
+{
+public:
+    static const int LIMBS = 96;
+    static const size_t BYTE_SIZE = 384;
+
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    /** From BYTE_SIZE little endian bytes */
+    explicit Num3072(const unsigned char* data);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    /** Multiply by the inverse of a */
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    /** The fully reduced value as BYTE_SIZE little endian bytes */
+    void ToBytes(unsigned char* out) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * Hash of a set of byte strings that can be updated one element at a time,
+ * in any order: inserting and removing the same element cancel out.
+ *
+ * Elements are hashed to numbers modulo a 3072 bit prime and multiplied
+ * together (MuHash, Bellare and Micciancio). Removals multiply a separate
+ * denominator so that only Finalize() has to compute an inverse.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    /** The empty set */
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Union with a set, or apply the inserts and removals of a change set */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    /** Undo operator*= */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** 32 byte digest of the set */
+    void Finalize(unsigned char out[32]) const;
+
+    /** The internal state, to persist and restore without an inversion */
+    void GetState(unsigned char* out) const;
+    void SetState(const unsigned char* in);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -285,6 +285,22 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
 void BIP32Hash(const unsigned char chainCode[32], unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
+/** SipHash-2-4, a fast keyed hash for short inputs, over a sequence of 64-bit words */
+class CSipHasher
+{
+private:
+    uint64_t v[4];
+    int count;
+
+public:
+    CSipHasher(uint64_t k0, uint64_t k1);
+    CSipHasher& Write(uint64_t data);
+    uint64_t Finalize() const;
+};
+
+/** SipHash-2-4 of a 256-bit value, as four little endian words; what CSipHasher gives for them */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+
 
 /* ----------- Keccak256 Hash ------------------------------------------------ */
 template <typename T1>
@@ -0,0 +1,218 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include "uint256.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+/** Both hex digits of every byte value, to write a byte with one lookup */
+class CHexTable
+{
+public:
+    char pairs[256][2];
+
+    CHexTable()
+    {
+        static const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+            '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+        for (int i = 0; i < 256; i++) {
+            pairs[i][0] = hexmap[i >> 4];
+            pairs[i][1] = hexmap[i & 15];
+        }
+    }
+};
+
+const CHexTable hexTable;
+
+/** Characters UniValue escapes, the same set as univalue_escapes.h */
+inline bool NeedsEscape(unsigned char ch)
+{
+    return ch < 0x20 || ch == '"' || ch == '\\' || ch == 0x7f;
+}
+} // anon namespace
+
+void CJSONWriter::Separator()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            out += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONWriter::AppendEscaped(const char* psz, size_t len)
+{
+    size_t nStart = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = psz[i];
+        if (!NeedsEscape(ch))
+            continue;
+        out.append(psz + nStart, i - nStart);
+        nStart = i + 1;
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\f': out += "\\f"; break;
+        case '\r': out += "\\r"; break;
+        default:
+            out += "\\u00";
+            out.append(hexTable.pairs[ch], 2);
+        }
+    }
+    out.append(psz + nStart, len - nStart);
+}
+
+void CJSONWriter::AppendHex(const unsigned char* pbegin, const unsigned char* pend, bool fReverse)
+{
+    size_t nPos = out.size();
+    out.resize(nPos + 2 * (pend - pbegin));
+    char* p = &out[0] + nPos;
+    if (fReverse) {
+        for (const unsigned char* it = pend; it != pbegin; p += 2)
+            memcpy(p, hexTable.pairs[*--it], 2);
+    } else {
+        for (const unsigned char* it = pbegin; it != pend; it++, p += 2)
+            memcpy(p, hexTable.pairs[*it], 2);
+    }
+}
+
+void CJSONWriter::AppendUInt(uint64_t n)
+{
+    char buf[20];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separator();
+    out += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONWriter::EndObject()
+{
+    vEmpty.pop_back();
+    out += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separator();
+    out += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONWriter::EndArray()
+{
+    vEmpty.pop_back();
+    out += ']';
+}
+
+void CJSONWriter::Key(const char* key)
+{
+    Separator();
+    out += '"';
+    AppendEscaped(key, strlen(key));
+    out += "\":";
+    fAfterKey = true;
+}
+
+void CJSONWriter::String(const std::string& str)
+{
+    Separator();
+    out += '"';
+    AppendEscaped(str.data(), str.size());
+    out += '"';
+}
+
+void CJSONWriter::String(const char* psz)
+{
+    Separator();
+    out += '"';
+    AppendEscaped(psz, strlen(psz));
+    out += '"';
+}
+
+void CJSONWriter::Hex(const unsigned char* pbegin, const unsigned char* pend)
+{
+    Separator();
+    out += '"';
+    AppendHex(pbegin, pend, false);
+    out += '"';
+}
+
+void CJSONWriter::Hash(const uint256& hash)
+{
+    Separator();
+    out += '"';
+    AppendHex(hash.begin(), hash.end(), true);
+    out += '"';
+}
+
+void CJSONWriter::Int(int64_t n)
+{
+    Separator();
+    if (n < 0) {
+        out += '-';
+        // Negated as unsigned, INT64_MIN has no positive counterpart
+        AppendUInt(-(uint64_t)n);
+    } else
+        AppendUInt(n);
+}
+
+void CJSONWriter::UInt(uint64_t n)
+{
+    Separator();
+    AppendUInt(n);
+}
+
+void CJSONWriter::Real(double d)
+{
+    Separator();
+    std::ostringstream oss;
+    oss << std::setprecision(16) << d;
+    out += oss.str();
+}
+
+void CJSONWriter::Number(const std::string& str)
+{
+    Separator();
+    out += str;
+}
+
+void CJSONWriter::Bool(bool f)
+{
+    Separator();
+    out += f ? "true" : "false";
+}
+
+void CJSONWriter::Null()
+{
+    Separator();
+    out += "null";
+}
+
+void CJSONWriter::Raw(const std::string& json)
+{
+    Separator();
+    out += json;
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class uint256;
+
+/**
+ * Appends JSON text to a string as values are handed to it, in exactly the
+ * format UniValue::write() produces without indentation. Lets large results
+ * such as blocks be rendered straight into a reply without building a
+ * UniValue tree and writing it out again.
+ *
+ * Well-formedness is up to the caller: keys only inside objects, and exactly
+ * one value after each key.
+ */
+class CJSONWriter
+{
+private:
+    std::string& out;
+    //! One entry per open object or array, true while it has no members yet
+    std::vector<bool> vEmpty;
+    //! A key was written and its value comes next
+    bool fAfterKey;
+
+    void Separator();
+    void AppendEscaped(const char* psz, size_t len);
+    void AppendHex(const unsigned char* pbegin, const unsigned char* pend, bool fReverse);
+    void AppendUInt(uint64_t n);
+
+public:
+    explicit CJSONWriter(std::string& outIn) : out(outIn), fAfterKey(false) {}
+
+    void Reserve(size_t nBytes) { out.reserve(out.size() + nBytes); }
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const char* key);
+
+    void String(const std::string& str);
+    void String(const char* psz);
+    /** Bytes as a lower case hex string, like HexStr() */
+    void Hex(const unsigned char* pbegin, const unsigned char* pend);
+    template <typename T>
+    void Hex(const T& vch)
+    {
+        Hex(vch.empty() ? NULL : (const unsigned char*)&vch[0], vch.empty() ? NULL : (const unsigned char*)&vch[0] + vch.size());
+    }
+    /** As uint256::GetHex() */
+    void Hash(const uint256& hash);
+    void Int(int64_t n);
+    void UInt(uint64_t n);
+    /** As UniValue(double) */
+    void Real(double d);
+    /** A number already formatted, e.g. by FormatMoney() */
+    void Number(const std::string& str);
+    void Bool(bool f);
+    void Null();
+    /** A complete value already rendered as JSON, e.g. by UniValue::write() */
+    void Raw(const std::string& json);
+};
+
+#endif // BITCOIN_JSONWRITER_H
@@ -63,7 +63,7 @@ static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // Get stake modifier selection interval (in seconds)
-static int64_t GetStakeModifierSelectionInterval()
+int64_t GetStakeModifierSelectionInterval()
 {
     int64_t nSelectionInterval = 0;
     for (int nSection = 0; nSection < 64; nSection++) {
@@ -88,10 +88,10 @@ static bool SelectBlockFromCandidates(
     uint256 hashBest = 0;
     *pindexSelected = (const CBlockIndex*)0;
     for (const PAIRTYPE(int64_t, uint256) & item : vSortedByTimestamp) {
-        if (!mapBlockIndex.count(item.second))
+        const CBlockIndex* pindex = LookupBlockIndex(item.second);
+        if (!pindex)
             return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString().c_str());
 
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
             break;
 
@@ -243,12 +243,8 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
+const CBlockIndex* GetKernelStakeModifierBlock(const CBlockIndex* pindexFrom, int& nStakeModifierHeight, int64_t& nStakeModifierTime)
 {
-    nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
-        return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -257,10 +253,8 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
 
     // loop to find the stake modifier later by a selection interval
     while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
-            // Should never happen
-            return error("Null pindexNext\n");
-        }
+        if (!pindexNext)
+            return NULL;
 
         pindex = pindexNext;
         pindexNext = chainActive[pindexNext->nHeight + 1];
@@ -269,6 +263,20 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
             nStakeModifierTime = pindex->GetBlockTime();
         }
     }
+    return pindex;
+}
+
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
+{
+    nStakeModifier = 0;
+    const CBlockIndex* pindexFrom = LookupBlockIndex(hashBlockFrom);
+    if (!pindexFrom)
+        return error("GetKernelStakeModifier() : block not indexed");
+    const CBlockIndex* pindex = GetKernelStakeModifierBlock(pindexFrom, nStakeModifierHeight, nStakeModifierTime);
+    if (!pindex) {
+        // Should never happen
+        return error("Null pindexNext\n");
+    }
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
@@ -352,10 +360,11 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         nTimeTx = nTryTime;
 
         if (fDebug || fPrintProofOfStake) {
+            const CBlockIndex* pindexFrom = LookupBlockIndex(blockFrom.GetHash());
             LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
                 boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
+                pindexFrom ? pindexFrom->nHeight : -1,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
             LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                 "0.3",
@@ -366,11 +375,38 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         break;
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    {
+        LOCK(cs_main);
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
     return fSuccess;
 }
 
+bool FindStakeKernel(const std::vector<CStakeCandidate>& vCandidates, unsigned int nBits, unsigned int nTimeFrom, unsigned int nTimeTo, size_t& nCandidate, unsigned int& nTimeTx, uint256& hashProofOfStake, uint64_t& nHashes)
+{
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    for (nCandidate = 0; nCandidate < vCandidates.size(); nCandidate++) {
+        const CStakeCandidate& candidate = vCandidates[nCandidate];
+        CDataStream ss(SER_GETHASH, 0);
+        ss << candidate.nStakeModifier;
+
+        // A kernel cannot be older than the block of its output
+        unsigned int nTimeStart = std::max(nTimeFrom, candidate.nTimeBlockFrom);
+        for (unsigned int nTryTime = nTimeTo; nTryTime >= nTimeStart && nTryTime != 0; nTryTime--) {
+            nHashes++;
+            hashProofOfStake = stakeHash(nTryTime, ss, candidate.prevout.n, candidate.prevout.hash, candidate.nTimeBlockFrom);
+            if (stakeTargetHit(hashProofOfStake, candidate.nValue, bnTargetPerCoinDay)) {
+                nTimeTx = nTryTime;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
 {
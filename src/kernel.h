@@ -18,15 +18,36 @@ extern unsigned int getIntervalVersion(bool fTestNet);
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
+// Get stake modifier selection interval (in seconds)
+int64_t GetStakeModifierSelectionInterval();
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Get the block whose stake modifier a kernel of an output in pindexFrom hashes,
+// NULL while the chain does not reach far enough past pindexFrom
+const CBlockIndex* GetKernelStakeModifierBlock(const CBlockIndex* pindexFrom, int& nStakeModifierHeight, int64_t& nStakeModifierTime);
+// Get the stake modifier a kernel of an output in block hashBlockFrom hashes
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
+// A stakeable output with what its kernel hash depends on besides the time
+struct CStakeCandidate {
+    COutPoint prevout;
+    CAmount nValue;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+};
+
+// Search timestamps nTimeFrom..nTimeTo of each candidate, latest first, for a
+// kernel meeting nBits; needs no locks. nHashes is increased by the hashes done
+bool FindStakeKernel(const std::vector<CStakeCandidate>& vCandidates, unsigned int nBits, unsigned int nTimeFrom, unsigned int nTimeTo, size_t& nCandidate, unsigned int& nTimeTx, uint256& hashProofOfStake, uint64_t& nHashes);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
@@ -10,18 +10,25 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockencodings.h"
+#include "blockimport.h"
 #include "chainparams.h"
+#include "chainsnapshot.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "crypto/common.h"
 #include "init.h"
 #include "kernel.h"
+#include "mappedfile.h"
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
 #include "net.h"
+#include "netmsgtable.h"
 #include "obfuscation.h"
 #include "pow.h"
 #include "spork.h"
+#include "spentjournal.h"
 #include "sporkdb.h"
 #include "swifttx.h"
 #include "txdb.h"
@@ -37,6 +44,9 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_set.hpp>
 #include <atomic>
 #include <queue>
 
@@ -56,12 +66,10 @@ using namespace std;
  */
 
 CCriticalSection cs_main;
-CCriticalSection cs_mapstake;
 
 BlockMap mapBlockIndex;
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
-map<COutPoint, int> mapStakeSpent;
 map<unsigned int, unsigned int> mapHashedBlocks;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
@@ -77,6 +85,7 @@ bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
 unsigned int nCoinCacheSize = 5000;
 bool fAlerts = DEFAULT_ALERTS;
+bool fCompactBlocks = DEFAULT_COMPACT_BLOCKS;
 bool fClearSpendCache = false;
 //const int nVersionFork = 163500;
 //const int nVersionSecondFork = 220000;
@@ -103,9 +112,18 @@ map<uint256, COrphanTx> mapOrphanTransactions;
 map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
 map<uint256, int64_t> mapRejectedBlocks;
 
+/**
+ * Transactions we turned down since the tip last changed, so that every peer
+ * announcing them again does not make us fetch and check them again. A new tip
+ * may make them valid, so it clears the filter. Protected by cs_main.
+ */
+boost::scoped_ptr<CRollingBloomFilter> recentRejects;
+uint256 hashRecentRejectsChainTip;
+
 void EraseOrphansFor(NodeId peer);
 
 static void CheckBlockIndex();
+static MappedFileRef MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer, const char*& pbegin, const char*& pend);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -138,6 +156,9 @@ struct CBlockIndexWorkComparator {
 
 CBlockIndex* pindexBestInvalid;
 
+/** Taken for writing around changes to mapBlockIndex, which also require cs_main, see LookupBlockIndex */
+boost::shared_mutex csBlockIndexLookup;
+
 /**
      * The set of all CBlockIndex entries with BLOCK_VALID_TRANSACTIONS (for itself and all ancestors) and
      * as good as our current tip or better. Entries may be failed, though.
@@ -152,6 +173,9 @@ CCriticalSection cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
 
+/** Read-only mappings of recently read blk/rev files; fewer where address space is short. */
+CMappedFileCache mappedBlockFiles(sizeof(void*) >= 8 ? 64 : 4);
+
 /**
      * Every received block is assigned a unique and increasing identifier, so we
      * know which one to give priority in case of a fork.
@@ -173,6 +197,7 @@ struct QueuedBlock {
     int64_t nTime;              //! Time of "getdata" request in microseconds.
     int nValidatedQueuedBefore; //! Number of blocks queued with validated headers (globally) at the time this one is requested.
     bool fValidatedHeaders;     //! Whether this block has validated headers at the time of request.
+    boost::shared_ptr<PartiallyDownloadedBlock> partialBlock; //! Set while rebuilding it from a compact block.
 };
 map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -182,6 +207,9 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/** Peers we asked to push new blocks as compact blocks without an inv first, oldest first. Protected by cs_main. */
+list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
 /** Dirty block index entries. */
 set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -308,6 +336,8 @@ struct CNodeState {
     bool fSyncStarted;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
+    //! When the headers sync with this peer times out (in microseconds), or 0.
+    int64_t nHeadersSyncTimeout;
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
@@ -325,6 +355,7 @@ struct CNodeState {
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
         nStallingSince = 0;
+        nHeadersSyncTimeout = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
     }
@@ -388,6 +419,7 @@ void FinalizeNode(NodeId nodeid)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -407,7 +439,7 @@ void MarkBlockAsReceived(const uint256& hash)
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex* pindex = NULL)
+void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex* pindex = NULL, boost::shared_ptr<PartiallyDownloadedBlock> partialBlock = boost::shared_ptr<PartiallyDownloadedBlock>())
 {
     CNodeState* state = State(nodeid);
     assert(state != NULL);
@@ -415,7 +447,7 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex* pindex
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL};
+    QueuedBlock newentry = {hash, pindex, GetTimeMicros(), nQueuedValidatedHeaders, pindex != NULL, partialBlock};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
     state->nBlocksInFlight++;
@@ -457,6 +489,12 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256& hash)
     }
 }
 
+/** Whether block sync with this peer goes through headers first rather than getblocks/inv. */
+static bool IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && pnode->nVersion >= HEADERS_FIRST_VERSION;
+}
+
 /** Find the last common ancestor two blocks have.
  *  Both pa and pb must be non-NULL. */
 CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
@@ -477,6 +515,21 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
     return pa;
 }
 
+/** Latest block time whose proof-of-stake can be checked against the active chain.
+ *  The kernel of a coinstake is at least nStakeMinAge old and its stake modifier is
+ *  taken one selection interval later, both from blocks that must already be connected,
+ *  so a PoS block much further ahead of the tip than this would be dropped on arrival. */
+static int64_t GetStakeDownloadHorizon()
+{
+    return chainActive.Tip()->GetBlockTime() + nStakeMinAge - GetStakeModifierSelectionInterval() - 10 * Params().TargetSpacing();
+}
+
+/** Deepest reorganization accepted, as set by -maxreorg */
+static int GetMaxReorgDepth()
+{
+    return GetArg("-maxreorg", Params().MaxReorganizationDepth());
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller)
@@ -515,6 +568,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     // download that next block if the window were 1 larger.
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
+    // Past the last PoW block the window is further bounded in time by the stake
+    // checks (the tip's direct successor is always fine); waiting on that is not
+    // the peer's fault, so it never marks a staller.
+    const int64_t nStakeHorizon = GetStakeDownloadHorizon();
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
@@ -541,6 +598,9 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
+                if (pindex->nHeight > Params().LAST_POW_BLOCK() && pindex->GetBlockTime() > nStakeHorizon &&
+                    !chainActive.Contains(pindex->pprev))
+                    return;
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
@@ -579,6 +639,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
     return true;
 }
 
+void static RegisterMessageHandlers(CNetMsgTable& table);
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -586,6 +648,7 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.SendMessages.connect(&SendMessages);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
+    RegisterMessageHandlers(netMsgTable);
 }
 
 void UnregisterNodeSignals(CNodeSignals& nodeSignals)
@@ -595,6 +658,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.SendMessages.disconnect(&SendMessages);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
+    netMsgTable.Clear();
 }
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -1437,8 +1501,8 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 {
     CBlockIndex* pindexSlow = blockIndex;
 
-    LOCK(cs_main);
-
+    // The mempool and transaction index have their own locks; only the scan
+    // through the coin database needs cs_main.
     if (!blockIndex) {
         if (mempool.lookup(hash, txOut)) {
             return true;
@@ -1447,14 +1511,24 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    const char* pbegin = NULL;
+                    const char* pend = NULL;
+                    MappedFileRef mapping = MapDiskRecord(postx, "blk", 0, pbegin, pend);
+                    if (mapping) {
+                        CSpanReader file(pbegin, pend, SER_DISK, CLIENT_VERSION);
+                        file >> header;
+                        file.ignore(postx.nTxOffset);
+                        file >> txOut;
+                    } else {
+                        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                        if (file.IsNull())
+                            return error("%s: OpenBlockFile failed", __func__);
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    }
                 } catch (std::exception& e) {
                     return error("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1469,6 +1543,7 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            LOCK(cs_main);
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -1528,14 +1603,20 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, from the mapped file when possible
     try {
-        filein >> block;
+        const char* pbegin = NULL;
+        const char* pend = NULL;
+        MappedFileRef mapping = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+        if (mapping) {
+            CSpanReader filein(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            filein >> block;
+        } else {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1560,6 +1641,61 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CDiskBlockPos& pos)
+{
+    vchBlock.clear();
+
+    const char* pbegin = NULL;
+    const char* pend = NULL;
+    MappedFileRef mapping = MapDiskRecord(pos, "blk", 0, pbegin, pend);
+    if (mapping) {
+        vchBlock.assign(pbegin, pend);
+        return true;
+    }
+
+    // Not mappable: read the size prefix the block was written with, then the block
+    static const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("ReadRawBlockFromDisk : invalid position");
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - nHeaderSize), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk : OpenBlockFile failed");
+    try {
+        unsigned char buf[MESSAGE_START_SIZE];
+        unsigned int nSize = 0;
+        filein >> FLATDATA(buf) >> nSize;
+        if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE) || nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
+            return error("ReadRawBlockFromDisk : no block record at file %d, position %u", pos.nFile, pos.nPos);
+        vchBlock.resize(nSize);
+        filein.read(&vchBlock[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CBlockIndex* pindex)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos()))
+        return false;
+
+    // The header leads the record, so the bytes can be matched against the
+    // index without parsing the transactions.
+    CBlockHeader header;
+    try {
+        CSpanReader stream(&vchBlock[0], &vchBlock[0] + vchBlock.size(), SER_DISK, CLIENT_VERSION);
+        stream >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, header.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
+        return error("ReadRawBlockFromDisk(std::vector<char>&, CBlockIndex*) : GetHash() doesn't match index");
+    }
+    return true;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -1877,18 +2013,28 @@ void static InvalidBlockFound(CBlockIndex* pindex, const CValidationState& state
 
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight)
 {
+    CUTXOStats& stats = inputs.StatsDelta();
+
     // mark inputs spent
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         for (const CTxIn& txin : tx.vin) {
             txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
+            if (coins->IsAvailable(txin.prevout.n))
+                stats.RemoveOutput(txin.prevout.hash, txin.prevout.n, *coins);
+            bool ret = coins->Spend(txin.prevout, txundo.vprevout.back());
             assert(ret);
+            if (coins->IsPruned())
+                stats.nTransactions--;
         }
     }
 
-    // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    // add outputs, replacing a duplicate that is still unspent
+    CCoinsModifier outs = inputs.ModifyCoins(tx.GetHash());
+    stats.RemoveCoins(tx.GetHash(), *outs);
+    outs->FromTx(tx, nHeight);
+    stats.AddCoins(tx.GetHash(), *outs);
 }
 
 bool CScriptCheck::operator()()
@@ -2045,6 +2191,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
             // remove outputs
+            view.StatsDelta().RemoveCoins(hash, *outs);
             outs->Clear();
         }
 
@@ -2057,31 +2204,41 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
                 CCoinsModifier coins = view.ModifyCoins(out.hash);
+                CUTXOStats& stats = view.StatsDelta();
                 if (undo.nHeight != 0) {
                     // undo data contains height: this is the last output of the prevout tx being spent
                     if (!coins->IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
+                    stats.RemoveCoins(out.hash, *coins);
                     coins->Clear();
                     coins->fCoinBase = undo.fCoinBase;
+                    coins->fCoinStake = undo.fCoinStake;
                     coins->nHeight = undo.nHeight;
                     coins->nVersion = undo.nVersion;
                 } else {
                     if (coins->IsPruned())
                         fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
                 }
-                if (coins->IsAvailable(out.n))
+                bool fWasPruned = coins->IsPruned();
+                if (coins->IsAvailable(out.n)) {
                     fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
+                    stats.RemoveOutput(out.hash, out.n, *coins);
+                }
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
-
-                LOCK(cs_mapstake);
-                // erase the spent input
-                mapStakeSpent.erase(out);
+                if (!undo.txout.IsNull()) {
+                    stats.AddOutput(out.hash, out.n, *coins);
+                    if (fWasPruned)
+                        stats.nTransactions++;
+                }
             }
         }
     }
 
+    // its inputs are unspent again
+    spentJournal.DisconnectBlock(pindex);
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2099,6 +2256,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Mappings may extend into the preallocated space about to be truncated
+    if (fFinalize)
+        mappedBlockFiles.Clear();
+
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -2136,7 +2297,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
-    if (!fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck))
+    if (!fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck, false))
         return false;
 
     // verify that the view's current state corresponds to the previous block
@@ -2303,29 +2464,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
-    {
-        LOCK(cs_mapstake);
-        // add new entries
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase())
-                continue;
-            for (const CTxIn& in: tx.vin) {
-                if (fDebug) LogPrintf("mapStakeSpent: Insert %s | %u\n", in.prevout.ToString(), pindex->nHeight);
-                mapStakeSpent.insert(std::make_pair(in.prevout, pindex->nHeight));
-            }
-        }
+    // remember what it spent, for coinstakes on forks below it
+    spentJournal.ConnectBlock(pindex, block);
+    spentJournal.Prune(pindex->nHeight - GetMaxReorgDepth());
 
-        // delete old entries
-        for (auto it = mapStakeSpent.begin(); it != mapStakeSpent.end();) {
-            if (it->second < pindex->nHeight - Params().MaxReorganizationDepth()) {
-                if (fDebug) LogPrintf("mapStakeSpent: Erase %s | %u\n", it->first.ToString(), it->second);
-                it = mapStakeSpent.erase(it);
-            }
-            else {
-                it++;
-            }
-        }
-    }
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2347,47 +2489,37 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 
 
-bool HF_IsBlocked(const CScript& scriptPubKey) {
-    CTxDestination dest;
-    ExtractDestination(scriptPubKey, dest);
-    CBitcoinAddress txAddr(dest);
-    std::string txAddrStr = txAddr.ToString();
-
-    BOOST_FOREACH(const std::string addr, HF_blAddrs) {
-        if (txAddrStr == addr) {
-            return true;
-        }
-    }
+struct HF_DestinationHasher {
+    size_t operator()(const uint160& id) const { return id.GetLow64(); }
+};
 
-    return false;
-}
+/** HF_blAddrs by the kind of destination, filled at startup and only read afterwards */
+static boost::unordered_set<uint160, HF_DestinationHasher> setHFBlockedKeys;
+static boost::unordered_set<uint160, HF_DestinationHasher> setHFBlockedScripts;
 
-bool HF_CheckTX(const CTransaction& tx, int n)
+void HF_InitBlockedDestinations()
 {
-    const CBlockIndex* pindex = chainActive.Tip();
-
-    if(pindex->nHeight < HF_ACTIVATION_BLOCK)
-        return true;
-
-    for (const CTxOut& txout : tx.vout) {
-        if (HF_IsBlocked(txout.scriptPubKey)) {
-            return false;
-        }
+    setHFBlockedKeys.clear();
+    setHFBlockedScripts.clear();
+    for (const std::string& strAddr : HF_blAddrs) {
+        CTxDestination dest = CBitcoinAddress(strAddr).Get();
+        if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+            setHFBlockedKeys.insert(*keyID);
+        else if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+            setHFBlockedScripts.insert(*scriptID);
     }
+}
 
-    for (const CTxIn txin : tx.vin) {
-        const COutPoint& outpoint = txin.prevout;
-
-        CTransaction tx2;
-        uint256 hashi;
-
-        if (GetTransaction(outpoint.hash, tx2, hashi)) {
-            if (HF_IsBlocked(tx2.vout[outpoint.n].scriptPubKey)) {
-                return false;
-            }
-        }
-    }
-    return true;
+bool HF_IsBlocked(const CScript& scriptPubKey)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest))
+        return setHFBlockedKeys.count(*keyID) > 0;
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest))
+        return setHFBlockedScripts.count(*scriptID) > 0;
+    return false;
 }
 
 
@@ -2441,6 +2573,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            ChainSnapshotCoinsFlushed();
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -2463,6 +2596,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot(chainActive, pindexBestHeader);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -2514,6 +2648,7 @@ bool static DisconnectTip(CValidationState& state)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    ChainSnapshotBlockApplied(block, *pcoinsTip);
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
@@ -2532,9 +2667,7 @@ bool static DisconnectTip(CValidationState& state)
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    for (const CTransaction& tx : block.vtx) {
-        SyncWithWallets(tx, NULL);
-    }
+    SyncWithWallets(block.vtx, NULL);
     return true;
 }
 
@@ -2585,6 +2718,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
     }
+    ChainSnapshotBlockApplied(*pblock, *pcoinsTip);
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -2607,13 +2741,10 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
-    for (const CTransaction& tx : txConflicted) {
-        SyncWithWallets(tx, NULL);
-    }
+    if (!txConflicted.empty())
+        SyncWithWallets(std::vector<CTransaction>(txConflicted.begin(), txConflicted.end()), NULL);
     // ... and about transactions that got confirmed:
-    for (const CTransaction& tx : pblock->vtx) {
-        SyncWithWallets(tx, pblock);
-    }
+    SyncWithWallets(pblock->vtx, pblock);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -2892,9 +3023,16 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
             {
                 LOCK(cs_vNodes);
-                for (CNode* pnode : vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                for (CNode* pnode : vNodes) {
+                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        // Peers that asked for it get the block itself right away, as a compact block
+                        if (pnode->fPreferHeaderAndIDs && pblock && pblock->GetHash() == hashNewTip) {
+                            if (pnode->AddInventoryKnownIfNew(CInv(MSG_BLOCK, hashNewTip)))
+                                pnode->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(*pblock));
+                        } else
+                            pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
@@ -2989,6 +3127,13 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    boost::shared_lock<boost::shared_mutex> lock(csBlockIndexLookup);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it == mapBlockIndex.end() ? NULL : it->second;
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -3004,6 +3149,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
+    // Readers looking the entry up without cs_main must not see it half built
+    boost::unique_lock<boost::shared_mutex> lockLookup(csBlockIndexLookup);
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
@@ -3020,6 +3167,12 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
+        // A header received ahead of its block carries no coinstake; past the
+        // last PoW block it is proof-of-stake all the same, and the stake
+        // modifier and trust computed below depend on knowing that.
+        if (block.vtx.empty() && pindexNew->nHeight > Params().LAST_POW_BLOCK())
+            pindexNew->SetProofOfStake();
+
         // ppcoin: compute chain trust score
         pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
 
@@ -3028,7 +3181,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
         // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
+        // (not known yet for a bare header, see ReceivedBlockTransactions)
+        if (pindexNew->IsProofOfStake() && !block.vtx.empty()) {
             if (!mapProofOfStake.count(hash))
                 LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
             pindexNew->hashProofOfStake = mapProofOfStake[hash];
@@ -3046,8 +3200,10 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        PublishChainSnapshot(chainActive, pindexBestHeader);
+    }
 
     //update previous block pointer
     if (pindexNew->nHeight)
@@ -3061,8 +3217,18 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
-    if (block.IsProofOfStake())
+    if (block.IsProofOfStake()) {
         pindexNew->SetProofOfStake();
+        // The index may have been created from the header alone
+        if (pindexNew->prevoutStake.IsNull()) {
+            pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+            pindexNew->nStakeTime = block.nTime;
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        }
+        std::map<uint256, uint256>::const_iterator it = mapProofOfStake.find(pindexNew->GetBlockHash());
+        if (it != mapProofOfStake.end())
+            pindexNew->hashProofOfStake = it->second;
+    }
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
@@ -3082,6 +3248,15 @@ bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBl
             CBlockIndex* pindex = queue.front();
             queue.pop_front();
             pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            // The checksum chains through the parent, so it is only final once
+            // the blocks are linked in order; headers-first indexes get theirs here.
+            if (pindex->pprev) {
+                unsigned int nChecksum = GetStakeModifierChecksum(pindex);
+                if (nChecksum != pindex->nStakeModifierChecksum) {
+                    pindex->nStakeModifierChecksum = nChecksum;
+                    setDirtyBlockIndex.insert(pindex);
+                }
+            }
             {
                 LOCK(cs_nBlockSequenceId);
                 pindex->nSequenceId = nBlockSequenceId++;
@@ -3193,9 +3368,10 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CheckBlockContextFree(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
 {
-    // These are checks that are independent of context.
+    // These are checks that are independent of context; they touch neither
+    // the chain nor the adjusted clock, so they may run without cs_main.
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
@@ -3203,12 +3379,6 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("CheckBlock() : CheckBlockHeader failed"),
             REJECT_INVALID, "bad-header", true);
 
-    // Check timestamp
-    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
-    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
-        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
-            REJECT_INVALID, "time-too-new");
-
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -3260,6 +3430,38 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                 return state.DoS(100, error("CheckBlock() : more than one coinstake"));
     }
 
+    // Check transactions
+    for (const CTransaction& tx : block.vtx)
+        if (!CheckTransaction(tx, state))
+            return error("CheckBlock() : CheckTransaction failed");
+
+    unsigned int nSigOps = 0;
+    for (const CTransaction& tx : block.vtx) {
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+
+    unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE_LEGACY / 50;
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
+            REJECT_INVALID, "bad-blk-sigops", true);
+
+    // Check the proof-of-stake block signature
+    if (fCheckSig && !block.CheckBlockSignature())
+        return state.DoS(100, error("CheckBlock() : bad proof-of-stake block signature"),
+            REJECT_INVALID, "bad-blk-sig");
+
+    return true;
+}
+
+/** The rest of CheckBlock, against the clock and the active chain */
+static bool CheckBlockTimeAndPayee(const CBlock& block, CValidationState& state)
+{
+    // Check timestamp
+    LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
+    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
+        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
+            REJECT_INVALID, "time-too-new");
+
     // masternode payments / budgets
     CBlockIndex* pindexPrev = chainActive.Tip();
     int nHeight = 0;
@@ -3290,24 +3492,14 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
-    // Check transactions
-    for (const CTransaction& tx : block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock() : CheckTransaction failed");
-
-    unsigned int nSigOps = 0;
-    for (const CTransaction& tx : block.vtx) {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-
-    unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE_LEGACY / 50;
-    if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"),
-            REJECT_INVALID, "bad-blk-sigops", true);
-
     return true;
 }
 
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    return CheckBlockContextFree(block, state, fCheckPOW, fCheckMerkleRoot, fCheckSig) && CheckBlockTimeAndPayee(block, state);
+}
+
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
 {
     if (!pindexPrev)
@@ -3345,7 +3537,7 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     int nHeight = pindexPrev->nHeight + 1;
 
     //If this is a reorg, check that it is not too deep
-    int nMaxReorgDepth = GetArg("-maxreorg", Params().MaxReorganizationDepth());
+    int nMaxReorgDepth = GetMaxReorgDepth();
     if (chainActive.Height() - nHeight >= nMaxReorgDepth)
         return state.DoS(1, error("%s: forked chain older than max reorganization depth (height %d)", __func__, chainActive.Height() - nHeight));
 
@@ -3356,6 +3548,18 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
             REJECT_INVALID, "time-too-old");
     }
 
+    // Check the difficulty target and the future drift. Full blocks also go
+    // through CheckWork and CheckBlock, but headers-first sync relies on these
+    // to reject a bad header chain before any of its blocks is downloaded.
+    if (block.nBits != GetNextWorkRequired(pindexPrev))
+        return state.DoS(100, error("%s : incorrect difficulty at %d", __func__, nHeight),
+            REJECT_INVALID, "bad-diffbits");
+
+    // A bare header does not tell PoS from PoW, the height does
+    if (block.GetBlockTime() > GetAdjustedTime() + (nHeight > Params().LAST_POW_BLOCK() ? 180 : 7200))
+        return state.Invalid(error("%s : block timestamp too far in the future", __func__),
+            REJECT_INVALID, "time-too-new");
+
     // Check that the block chain matches the known block chain up to a checkpoint
     if (!Checkpoints::CheckBlock(nHeight, hash))
         return state.DoS(100, error("%s : rejected by checkpoint lock-in at %d", __func__, nHeight),
@@ -3382,10 +3586,11 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
 
 bool IsBlockHashInChain(const uint256& hashBlock)
 {
-    if (hashBlock == 0 || !mapBlockIndex.count(hashBlock))
+    if (hashBlock == 0)
         return false;
 
-    return chainActive.Contains(mapBlockIndex[hashBlock]);
+    CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+    return pindex && chainActive.Contains(pindex);
 }
 
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx)
@@ -3483,6 +3688,9 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
                              REJECT_INVALID, "bad-prevblk");
         }
 
+        // A header received on its own has not been through CheckBlock
+        if (block.vtx.empty() && pindexPrev->nHeight + 1 <= Params().LAST_POW_BLOCK() && !CheckBlockHeader(block, state, true))
+            return false;
     }
 
     if (!ContextualCheckBlockHeader(block, state, pindexPrev))
@@ -3548,7 +3756,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return true;
     }
 
-    if ((!fAlreadyCheckedBlock && !CheckBlock(block, state)) || !ContextualCheckBlock(block, state, pindex->pprev)) {
+    if ((!fAlreadyCheckedBlock && !CheckBlock(block, state, true, true, false)) || !ContextualCheckBlock(block, state, pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
             setDirtyBlockIndex.insert(pindex);
@@ -3565,24 +3773,24 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         CCoinsViewCache coins(pcoinsTip);
 
         if (!coins.HaveInputs(block.vtx[1])) {
-
-        LOCK(cs_mapstake);
-
             // the inputs are spent at the chain tip so we should look at the recently spent outputs
-            for (CTxIn in : block.vtx[1].vin) {
-                auto it = mapStakeSpent.find(in.prevout);
-                if (it == mapStakeSpent.end()) {
+            for (const CTxIn& in : block.vtx[1].vin) {
+                int nSpendHeight;
+                if (!spentJournal.GetActiveSpendHeight(in.prevout, nSpendHeight)) {
                     return false;
                 }
-                if (it->second < pindexPrev->nHeight) {
+                if (nSpendHeight < pindexPrev->nHeight) {
                     return false;
                 }
             }
         }
 
-        // Blocks arrives in order, so if prev block is not the tip then we are on a fork.
+        // If prev block is neither the tip nor one of its descendants then we are on a fork.
+        // Blocks downloaded ahead of the tip are not: the blocks in between are connected
+        // on top of the tip first, and ConnectBlock sees any spend of the stake input there.
         // Extra info: duplicated blocks are skipping this checks, so we don't have to worry about those here.
-        bool isBlockFromFork = pindexPrev != nullptr && chainActive.Tip() != pindexPrev;
+        bool isBlockFromFork = pindexPrev != nullptr && chainActive.Tip() != pindexPrev &&
+                               pindexPrev->GetAncestor(chainActive.Height()) != chainActive.Tip();
 
         // Coin stake
         CTransaction &stakeTxIn = block.vtx[1];
@@ -3617,10 +3825,6 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
             // Start at the block we're adding on to
             CBlockIndex *prev = pindexPrev;
 
-            CBlock bl;
-            if (!ReadBlockFromDisk(bl, prev))
-                return error("%s: previous block %s not on disk", __func__, prev->GetBlockHash().GetHex());
-
             int readBlock = 0;
             // Go backwards on the forked chain up to the split
             while (!chainActive.Contains(prev)) {
@@ -3633,31 +3837,26 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                     return error("%s: forked chain longer than maximum reorg limit", __func__);
                 }
 
-                // Loop through every input from said block
-                for (const CTransaction &t : bl.vtx) {
-                    for (const CTxIn &in: t.vin) {
-                        // Loop through every input of the staking tx
-                        for (const CTxIn &stakeIn : lnoInputs) {
-                            // if it's already spent
-
-                            // First regular staking check
-                            if (hasLNOInputs) {
-                                if (stakeIn.prevout == in.prevout) {
-                                    return state.DoS(100, error("%s: input already spent on a previous block",
-                                                                __func__));
-                                }
+                // Fork blocks are journaled as they are stored; only those from before a restart are read back.
+                // Blocks below the pruned height are not journaled again, so check what they spend directly
+                CBlock bl;
+                bool fJournaled = spentJournal.HaveBlock(prev);
+                if (!fJournaled) {
+                    if (!ReadBlockFromDisk(bl, prev))
+                        return error("%s: previous block %s not on disk", __func__, prev->GetBlockHash().GetHex());
+                    fJournaled = spentJournal.AddBlock(prev, bl);
+                }
 
-                            }
-                        }
+                // Check every input of the staking tx against what said block spent
+                for (const CTxIn &stakeIn : lnoInputs) {
+                    if (fJournaled ? spentJournal.IsSpentBy(prev, stakeIn.prevout) : CSpentOutPointJournal::BlockSpends(bl, stakeIn.prevout)) {
+                        return state.DoS(100, error("%s: input already spent on a previous block",
+                                                    __func__));
                     }
                 }
 
                 // Prev block
                 prev = prev->pprev;
-                if (!ReadBlockFromDisk(bl, prev))
-                    // Previous block not on disk
-                    return error("%s: previous block %s not on disk", __func__, prev->GetBlockHash().GetHex());
-
             }
         }
 
@@ -3676,6 +3875,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                 return state.Abort("Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock() : ReceivedBlockTransactions failed");
+        spentJournal.AddBlock(pindex, block);
     } catch (std::runtime_error& e) {
         return state.Abort(std::string("System error: ") + e.what());
     }
@@ -3744,20 +3944,25 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp, bool fContextFreeChecked)
 {
-    // Preliminary checks
+    // Preliminary checks; the import pipeline runs the context-free ones,
+    // signature included, on its worker threads
     int64_t nStartTime = GetTimeMillis();
-    bool checked = CheckBlock(*pblock, state);
+    bool checked = fContextFreeChecked ? CheckBlockTimeAndPayee(*pblock, state) : CheckBlock(*pblock, state, true, true, false);
 
-    if (!pblock->CheckBlockSignature())
+    if (!fContextFreeChecked && !pblock->CheckBlockSignature())
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            if (IsHeadersFirstPeer(pfrom)) {
+                LOCK(cs_main);
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256(0));
+            } else
+                pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
             return false;
         }
     }
@@ -3844,7 +4049,7 @@ bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex
     if (!ContextualCheckBlockHeader(block, state, pindexPrev)) {
         LogPrintf("TestBlockValidity(): !ContextualCheckBlockHeader"); return false;
     }
-    if (!CheckBlock(block, state, fCheckPOW, fCheckMerkleRoot)) {
+    if (!CheckBlock(block, state, fCheckPOW, fCheckMerkleRoot, false)) {
         LogPrintf("TestBlockValidity(): !CheckBlock"); return false;
     }
     if (!ContextualCheckBlock(block, state, pindexPrev)) {
@@ -3914,6 +4119,38 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly)
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+/**
+ * Locate the record at pos, which is preceded by the message start and its
+ * size and followed by nTrailer bytes, in a mapping of its file. Returns an
+ * empty reference if the file can't be mapped or the record header doesn't
+ * check out, and the caller then reads through stdio as before.
+ */
+static MappedFileRef MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nTrailer, const char*& pbegin, const char*& pend)
+{
+    static const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return MappedFileRef();
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    MappedFileRef mapping = mappedBlockFiles.Get(path, pos.nPos);
+    if (!mapping)
+        return mapping;
+    const unsigned char* pheader = (const unsigned char*)mapping->begin() + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, Params().MessageStart(), MESSAGE_START_SIZE))
+        return MappedFileRef();
+    uint64_t nEnd = (uint64_t)pos.nPos + ReadLE32(pheader + MESSAGE_START_SIZE) + nTrailer;
+    if (nEnd > mapping->size()) {
+        // Written after the file was mapped
+        mapping = mappedBlockFiles.Get(path, nEnd);
+        if (!mapping)
+            return mapping;
+    }
+
+    pbegin = mapping->begin() + pos.nPos;
+    pend = mapping->begin() + nEnd;
+    return mapping;
+}
+
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -3933,6 +4170,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    boost::unique_lock<boost::shared_mutex> lockLookup(csBlockIndexLookup);
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
@@ -4105,6 +4343,7 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot(chainActive, pindexBestHeader);
 
     PruneBlockIndexCandidates();
 
@@ -4154,7 +4393,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         if (!ReadBlockFromDisk(block, pindex))
             return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
+        if (nCheckLevel >= 1 && !CheckBlock(block, state, true, true, false))
             return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 2: verify undo validity
         if (nCheckLevel >= 2 && pindex) {
@@ -4206,6 +4445,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    ResetChainSnapshot(NULL);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -4225,7 +4465,10 @@ void UnloadBlockIndex()
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
+    recentRejects.reset(NULL);
+    spentJournal.Clear();
 
+    boost::unique_lock<boost::shared_mutex> lockLookup(csBlockIndexLookup);
     for (BlockMap::value_type& entry : mapBlockIndex) {
         delete entry.second;
     }
@@ -4244,6 +4487,10 @@ bool LoadBlockIndex(string& strError)
 bool InitBlockIndex()
 {
     LOCK(cs_main);
+
+    // Room for a few blocks' worth of rejected transactions between tips
+    recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+
     // Check whether we're already initialized
     if (chainActive.Genesis() != NULL)
         return true;
@@ -4286,48 +4533,43 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    int64_t nLastProgress = nStart;
 
     int nLoaded = 0;
+    int nRead = 0;
+    uint64_t nBytesRead = 0, nCheckFailed = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCKFILE_SIZE, MAX_BLOCKFILE_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // Reading, deserialization and the context-free block checks run
+        // ahead on the pipeline's threads; blocks come back in file order and
+        // are connected here, one at a time, exactly as before.
+        CBlockImportPipeline pipeline(fileIn, GetImportThreads());
+        CImportedBlock imported;
+        while (pipeline.Next(imported)) {
             boost::this_thread::interruption_point();
+            nRead++;
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCKFILE_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            int64_t nNow = GetTimeMillis();
+            if (nNow - nLastProgress > 10000) {
+                LogPrint("reindex", "%s: %d blocks read, %d connected, %.1f blocks/s, %u in flight\n", __func__,
+                    nRead, nLoaded, 1000.0 * nRead / (nNow - nStart), pipeline.InFlight());
+                nLastProgress = nNow;
+            }
+
+            if (!imported.fDeserialized) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, imported.strError);
+                continue;
             }
+            // Rejected, and logged, by the worker that checked it
+            if (!imported.fChecked)
+                continue;
+
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+                CBlock& block = imported.block;
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = imported.nPos;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
+                uint256 hash = imported.hash;
                 if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                         block.hashPrevBlock.ToString());
@@ -4339,7 +4581,7 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 // process in case the block isn't known yet
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
                     CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
+                    if (ProcessNewBlock(state, NULL, &block, dbp, true))
                         nLoaded++;
                     if (state.IsError())
                         break;
@@ -4373,11 +4615,16 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
         }
+        nBytesRead = pipeline.nBytesRead;
+        nCheckFailed = pipeline.nCheckFailed;
     } catch (std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    if (nLoaded > 0) {
+        int64_t nElapsed = std::max(GetTimeMillis() - nStart, (int64_t)1);
+        LogPrintf("Loaded %i blocks from external file in %dms (%.1f blocks/s, %.1fMB read, %u failed context-free checks)\n",
+            nLoaded, nElapsed, 1000.0 * nLoaded / nElapsed, nBytesRead / 1048576.0, nCheckFailed);
+    }
     return nLoaded > 0;
 }
 
@@ -4586,9 +4833,16 @@ bool static AlreadyHave(const CInv& inv)
 {
     switch (inv.type) {
     case MSG_TX: {
+        assert(recentRejects);
+        if (chainActive.Tip()->GetBlockHash() != hashRecentRejectsChainTip) {
+            // What the old tip made invalid, the new one may accept
+            hashRecentRejectsChainTip = chainActive.Tip()->GetBlockHash();
+            recentRejects->reset();
+        }
+
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
-        return txInMap || mapOrphanTransactions.count(inv.hash) ||
+        return recentRejects->contains(inv.hash) || txInMap || mapOrphanTransactions.count(inv.hash) ||
                pcoinsTip->HaveCoins(inv.hash);
     }
     case MSG_DSTX:
@@ -4603,7 +4857,7 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        if (masternodePayments.HasVote(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
@@ -4640,7 +4894,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -4659,14 +4913,25 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    // Send block from disk. Compact blocks only pay off while the peer
+                    // still holds the transactions, so deeper ones go out in full.
+                    bool fSendCompact = inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight > chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                    if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fSendCompact)) {
+                        // The stored bytes are already in network format
+                        std::vector<char> vchBlock;
+                        if (!ReadRawBlockFromDisk(vchBlock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("block", CFlatData(vchBlock));
+                    } else if (fSendCompact) {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -4679,7 +4944,7 @@ void static ProcessGetData(CNode* pfrom)
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             for (PairType& pair : merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                if (!pfrom->filterInventoryKnown.contains(CInv(MSG_TX, pair.second).GetKey()))
                                     pfrom->PushMessage("tx", block.vtx[pair.first]);
                         }
                         // else
@@ -4748,12 +5013,12 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
 
-                auto mnw = masternodePayments.mapMasternodePayeeVotes.find(inv.hash);
+                CMasternodePaymentWinner mnw;
 
-                if(mnw != masternodePayments.mapMasternodePayeeVotes.cend()) {
+                if(masternodePayments.GetVote(inv.hash, mnw)) {
                     CDataStream ss{SER_NETWORK, PROTOCOL_VERSION};
                         ss.reserve(1000);
-                    ss << mnw->second;
+                    ss << mnw;
                     pfrom->PushMessage("mnw", ss);
                         pushed = true;
                     }
@@ -4818,699 +5083,995 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
-bool fRequestedSporksIDB = false;
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+/**
+ * Ask a peer that just handed us a new tip to push its next blocks to us as
+ * compact blocks without announcing them first. Only the last few such peers
+ * are kept; the oldest one is asked to go back to announcing. Requires cs_main.
+ */
+void static MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
 {
-    RandAddSeedPerfmon();
-    if (fDebug)
-        LogPrintf("received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
-    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0) {
-        LogPrintf("dropmessagestest DROPPING RECV MESSAGE\n");
-        return true;
-    }
+    if (!fCompactBlocks || !pfrom->fSupportsCompactBlocks)
+        return;
 
-    if (strCommand == "version") {
-        // Each connection can only send one version message
-        if (pfrom->nVersion != 0) {
-            pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, string("Duplicate version message"));
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 1);
-            return false;
+    NodeId nodeid = pfrom->GetId();
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
         }
+    }
 
-        if (!fRequestedSporksIDB) {
-            LogPrintf("asking peer for sporks\n");
-            pfrom->PushMessage("getsporks");
-            fRequestedSporksIDB = true;
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_HB_PEERS) {
+        NodeId nodeidEvict = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            if (pnode->GetId() == nodeidEvict) {
+                pnode->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
+                pnode->fRequestedHeaderAndIDs = false;
+                break;
+            }
         }
+    }
+    pfrom->PushMessage("sendcmpct", true, CMPCTBLOCKS_VERSION);
+    pfrom->fRequestedHeaderAndIDs = true;
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+}
 
-        int64_t nTime;
-        CAddress addrMe;
-        CAddress addrFrom;
-        uint64_t nNonce = 1;
-        vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
-        if (pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand))
-            return false;
+/** Validate a block a peer sent us, whole or rebuilt from a compact block. */
+void static ProcessBlockFromPeer(CNode* pfrom, CBlock& block, const string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
 
-        if (pfrom->nVersion == 10300)
-            pfrom->nVersion = 300;
-        if (!vRecv.empty())
-            vRecv >> addrFrom >> nNonce;
-        if (!vRecv.empty()) {
-            vRecv >> LIMITED_STRING(pfrom->strSubVer, 256);
-            pfrom->cleanSubVer = SanitizeString(pfrom->strSubVer);
-        }
-        if (!vRecv.empty())
-            vRecv >> pfrom->nStartingHeight;
-        if (!vRecv.empty())
-            vRecv >> pfrom->fRelayTxes; // set to true after we get the first filter* message
-        else
-            pfrom->fRelayTxes = true;
-
-        // Disconnect if we connected to ourself
-        if (nNonce == nLocalHostNonce && nNonce > 1) {
-            LogPrintf("connected to self at %s, disconnecting\n", pfrom->addr.ToString());
-            pfrom->fDisconnect = true;
-            return true;
+    {
+        // With headers first the header is known well before the block arrives
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            MarkBlockAsReceived(inv.hash);
+            LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, inv.hash.GetHex());
+            return;
         }
+    }
 
-        pfrom->addrLocal = addrMe;
-        if (pfrom->fInbound && addrMe.IsRoutable()) {
-            SeenLocal(addrMe);
+    CValidationState state;
+    ProcessNewBlock(state, pfrom, &block);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
         }
+    } else {
+        LOCK(cs_main);
+        if (chainActive.Tip()->GetBlockHash() == inv.hash)
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+    }
+    //disconnect this node if its old protocol version
+    pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+}
 
-        // Be shy and don't send version until we hear
-        if (pfrom->fInbound)
-            pfrom->PushVersion();
+bool fRequestedSporksIDB = false;
+bool static ProcessVersionMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Each connection can only send one version message
+    if (pfrom->nVersion != 0) {
+        pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, string("Duplicate version message"));
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 1);
+        return false;
+    }
 
-        pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
+    if (!fRequestedSporksIDB) {
+        LogPrintf("asking peer for sporks\n");
+        pfrom->PushMessage("getsporks");
+        fRequestedSporksIDB = true;
+    }
 
-        // Potentially mark this peer as a preferred download peer.
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+    int64_t nTime;
+    CAddress addrMe;
+    CAddress addrFrom;
+    uint64_t nNonce = 1;
+    vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
+    if (pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand))
+        return false;
 
-        // Change version
-        pfrom->PushMessage("verack");
-        pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+    if (pfrom->nVersion == 10300)
+        pfrom->nVersion = 300;
+    if (!vRecv.empty())
+        vRecv >> addrFrom >> nNonce;
+    if (!vRecv.empty()) {
+        vRecv >> LIMITED_STRING(pfrom->strSubVer, 256);
+        pfrom->cleanSubVer = SanitizeString(pfrom->strSubVer);
+    }
+    if (!vRecv.empty())
+        vRecv >> pfrom->nStartingHeight;
+    if (!vRecv.empty())
+        vRecv >> pfrom->fRelayTxes; // set to true after we get the first filter* message
+    else
+        pfrom->fRelayTxes = true;
 
-        if (!pfrom->fInbound) {
-            // Advertise our address
-            if (fListen && !IsInitialBlockDownload()) {
-                CAddress addr = GetLocalAddress(&pfrom->addr);
-                if (addr.IsRoutable()) {
-                    LogPrintf("ProcessMessages: advertizing address %s\n", addr.ToString());
-                    pfrom->PushAddress(addr);
-                } else if (IsPeerAddrLocalGood(pfrom)) {
-                    addr.SetIP(pfrom->addrLocal);
-                    LogPrintf("ProcessMessages: advertizing address %s\n", addr.ToString());
-                    pfrom->PushAddress(addr);
-                }
-            }
+    // Disconnect if we connected to ourself
+    if (nNonce == nLocalHostNonce && nNonce > 1) {
+        LogPrintf("connected to self at %s, disconnecting\n", pfrom->addr.ToString());
+        pfrom->fDisconnect = true;
+        return true;
+    }
 
-            // Get recent addresses
-            if (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION || addrman.size() < 1000) {
-                pfrom->PushMessage("getaddr");
-                pfrom->fGetAddr = true;
-            }
-            addrman.Good(pfrom->addr);
-        } else {
-            if (((CNetAddr)pfrom->addr) == (CNetAddr)addrFrom) {
-                addrman.Add(addrFrom, addrFrom);
-                addrman.Good(addrFrom);
-            }
-        }
+    pfrom->addrLocal = addrMe;
+    if (pfrom->fInbound && addrMe.IsRoutable()) {
+        SeenLocal(addrMe);
+    }
 
-        // Relay alerts
-        {
-            LOCK(cs_mapAlerts);
-            for (PAIRTYPE(const uint256, CAlert) & item : mapAlerts)
-                item.second.RelayTo(pfrom);
-        }
+    // Be shy and don't send version until we hear
+    if (pfrom->fInbound)
+        pfrom->PushVersion();
 
-        pfrom->fSuccessfullyConnected = true;
+    pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
-        string remoteAddr;
-        if (fLogIPs)
-            remoteAddr = ", peeraddr=" + pfrom->addr.ToString();
+    // Potentially mark this peer as a preferred download peer.
+    UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
 
-        LogPrintf("receive version message: %s: version %d, blocks=%d, us=%s, peer=%d%s\n",
-            pfrom->cleanSubVer, pfrom->nVersion,
-            pfrom->nStartingHeight, addrMe.ToString(), pfrom->id,
-            remoteAddr);
+    // Change version
+    pfrom->PushMessage("verack");
+    pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
-        int64_t nTimeOffset = nTime - GetTime();
-        pfrom->nTimeOffset = nTimeOffset;
-        AddTimeData(pfrom->addr, nTimeOffset);
-    }
+    if (!pfrom->fInbound) {
+        // Advertise our address
+        if (fListen && !IsInitialBlockDownload()) {
+            CAddress addr = GetLocalAddress(&pfrom->addr);
+            if (addr.IsRoutable()) {
+                LogPrintf("ProcessMessages: advertizing address %s\n", addr.ToString());
+                pfrom->PushAddress(addr);
+            } else if (IsPeerAddrLocalGood(pfrom)) {
+                addr.SetIP(pfrom->addrLocal);
+                LogPrintf("ProcessMessages: advertizing address %s\n", addr.ToString());
+                pfrom->PushAddress(addr);
+            }
+        }
 
-    else if (pfrom->nVersion == 0) {
-        // Must have a version message before anything else
-        LOCK(cs_main);
-        Misbehaving(pfrom->GetId(), 1);
-        return false;
+        // Get recent addresses
+        if (pfrom->fOneShot || pfrom->nVersion >= CADDR_TIME_VERSION || addrman.size() < 1000) {
+            pfrom->PushMessage("getaddr");
+            pfrom->fGetAddr = true;
+        }
+        addrman.Good(pfrom->addr);
+    } else {
+        if (((CNetAddr)pfrom->addr) == (CNetAddr)addrFrom) {
+            addrman.Add(addrFrom, addrFrom);
+            addrman.Good(addrFrom);
+        }
     }
 
-
-    else if (pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand)) {
-        // Instantly disconnect old protocol
-        return false;
+    // Relay alerts
+    {
+        LOCK(cs_mapAlerts);
+        for (PAIRTYPE(const uint256, CAlert) & item : mapAlerts)
+            item.second.RelayTo(pfrom);
     }
 
+    pfrom->fSuccessfullyConnected = true;
 
-    else if (strCommand == "verack") {
-        pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+    string remoteAddr;
+    if (fLogIPs)
+        remoteAddr = ", peeraddr=" + pfrom->addr.ToString();
 
-        // Mark this node as currently connected, so we update its timestamp later.
-        if (pfrom->fNetworkNode) {
-            LOCK(cs_main);
-            State(pfrom->GetId())->fCurrentlyConnected = true;
-        }
-    }
+    LogPrintf("receive version message: %s: version %d, blocks=%d, us=%s, peer=%d%s\n",
+        pfrom->cleanSubVer, pfrom->nVersion,
+        pfrom->nStartingHeight, addrMe.ToString(), pfrom->id,
+        remoteAddr);
 
-    else if (strCommand == "addr") {
-        vector<CAddress> vAddr;
-        vRecv >> vAddr;
+    int64_t nTimeOffset = nTime - GetTime();
+    pfrom->nTimeOffset = nTimeOffset;
+    AddTimeData(pfrom->addr, nTimeOffset);
 
-        // Don't want addr from older versions unless seeding
-        if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.size() > 1000)
-            return true;
-        if (vAddr.size() > 1000) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 20);
-            return error("message addr size() = %u", vAddr.size());
-        }
+    return true;
+}
 
-        // Store the new addresses
-        vector<CAddress> vAddrOk;
-        int64_t nNow = GetAdjustedTime();
-        int64_t nSince = nNow - 10 * 60;
-        for (CAddress& addr : vAddr) {
-            boost::this_thread::interruption_point();
+bool static ProcessVerackMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
-            if (addr.nTime <= 100000000 || addr.nTime > nNow + 10 * 60)
-                addr.nTime = nNow - 5 * 24 * 60 * 60;
-            pfrom->AddAddressKnown(addr);
-            bool fReachable = IsReachable(addr);
-            if (addr.nTime > nSince && !pfrom->fGetAddr && vAddr.size() <= 10 && addr.IsRoutable()) {
-                // Relay to a limited number of other nodes
-                {
-                    LOCK(cs_vNodes);
-                    // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint64_t hashAddr = addr.GetHash();
-                    uint256 hashRand = hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    multimap<uint256, CNode*> mapMix;
-                    for (CNode* pnode : vNodes) {
-                        if (pnode->nVersion < CADDR_TIME_VERSION)
-                            continue;
-                        unsigned int nPointer;
-                        memcpy(&nPointer, &pnode, sizeof(nPointer));
-                        uint256 hashKey = hashRand ^ nPointer;
-                        hashKey = Hash(BEGIN(hashKey), END(hashKey));
-                        mapMix.insert(make_pair(hashKey, pnode));
-                    }
-                    int nRelayNodes = fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
-                    for (multimap<uint256, CNode*>::iterator mi = mapMix.begin(); mi != mapMix.end() && nRelayNodes-- > 0; ++mi)
-                        ((*mi).second)->PushAddress(addr);
-                }
-            }
-            // Do not store addresses outside our network
-            if (fReachable)
-                vAddrOk.push_back(addr);
-        }
-        addrman.Add(vAddrOk, pfrom->addr, 2 * 60 * 60);
-        if (vAddr.size() < 1000)
-            pfrom->fGetAddr = false;
-        if (pfrom->fOneShot)
-            pfrom->fDisconnect = true;
+    // Mark this node as currently connected, so we update its timestamp later.
+    if (pfrom->fNetworkNode) {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fCurrentlyConnected = true;
     }
 
+    // Let the peer know we take compact blocks; whether it should push them
+    // to us unannounced is decided later, by how fast it relays new tips
+    if (fCompactBlocks && pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+        pfrom->PushMessage("sendcmpct", false, CMPCTBLOCKS_VERSION);
 
-    else if (strCommand == "inv") {
+    return true;
+}
 
-        vector<CInv> vInv;
-        vRecv >> vInv;
-        if (vInv.size() > MAX_INV_SZ) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 20);
-            return error("message inv size() = %u", vInv.size());
-        }
+bool static ProcessSendCmpctMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    bool fAnnounceUsingCMPCTBLOCK = false;
+    uint64_t nCMPCTBLOCKVersion = 0;
+    vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+    if (fCompactBlocks && nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+        pfrom->fSupportsCompactBlocks = true;
+        pfrom->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+    }
+
+    return true;
+}
 
+bool static ProcessAddrMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    vector<CAddress> vAddr;
+    vRecv >> vAddr;
+
+    // Don't want addr from older versions unless seeding
+    if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.size() > 1000)
+        return true;
+    if (vAddr.size() > 1000) {
         LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 20);
+        return error("message addr size() = %u", vAddr.size());
+    }
 
-        std::vector<CInv> vToFetch;
-        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
-            const CInv& inv = vInv[nInv];
+    // Store the new addresses
+    vector<CAddress> vAddrOk;
+    int64_t nNow = GetAdjustedTime();
+    int64_t nSince = nNow - 10 * 60;
+    for (CAddress& addr : vAddr) {
+        boost::this_thread::interruption_point();
 
-            boost::this_thread::interruption_point();
-            pfrom->AddInventoryKnown(inv);
-            bool fAlreadyHave = AlreadyHave(inv);
-            LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
+        if (addr.nTime <= 100000000 || addr.nTime > nNow + 10 * 60)
+            addr.nTime = nNow - 5 * 24 * 60 * 60;
+        pfrom->AddAddressKnown(addr);
+        bool fReachable = IsReachable(addr);
+        if (addr.nTime > nSince && !pfrom->fGetAddr && vAddr.size() <= 10 && addr.IsRoutable()) {
+            // Relay to a limited number of other nodes
+            {
+                LOCK(cs_vNodes);
+                // Use deterministic randomness to send to the same nodes for 24 hours
+                // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                static uint256 hashSalt;
+                if (hashSalt == 0)
+                    hashSalt = GetRandHash();
+                uint64_t hashAddr = addr.GetHash();
+                uint256 hashRand = hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
+                hashRand = Hash(BEGIN(hashRand), END(hashRand));
+                multimap<uint256, CNode*> mapMix;
+                for (CNode* pnode : vNodes) {
+                    if (pnode->nVersion < CADDR_TIME_VERSION)
+                        continue;
+                    unsigned int nPointer;
+                    memcpy(&nPointer, &pnode, sizeof(nPointer));
+                    uint256 hashKey = hashRand ^ nPointer;
+                    hashKey = Hash(BEGIN(hashKey), END(hashKey));
+                    mapMix.insert(make_pair(hashKey, pnode));
+                }
+                int nRelayNodes = fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
+                for (multimap<uint256, CNode*>::iterator mi = mapMix.begin(); mi != mapMix.end() && nRelayNodes-- > 0; ++mi)
+                    ((*mi).second)->PushAddress(addr);
+            }
+        }
+        // Do not store addresses outside our network
+        if (fReachable)
+            vAddrOk.push_back(addr);
+    }
+    addrman.Add(vAddrOk, pfrom->addr, 2 * 60 * 60);
+    if (vAddr.size() < 1000)
+        pfrom->fGetAddr = false;
+    if (pfrom->fOneShot)
+        pfrom->fDisconnect = true;
+
+    return true;
+}
+
+bool static ProcessInvMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    vector<CInv> vInv;
+    vRecv >> vInv;
+    if (vInv.size() > MAX_INV_SZ) {
+        Misbehaving(pfrom->GetId(), 20);
+        return error("message inv size() = %u", vInv.size());
+    }
 
-            if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
-                pfrom->AskFor(inv);
+    std::vector<CInv> vToFetch;
+    for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+        const CInv& inv = vInv[nInv];
 
-            if (inv.type == MSG_BLOCK) {
-                UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+        boost::this_thread::interruption_point();
+        pfrom->AddInventoryKnown(inv);
+        bool fAlreadyHave = AlreadyHave(inv);
+        LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
+
+        if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
+            pfrom->AskFor(inv);
+
+        if (inv.type == MSG_BLOCK) {
+            UpdateBlockAvailability(pfrom->GetId(), inv.hash);
+            if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                if (IsHeadersFirstPeer(pfrom)) {
+                    // First request the headers preceding the announced block, so that the
+                    // block download logic can fetch it together with any missing parents.
+                    // When we are close to synced, also ask for the block itself right away
+                    // to save a round trip; it is accepted as long as the headers leading up
+                    // to it arrive first.
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                    CNodeState* nodestate = State(pfrom->GetId());
+                    if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().TargetSpacing() * 20 &&
+                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                        // A peer that speaks compact blocks sends it as one, mostly
+                        // made of transactions we already have
+                        vToFetch.push_back(pfrom->fSupportsCompactBlocks ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
+                        // Mark block as in flight already, even though the actual "getdata" message only goes out
+                        // later (within the same cs_main lock, though).
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                    }
+                    LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                } else {
                     // Add this to the list of blocks to request
                     vToFetch.push_back(inv);
                     LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
             }
-
-            // Track requests for our stuff
-            GetMainSignals().Inventory(inv.hash);
-
-            if (pfrom->nSendSize > (SendBufferSize() * 2)) {
-                Misbehaving(pfrom->GetId(), 50);
-                return error("send buffer size() = %u", pfrom->nSendSize);
-            }
         }
 
-        if (!vToFetch.empty())
-            pfrom->PushMessage("getdata", vToFetch);
-    }
-
+        // Track requests for our stuff
+        GetMainSignals().Inventory(inv.hash);
 
-    else if (strCommand == "getdata") {
-        vector<CInv> vInv;
-        vRecv >> vInv;
-        if (vInv.size() > MAX_INV_SZ) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 20);
-            return error("message getdata size() = %u", vInv.size());
+        if (pfrom->nSendSize > (SendBufferSize() * 2)) {
+            Misbehaving(pfrom->GetId(), 50);
+            return error("send buffer size() = %u", pfrom->nSendSize);
         }
+    }
 
-        if (fDebug || (vInv.size() != 1))
-            LogPrint("net", "received getdata (%u invsz) peer=%d\n", vInv.size(), pfrom->id);
+    if (!vToFetch.empty())
+        pfrom->PushMessage("getdata", vToFetch);
 
-        if ((fDebug && vInv.size() > 0) || (vInv.size() == 1))
-            LogPrint("net", "received getdata for: %s peer=%d\n", vInv[0].ToString(), pfrom->id);
+    return true;
+}
 
-        pfrom->vRecvGetData.insert(pfrom->vRecvGetData.end(), vInv.begin(), vInv.end());
-        ProcessGetData(pfrom);
+bool static ProcessGetDataMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    vector<CInv> vInv;
+    vRecv >> vInv;
+    if (vInv.size() > MAX_INV_SZ) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 20);
+        return error("message getdata size() = %u", vInv.size());
     }
 
+    if (fDebug || (vInv.size() != 1))
+        LogPrint("net", "received getdata (%u invsz) peer=%d\n", vInv.size(), pfrom->id);
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
-        CBlockLocator locator;
-        uint256 hashStop;
-        vRecv >> locator >> hashStop;
+    if ((fDebug && vInv.size() > 0) || (vInv.size() == 1))
+        LogPrint("net", "received getdata for: %s peer=%d\n", vInv[0].ToString(), pfrom->id);
 
-        LOCK(cs_main);
+    pfrom->vRecvGetData.insert(pfrom->vRecvGetData.end(), vInv.begin(), vInv.end());
+    ProcessGetData(pfrom);
 
-        // Find the last block the caller has in the main chain
-        CBlockIndex* pindex = FindForkInGlobalIndex(chainActive, locator);
+    return true;
+}
 
-        // Send the rest of the chain
-        if (pindex)
-            pindex = chainActive.Next(pindex);
-        int nLimit = 500;
-        LogPrint("net", "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop == uint256(0) ? "end" : hashStop.ToString(), nLimit, pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex)) {
-            if (pindex->GetBlockHash() == hashStop) {
-                LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                break;
-            }
-            pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
-            if (--nLimit <= 0) {
-                // When this block is requested, we'll send an inv that'll make them
-                // getblocks the next batch of inventory.
-                LogPrint("net", "  getblocks stopping at limit %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                pfrom->hashContinue = pindex->GetBlockHash();
-                break;
-            }
+bool static ProcessGetBlocksMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    CBlockLocator locator;
+    uint256 hashStop;
+    vRecv >> locator >> hashStop;
+
+    // Find the last block the caller has in the main chain
+    CBlockIndex* pindex = FindForkInGlobalIndex(chainActive, locator);
+
+    // Send the rest of the chain
+    if (pindex)
+        pindex = chainActive.Next(pindex);
+    int nLimit = 500;
+    LogPrint("net", "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop == uint256(0) ? "end" : hashStop.ToString(), nLimit, pfrom->id);
+    for (; pindex; pindex = chainActive.Next(pindex)) {
+        if (pindex->GetBlockHash() == hashStop) {
+            LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            break;
+        }
+        pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+        if (--nLimit <= 0) {
+            // When this block is requested, we'll send an inv that'll make them
+            // getblocks the next batch of inventory.
+            LogPrint("net", "  getblocks stopping at limit %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            pfrom->hashContinue = pindex->GetBlockHash();
+            break;
         }
     }
 
+    return true;
+}
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
-        CBlockLocator locator;
-        uint256 hashStop;
-        vRecv >> locator >> hashStop;
+bool static ProcessGetHeadersMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Peers from before headers first ask for blocks this way
+    if (pfrom->nVersion < HEADERS_FIRST_VERSION)
+        return ProcessGetBlocksMessage(pfrom, strCommand, vRecv, nTimeReceived);
 
-        LOCK(cs_main);
+    CBlockLocator locator;
+    uint256 hashStop;
+    vRecv >> locator >> hashStop;
 
-        if (IsInitialBlockDownload())
-            return true;
+    if (IsInitialBlockDownload())
+        return true;
 
-        CBlockIndex* pindex = NULL;
-        if (locator.IsNull()) {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
-                return true;
-            pindex = (*mi).second;
-        } else {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
-            if (pindex)
-                pindex = chainActive.Next(pindex);
-        }
+    CBlockIndex* pindex = NULL;
+    if (locator.IsNull()) {
+        // If locator is null, return the hashStop block
+        BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+        if (mi == mapBlockIndex.end())
+            return true;
+        pindex = (*mi).second;
+    } else {
+        // Find the last block the caller has in the main chain
+        pindex = FindForkInGlobalIndex(chainActive, locator);
+        if (pindex)
+            pindex = chainActive.Next(pindex);
+    }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        if (fDebug)
-            LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex)) {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
-        }
-        pfrom->PushMessage("headers", vHeaders);
+    // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+    vector<CBlock> vHeaders;
+    int nLimit = MAX_HEADERS_RESULTS;
+    if (fDebug)
+        LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+    for (; pindex; pindex = chainActive.Next(pindex)) {
+        vHeaders.push_back(pindex->GetBlockHeader());
+        if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+            break;
     }
+    pfrom->PushMessage("headers", vHeaders);
 
+    return true;
+}
 
-    else if (strCommand == "tx" || strCommand == "dstx") {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
-        CTransaction tx;
+bool static ProcessTxMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    vector<uint256> vWorkQueue;
+    vector<uint256> vEraseQueue;
+    CTransaction tx;
 
-        //masternode signed transaction
-        bool ignoreFees = false;
-        CTxIn vin;
-        vector<unsigned char> vchSig;
-        int64_t sigTime;
-
-        if (strCommand == "tx") {
-            vRecv >> tx;
-        } else if (strCommand == "dstx") {
-            //these allow masternodes to publish a limited amount of free transactions
-            vRecv >> tx >> vin >> vchSig >> sigTime;
-
-            CMasternode* pmn = mnodeman.Find(vin);
-            if (pmn != NULL) {
-                if (!pmn->allowFreeTx) {
-                    //multiple peers can send us a valid masternode transaction
-                    if (fDebug) LogPrintf("dstx: Masternode sending too many transactions %s\n", tx.GetHash().ToString());
-                    return true;
-                }
+    //masternode signed transaction
+    bool ignoreFees = false;
+    CTxIn vin;
+    vector<unsigned char> vchSig;
+    int64_t sigTime;
+
+    if (strCommand == "tx") {
+        vRecv >> tx;
+    } else if (strCommand == "dstx") {
+        //these allow masternodes to publish a limited amount of free transactions
+        vRecv >> tx >> vin >> vchSig >> sigTime;
+
+        CMasternode* pmn = mnodeman.Find(vin);
+        if (pmn != NULL) {
+            if (!pmn->allowFreeTx) {
+                //multiple peers can send us a valid masternode transaction
+                if (fDebug) LogPrintf("dstx: Masternode sending too many transactions %s\n", tx.GetHash().ToString());
+                return true;
+            }
 
-                std::string strMessage = tx.GetHash().ToString() + std::to_string(sigTime);
+            std::string strMessage = tx.GetHash().ToString() + std::to_string(sigTime);
 
-                std::string errorMessage = "";
-                if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
-                    LogPrintf("dstx: Got bad masternode address signature %s \n", vin.ToString());
-                    //pfrom->Misbehaving(20);
-                    return false;
-                }
+            std::string errorMessage = "";
+            if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
+                LogPrintf("dstx: Got bad masternode address signature %s \n", vin.ToString());
+                //pfrom->Misbehaving(20);
+                return false;
+            }
 
-                LogPrintf("dstx: Got Masternode transaction %s\n", tx.GetHash().ToString());
+            LogPrintf("dstx: Got Masternode transaction %s\n", tx.GetHash().ToString());
 
-                ignoreFees = true;
-                pmn->allowFreeTx = false;
+            ignoreFees = true;
+            pmn->allowFreeTx = false;
 
-                if (!mapObfuscationBroadcastTxes.count(tx.GetHash())) {
-                    CObfuscationBroadcastTx dstx;
-                    dstx.tx = tx;
-                    dstx.vin = vin;
-                    dstx.vchSig = vchSig;
-                    dstx.sigTime = sigTime;
+            if (!mapObfuscationBroadcastTxes.count(tx.GetHash())) {
+                CObfuscationBroadcastTx dstx;
+                dstx.tx = tx;
+                dstx.vin = vin;
+                dstx.vchSig = vchSig;
+                dstx.sigTime = sigTime;
 
-                    mapObfuscationBroadcastTxes.insert(make_pair(tx.GetHash(), dstx));
-                }
+                mapObfuscationBroadcastTxes.insert(make_pair(tx.GetHash(), dstx));
             }
         }
+    }
 
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
+    CInv inv(MSG_TX, tx.GetHash());
+    pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
+    LOCK(cs_main);
 
-        bool fMissingInputs = false;
-        CValidationState state;
+    bool fMissingInputs = false;
+    CValidationState state;
 
-        mapAlreadyAskedFor.erase(inv);
+    mapAlreadyAskedFor.erase(inv);
 
-        if (AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for(unsigned int i = 0; i < vWorkQueue.size(); i++) {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
+    if (AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+        vWorkQueue.push_back(inv.hash);
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+
+        // Recursively process any orphan transactions that depended on this one
+        set<NodeId> setMisbehaving;
+        for(unsigned int i = 0; i < vWorkQueue.size(); i++) {
+            map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
+            if(itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for(set<uint256>::iterator mi = itByPrev->second.begin();
+                mi != itByPrev->second.end();
+                ++mi) {
+                const uint256 &orphanHash = *mi;
+                const CTransaction &orphanTx = mapOrphanTransactions[orphanHash].tx;
+                NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if(setMisbehaving.count(fromPeer))
                     continue;
-                for(set<uint256>::iterator mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const uint256 &orphanHash = *mi;
-                    const CTransaction &orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if(setMisbehaving.count(fromPeer))
-                        continue;
-                    if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    } else if(!fMissingInputs2) {
-                        int nDos = 0;
-                        if(stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
+                if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
+                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx);
+                    vWorkQueue.push_back(orphanHash);
+                    vEraseQueue.push_back(orphanHash);
+                } else if(!fMissingInputs2) {
+                    int nDos = 0;
+                    if(stateDummy.IsInvalid(nDos) && nDos > 0) {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
                     }
-                    mempool.check(pcoinsTip);
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee/priority
+                    LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    recentRejects->insert(orphanHash);
                 }
+                mempool.check(pcoinsTip);
             }
+        }
+
+        for (uint256 hash : vEraseQueue)
+            EraseOrphanTx(hash);
+    } else if (fMissingInputs) {
+        AddOrphanTx(tx, pfrom->GetId());
+
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else {
+        // Already in the pool is not a rejection
+        if (!mempool.exists(inv.hash))
+            recentRejects->insert(inv.hash);
 
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
-        } else if (fMissingInputs) {
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else if (pfrom->fWhitelisted) {
+        if (pfrom->fWhitelisted) {
             // Always relay transactions received from whitelisted peers, even
             // if they are already in the mempool (allowing the node to function
             // as a gateway for nodes hidden behind it).
 
             RelayTransaction(tx);
         }
+    }
 
-        if (strCommand == "dstx") {
-            CInv inv(MSG_DSTX, tx.GetHash());
-            RelayInv(inv);
-        }
+    if (strCommand == "dstx") {
+        CInv inv(MSG_DSTX, tx.GetHash());
+        RelayInv(inv);
+    }
 
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
-                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
-        }
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            state.GetRejectReason());
+        pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
+            state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
     }
 
+    return true;
+}
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive() && !fImporting && !fReindex) // Ignore headers received while importing
-    {
-        std::vector<CBlockHeader> headers;
+bool static ProcessHeadersMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Ignore headers received while importing
+    if (!Params().HeadersFirstSyncingActive() || fImporting || fReindex)
+        return true;
 
-        // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
-        unsigned int nCount = ReadCompactSize(vRecv);
-        if (nCount > MAX_HEADERS_RESULTS) {
-            LOCK(cs_main);
+    std::vector<CBlockHeader> headers;
+
+    // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
+    unsigned int nCount = ReadCompactSize(vRecv);
+    if (nCount > MAX_HEADERS_RESULTS) {
+        Misbehaving(pfrom->GetId(), 20);
+        return error("headers message size = %u", nCount);
+    }
+    headers.resize(nCount);
+    for (unsigned int n = 0; n < nCount; n++) {
+        vRecv >> headers[n];
+        ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+    }
+
+    if (nCount == 0) {
+        // Nothing interesting. Stop asking this peers for more headers.
+        return true;
+    }
+    CBlockIndex* pindexLast = NULL;
+    for (const CBlockHeader& header : headers) {
+        CValidationState state;
+        if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
             Misbehaving(pfrom->GetId(), 20);
-            return error("headers message size = %u", nCount);
+            return error("non-continuous headers sequence");
+        }
+
+        /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
+         * before headers are reimplemented on mainnet
+         */
+        if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                std::string strError = "invalid header received " + header.GetHash().ToString();
+                return error(strError.c_str());
+            }
         }
-        headers.resize(nCount);
-        for (unsigned int n = 0; n < nCount; n++) {
-            vRecv >> headers[n];
-            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+    }
+
+    if (pindexLast)
+        UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+
+    if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        // Headers message had its maximum size; the peer may have more headers.
+        // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
+        // from there instead.
+        LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256(0));
+    }
+
+    CheckBlockIndex();
+
+    return true;
+}
+
+bool static ProcessBlockMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Ignore blocks received while importing
+    if (fImporting || fReindex)
+        return true;
+
+    CBlock block;
+    vRecv >> block;
+    uint256 hashBlock = block.GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+    LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+
+    //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
+    if (!mapBlockIndex.count(block.hashPrevBlock) && IsHeadersFirstPeer(pfrom)) {
+        // Fetch the headers in between; the block is downloaded again once they connect
+        LOCK(cs_main);
+        MarkBlockAsReceived(hashBlock);
+        UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256(0));
+    } else if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+            //we already asked for this block, so lets work backwards and ask for the previous block
+            pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
+            pfrom->vBlockRequested.push_back(block.hashPrevBlock);
+        } else {
+            //ask to sync to this block
+            pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
+            pfrom->vBlockRequested.push_back(hashBlock);
         }
+    } else {
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+    }
 
+    return true;
+}
+
+bool static ProcessCmpctBlockMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Ignore blocks received while importing
+    if (fImporting || fReindex)
+        return true;
+
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    vRecv >> cmpctblock;
+    uint256 hashBlock = cmpctblock.header.GetHash();
+    LogPrint("cmpctblock", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+    CBlock block;
+    bool fBlockReconstructed = false;
+    {
         LOCK(cs_main);
 
-        if (nCount == 0) {
-            // Nothing interesting. Stop asking this peers for more headers.
+        if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+            // Doesn't connect to anything we know; the headers in between come first
+            if (!IsInitialBlockDownload())
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256(0));
             return true;
         }
-        CBlockIndex* pindexLast = NULL;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-                Misbehaving(pfrom->GetId(), 20);
-                return error("non-continuous headers sequence");
-            }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
-            if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
-                    return error(strError.c_str());
-                }
+        CBlockIndex* pindex = NULL;
+        CValidationState state;
+        if (!AcceptBlockHeader(CBlock(cmpctblock.header), state, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header received in cmpctblock %s", hashBlock.ToString());
             }
+            return true;
+        }
+        UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+        bool fInFlightFromPeer = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (fInFlightFromPeer)
+                MarkBlockAsReceived(hashBlock);
+            return true;
+        }
+        if (itInFlight != mapBlocksInFlight.end() && (!fInFlightFromPeer || itInFlight->second.second->partialBlock)) {
+            // Already coming from elsewhere, or already being rebuilt
+            return true;
+        }
+        if (!fInFlightFromPeer && (pindex->nChainWork <= chainActive.Tip()->nChainWork ||
+                                      State(pfrom->GetId())->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)) {
+            // Unasked for, and either no better than our tip or the download logic's to fetch
+            return true;
+        }
+
+        vector<CInv> vGetData(1, CInv(MSG_BLOCK, hashBlock));
+        if (pindex->pprev != chainActive.Tip()) {
+            // Our pool holds the transactions of a different branch; take it whole
+            MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex);
+            pfrom->PushMessage("getdata", vGetData);
+            return true;
         }
 
-        if (pindexLast)
-            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        // Orphans are transactions we have seen but could not take in yet;
+        // they may well be in the block
+        vector<const CTransaction*> vExtraTxn;
+        vExtraTxn.reserve(mapOrphanTransactions.size());
+        for (map<uint256, COrphanTx>::const_iterator it = mapOrphanTransactions.begin(); it != mapOrphanTransactions.end(); it++)
+            vExtraTxn.push_back(&it->second.tx);
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
-            // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrintf("more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256(0));
+        boost::shared_ptr<PartiallyDownloadedBlock> partialBlock(new PartiallyDownloadedBlock(&mempool));
+        ReadStatus status = partialBlock->InitData(cmpctblock, vExtraTxn);
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(hashBlock);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("invalid cmpctblock %s from peer=%d", hashBlock.ToString(), pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Short ids collided within the block; take it whole
+            MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex);
+            pfrom->PushMessage("getdata", vGetData);
+            return true;
         }
 
-        CheckBlockIndex();
+        BlockTransactionsRequest req;
+        req.blockhash = hashBlock;
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!partialBlock->IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        if (!req.indexes.empty()) {
+            MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex, partialBlock);
+            pfrom->PushMessage("getblocktxn", req);
+            return true;
+        }
+        if (partialBlock->FillBlock(block, vector<CTransaction>()) != READ_STATUS_OK) {
+            // One of ours only shared a short id with the transaction in the block
+            MarkBlockAsInFlight(pfrom->GetId(), hashBlock, pindex);
+            pfrom->PushMessage("getdata", vGetData);
+            return true;
+        }
+        fBlockReconstructed = true;
     }
 
-    else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
+    // Validation takes cs_main itself
+    if (fBlockReconstructed)
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+
+    return true;
+}
+
+bool static ProcessGetBlockTxnMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    BlockTransactionsRequest req;
+    vRecv >> req;
+
+    BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+    if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+        LogPrint("net", "peer=%d asked for transactions of block %s we don't have\n", pfrom->id, req.blockhash.ToString());
+        return true;
+    }
+    if (!chainActive.Contains(mi->second) || mi->second->nHeight <= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+        // Not recent enough to pick apart; answer as a getdata would, which
+        // also decides whether it may be served at all
+        pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+        ProcessGetData(pfrom);
+        return true;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, mi->second))
+        assert(!"cannot load block from disk");
+    BlockTransactions resp(req);
+    for (size_t i = 0; i < req.indexes.size(); i++) {
+        if (req.indexes[i] >= block.vtx.size()) {
+            Misbehaving(pfrom->GetId(), 100);
+            return error("getblocktxn index %u out of range for block %s, peer=%d", req.indexes[i], req.blockhash.ToString(), pfrom->id);
+        }
+        resp.txn[i] = block.vtx[req.indexes[i]];
+    }
+    pfrom->PushMessage("blocktxn", resp);
+
+    return true;
+}
+
+bool static ProcessBlockTxnMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    // Ignore blocks received while importing
+    if (fImporting || fReindex)
+        return true;
+
+    BlockTransactions resp;
+    vRecv >> resp;
+
+    CBlock block;
+    bool fBlockReconstructed = false;
     {
-        CBlock block;
-        vRecv >> block;
-        uint256 hashBlock = block.GetHash();
-        CInv inv(MSG_BLOCK, hashBlock);
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
-
-        //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
-                //we already asked for this block, so lets work backwards and ask for the previous block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
-                pfrom->vBlockRequested.push_back(block.hashPrevBlock);
-            } else {
-                //ask to sync to this block
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashBlock);
-                pfrom->vBlockRequested.push_back(hashBlock);
-            }
-        } else {
-            pfrom->AddInventoryKnown(inv);
+        LOCK(cs_main);
 
-            CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
-                }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
-            } else {
-                LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
-            }
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+        if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() || !itInFlight->second.second->partialBlock) {
+            LogPrint("net", "peer=%d sent transactions of block %s we did not ask for\n", pfrom->id, resp.blockhash.ToString());
+            return true;
         }
+
+        CBlockIndex* pindex = itInFlight->second.second->pindex;
+        ReadStatus status = itInFlight->second.second->partialBlock->FillBlock(block, resp.txn);
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(resp.blockhash);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("invalid blocktxn for block %s from peer=%d", resp.blockhash.ToString(), pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // One of ours only shared a short id with the transaction in the block
+            MarkBlockAsInFlight(pfrom->GetId(), resp.blockhash, pindex);
+            pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+            return true;
+        }
+        fBlockReconstructed = true;
     }
 
+    if (fBlockReconstructed)
+        ProcessBlockFromPeer(pfrom, block, strCommand);
+
+    return true;
+}
 
+bool static ProcessGetAddrMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
     // Making users (which are behind NAT and can only make outgoing connections) ignore
     // getaddr message mitigates the attack.
-    else if ((strCommand == "getaddr") && (pfrom->fInbound)) {
-        pfrom->vAddrToSend.clear();
-        vector<CAddress> vAddr = addrman.GetAddr();
-        for (const CAddress& addr : vAddr)
-            pfrom->PushAddress(addr);
-    }
-
+    if (!pfrom->fInbound)
+        return true;
 
-    else if (strCommand == "mempool") {
-        LOCK2(cs_main, pfrom->cs_filter);
+    pfrom->vAddrToSend.clear();
+    vector<CAddress> vAddr = addrman.GetAddr();
+    for (const CAddress& addr : vAddr)
+        pfrom->PushAddress(addr);
 
-        std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
-        vector<CInv> vInv;
-        for (uint256& hash : vtxid) {
-            CInv inv(MSG_TX, hash);
-            CTransaction tx;
-            bool fInMemPool = mempool.lookup(hash, tx);
-            if (!fInMemPool) continue; // another thread removed since queryHashes, maybe...
-            if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(tx)) ||
-                (!pfrom->pfilter))
-                vInv.push_back(inv);
-            if (vInv.size() == MAX_INV_SZ) {
-                pfrom->PushMessage("inv", vInv);
-                vInv.clear();
-            }
-        }
-        if (vInv.size() > 0)
-            pfrom->PushMessage("inv", vInv);
-    }
+    return true;
+}
 
+bool static ProcessMempoolMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    LOCK(pfrom->cs_filter);
 
-    else if (strCommand == "ping") {
-        if (pfrom->nVersion > BIP0031_VERSION) {
-            uint64_t nonce = 0;
-            vRecv >> nonce;
-            // Echo the message back with the nonce. This allows for two useful features:
-            //
-            // 1) A remote node can quickly check if the connection is operational
-            // 2) Remote nodes can measure the latency of the network thread. If this node
-            //    is overloaded it won't respond to pings quickly and the remote node can
-            //    avoid sending us more work, like chain download requests.
-            //
-            // The nonce stops the remote getting confused between different pings: without
-            // it, if the remote node sends a ping once per second and this node takes 5
-            // seconds to respond to each, the 5th ping the remote sends would appear to
-            // return very quickly.
-            pfrom->PushMessage("pong", nonce);
+    std::vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+    vector<CInv> vInv;
+    for (uint256& hash : vtxid) {
+        CInv inv(MSG_TX, hash);
+        CTransaction tx;
+        bool fInMemPool = mempool.lookup(hash, tx);
+        if (!fInMemPool) continue; // another thread removed since queryHashes, maybe...
+        if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(tx)) ||
+            (!pfrom->pfilter))
+            vInv.push_back(inv);
+        if (vInv.size() == MAX_INV_SZ) {
+            pfrom->PushMessage("inv", vInv);
+            vInv.clear();
         }
     }
+    if (vInv.size() > 0)
+        pfrom->PushMessage("inv", vInv);
 
+    return true;
+}
 
-    else if (strCommand == "pong") {
-        int64_t pingUsecEnd = nTimeReceived;
+bool static ProcessPingMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (pfrom->nVersion > BIP0031_VERSION) {
         uint64_t nonce = 0;
-        size_t nAvail = vRecv.in_avail();
-        bool bPingFinished = false;
-        std::string sProblem;
+        vRecv >> nonce;
+        // Echo the message back with the nonce. This allows for two useful features:
+        //
+        // 1) A remote node can quickly check if the connection is operational
+        // 2) Remote nodes can measure the latency of the network thread. If this node
+        //    is overloaded it won't respond to pings quickly and the remote node can
+        //    avoid sending us more work, like chain download requests.
+        //
+        // The nonce stops the remote getting confused between different pings: without
+        // it, if the remote node sends a ping once per second and this node takes 5
+        // seconds to respond to each, the 5th ping the remote sends would appear to
+        // return very quickly.
+        pfrom->PushMessage("pong", nonce);
+    }
 
-        if (nAvail >= sizeof(nonce)) {
-            vRecv >> nonce;
+    return true;
+}
 
-            // Only process pong message if there is an outstanding ping (old ping without nonce should never pong)
-            if (pfrom->nPingNonceSent != 0) {
-                if (nonce == pfrom->nPingNonceSent) {
-                    // Matching pong received, this ping is no longer outstanding
-                    bPingFinished = true;
-                    int64_t pingUsecTime = pingUsecEnd - pfrom->nPingUsecStart;
-                    if (pingUsecTime > 0) {
-                        // Successful ping time measurement, replace previous
-                        pfrom->nPingUsecTime = pingUsecTime;
-                    } else {
-                        // This should never happen
-                        sProblem = "Timing mishap";
-                    }
+bool static ProcessPongMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    int64_t pingUsecEnd = nTimeReceived;
+    uint64_t nonce = 0;
+    size_t nAvail = vRecv.in_avail();
+    bool bPingFinished = false;
+    std::string sProblem;
+
+    if (nAvail >= sizeof(nonce)) {
+        vRecv >> nonce;
+
+        // Only process pong message if there is an outstanding ping (old ping without nonce should never pong)
+        if (pfrom->nPingNonceSent != 0) {
+            if (nonce == pfrom->nPingNonceSent) {
+                // Matching pong received, this ping is no longer outstanding
+                bPingFinished = true;
+                int64_t pingUsecTime = pingUsecEnd - pfrom->nPingUsecStart;
+                if (pingUsecTime > 0) {
+                    // Successful ping time measurement, replace previous
+                    pfrom->nPingUsecTime = pingUsecTime;
                 } else {
-                    // Nonce mismatches are normal when pings are overlapping
-                    sProblem = "Nonce mismatch";
-                    if (nonce == 0) {
-                        // This is most likely a bug in another implementation somewhere, cancel this ping
-                        bPingFinished = true;
-                        sProblem = "Nonce zero";
-                    }
+                    // This should never happen
+                    sProblem = "Timing mishap";
                 }
             } else {
-                sProblem = "Unsolicited pong without ping";
+                // Nonce mismatches are normal when pings are overlapping
+                sProblem = "Nonce mismatch";
+                if (nonce == 0) {
+                    // This is most likely a bug in another implementation somewhere, cancel this ping
+                    bPingFinished = true;
+                    sProblem = "Nonce zero";
+                }
             }
+        } else {
+            sProblem = "Unsolicited pong without ping";
         }
+    }
 
 //      else {
 //          // This is most likely a bug in another implementation somewhere, cancel this ping
@@ -5518,137 +6079,223 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 //          sProblem = "Short payload";
 //      }
 
-        if (!(sProblem.empty())) {
-            LogPrint("net", "pong peer=%d %s: %s, %x expected, %x received, %u bytes\n",
-                pfrom->id,
-                pfrom->cleanSubVer,
-                sProblem,
-                pfrom->nPingNonceSent,
-                nonce,
-                nAvail);
-        }
-        if (bPingFinished) {
-            pfrom->nPingNonceSent = 0;
-        }
+    if (!(sProblem.empty())) {
+        LogPrint("net", "pong peer=%d %s: %s, %x expected, %x received, %u bytes\n",
+            pfrom->id,
+            pfrom->cleanSubVer,
+            sProblem,
+            pfrom->nPingNonceSent,
+            nonce,
+            nAvail);
+    }
+    if (bPingFinished) {
+        pfrom->nPingNonceSent = 0;
     }
 
+    return true;
+}
+
+bool static ProcessAlertMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (!fAlerts)
+        return true;
 
-    else if (fAlerts && strCommand == "alert") {
-        CAlert alert;
-        vRecv >> alert;
+    CAlert alert;
+    vRecv >> alert;
 
-        uint256 alertHash = alert.GetHash();
-        if (pfrom->setKnown.count(alertHash) == 0) {
-            if (alert.ProcessAlert()) {
-                // Relay
-                pfrom->setKnown.insert(alertHash);
-                {
-                    LOCK(cs_vNodes);
-                    for (CNode* pnode : vNodes)
-                        alert.RelayTo(pnode);
-                }
-            } else {
-                // Small DoS penalty so peers that send us lots of
-                // duplicate/expired/invalid-signature/whatever alerts
-                // eventually get banned.
-                // This isn't a Misbehaving(100) (immediate ban) because the
-                // peer might be an older or different implementation with
-                // a different signature key, etc.
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), 10);
+    uint256 alertHash = alert.GetHash();
+    if (pfrom->setKnown.count(alertHash) == 0) {
+        if (alert.ProcessAlert()) {
+            // Relay
+            pfrom->setKnown.insert(alertHash);
+            {
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodes)
+                    alert.RelayTo(pnode);
             }
+        } else {
+            // Small DoS penalty so peers that send us lots of
+            // duplicate/expired/invalid-signature/whatever alerts
+            // eventually get banned.
+            // This isn't a Misbehaving(100) (immediate ban) because the
+            // peer might be an older or different implementation with
+            // a different signature key, etc.
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
         }
     }
 
-    else if (!(nLocalServices & NODE_BLOOM) &&
-             (strCommand == "filterload" ||
-                 strCommand == "filteradd" ||
-                 strCommand == "filterclear")) {
-        LogPrintf("bloom message=%s\n", strCommand);
+    return true;
+}
+
+/** Filter messages are only for nodes offering NODE_BLOOM; peers sending them anyway misbehave */
+bool static CheckBloomService(CNode* pfrom, const string& strCommand)
+{
+    if (nLocalServices & NODE_BLOOM)
+        return true;
+    LogPrintf("bloom message=%s\n", strCommand);
+    LOCK(cs_main);
+    Misbehaving(pfrom->GetId(), 100);
+    return false;
+}
+
+bool static ProcessFilterLoadMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (!CheckBloomService(pfrom, strCommand))
+        return true;
+
+    CBloomFilter filter;
+    vRecv >> filter;
+
+    if (!filter.IsWithinSizeConstraints()) {
+        // There is no excuse for sending a too-large filter
         LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 100);
+    } else {
+        LOCK(pfrom->cs_filter);
+        delete pfrom->pfilter;
+        pfrom->pfilter = new CBloomFilter(filter);
+        pfrom->pfilter->UpdateEmptyFull();
     }
+    pfrom->fRelayTxes = true;
 
-    else if (strCommand == "filterload") {
-        CBloomFilter filter;
-        vRecv >> filter;
+    return true;
+}
 
-        if (!filter.IsWithinSizeConstraints()) {
-            // There is no excuse for sending a too-large filter
+bool static ProcessFilterAddMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (!CheckBloomService(pfrom, strCommand))
+        return true;
+
+    vector<unsigned char> vData;
+    vRecv >> vData;
+
+    // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
+    // and thus, the maximum size any matched object can have) in a filteradd message
+    if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 100);
+    } else {
+        LOCK(pfrom->cs_filter);
+        if (pfrom->pfilter)
+            pfrom->pfilter->insert(vData);
+        else {
             LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
-        } else {
-            LOCK(pfrom->cs_filter);
-            delete pfrom->pfilter;
-            pfrom->pfilter = new CBloomFilter(filter);
-            pfrom->pfilter->UpdateEmptyFull();
         }
-        pfrom->fRelayTxes = true;
     }
 
+    return true;
+}
 
-    else if (strCommand == "filteradd") {
-        vector<unsigned char> vData;
-        vRecv >> vData;
+bool static ProcessFilterClearMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (!CheckBloomService(pfrom, strCommand))
+        return true;
 
-        // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
-        // and thus, the maximum size any matched object can have) in a filteradd message
-        if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 100);
-        } else {
-            LOCK(pfrom->cs_filter);
-            if (pfrom->pfilter)
-                pfrom->pfilter->insert(vData);
-            else {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), 100);
+    LOCK(pfrom->cs_filter);
+    delete pfrom->pfilter;
+    pfrom->pfilter = new CBloomFilter();
+    pfrom->fRelayTxes = true;
+
+    return true;
+}
+
+bool static ProcessRejectMessage(CNode* pfrom, string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    if (fDebug) {
+        try {
+            string strMsg;
+            unsigned char ccode;
+            string strReason;
+            vRecv >> LIMITED_STRING(strMsg, CMessageHeader::COMMAND_SIZE) >> ccode >> LIMITED_STRING(strReason, MAX_REJECT_MESSAGE_LENGTH);
+
+            ostringstream ss;
+            ss << strMsg << " code " << itostr(ccode) << ": " << strReason;
+
+            if (strMsg == "block" || strMsg == "tx") {
+                uint256 hash;
+                vRecv >> hash;
+                ss << ": hash " << hash.ToString();
             }
+            LogPrint("net", "Reject %s\n", SanitizeString(ss.str()));
+        } catch (std::ios_base::failure& e) {
+            // Avoid feedback loops by preventing reject messages from triggering a new reject message.
+            LogPrint("net", "Unparseable reject message received\n");
         }
     }
 
+    return true;
+}
 
-    else if (strCommand == "filterclear") {
-        LOCK(pfrom->cs_filter);
-        delete pfrom->pfilter;
-        pfrom->pfilter = new CBloomFilter();
-        pfrom->fRelayTxes = true;
-    }
+/**
+ * The messages of the protocol itself; the masternode, obfuscation and spork
+ * modules register theirs next to these in RegisterMessageHandlers().
+ */
+static const CNetMsgHandler vNetMsgHandlers[] =
+    {
+        //  command        actor (function)                 locks
+        //  -------------  -------------------------------  ----------------
+        {"version", &ProcessVersionMessage, NETMSG_LOCK_NONE},
+        {"verack", &ProcessVerackMessage, NETMSG_LOCK_NONE},
+        {"sendcmpct", &ProcessSendCmpctMessage, NETMSG_LOCK_NONE},
+        {"addr", &ProcessAddrMessage, NETMSG_LOCK_NONE},
+        {"inv", &ProcessInvMessage, NETMSG_LOCK_MAIN},
+        {"getdata", &ProcessGetDataMessage, NETMSG_LOCK_NONE},
+        {"getblocks", &ProcessGetBlocksMessage, NETMSG_LOCK_MAIN},
+        {"getheaders", &ProcessGetHeadersMessage, NETMSG_LOCK_MAIN},
+        {"tx", &ProcessTxMessage, NETMSG_LOCK_NONE},
+        {"dstx", &ProcessTxMessage, NETMSG_LOCK_NONE},
+        {"headers", &ProcessHeadersMessage, NETMSG_LOCK_MAIN},
+        {"block", &ProcessBlockMessage, NETMSG_LOCK_NONE},
+        {"cmpctblock", &ProcessCmpctBlockMessage, NETMSG_LOCK_NONE},
+        {"getblocktxn", &ProcessGetBlockTxnMessage, NETMSG_LOCK_MAIN},
+        {"blocktxn", &ProcessBlockTxnMessage, NETMSG_LOCK_NONE},
+        {"getaddr", &ProcessGetAddrMessage, NETMSG_LOCK_NONE},
+        {"mempool", &ProcessMempoolMessage, NETMSG_LOCK_MAIN},
+        {"ping", &ProcessPingMessage, NETMSG_LOCK_NONE},
+        {"pong", &ProcessPongMessage, NETMSG_LOCK_NONE},
+        {"alert", &ProcessAlertMessage, NETMSG_LOCK_NONE},
+        {"filterload", &ProcessFilterLoadMessage, NETMSG_LOCK_NONE},
+        {"filteradd", &ProcessFilterAddMessage, NETMSG_LOCK_NONE},
+        {"filterclear", &ProcessFilterClearMessage, NETMSG_LOCK_NONE},
+        {"reject", &ProcessRejectMessage, NETMSG_LOCK_NONE},
+    };
+
+void static RegisterMessageHandlers(CNetMsgTable& table)
+{
+    table.Register(vNetMsgHandlers, ARRAYLEN(vNetMsgHandlers));
+    RegisterObfuscationMessages(table);
+    RegisterMasternodeManMessages(table);
+    RegisterMasternodePaymentsMessages(table);
+    RegisterSporkMessages(table);
+    RegisterMasternodeSyncMessages(table);
+}
 
+bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    RandAddSeedPerfmon();
+    if (fDebug)
+        LogPrintf("received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
+    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0) {
+        LogPrintf("dropmessagestest DROPPING RECV MESSAGE\n");
+        return true;
+    }
 
-    else if (strCommand == "reject") {
-        if (fDebug) {
-            try {
-                string strMsg;
-                unsigned char ccode;
-                string strReason;
-                vRecv >> LIMITED_STRING(strMsg, CMessageHeader::COMMAND_SIZE) >> ccode >> LIMITED_STRING(strReason, MAX_REJECT_MESSAGE_LENGTH);
-
-                ostringstream ss;
-                ss << strMsg << " code " << itostr(ccode) << ": " << strReason;
-
-                if (strMsg == "block" || strMsg == "tx") {
-                    uint256 hash;
-                    vRecv >> hash;
-                    ss << ": hash " << hash.ToString();
-                }
-                LogPrint("net", "Reject %s\n", SanitizeString(ss.str()));
-            } catch (std::ios_base::failure& e) {
-                // Avoid feedback loops by preventing reject messages from triggering a new reject message.
-                LogPrint("net", "Unparseable reject message received\n");
-            }
+    if (strCommand != "version") {
+        if (pfrom->nVersion == 0) {
+            // Must have a version message before anything else
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 1);
+            return false;
         }
-    } else {
-        //probably one the extensions
-        obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
-        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
-    }
 
+        // Instantly disconnect old protocol
+        if (pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand))
+            return false;
+    }
 
-    return true;
+    return netMsgTable.Dispatch(pfrom, strCommand, vRecv, nTimeReceived);
 }
 
 // Note: whenever a protocol update is needed toggle between both implementations (comment out the formerly active one)
@@ -5785,7 +6432,7 @@ bool ProcessMessages(CNode* pfrom)
 
     // In case the connection got shut down, its receive buffer was wiped
     if (!pfrom->fDisconnect)
-        pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+        pfrom->EraseRecvMsgs(it);
 
     return fOk;
 }
@@ -5835,9 +6482,9 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodes) {
-                // Periodically clear setAddrKnown to allow refresh broadcasts
+                // Periodically clear addrKnown to allow refresh broadcasts
                 if (nLastRebroadcast)
-                    pnode->setAddrKnown.clear();
+                    pnode->addrKnown.reset();
 
                 // Rebroadcast our address
                 AdvertiseLocal(pnode);
@@ -5853,8 +6500,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
+                if (!pto->addrKnown.contains(addr.GetKey())) {
+                    pto->addrKnown.insert(addr.GetKey());
                     vAddr.push_back(addr);
                     // receiver rejects addr messages larger than 1000
                     if (vAddr.size() >= 1000) {
@@ -5896,10 +6543,16 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (IsHeadersFirstPeer(pto)) {
+                    // The peer has this long to get our headers close to today, given the number of
+                    // headers we expect; otherwise sync is handed to another peer (see below).
+                    state.nHeadersSyncTimeout = GetTimeMicros() + HEADERS_DOWNLOAD_TIMEOUT_BASE + HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER *
+                        (GetAdjustedTime() - pindexBestHeader->GetBlockTime()) / Params().TargetSpacing();
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+                } else
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
             }
         }
 
@@ -5920,7 +6573,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vInv.reserve(pto->vInventoryToSend.size());
             vInvWait.reserve(pto->vInventoryToSend.size());
             for (const CInv& inv : pto->vInventoryToSend) {
-                if (pto->setInventoryKnown.count(inv))
+                std::vector<unsigned char> vKey = inv.GetKey();
+                if (pto->filterInventoryKnown.contains(vKey))
                     continue;
 
                 // trickle out tx inv to protect privacy
@@ -5939,13 +6593,11 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second) {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000) {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                pto->filterInventoryKnown.insert(vKey);
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000) {
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
             }
             pto->vInventoryToSend = vInvWait;
@@ -5971,6 +6623,25 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             LogPrintf("Timeout downloading block %s from peer=%d, disconnecting\n", state.vBlocksInFlight.front().hash.ToString(), pto->id);
             pto->fDisconnect = true;
         }
+        // Headers are fetched from a single peer until we are close to today. If that peer is too slow
+        // about it, hand the job over to the next one: disconnect it unless it is whitelisted, and
+        // start over with whoever SendMessages sees next.
+        if (!pto->fDisconnect && state.fSyncStarted && state.nHeadersSyncTimeout > 0) {
+            if (pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 24 * 60 * 60) {
+                // Close enough to today, headers now follow block announcements
+                state.nHeadersSyncTimeout = 0;
+            } else if (nNow > state.nHeadersSyncTimeout && nSyncStarted == 1 && nPreferredDownload - state.fPreferredDownload >= 1) {
+                if (pto->fWhitelisted)
+                    LogPrintf("Timeout downloading headers from whitelisted peer=%d, not disconnecting\n", pto->id);
+                else {
+                    LogPrintf("Timeout downloading headers from peer=%d, disconnecting\n", pto->id);
+                    pto->fDisconnect = true;
+                }
+                state.fSyncStarted = false;
+                state.nHeadersSyncTimeout = 0;
+                nSyncStarted--;
+            }
+        }
 
         //
         // Message: getdata (blocks)
@@ -6046,16 +6717,23 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read undo data and the checksum that follows it, from the mapped file when possible
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        const char* pbegin = NULL;
+        const char* pend = NULL;
+        MappedFileRef mapping = MapDiskRecord(pos, "rev", sizeof(hashChecksum), pbegin, pend);
+        if (mapping) {
+            CSpanReader filein(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            filein >> *this;
+            filein >> hashChecksum;
+        } else {
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+            filein >> *this;
+            filein >> hashChecksum;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -0,0 +1,83 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nLength);
+#endif
+}
+
+MappedFileRef CMappedFileCache::Map(const std::string& strPath)
+{
+#ifndef WIN32
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd == -1)
+        return MappedFileRef();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)(size_t)-1) {
+        close(fd);
+        return MappedFileRef();
+    }
+    size_t nLength = (size_t)st.st_size;
+    void* p = mmap(NULL, nLength, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("mmap", "%s: mmap of %s failed\n", __func__, strPath);
+        return MappedFileRef();
+    }
+    return MappedFileRef(new CMappedFile((const char*)p, nLength));
+#else
+    return MappedFileRef();
+#endif
+}
+
+MappedFileRef CMappedFileCache::Get(const boost::filesystem::path& path, uint64_t nMinSize)
+{
+    const std::string strPath = path.string();
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    std::list<CEntry>::iterator it = listEntries.begin();
+    while (it != listEntries.end() && it->strPath != strPath)
+        it++;
+    if (it != listEntries.end()) {
+        listEntries.splice(listEntries.begin(), listEntries, it);
+        if (it->mapping->size() >= nMinSize)
+            return it->mapping;
+        // The file has grown since it was mapped
+        listEntries.erase(it);
+    }
+
+    MappedFileRef mapping = Map(strPath);
+    if (!mapping || mapping->size() < nMinSize)
+        return MappedFileRef();
+    LogPrint("mmap", "%s: mapped %s (%u bytes)\n", __func__, strPath, mapping->size());
+
+    CEntry entry;
+    entry.strPath = strPath;
+    entry.mapping = mapping;
+    listEntries.push_front(entry);
+    while (listEntries.size() > nMaxFiles)
+        listEntries.pop_back();
+    return mapping;
+}
+
+void CMappedFileCache::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    listEntries.clear();
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** A whole file mapped read-only into memory; unmapped when the last reference goes */
+class CMappedFile
+{
+private:
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pdata;
+    size_t nLength;
+
+public:
+    CMappedFile(const char* pdataIn, size_t nLengthIn) : pdata(pdataIn), nLength(nLengthIn) {}
+    ~CMappedFile();
+
+    const char* begin() const { return pdata; }
+    const char* end() const { return pdata + nLength; }
+    size_t size() const { return nLength; }
+};
+
+typedef boost::shared_ptr<const CMappedFile> MappedFileRef;
+
+/**
+ * Small LRU pool of read-only file mappings, used for the blk/rev files so
+ * that serving a block does not cost an open/seek/read/close round trip.
+ *
+ * Files that are still being appended to are remapped on demand when a read
+ * reaches past the end of the current mapping. Readers hold a reference, so
+ * a mapping evicted or replaced meanwhile stays valid until they are done.
+ * On platforms without mmap Get() always returns an empty reference and
+ * callers fall back to stdio.
+ */
+class CMappedFileCache
+{
+private:
+    struct CEntry {
+        std::string strPath;
+        MappedFileRef mapping;
+    };
+
+    boost::mutex cs;
+    //! Most recently used first
+    std::list<CEntry> listEntries;
+    size_t nMaxFiles;
+
+public:
+    explicit CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Map the whole of a file that is not written to meanwhile, bypassing the pool */
+    static MappedFileRef Map(const std::string& strPath);
+
+    /** Return a mapping of path at least nMinSize bytes long, or an empty reference */
+    MappedFileRef Get(const boost::filesystem::path& path, uint64_t nMinSize);
+
+    /** Drop all mappings, e.g. before files are rewritten or removed */
+    void Clear();
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
@@ -7,8 +7,10 @@
 
 #include "masternode-payments.h"
 #include "addrman.h"
+#include "cachefile.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
+#include "netmsgtable.h"
 #include "obfuscation.h"
 #include "spork.h"
 #include "sync.h"
@@ -25,6 +27,106 @@ CCriticalSection cs_vecPayments;
 CCriticalSection cs_mapMasternodeBlocks;
 CCriticalSection cs_mapMasternodePayeeVotes;
 
+//
+// CMasternodePaymentDB
+//
+
+CMasternodePaymentDB::CMasternodePaymentDB()
+{
+    pathDB = GetDataDir() / "mnpayments.dat";
+    strMagicMessage = "MasternodePayments";
+}
+
+bool CMasternodePaymentDB::Write(const CMasternodePayments& paymentsToSave)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::map<int, std::vector<CMasternodePaymentDiskVote> > mapDiskVotes;
+    paymentsToSave.GetDiskVotes(mapDiskVotes);
+
+    // One item per block height, so the heights are spread over the chunks
+    CCacheFileWriter writer(strMagicMessage, MNPAYMENTS_FILE_FORMAT);
+    writer.WriteSection(std::vector<std::pair<int, std::vector<CMasternodePaymentDiskVote> > >(mapDiskVotes.begin(), mapDiskVotes.end()));
+    if (!writer.Commit(pathDB))
+        return false;
+
+    LogPrint("mnpayments","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("mnpayments","  %s\n", paymentsToSave.ToString());
+
+    return true;
+}
+
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& paymentsToLoad, bool fDryRun)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::vector<std::pair<int, std::vector<CMasternodePaymentDiskVote> > > vDiskVotes;
+    CCacheFileReader reader(nScriptCheckThreads);
+    CCacheFileReader::ReadResult result = reader.Open(pathDB, strMagicMessage, MNPAYMENTS_FILE_FORMAT);
+    if (result == CCacheFileReader::Ok)
+        result = reader.ReadSection(vDiskVotes);
+    if (result == CCacheFileReader::Ok && !reader.AtEnd())
+        result = CCacheFileReader::IncorrectFormat;
+
+    switch (result) {
+    case CCacheFileReader::Ok:
+        break;
+    case CCacheFileReader::FileError:
+        error("%s : Failed to open file %s", __func__, pathDB.string());
+        return FileError;
+    case CCacheFileReader::IncorrectHash:
+        error("%s : Checksum mismatch, data corrupted", __func__);
+        return IncorrectHash;
+    case CCacheFileReader::IncorrectMagicMessage:
+        error("%s : Invalid masternode payments magic message", __func__);
+        return IncorrectMagicMessage;
+    case CCacheFileReader::IncorrectMagicNumber:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    case CCacheFileReader::IncorrectFormat:
+        error("%s : Unknown format version or malformed data", __func__);
+        return IncorrectFormat;
+    }
+
+    paymentsToLoad.LoadDiskVotes(std::map<int, std::vector<CMasternodePaymentDiskVote> >(vDiskVotes.begin(), vDiskVotes.end()));
+
+    LogPrint("mnpayments","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("mnpayments","  %s\n", paymentsToLoad.ToString());
+    if (!fDryRun) {
+        paymentsToLoad.CleanPaymentList();
+        LogPrint("mnpayments","Masternode payments - cleaned: %s\n", paymentsToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+void DumpMasternodePayments()
+{
+    int64_t nStart = GetTimeMillis();
+
+    CMasternodePaymentDB paymentdb;
+    CMasternodePayments tempPayments;
+
+    LogPrint("mnpayments","Verifying mnpayments.dat format...\n");
+    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
+    // there was an error and it was not an error on file opening => do not proceed
+    if (readResult == CMasternodePaymentDB::FileError)
+        LogPrint("mnpayments","Missing payment votes file - mnpayments.dat, will try to recreate\n");
+    else if (readResult != CMasternodePaymentDB::Ok) {
+        LogPrint("mnpayments","Error reading mnpayments.dat: ");
+        if (readResult == CMasternodePaymentDB::IncorrectFormat)
+            LogPrint("mnpayments","magic is ok but data has invalid format, will try to recreate\n");
+        else {
+            LogPrint("mnpayments","file format is unknown or invalid, please fix it manually\n");
+            return;
+        }
+    }
+    LogPrint("mnpayments","Writting info to mnpayments.dat...\n");
+    paymentdb.Write(masternodePayments);
+
+    LogPrint("mnpayments","Masternode payments dump finished  %dms\n", GetTimeMillis() - nStart);
+}
+
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -133,25 +235,6 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
 
     if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
 
-    if (strCommand == "mnget") { //Masternode Payments Request Sync
-
-        int nCountNeeded;
-        vRecv >> nCountNeeded;
-
-        if (Params().NetworkID() == CBaseChainParams::MAIN) {
-
-            if (pfrom->HasFulfilledRequest("mnget")) {
-                LogPrintf("mnget - peer already asked me for the list\n");
-                Misbehaving(pfrom->GetId(), 20);
-                return;
-            }
-        }
-
-        pfrom->FulfilledRequest("mnget");
-        masternodePayments.Sync(pfrom, nCountNeeded);
-        LogPrint("mnpayments", "mnget - Sent Masternode winners to peer %i\n", pfrom->GetId());
-    } else
-
     if (strCommand == "mnw") { //Masternode Payments Declare Winner
         //this is required in litemodef
         CMasternodePaymentWinner winner;
@@ -179,7 +262,7 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
 
         winner.payeeLevel = winner_mn->Level();
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
+        if (masternodePayments.HasVote(winner.GetHash())) {
             LogPrint("mnpayments", "mnw - Already seen - %s bestHeight %d\n", winner.GetHash().ToString().c_str(), nHeight);
             masternodeSync.AddedMasternodeWinner(winner.GetHash());
             return;
@@ -219,6 +302,20 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+static bool ProcessMasternodePaymentsMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void RegisterMasternodePaymentsMessages(CNetMsgTable& table)
+{
+    static const CNetMsgHandler vMessages[] = {
+        {"mnw", &ProcessMasternodePaymentsMessage, NETMSG_LOCK_NONE},
+    };
+    table.Register(vMessages, ARRAYLEN(vMessages));
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
@@ -272,19 +369,22 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
 
     CScript mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
-    for(int64_t h = nHeight; h <= nHeight + 8; ++h) {
+    // Only the blocks this payee has votes for can have it as their payee
+    auto payee_heights = mapPayeeHeights.find(mnpayee);
 
-        if(h == nNotBlockHeight)
-            continue;
+    if(payee_heights == mapPayeeHeights.cend())
+        return false;
 
-        auto block_payees = mapMasternodeBlocks.find(h);
+    auto h = payee_heights->second.lower_bound(nHeight);
 
-        if(block_payees == mapMasternodeBlocks.cend())
+    for(; h != payee_heights->second.cend() && *h <= nHeight + 8; ++h) {
+
+        if(*h == nNotBlockHeight)
             continue;
 
         CScript payee;
 
-        if(!block_payees->second.GetPayee(mn.Level(), payee))
+        if(!GetBlockPayee(*h, mn.Level(), payee))
             continue;
 
         if(mnpayee == payee)
@@ -322,22 +422,112 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
     if (!GetBlockHash(blockHash, winnerIn.nBlockHeight - 100))
         return false;
 
-    {
-        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-        auto vote_ins_res = mapMasternodePayeeVotes.emplace(winnerIn.GetHash(), winnerIn);
+    return AddVote(winnerIn);
+}
 
-        if(!vote_ins_res.second)
-            return false;
+bool CMasternodePayments::AddVote(const CMasternodePaymentWinner& winner)
+{
+    uint256 hash = winner.GetHash();
 
-        auto mnblock = mapMasternodeBlocks.emplace(winnerIn.nBlockHeight, winnerIn.nBlockHeight).first;
+    auto vote_ins_res = mapMasternodePayeeVotes.emplace(hash, winner);
 
-        mnblock->second.AddPayee(winnerIn.payeeLevel, winnerIn.payee, 1);
-    }
+    if(!vote_ins_res.second)
+        return false;
+
+    mapVotesByHeight[winner.nBlockHeight].push_back(hash);
 
+    auto mnblock = mapMasternodeBlocks.emplace(winner.nBlockHeight, winner.nBlockHeight).first;
+
+    mnblock->second.AddPayee(winner.payeeLevel, winner.payee, 1);
+
+    mapPayeeHeights[winner.payee].insert(winner.nBlockHeight);
+
+    return true;
+}
+
+bool CMasternodePayments::HasVote(const uint256& hash)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    return mapMasternodePayeeVotes.count(hash) > 0;
+}
+
+bool CMasternodePayments::GetVote(const uint256& hash, CMasternodePaymentWinner& winner)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    auto vote = mapMasternodePayeeVotes.find(hash);
+
+    if(vote == mapMasternodePayeeVotes.cend())
+        return false;
+
+    winner = vote->second;
     return true;
 }
 
+std::vector<uint256> CMasternodePayments::GetVotesAtHeight(int nBlockHeight)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    auto height = mapVotesByHeight.find(nBlockHeight);
+
+    if(height == mapVotesByHeight.cend())
+        return std::vector<uint256>();
+
+    return height->second;
+}
+
+std::set<int> CMasternodePayments::GetPayeeHeights(const CScript& payee)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    auto payee_heights = mapPayeeHeights.find(payee);
+
+    if(payee_heights == mapPayeeHeights.cend())
+        return std::set<int>();
+
+    return payee_heights->second;
+}
+
+void CMasternodePayments::GetDiskVotes(std::map<int, std::vector<CMasternodePaymentDiskVote> >& mapDiskVotes) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    for(const auto& height : mapVotesByHeight) {
+        auto& votes = mapDiskVotes[height.first];
+        votes.reserve(height.second.size());
+
+        for(const uint256& hash : height.second) {
+            const CMasternodePaymentWinner& winner = mapMasternodePayeeVotes.at(hash);
+            CMasternodePaymentDiskVote vote;
+            vote.prevout = winner.vinMasternode.prevout;
+            vote.payee = winner.payee;
+            vote.payeeLevel = winner.payeeLevel;
+            vote.vchSig = winner.vchSig;
+            votes.push_back(vote);
+        }
+    }
+}
+
+// The votes were checked when they were first received; only the indexes are rebuilt
+void CMasternodePayments::LoadDiskVotes(const std::map<int, std::vector<CMasternodePaymentDiskVote> >& mapDiskVotes)
+{
+    Clear();
+
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    for(const auto& height : mapDiskVotes) {
+        for(const CMasternodePaymentDiskVote& vote : height.second) {
+            CMasternodePaymentWinner winner(CTxIn(vote.prevout));
+            winner.nBlockHeight = height.first;
+            winner.AddPayee(vote.payee, vote.payeeLevel);
+            winner.vchSig = vote.vchSig;
+            AddVote(winner);
+        }
+    }
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -473,18 +663,28 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+    // Votes are indexed by height, so only the expired ones are visited
+    auto it = mapVotesByHeight.begin();
+    while (it != mapVotesByHeight.end() && nHeight - it->first > nLimit) {
+        LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payments - block %d\n", it->first);
+        for (const uint256& hash : it->second) {
+            masternodeSync.mapSeenSyncMNW.erase(hash);
+            mapMasternodePayeeVotes.erase(hash);
+        }
+        mapVotesByHeight.erase(it++);
+    }
 
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+    auto block = mapMasternodeBlocks.begin();
+    while (block != mapMasternodeBlocks.end() && nHeight - block->first > nLimit) {
+        for (const CMasternodePayee& payee : block->second.vecPayments) {
+            auto payee_heights = mapPayeeHeights.find(payee.scriptPubKey);
+            if (payee_heights == mapPayeeHeights.end())
+                continue;
+            payee_heights->second.erase(block->first);
+            if (payee_heights->second.empty())
+                mapPayeeHeights.erase(payee_heights);
         }
+        mapMasternodeBlocks.erase(block++);
     }
 }
 
@@ -658,15 +858,17 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
 
     int nInvCount = 0;
 
-    for(const auto& vote : mapMasternodePayeeVotes) {
-            const auto& winner = vote.second;
-            bool push =  winner.nBlockHeight >= nHeight - max_mn_count && winner.nBlockHeight <= nHeight + 20;
-            if(!push)
-                continue;
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
+    // Only the heights in the window are visited, not every vote kept
+    auto first = mapVotesByHeight.lower_bound(nHeight - (int)max_mn_count);
+    auto last = mapVotesByHeight.upper_bound(nHeight + 20);
+
+    for(auto height = first; height != last; ++height) {
+        for(const uint256& hash : height->second) {
+            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, hash));
             ++nInvCount;
         }
-        node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
+    }
+    node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
 }
 
 std::string CMasternodePayments::ToString() const
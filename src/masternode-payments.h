@@ -21,13 +21,20 @@ extern CCriticalSection cs_mapMasternodePayeeVotes;
 class CMasternodePayments;
 class CMasternodePaymentWinner;
 class CMasternodeBlockPayees;
+class CNetMsgTable;
 
 extern CMasternodePayments masternodePayments;
+void DumpMasternodePayments();
+
+/** Layout of mnpayments.dat, see CCacheFileWriter */
+static const int MNPAYMENTS_FILE_FORMAT = 2;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+/** mnw goes to masternodePayments; the mnget requesting winners is answered by mnodeman */
+void RegisterMasternodePaymentsMessages(CNetMsgTable& table);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
 std::string GetRequiredPaymentsString(int nBlockHeight);
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted);
@@ -205,6 +212,50 @@ public:
     }
 };
 
+/** A vote as mnpayments.dat keeps it, under the height of its block */
+class CMasternodePaymentDiskVote
+{
+public:
+    COutPoint prevout;
+    CScript payee;
+    unsigned payeeLevel;
+    std::vector<unsigned char> vchSig;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(prevout);
+        READWRITE(payee);
+        READWRITE(VARINT(payeeLevel));
+        READWRITE(vchSig);
+    }
+};
+
+/** Access to the MN payment votes database (mnpayments.dat) */
+class CMasternodePaymentDB
+{
+private:
+    boost::filesystem::path pathDB;
+    std::string strMagicMessage;
+
+public:
+    enum ReadResult {
+        Ok,
+        FileError,
+        HashReadError,
+        IncorrectHash,
+        IncorrectMagicMessage,
+        IncorrectMagicNumber,
+        IncorrectFormat
+    };
+
+    CMasternodePaymentDB();
+    bool Write(const CMasternodePayments& paymentsToSave);
+    ReadResult Read(CMasternodePayments& paymentsToLoad, bool fDryRun = false);
+};
+
 //
 // Masternode Payments Class
 // Keeps track of who should get paid for which blocks
@@ -216,6 +267,19 @@ private:
 
     int nLastBlockHeight;
 
+    //! Hashes of the votes for each block, requires cs_mapMasternodePayeeVotes
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+    //! Blocks each payee has votes for, requires cs_mapMasternodeBlocks
+    std::map<CScript, std::set<int> > mapPayeeHeights;
+
+    // requires LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks)
+    bool AddVote(const CMasternodePaymentWinner& winner);
+
+    void GetDiskVotes(std::map<int, std::vector<CMasternodePaymentDiskVote> >& mapDiskVotes) const;
+    void LoadDiskVotes(const std::map<int, std::vector<CMasternodePaymentDiskVote> >& mapDiskVotes);
+
+    friend class CMasternodePaymentDB;
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -232,8 +296,17 @@ public:
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
         mapMasternodesLastVote.clear();
+        mapVotesByHeight.clear();
+        mapPayeeHeights.clear();
     }
 
+    bool HasVote(const uint256& hash);
+    bool GetVote(const uint256& hash, CMasternodePaymentWinner& winner);
+    /** Hashes of the votes kept for the block at nBlockHeight */
+    std::vector<uint256> GetVotesAtHeight(int nBlockHeight);
+    /** Heights of the blocks the payee has votes for */
+    std::set<int> GetPayeeHeights(const CScript& payee);
+
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
 
@@ -253,11 +326,17 @@ public:
 
     ADD_SERIALIZE_METHODS;
 
+    // Only the votes, by height; the payees of each block are counted again
+    // from them on load, and their signatures were checked when they came in
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(mapMasternodePayeeVotes);
-        READWRITE(mapMasternodeBlocks);
+        std::map<int, std::vector<CMasternodePaymentDiskVote> > mapDiskVotes;
+        if (!ser_action.ForRead())
+            GetDiskVotes(mapDiskVotes);
+        READWRITE(mapDiskVotes);
+        if (ser_action.ForRead())
+            LoadDiskVotes(mapDiskVotes);
     }
 };
 
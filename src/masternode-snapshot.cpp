@@ -0,0 +1,150 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-snapshot.h"
+
+#include "hash.h"
+#include "masternode.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "version.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+void CMasternodeListSnapshot::Pack(const std::vector<CMasternodeBroadcast>& vMnb)
+{
+    int64_t nBaseTime = std::numeric_limits<int64_t>::max();
+    std::vector<uint256> vBlockHashes;
+    std::map<uint256, uint64_t> mapBlockHashIndex;
+    for (const CMasternodeBroadcast& mnb : vMnb) {
+        nBaseTime = std::min(nBaseTime, mnb.sigTime);
+        if (mnb.lastPing.vin != mnb.vin)
+            continue;
+        nBaseTime = std::min(nBaseTime, mnb.lastPing.sigTime);
+        if (mapBlockHashIndex.emplace(mnb.lastPing.blockHash, vBlockHashes.size()).second)
+            vBlockHashes.push_back(mnb.lastPing.blockHash);
+    }
+    if (vMnb.empty())
+        nBaseTime = 0;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << COMPACTSIZE((uint64_t)vMnb.size());
+    ss << nBaseTime;
+    ss << vBlockHashes;
+    for (const CMasternodeBroadcast& mnb : vMnb) {
+        uint64_t nTimeOffset = mnb.sigTime - nBaseTime;
+        uint64_t nProtocolVersion = std::max(mnb.protocolVersion, 0);
+        uint64_t nLastDsq = std::max(mnb.nLastDsq, (int64_t)0);
+        ss << mnb.vin << mnb.addr << mnb.pubKeyCollateralAddress << mnb.pubKeyMasternode << mnb.sig;
+        ss << VARINT(nTimeOffset) << VARINT(nProtocolVersion) << VARINT(nLastDsq);
+
+        unsigned char fPing = mnb.lastPing.vin == mnb.vin;
+        ss << fPing;
+        if (fPing) {
+            uint64_t nHashIndex = mapBlockHashIndex[mnb.lastPing.blockHash];
+            uint64_t nPingOffset = mnb.lastPing.sigTime - nBaseTime;
+            ss << VARINT(nHashIndex) << VARINT(nPingOffset) << mnb.lastPing.vchSig;
+        }
+    }
+
+    nFormat = MNLIST_SNAPSHOT_FORMAT;
+    vchEntries.assign(ss.begin(), ss.end());
+    hashList = Hash(vchEntries.begin(), vchEntries.end());
+}
+
+bool CMasternodeListSnapshot::Unpack(std::vector<CMasternodeBroadcast>& vMnb, std::string& strError) const
+{
+    vMnb.clear();
+    if (nFormat != MNLIST_SNAPSHOT_FORMAT) {
+        strError = strprintf("unknown format %d", nFormat);
+        return false;
+    }
+    if (Hash(vchEntries.begin(), vchEntries.end()) != hashList) {
+        strError = "list hash mismatch";
+        return false;
+    }
+
+    CDataStream ss(vchEntries, SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        uint64_t nCount;
+        int64_t nBaseTime;
+        std::vector<uint256> vBlockHashes;
+        ss >> COMPACTSIZE(nCount);
+        if (nCount > MNLIST_SNAPSHOT_MAX_ENTRIES) {
+            strError = strprintf("too many entries (%u)", nCount);
+            return false;
+        }
+        ss >> nBaseTime;
+        ss >> vBlockHashes;
+        if (vBlockHashes.size() > nCount) {
+            strError = "more block hashes than entries";
+            return false;
+        }
+
+        vMnb.resize(nCount);
+        for (CMasternodeBroadcast& mnb : vMnb) {
+            uint64_t nTimeOffset, nProtocolVersion, nLastDsq;
+            unsigned char fPing;
+            ss >> mnb.vin >> mnb.addr >> mnb.pubKeyCollateralAddress >> mnb.pubKeyMasternode >> mnb.sig;
+            ss >> VARINT(nTimeOffset) >> VARINT(nProtocolVersion) >> VARINT(nLastDsq);
+            if (nProtocolVersion > (uint64_t)std::numeric_limits<int>::max()) {
+                strError = "bad protocol version";
+                return false;
+            }
+            mnb.sigTime = nBaseTime + nTimeOffset;
+            mnb.protocolVersion = nProtocolVersion;
+            mnb.nLastDsq = nLastDsq;
+
+            ss >> fPing;
+            mnb.lastPing = CMasternodePing();
+            if (fPing) {
+                uint64_t nHashIndex, nPingOffset;
+                ss >> VARINT(nHashIndex) >> VARINT(nPingOffset) >> mnb.lastPing.vchSig;
+                if (nHashIndex >= vBlockHashes.size()) {
+                    strError = "ping block hash index out of range";
+                    return false;
+                }
+                mnb.lastPing.vin = mnb.vin;
+                mnb.lastPing.blockHash = vBlockHashes[nHashIndex];
+                mnb.lastPing.sigTime = nBaseTime + nPingOffset;
+            }
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("malformed entries: %s", e.what());
+        return false;
+    }
+    if (!ss.empty()) {
+        strError = "trailing data after the entries";
+        return false;
+    }
+    return true;
+}
+
+static void CheckSignatureRange(std::vector<CMasternodeBroadcast>* pvMnb, std::vector<char>* pvValid, std::atomic<size_t>* pnNext)
+{
+    size_t i;
+    while ((i = (*pnNext)++) < pvMnb->size())
+        (*pvValid)[i] = (*pvMnb)[i].CheckSignature();
+}
+
+void CheckMasternodeBroadcastSignatures(std::vector<CMasternodeBroadcast>& vMnb, std::vector<char>& vValid, int nThreads)
+{
+    vValid.assign(vMnb.size(), 0);
+
+    // Not worth a thread for fewer than 64 signatures
+    nThreads = std::min(nThreads, (int)(vMnb.size() / 64));
+
+    std::atomic<size_t> nNext(0);
+    boost::thread_group helpers;
+    for (int i = 1; i < nThreads; i++)
+        helpers.create_thread(boost::bind(&CheckSignatureRange, &vMnb, &vValid, &nNext));
+    CheckSignatureRange(&vMnb, &vValid, &nNext);
+    helpers.join_all();
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_SNAPSHOT_H
+#define MASTERNODE_SNAPSHOT_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+class CMasternodeBroadcast;
+
+/** Encoding of the entries in an mnlist message */
+static const int MNLIST_SNAPSHOT_FORMAT = 1;
+/** Most masternodes one mnlist message carries; a longer list is sent in several */
+static const unsigned int MNLIST_SNAPSHOT_MAX_ENTRIES = 4000;
+
+/**
+ * A part of the masternode list with the latest ping of each entry, sent
+ * in one message to a peer that asked with getmnlist instead of as one
+ * inventory item per masternode.
+ *
+ * The entries are packed: times are offsets from the oldest one, the block
+ * hash a ping refers to is an index into a table shared by all pings, and
+ * a ping does not repeat the input of its masternode. hashList commits to
+ * the packed entries and is checked before any of them is used.
+ */
+class CMasternodeListSnapshot
+{
+public:
+    int nFormat;
+    uint256 hashList;
+    std::vector<unsigned char> vchEntries;
+
+    CMasternodeListSnapshot() : nFormat(MNLIST_SNAPSHOT_FORMAT), hashList(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nFormat);
+        READWRITE(hashList);
+        READWRITE(vchEntries);
+    }
+
+    void Pack(const std::vector<CMasternodeBroadcast>& vMnb);
+    bool Unpack(std::vector<CMasternodeBroadcast>& vMnb, std::string& strError) const;
+};
+
+/**
+ * Check the collateral address signature of each broadcast, on nThreads
+ * threads including the calling one. vValid[i] is set for the good ones.
+ */
+void CheckMasternodeBroadcastSignatures(std::vector<CMasternodeBroadcast>& vMnb, std::vector<char>& vValid, int nThreads);
+
+#endif // MASTERNODE_SNAPSHOT_H
@@ -10,6 +10,7 @@
 #include "masternode-payments.h"
 #include "masternode.h"
 #include "masternodeman.h"
+#include "netmsgtable.h"
 #include "spork.h"
 #include "util.h"
 #include "addrman.h"
@@ -180,6 +181,20 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
     }
 }
 
+static bool ProcessMasternodeSyncMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void RegisterMasternodeSyncMessages(CNetMsgTable& table)
+{
+    static const CNetMsgHandler vMessages[] = {
+        {"ssc", &ProcessMasternodeSyncMessage, NETMSG_LOCK_NONE},
+    };
+    table.Register(vMessages, ARRAYLEN(vMessages));
+}
+
 void CMasternodeSync::ClearFulfilledRequest()
 {
     TRY_LOCK(cs_vNodes, lockRecv);
@@ -17,8 +17,11 @@
 #define MASTERNODE_SYNC_THRESHOLD 2
 
 class CMasternodeSync;
+class CNetMsgTable;
 extern CMasternodeSync masternodeSync;
 
+void RegisterMasternodeSyncMessages(CNetMsgTable& table);
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -72,6 +72,7 @@ CMasternode::CMasternode()
     protocolVersion = PROTOCOL_VERSION;
     nLastDsq = 0;
     lastTimeChecked = 0;
+    fTrustedFromCache = false;
 }
 
 CMasternode::CMasternode(const CMasternode& other)
@@ -93,6 +94,7 @@ CMasternode::CMasternode(const CMasternode& other)
     protocolVersion = other.protocolVersion;
     nLastDsq = other.nLastDsq;
     lastTimeChecked = 0;
+    fTrustedFromCache = other.fTrustedFromCache;
 }
 
 CMasternode::CMasternode(const CMasternodeBroadcast& mnb)
@@ -121,6 +123,7 @@ CMasternode::CMasternode(const CMasternodeBroadcast& mnb)
     protocolVersion = mnb.protocolVersion;
     nLastDsq = mnb.nLastDsq;
     lastTimeChecked = 0;
+    fTrustedFromCache = false;
 }
 
 //
@@ -138,6 +141,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
     protocolVersion = mnb.protocolVersion;
     addr = mnb.addr;
     lastTimeChecked = 0;
+    fTrustedFromCache = false;
     int nDoS = 0;
     if (mnb.lastPing == CMasternodePing() || (mnb.lastPing != CMasternodePing() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
         lastPing = mnb.lastPing;
@@ -178,6 +182,23 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     return r;
 }
 
+// Take an entry loaded from mncache.dat as checked when it was saved; only
+// what its ping times tell is updated now, the signature and collateral
+// checks are left to the first Check() that is due
+void CMasternode::TrustFromCache()
+{
+    fTrustedFromCache = true;
+    lastTimeChecked = GetTime();
+
+    if (activeState == MASTERNODE_VIN_SPENT)
+        return;
+
+    if (!IsPingedWithin(MASTERNODE_REMOVAL_SECONDS))
+        activeState = MASTERNODE_REMOVE;
+    else if (!IsPingedWithin(MASTERNODE_EXPIRATION_SECONDS))
+        activeState = MASTERNODE_EXPIRED;
+}
+
 void CMasternode::Check(bool forceCheck)
 {
     if(ShutdownRequested())
@@ -192,6 +213,16 @@ void CMasternode::Check(bool forceCheck)
     if (activeState == MASTERNODE_VIN_SPENT)
         return;
 
+    // The first check of an entry from mncache.dat also covers its signature
+    if (fTrustedFromCache) {
+        fTrustedFromCache = false;
+        if (!CMasternodeBroadcast(*this).CheckSignature()) {
+            LogPrint("masternode", "CMasternode::Check - Bad signature on cached Masternode %s\n", vin.prevout.hash.ToString());
+            activeState = MASTERNODE_REMOVE;
+            return;
+        }
+    }
+
     if (!IsPingedWithin(MASTERNODE_REMOVAL_SECONDS)) {
         activeState = MASTERNODE_REMOVE;
         return;
@@ -203,36 +234,38 @@ void CMasternode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
+        CMasternodeCollateral collateral;
 
-/*
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut(9999.99 * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-*/
-        CMutableTransaction tx;
-
-        CValidationState state = CMasternodeMan::GetInputCheckingTx(vin, tx);
+        // Only when its first lookup finds cs_main busy
+        if (!mnCollateral.Get(vin.prevout, collateral))
+            return;
 
-        if(!state.IsValid()) {
+        if (collateral.fSpent || !IsDepositCoins(collateral.nValue)) {
             activeState = MASTERNODE_VIN_SPENT;
             return;
         }
+    }
 
-        {
-            TRY_LOCK(cs_main, lockMain);
+    activeState = MASTERNODE_ENABLED; // OK
+}
 
-            if (!lockMain)
-                return;
+int CMasternode::GetMasternodeInputAge()
+{
+    if (chainActive.Tip() == NULL) return 0;
 
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, nullptr)) {
-                activeState = MASTERNODE_VIN_SPENT;
-                return;
-            }
-        }
+    CMasternodeCollateral collateral;
+    if (mnCollateral.Get(vin.prevout, collateral)) {
+        if (collateral.nHeight == 0)
+            return collateral.fSpent ? -1 : 0;
+        return (chainActive.Tip()->nHeight + 1) - collateral.nHeight;
     }
 
-    activeState = MASTERNODE_ENABLED; // OK
+    if (cacheInputAge == 0) {
+        cacheInputAge = GetInputAge(vin);
+        cacheInputAgeBlock = chainActive.Tip()->nHeight;
+    }
+
+    return cacheInputAge + (chainActive.Tip()->nHeight - cacheInputAgeBlock);
 }
 
 int64_t CMasternode::SecondsSincePayment()
@@ -543,7 +576,7 @@ bool CMasternodeBroadcast::CheckDefaultPort(const CService& service, std::string
     return true;
 }
 
-bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
+bool CMasternodeBroadcast::CheckAndUpdate(int& nDos, bool fSignatureChecked)
 {
     // make sure signature isn't in the future (past is OK)
     if (sigTime > GetAdjustedTime() + 60 * 60) {
@@ -552,10 +585,6 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
-
     if (protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
         LogPrint("masternode","mnb - ignoring outdated Masternode %s protocol version %d\n", vin.prevout.hash.ToString(), protocolVersion);
         return false;
@@ -586,7 +615,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
 
     std::string errorMessage = "";
 
-    if (!obfuScationSigner.VerifyMessage(pubKeyCollateralAddress, sig, strMessage, errorMessage)) {
+    if (!fSignatureChecked && !CheckSignature()) {
         LogPrint("masternode","mnb - Got bad Masternode address signature\n");
         nDos = 100;
         return false;
@@ -756,6 +785,14 @@ bool CMasternodeBroadcast::Sign(CKey& keyCollateralAddress)
     return true;
 }
 
+// The message a broadcast is checked against when it is received
+bool CMasternodeBroadcast::CheckSignature()
+{
+    std::string errorMessage;
+
+    return obfuScationSigner.VerifyMessage(pubKeyCollateralAddress, sig, GetOldStrMessage(), errorMessage);
+}
+
 bool CMasternodeBroadcast::VerifySignature()
 {
     std::string errorMessage;
@@ -111,6 +111,8 @@ private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
+    //! Loaded from mncache.dat and not checked since
+    bool fTrustedFromCache;
 
 public:
     enum state {
@@ -180,6 +182,7 @@ public:
         swap(first.allowFreeTx, second.allowFreeTx);
         swap(first.protocolVersion, second.protocolVersion);
         swap(first.nLastDsq, second.nLastDsq);
+        swap(first.fTrustedFromCache, second.fTrustedFromCache);
     }
 
     CMasternode& operator=(CMasternode from)
@@ -234,6 +237,7 @@ public:
     }
 
     void Check(bool forceCheck = false);
+    void TrustFromCache();
 
     bool IsBroadcastedWithin(int seconds)
     {
@@ -258,17 +262,7 @@ public:
         return activeState == MASTERNODE_ENABLED;
     }
 
-    int GetMasternodeInputAge()
-    {
-        if (chainActive.Tip() == NULL) return 0;
-
-        if (cacheInputAge == 0) {
-            cacheInputAge = GetInputAge(vin);
-            cacheInputAgeBlock = chainActive.Tip()->nHeight;
-        }
-
-        return cacheInputAge + (chainActive.Tip()->nHeight - cacheInputAgeBlock);
-    }
+    int GetMasternodeInputAge();
 
     std::string GetStatus();
 
@@ -306,8 +300,10 @@ public:
     CMasternodeBroadcast(CService newAddr, CTxIn newVin, CPubKey newPubkey, CPubKey newPubkey2, int protocolVersionIn);
     CMasternodeBroadcast(const CMasternode& mn);
 
-    bool CheckAndUpdate(int& nDoS);
+    /** fSignatureChecked: CheckSignature() already passed, as for the entries of a list snapshot */
+    bool CheckAndUpdate(int& nDoS, bool fSignatureChecked = false);
     bool CheckInputsAndAdd(int& nDos);
+    bool CheckSignature();
     bool Sign(CKey& keyCollateralAddress);
     bool VerifySignature();
     void Relay();
@@ -7,7 +7,10 @@
 #include "masternodeman.h"
 #include "activemasternode.h"
 #include "addrman.h"
+#include "cachefile.h"
 #include "masternode.h"
+#include "masternode-snapshot.h"
+#include "netmsgtable.h"
 #include "obfuscation.h"
 #include "spork.h"
 #include "util.h"
@@ -16,6 +19,7 @@
 
 /** Masternode manager */
 CMasternodeMan mnodeman;
+CMasternodeCollateralTracker mnCollateral;
 
 struct CompareLastPaid {
     bool operator()(const pair<int64_t, CTxIn>& t1,
@@ -55,28 +59,10 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    CCacheFileWriter writer(strMagicMessage, MNCACHE_FILE_FORMAT);
+    mnodemanToSave.WriteCache(writer);
+    if (!writer.Commit(pathMN))
+        return false;
 
     LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
@@ -87,69 +73,31 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathMN.string());
-        return FileError;
-    }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
+    CCacheFileReader reader(nScriptCheckThreads);
+    CCacheFileReader::ReadResult result = reader.Open(pathMN, strMagicMessage, MNCACHE_FILE_FORMAT);
+    if (result == CCacheFileReader::Ok)
+        result = mnodemanToLoad.ReadCache(reader);
 
-    CDataStream ssMasternodes(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    if (hashIn != hashTmp) {
+    switch (result) {
+    case CCacheFileReader::Ok:
+        break;
+    case CCacheFileReader::FileError:
+        error("%s : Failed to open file %s", __func__, pathMN.string());
+        return FileError;
+    case CCacheFileReader::IncorrectHash:
+        mnodemanToLoad.Clear();
         error("%s : Checksum mismatch, data corrupted", __func__);
         return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-
-        ssMasternodes >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-        // de-serialize file header (network specific magic number) and ..
-        ssMasternodes >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-        // de-serialize data into CMasternodeMan object
-        ssMasternodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
+    case CCacheFileReader::IncorrectMagicMessage:
+        error("%s : Invalid masternode cache magic message", __func__);
+        return IncorrectMagicMessage;
+    case CCacheFileReader::IncorrectMagicNumber:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    case CCacheFileReader::IncorrectFormat:
         mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        error("%s : Unknown format version or malformed data", __func__);
         return IncorrectFormat;
     }
 
@@ -197,6 +145,52 @@ CMasternodeMan::CMasternodeMan()
     nDsqCount = 0;
 }
 
+void CMasternodeMan::WriteCache(CCacheFileWriter& writer) const
+{
+    LOCK(cs);
+
+    writer.WriteSection(vMasternodes);
+    writer.WriteObject(mAskedUsForMasternodeList);
+    writer.WriteObject(mWeAskedForMasternodeList);
+    writer.WriteObject(mWeAskedForMasternodeListEntry);
+    writer.WriteObject(mAskedUsForWinnerMasternodeList);
+    writer.WriteObject(mWeAskedForWinnerMasternodeList);
+    writer.WriteObject(nDsqCount);
+    writer.WriteSection(std::vector<std::pair<uint256, CMasternodeBroadcast> >(mapSeenMasternodeBroadcast.begin(), mapSeenMasternodeBroadcast.end()));
+    writer.WriteSection(std::vector<std::pair<uint256, CMasternodePing> >(mapSeenMasternodePing.begin(), mapSeenMasternodePing.end()));
+}
+
+CCacheFileReader::ReadResult CMasternodeMan::ReadCache(CCacheFileReader& reader)
+{
+    LOCK(cs);
+
+    std::vector<std::pair<uint256, CMasternodeBroadcast> > vSeenBroadcasts;
+    std::vector<std::pair<uint256, CMasternodePing> > vSeenPings;
+    CCacheFileReader::ReadResult result;
+    if ((result = reader.ReadSection(vMasternodes)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(mAskedUsForMasternodeList)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(mWeAskedForMasternodeList)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(mWeAskedForMasternodeListEntry)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(mAskedUsForWinnerMasternodeList)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(mWeAskedForWinnerMasternodeList)) != CCacheFileReader::Ok ||
+        (result = reader.ReadObject(nDsqCount)) != CCacheFileReader::Ok ||
+        (result = reader.ReadSection(vSeenBroadcasts)) != CCacheFileReader::Ok ||
+        (result = reader.ReadSection(vSeenPings)) != CCacheFileReader::Ok)
+        return result;
+    if (!reader.AtEnd())
+        return CCacheFileReader::IncorrectFormat;
+
+    mapSeenMasternodeBroadcast.clear();
+    mapSeenMasternodeBroadcast.insert(vSeenBroadcasts.begin(), vSeenBroadcasts.end());
+    mapSeenMasternodePing.clear();
+    mapSeenMasternodePing.insert(vSeenPings.begin(), vSeenPings.end());
+
+    for (CMasternode& mn : vMasternodes)
+        mn.TrustFromCache();
+
+    return CCacheFileReader::Ok;
+}
+
 CValidationState CMasternodeMan::GetInputCheckingTx(const CTxIn& vin, CMutableTransaction& tx)
 {
     CValidationState state;
@@ -303,6 +297,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            mnCollateral.Forget((*it).vin.prevout);
             it = vMasternodes.erase(it);
         } else {
             ++it;
@@ -393,6 +388,7 @@ void CMasternodeMan::Clear()
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
+    mnCollateral.Clear();
 }
 
 int CMasternodeMan::size(unsigned mnlevel)
@@ -528,7 +524,11 @@ bool CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    // Peers that can send the list as a snapshot get asked for it that way
+    if (pnode->nVersion >= MNLIST_SNAPSHOT_VERSION)
+        pnode->PushMessage("getmnlist", MNLIST_SNAPSHOT_FORMAT);
+    else
+        pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
     return true;
@@ -890,68 +890,122 @@ void CMasternodeMan::ProcessMasternodeConnections()
     }
 }
 
-void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+// Returns false when the peer misbehaved by sending it
+bool CMasternodeMan::ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb, bool fSignatureChecked)
 {
-    if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
-    if (!masternodeSync.IsBlockchainSynced()) return;
+    auto pmn = mnodeman.Find(mnb.addr);
 
-    LOCK(cs_process_message);
+    if(pmn && pmn->vin != mnb.vin)
+    {
+        pmn->Check(true);
 
-    if (strCommand == "mnb") { //Masternode Broadcast
-        CMasternodeBroadcast mnb;
-        vRecv >> mnb;
+        if(pmn->IsEnabled())
+        {
+            LogPrint("masternode","mnb - More than one vin used for single IP address\n");
+            Misbehaving(pfrom->GetId(), 100);
+            return false;
+        }
+    }
 
-        auto pmn = mnodeman.Find(mnb.addr);
+    if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+        return true;
+    }
 
-        if(pmn && pmn->vin != mnb.vin)
-        {
-            pmn->Check(true);
+    mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
 
-            if(pmn->IsEnabled())
-            {
-                LogPrint("masternode","mnb - More than one vin used for single IP address\n");
-                Misbehaving(pfrom->GetId(), 100);
-                return;
-            }
+    int nDoS = 0;
+    if (!mnb.CheckAndUpdate(nDoS, fSignatureChecked)) {
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+
+        //failed
+        return nDoS == 0;
+    }
+
+    // make sure the vout that was signed is related to the transaction that spawned the Masternode
+    //  - this is expensive, so it's only done once per Masternode
+    if (!obfuScationSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
+        LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
+        Misbehaving(pfrom->GetId(), 33);
+        return false;
+    }
+
+    // make sure it's still unspent
+    //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
+    if (mnb.CheckInputsAndAdd(nDoS)) {
+        // use this as a peer
+        addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
+        masternodeSync.AddedMasternodeList(mnb.GetHash());
+    } else {
+        LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
+        if (nDoS > 0) {
+            Misbehaving(pfrom->GetId(), nDoS);
+            return false;
         }
+    }
 
-        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) { //seen
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
+    return true;
+}
+
+// A peer we asked with getmnlist sends the list in one or more parts
+void CMasternodeMan::ProcessSnapshot(CNode* pfrom, const CMasternodeListSnapshot& snapshot)
+{
+    {
+        LOCK(cs);
+        if (!mWeAskedForMasternodeList.count(pfrom->addr)) {
+            LogPrint("masternode", "mnlist - unrequested list from peer %i\n", pfrom->GetId());
+            Misbehaving(pfrom->GetId(), 20);
             return;
         }
+    }
 
-        mapSeenMasternodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
+    std::vector<CMasternodeBroadcast> vMnb;
+    std::string strError;
+    if (!snapshot.Unpack(vMnb, strError)) {
+        LogPrintf("mnlist - bad list from peer %i: %s\n", pfrom->GetId(), strError);
+        Misbehaving(pfrom->GetId(), 100);
+        return;
+    }
 
-        int nDoS = 0;
-        if (!mnb.CheckAndUpdate(nDoS)) {
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
+    // Only the signatures of the entries we have not seen yet need checking
+    std::vector<CMasternodeBroadcast> vNew;
+    for (CMasternodeBroadcast& mnb : vMnb) {
+        if (mapSeenMasternodeBroadcast.count(mnb.GetHash()))
+            masternodeSync.AddedMasternodeList(mnb.GetHash());
+        else
+            vNew.push_back(mnb);
+    }
 
-            //failed
+    int64_t nStart = GetTimeMillis();
+    std::vector<char> vValid;
+    CheckMasternodeBroadcastSignatures(vNew, vValid, std::max(nScriptCheckThreads, 1));
+    LogPrint("masternode", "mnlist - %u entries from peer %i, %u new, signatures checked in %dms\n",
+        vMnb.size(), pfrom->GetId(), vNew.size(), GetTimeMillis() - nStart);
+
+    for (size_t i = 0; i < vNew.size(); i++) {
+        if (!vValid[i]) {
+            LogPrint("masternode","mnlist - Got bad Masternode address signature\n");
+            Misbehaving(pfrom->GetId(), 100);
             return;
         }
-
-        // make sure the vout that was signed is related to the transaction that spawned the Masternode
-        //  - this is expensive, so it's only done once per Masternode
-        if (!obfuScationSigner.IsVinAssociatedWithPubkey(mnb.vin, mnb.pubKeyCollateralAddress)) {
-            LogPrint("masternode","mnb - Got mismatched pubkey and vin\n");
-            Misbehaving(pfrom->GetId(), 33);
+        if (!ProcessBroadcast(pfrom, vNew[i], true))
             return;
-        }
+    }
+}
 
-        // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckObfuScationPool()
-        if (mnb.CheckInputsAndAdd(nDoS)) {
-            // use this as a peer
-            addrman.Add(CAddress(mnb.addr), pfrom->addr, 2 * 60 * 60);
-            masternodeSync.AddedMasternodeList(mnb.GetHash());
-        } else {
-            LogPrint("masternode","mnb - Rejected Masternode entry %s\n", mnb.vin.prevout.hash.ToString());
-            if (nDoS > 0) {
-                Misbehaving(pfrom->GetId(), nDoS);
-                return;
-            }
-        }
+void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+{
+    if (fLiteMode) return; //disable all Obfuscation/Masternode related functionality
+    if (!masternodeSync.IsBlockchainSynced()) return;
+
+    LOCK(cs_process_message);
+
+    if (strCommand == "mnb") { //Masternode Broadcast
+        CMasternodeBroadcast mnb;
+        vRecv >> mnb;
+
+        ProcessBroadcast(pfrom, mnb, false);
     }
 
     else if (strCommand == "mnp") { //Masternode Ping
@@ -1038,6 +1092,62 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         }
     }
 
+    else if (strCommand == "getmnlist") { //Get the Masternode list as a snapshot
+
+        int nFormat;
+        vRecv >> nFormat;
+
+        bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+
+        if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
+            std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
+            if (i != mAskedUsForMasternodeList.end()) {
+                int64_t t = (*i).second;
+                if (GetTime() < t) {
+                    Misbehaving(pfrom->GetId(), 34);
+                    LogPrintf("getmnlist - peer already asked me for the list\n");
+                    return;
+                }
+            }
+            int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+            mAskedUsForMasternodeList[pfrom->addr] = askAgain;
+        }
+
+        std::vector<CMasternodeBroadcast> vMnb;
+        for (CMasternode& mn : vMasternodes) {
+            if (mn.addr.IsRFC1918()) continue; //local network
+            if (!mn.IsEnabled()) continue;
+
+            CMasternodeBroadcast mnb = CMasternodeBroadcast(mn);
+            uint256 hash = mnb.GetHash();
+            if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(make_pair(hash, mnb));
+            vMnb.push_back(mnb);
+        }
+
+        if (nFormat != MNLIST_SNAPSHOT_FORMAT) {
+            // a format we do not know, send the list item by item
+            for (CMasternodeBroadcast& mnb : vMnb)
+                pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, mnb.GetHash()));
+        } else {
+            for (size_t nFirst = 0; nFirst < vMnb.size(); nFirst += MNLIST_SNAPSHOT_MAX_ENTRIES) {
+                size_t nEnd = std::min(vMnb.size(), nFirst + MNLIST_SNAPSHOT_MAX_ENTRIES);
+                CMasternodeListSnapshot snapshot;
+                snapshot.Pack(std::vector<CMasternodeBroadcast>(vMnb.begin() + nFirst, vMnb.begin() + nEnd));
+                pfrom->PushMessage("mnlist", snapshot);
+            }
+        }
+
+        pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, (int)vMnb.size());
+        LogPrintf("getmnlist - Sent %d Masternode entries to %s\n", vMnb.size(), pfrom->addr.ToString());
+    }
+
+    else if (strCommand == "mnlist") { //Masternode list snapshot
+        CMasternodeListSnapshot snapshot;
+        vRecv >> snapshot;
+
+        ProcessSnapshot(pfrom, snapshot);
+    }
+
     else if (strCommand == "mnget") { //Get winnign Masternode list
 
         int nCountNeeded;
@@ -1065,6 +1175,25 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
 }
 
+static bool ProcessMasternodeManMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void RegisterMasternodeManMessages(CNetMsgTable& table)
+{
+    static const CNetMsgHandler vMessages[] = {
+        {"mnb", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+        {"mnp", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+        {"dseg", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+        {"getmnlist", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+        {"mnlist", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+        {"mnget", &ProcessMasternodeManMessage, NETMSG_LOCK_NONE},
+    };
+    table.Register(vMessages, ARRAYLEN(vMessages));
+}
+
 void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
@@ -1073,6 +1202,7 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            mnCollateral.Forget((*it).vin.prevout);
             vMasternodes.erase(it);
             break;
         }
@@ -1105,3 +1235,92 @@ std::string CMasternodeMan::ToString() const
 
     return info.str();
 }
+
+/** The collateral as the chain tip and the memory pool have it, requires cs_main */
+static CMasternodeCollateral LookupCollateral(const COutPoint& outpoint)
+{
+    CMasternodeCollateral collateral;
+    LOCK(mempool.cs);
+    CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
+    CCoins coins;
+    if (!viewMempool.GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n))
+        return collateral;
+
+    collateral.fSpent = mempool.mapNextTx.count(outpoint) > 0;
+    collateral.nHeight = coins.nHeight == (int)MEMPOOL_HEIGHT ? 0 : coins.nHeight;
+    collateral.nValue = coins.vout[outpoint.n].nValue;
+    return collateral;
+}
+
+void CMasternodeCollateralTracker::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    LOCK(cs);
+    if (mapCollateral.empty())
+        return;
+
+    // Without a block the transaction entered the memory pool, or it left a
+    // disconnected block or the pool; only the first tells what it spent
+    int nInPool = -1;
+    for (const CTxIn& txin : tx.vin) {
+        std::map<COutPoint, CMasternodeCollateral>::iterator it = mapCollateral.find(txin.prevout);
+        if (it == mapCollateral.end())
+            continue;
+        if (!pblock && nInPool < 0)
+            nInPool = mempool.exists(tx.GetHash()) ? 1 : 0;
+        if (pblock || nInPool == 1)
+            it->second.fSpent = true;
+        else
+            mapCollateral.erase(it);
+    }
+
+    const uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        std::map<COutPoint, CMasternodeCollateral>::iterator it = mapCollateral.find(COutPoint(hash, i));
+        if (it == mapCollateral.end())
+            continue;
+        const CBlockIndex* pindex = pblock ? LookupBlockIndex(pblock->GetHash()) : NULL;
+        if (pindex)
+            it->second.nHeight = pindex->nHeight;
+        else
+            mapCollateral.erase(it);
+    }
+}
+
+bool CMasternodeCollateralTracker::Get(const COutPoint& outpoint, CMasternodeCollateral& collateral)
+{
+    {
+        LOCK(cs);
+        std::map<COutPoint, CMasternodeCollateral>::const_iterator it = mapCollateral.find(outpoint);
+        if (it != mapCollateral.end()) {
+            collateral = it->second;
+            return true;
+        }
+    }
+
+    // Events come in under cs_main, so none can be missed between the lookup and storing it
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return false;
+    collateral = LookupCollateral(outpoint);
+    LOCK(cs);
+    mapCollateral[outpoint] = collateral;
+    return true;
+}
+
+void CMasternodeCollateralTracker::Forget(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    mapCollateral.erase(outpoint);
+}
+
+void CMasternodeCollateralTracker::Clear()
+{
+    LOCK(cs);
+    mapCollateral.clear();
+}
+
+size_t CMasternodeCollateralTracker::size() const
+{
+    LOCK(cs);
+    return mapCollateral.size();
+}
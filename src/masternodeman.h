@@ -7,22 +7,33 @@
 #define MASTERNODEMAN_H
 
 #include "base58.h"
+#include "cachefile.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
+/** Layout of mncache.dat, see CCacheFileWriter */
+static const int MNCACHE_FILE_FORMAT = 2;
+
 using namespace std;
 
 class CMasternodeMan;
+class CMasternodeCollateralTracker;
+class CMasternodeListSnapshot;
+class CNetMsgTable;
 
 extern CMasternodeMan mnodeman;
+extern CMasternodeCollateralTracker mnCollateral;
 void DumpMasternodes();
+/** mnb, mnp, dseg, getmnlist, mnlist and mnget go to mnodeman */
+void RegisterMasternodeManMessages(CNetMsgTable& table);
 
 /** Access to the MN database (mncache.dat)
  */
@@ -70,6 +81,9 @@ private:
     // who we asked for the winning Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForWinnerMasternodeList;
 
+    bool ProcessBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb, bool fSignatureChecked);
+    void ProcessSnapshot(CNode* pfrom, const CMasternodeListSnapshot& snapshot);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -102,6 +116,10 @@ public:
 
     static CValidationState GetInputCheckingTx(const CTxIn& vin, CMutableTransaction&);
 
+    /// Save to or load from mncache.dat; loaded entries are trusted until they are next checked
+    void WriteCache(CCacheFileWriter& writer) const;
+    CCacheFileReader::ReadResult ReadCache(CCacheFileReader& reader);
+
     /// Add an entry
     bool Add(CMasternode& mn);
 
@@ -172,4 +190,37 @@ public:
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
 };
 
+/** What the masternode list needs to know about a collateral outpoint */
+struct CMasternodeCollateral {
+    bool fSpent;    //!< missing, spent in the chain or spent by a memory pool transaction
+    int nHeight;    //!< height of the block that created it, 0 while unconfirmed
+    CAmount nValue;
+
+    CMasternodeCollateral() : fSpent(true), nHeight(0), nValue(0) {}
+};
+
+/**
+ * Keeps the state of masternode collaterals up to date from the transactions
+ * core connects, disconnects and accepts to the memory pool, so that checking
+ * a masternode needs no cs_main. An outpoint is looked up in the coins when
+ * it is first asked for, and again after an event that leaves its state open.
+ */
+class CMasternodeCollateralTracker : public CValidationInterface
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CMasternodeCollateral> mapCollateral;
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
+public:
+    /** False if the outpoint needs a lookup while cs_main is busy */
+    bool Get(const COutPoint& outpoint, CMasternodeCollateral& collateral);
+    /** Stop tracking the collateral of a masternode that left the list */
+    void Forget(const COutPoint& outpoint);
+    void Clear();
+    size_t size() const;
+};
+
 #endif
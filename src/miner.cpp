@@ -10,6 +10,7 @@
 
 #include "amount.h"
 #include "hash.h"
+#include "kernel.h"
 #include "main.h"
 #include "masternode-sync.h"
 #include "net.h"
@@ -19,6 +20,7 @@
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #endif
@@ -88,7 +90,7 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
 }
 
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, const CStakeKernel* pkernel)
 {
     // Create new block
     unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
@@ -118,34 +120,22 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     pblocktemplate->vTxFees.push_back(-1);   // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    // ppcoin: if coinstake available add coinstake tx
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
-
+    // ppcoin: add the coinstake tx spending the kernel the stake minter found
     if (fProofOfStake) {
         boost::this_thread::interruption_point();
-        pblock->nTime = GetAdjustedTime();
+        LOCK(cs_main);
         CBlockIndex* pindexPrev = chainActive.Tip();
+        if (!pkernel || pkernel->hashPrevBlock != pindexPrev->GetBlockHash())
+            return nullptr;
+        pblock->nTime = pkernel->nTime;
         pblock->nBits = GetNextWorkRequired(pindexPrev);
         CMutableTransaction txCoinStake;
-        int64_t nSearchTime = pblock->nTime; // search to current time
-        bool fStakeFound = false;
-        if (nSearchTime >= nLastCoinStakeSearchTime) {
-            unsigned int nTxNewTime = 0;
-            if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake, nTxNewTime)) {
-                pblock->nTime = nTxNewTime;
-
-                LogPrintf("CreateNewBlock() if fProofOfStake: chainActive.Height() = %s \n", chainActive.Height());
-                pblock->vtx[0].vout[0].SetEmpty();
-
-                pblock->vtx.push_back(CTransaction(txCoinStake));
-                fStakeFound = true;
-            }
-            nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-            nLastCoinStakeSearchTime = nSearchTime;
-        }
-
-        if (!fStakeFound)
+        if (!pwallet->CreateCoinStake(*pwallet, pkernel->prevout, pkernel->nTime, txCoinStake))
             return nullptr;
+
+        LogPrintf("CreateNewBlock() if fProofOfStake: chainActive.Height() = %s \n", chainActive.Height());
+        pblock->vtx[0].vout[0].SetEmpty();
+        pblock->vtx.push_back(CTransaction(txCoinStake));
     }
 
     // Largest block you're willing to create:
@@ -171,6 +161,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         LOCK2(cs_main, mempool.cs);
 
         CBlockIndex* pindexPrev = chainActive.Tip();
+        // A block came in since the coinstake was made
+        if (fProofOfStake && pkernel->hashPrevBlock != pindexPrev->GetBlockHash())
+            return nullptr;
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
@@ -409,7 +402,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->UpdateMerkleTreeCoinbase();
 }
 
 #ifdef ENABLE_WALLET
@@ -420,14 +413,14 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
 double dHashesPerSec = 0.0;
 int64_t nHPSTimerStart = 0;
 
-CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake)
+CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake, const CStakeKernel* pkernel)
 {
     CPubKey pubkey;
     if (!reservekey.GetReservedKey(pubkey))
         return NULL;
 
     CScript scriptPubKey = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
-    return CreateNewBlock(scriptPubKey, pwallet, fProofOfStake);
+    return CreateNewBlock(scriptPubKey, pwallet, fProofOfStake, pkernel);
 }
 
 bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
@@ -465,61 +458,195 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
 
 bool fGenerateBitcoins = false;
 
-// ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
+/** Wakes the stake minter as soon as the tip changes */
+class CStakeMinterWaker : public CValidationInterface
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    uint64_t nTipUpdates;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            nTipUpdates++;
+        }
+        cond.notify_all();
+    }
+
+public:
+    CStakeMinterWaker() : nTipUpdates(0) {}
+
+    uint64_t GetTipUpdates()
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        return nTipUpdates;
+    }
+
+    /** Sleep until the tip changes after nTipUpdatesSeen updates, or for nMillis */
+    void Wait(uint64_t nTipUpdatesSeen, int64_t nMillis)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nMillis);
+        while (nTipUpdates == nTipUpdatesSeen)
+            if (!cond.timed_wait(lock, deadline))
+                break;
+    }
+};
+
+static CCriticalSection cs_stakeMinterStats;
+static CStakeMinterStats stakeMinterStats = {0.0, 0, 0, -1};
 
-void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
+CStakeMinterStats GetStakeMinterStats()
 {
-    LogPrintf("ROCOMiner started\n");
+    LOCK(cs_stakeMinterStats);
+    return stakeMinterStats;
+}
+
+void StakeMinter(CWallet* pwallet)
+{
+    LogPrintf("StakeMinter started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    RenameThread("roco-miner");
+    RenameThread("roco-staker");
+
+    CStakeMinterWaker waker;
+    RegisterValidationInterface(&waker);
 
-    // Each thread has its own key and counter
     CReserveKey reservekey(pwallet);
     unsigned int nExtraNonce = 0;
 
     //control the amount of times the client will check for mintable coins
-    static bool fMintableCoins = false;
-    static int nMintableLastCheck = 0;
+    bool fMintableCoins = false;
+    int64_t nMintableLastCheck = 0;
 
-    if (fProofOfStake && (GetTime() - nMintableLastCheck > 5 * 60)) // 5 minute check time
-    {
-        nMintableLastCheck = GetTime();
-        fMintableCoins = pwallet->MintableCoins();
-    }
+    // The coins kernels are searched over, picked from the wallet's stakeable
+    // coins under the locks each round and hashed without them
+    std::vector<CStakeCandidate> vCandidates;
 
-    while (fGenerateBitcoins || fProofOfStake) {
-        if (fProofOfStake) {
-            if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK()) {
-                MilliSleep(5000);
-                continue;
+    // Each timestamp is only hashed once on a given tip
+    const CBlockIndex* pindexSearched = NULL;
+    unsigned int nSearchedTo = 0;
+    int64_t nTipSeenMillis = 0;
+
+    int64_t nMeterStart = GetTimeMillis();
+    uint64_t nMeterHashes = 0;
+
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+            uint64_t nTipUpdates = waker.GetTipUpdates();
+
+            if (GetTime() - nMintableLastCheck > (fMintableCoins ? 5 : 1) * 60) {
+                nMintableLastCheck = GetTime();
+                fMintableCoins = pwallet->MintableCoins();
             }
 
             //todo: check nTime < GMT: Thursday, 18 August 2016 г., 01:00:00
-            while (vNodes.empty() || pwallet->IsLocked() || !fMintableCoins || (pwallet->GetBalance() > 0 && nReserveBalance >= pwallet->GetBalance())|| !masternodeSync.IsSynced()) {
+            if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK() || vNodes.empty() || pwallet->IsLocked() || !fMintableCoins ||
+                (pwallet->GetBalance() > 0 && nReserveBalance >= pwallet->GetBalance()) || !masternodeSync.IsSynced()) {
                 nLastCoinStakeSearchInterval = 0;
-                if (!fMintableCoins) {
-                    if (GetTime() - nMintableLastCheck > 1 * 60) // 1 minute check time
-                    {
-                        nMintableLastCheck = GetTime();
-                        fMintableCoins = pwallet->MintableCoins();
-                    }
-                }
-                MilliSleep(5000);
-                if (!fGenerateBitcoins && !fProofOfStake)
-                    continue;
+                waker.Wait(nTipUpdates, 5000);
+                continue;
             }
 
-
-            if (mapHashedBlocks.count(chainActive.Tip()->nHeight)) //search our map of hashed blocks, see if bestblock has been hashed yet
+            CBlockIndex* pindexPrev;
+            unsigned int nBits;
             {
-                if (GetTime() - mapHashedBlocks[chainActive.Tip()->nHeight] < max(pwallet->nHashInterval, (unsigned int)1)) // wait half of the nHashDrift with max wait of 3 minutes
+                LOCK(cs_main);
+                pindexPrev = chainActive.Tip();
+                nBits = GetNextWorkRequired(pindexPrev);
+                pwallet->GetStakeCandidates(vCandidates);
+            }
+            if (pindexPrev != pindexSearched) {
+                pindexSearched = pindexPrev;
+                nSearchedTo = 0;
+                nTipSeenMillis = GetTimeMillis();
+            }
+
+            // From the first timestamp not hashed on this tip, and never at or
+            // before the median time past, up to the future drift limit
+            unsigned int nTimeFrom = std::max((int64_t)nSearchedTo, std::max(GetAdjustedTime(), pindexPrev->GetMedianTimePast())) + 1;
+            unsigned int nTimeTo = GetAdjustedTime() + pwallet->nHashDrift;
+            bool fKernelFound = false;
+            size_t nCandidate = 0;
+            unsigned int nTimeTx = 0;
+            if (nTimeFrom <= nTimeTo) {
+                uint64_t nHashes = 0;
+                uint256 hashProofOfStake;
+                fKernelFound = FindStakeKernel(vCandidates, nBits, nTimeFrom, nTimeTo, nCandidate, nTimeTx, hashProofOfStake, nHashes);
+                nSearchedTo = nTimeTo;
+                nLastCoinStakeSearchInterval = nTimeTo - nTimeFrom + 1;
                 {
-                    MilliSleep(5000);
-                    continue;
+                    LOCK(cs_main);
+                    mapHashedBlocks.clear();
+                    mapHashedBlocks[pindexPrev->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+                }
+
+                // Meter kernel hashes/sec
+                nMeterHashes += nHashes;
+                LOCK(cs_stakeMinterStats);
+                stakeMinterStats.nKernelsTested += nHashes;
+                if (GetTimeMillis() - nMeterStart > 60 * 1000) {
+                    stakeMinterStats.dAttemptsPerSec = 1000.0 * nMeterHashes / (GetTimeMillis() - nMeterStart);
+                    nMeterStart = GetTimeMillis();
+                    nMeterHashes = 0;
                 }
             }
+
+            if (!fKernelFound) {
+                // Nothing more to hash until the tip changes or time moves on
+                waker.Wait(nTipUpdates, std::max(pwallet->nHashInterval, (unsigned int)1) * 1000);
+                continue;
+            }
+
+            CStakeKernel kernel;
+            kernel.hashPrevBlock = pindexPrev->GetBlockHash();
+            kernel.prevout = vCandidates[nCandidate].prevout;
+            kernel.nTime = nTimeTx;
+
+            unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey, pwallet, true, &kernel));
+            if (!pblocktemplate.get())
+                continue;
+
+            CBlock* pblock = &pblocktemplate->block;
+            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+            LogPrintf("StakeMinter : proof-of-stake block found %s \n", pblock->GetHash().ToString().c_str());
+
+            if (!pblock->SignBlock(*pwallet)) {
+                LogPrintf("StakeMinter(): Signing new block failed \n");
+                continue;
+            }
+
+            LogPrintf("StakeMinter : proof-of-stake block was signed %s \n", pblock->GetHash().ToString().c_str());
+            SetThreadPriority(THREAD_PRIORITY_NORMAL);
+            if (ProcessBlockFound(pblock, *pwallet, reservekey)) {
+                LOCK(cs_stakeMinterStats);
+                stakeMinterStats.nBlocksFound++;
+                stakeMinterStats.nLastTimeToBlock = GetTimeMillis() - nTipSeenMillis;
+            }
+            SetThreadPriority(THREAD_PRIORITY_LOWEST);
         }
+    } catch (...) {
+        UnregisterValidationInterface(&waker);
+        throw;
+    }
+}
+
+// ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
+
+void BitcoinMiner(CWallet* pwallet)
+{
+    LogPrintf("ROCOMiner started\n");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("roco-miner");
+
+    // Each thread has its own key and counter
+    CReserveKey reservekey(pwallet);
+    unsigned int nExtraNonce = 0;
 
+    while (fGenerateBitcoins) {
         //
         // Create new block
         //
@@ -528,30 +655,13 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         if (!pindexPrev)
             continue;
 
-        unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey, pwallet, fProofOfStake));
+        unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey, pwallet, false));
         if (!pblocktemplate.get())
             continue;
 
         CBlock* pblock = &pblocktemplate->block;
         IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
 
-        //Stake miner main
-        if (fProofOfStake) {
-            LogPrintf("CPUMiner : proof-of-stake block found %s \n", pblock->GetHash().ToString().c_str());
-
-            if (!pblock->SignBlock(*pwallet)) {
-                LogPrintf("BitcoinMiner(): Signing new block failed \n");
-                continue;
-            }
-
-            LogPrintf("CPUMiner : proof-of-stake block was signed %s \n", pblock->GetHash().ToString().c_str());
-            SetThreadPriority(THREAD_PRIORITY_NORMAL);
-            ProcessBlockFound(pblock, *pwallet, reservekey);
-            SetThreadPriority(THREAD_PRIORITY_LOWEST);
-
-            continue;
-        }
-
         LogPrintf("Running ROCOMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
             ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
 
@@ -634,7 +744,7 @@ void static ThreadBitcoinMiner(void* parg)
     boost::this_thread::interruption_point();
     CWallet* pwallet = (CWallet*)parg;
     try {
-        BitcoinMiner(pwallet, false);
+        BitcoinMiner(pwallet);
         boost::this_thread::interruption_point();
     } catch (std::exception& e) {
         LogPrintf("ThreadBitcoinMiner() exception");
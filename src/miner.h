@@ -6,6 +6,9 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "primitives/transaction.h"
+#include "uint256.h"
+
 #include <stdint.h>
 
 class CBlock;
@@ -17,17 +20,37 @@ class CWallet;
 
 struct CBlockTemplate;
 
+/** A stake kernel found by the stake minter, good on top of hashPrevBlock only */
+struct CStakeKernel {
+    uint256 hashPrevBlock;
+    COutPoint prevout;
+    unsigned int nTime;
+};
+
+/** Counters of the stake minter, reported by getstakingstatus */
+struct CStakeMinterStats {
+    //! Kernel hashes tried per second of wall time over the last minute or so
+    double dAttemptsPerSec;
+    uint64_t nKernelsTested;
+    uint64_t nBlocksFound;
+    //! Milliseconds from a tip showing up to our block on top of it, -1 before any
+    int64_t nLastTimeToBlock;
+};
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
-/** Generate a new block, without valid proof-of-work */
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
-CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake);
+/** Generate a new block, without valid proof-of-work; a proof-of-stake block needs pkernel */
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, const CStakeKernel* pkernel = NULL);
+CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake, const CStakeKernel* pkernel = NULL);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
 void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
 
-void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
+void BitcoinMiner(CWallet* pwallet);
+/** Stake from pwallet until interrupted, searching for kernels whenever the tip or the time moves on */
+void StakeMinter(CWallet* pwallet);
+CStakeMinterStats GetStakeMinterStats();
 
 extern double dHashesPerSec;
 extern int64_t nHPSTimerStart;
@@ -344,6 +344,7 @@ uint64_t CNode::nTotalBytesRecv = 0;
 uint64_t CNode::nTotalBytesSent = 0;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
+std::atomic<size_t> CNode::nTotalRecvQueueSize(0);
 
 CNode* FindNode(const CNetAddr& ip)
 {
@@ -457,7 +458,7 @@ void CNode::CloseSocketDisconnect()
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
     TRY_LOCK(cs_vRecvMsg, lockRecv);
     if (lockRecv)
-        vRecvMsg.clear();
+        ClearRecvMsgs();
 }
 
 bool CNode::DisconnectOldProtocol(int nVersionRequired, string strLastCommand)
@@ -687,7 +688,11 @@ void CNode::copyStats(CNodeStats& stats)
     X(nStartingHeight);
     X(nSendBytes);
     X(nRecvBytes);
+    X(nRecvQueueSize);
     X(fWhitelisted);
+    X(fSupportsCompactBlocks);
+    X(fPreferHeaderAndIDs);
+    X(fRequestedHeaderAndIDs);
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -706,6 +711,11 @@ void CNode::copyStats(CNodeStats& stats)
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    {
+        LOCK(cs_msgStats);
+        X(mapRecvMsgStats);
+    }
 }
 #undef X
 
@@ -716,7 +726,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(SER_NETWORK, nRecvVersion));
+            vRecvMsg.emplace_back(SER_NETWORK, nRecvVersion);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -730,6 +740,12 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
         if (handled < 0)
             return false;
 
+        // Counted on the message too, so that dropping it, even when it was
+        // rejected half read, takes back exactly what was added
+        msg.nQueuedBytes += handled;
+        nRecvQueueSize += handled;
+        nTotalRecvQueueSize += handled;
+
         if (msg.in_data && msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH) {
             LogPrint("net", "Oversized message from peer=%i, disconnecting", GetId());
             return false;
@@ -747,6 +763,24 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
     return true;
 }
 
+void CNode::EraseRecvMsgs(std::deque<CNetMessage>::iterator it)
+{
+    size_t nErased = 0;
+    for (std::deque<CNetMessage>::iterator mi = vRecvMsg.begin(); mi != it; mi++)
+        nErased += mi->nQueuedBytes;
+    vRecvMsg.erase(vRecvMsg.begin(), it);
+    nRecvQueueSize -= nErased;
+    nTotalRecvQueueSize -= nErased;
+}
+
+bool CNode::IsRecvFlooded() const
+{
+    // Only while a complete message waits to be handled, which will free room again
+    if (vRecvMsg.empty() || !vRecvMsg.front().complete())
+        return false;
+    return nRecvQueueSize > ReceiveFloodSize() || nTotalRecvQueueSize > TotalReceiveFloodSize();
+}
+
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -782,13 +816,14 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Grow at least twice over and up to 256 KiB ahead, but never beyond the
+        // total message size. The bytes are appended, not zero filled first.
+        vRecv.reserve(std::min(hdr.nMessageSize, std::max(2 * nDataPos, nDataPos + nCopy + 256 * 1024)));
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -972,8 +1007,7 @@ void ThreadSocketHandler()
                 }
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    if (lockRecv && !pnode->IsRecvFlooded())
                         FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
@@ -1565,9 +1599,9 @@ void ThreadMessageHandler()
 
                     if(performRebroadcast) {
 
-                        // Periodically clear setAddrKnown to allow refresh broadcasts
+                        // Periodically clear addrKnown to allow refresh broadcasts
                         if (nLastRebroadcast)
-                            pnode->setAddrKnown.clear();
+                            pnode->addrKnown.reset();
 
                         // Logging from quato
                         LogPrintf("Rebroadcast our address with AdvertiseLocal\n");
@@ -1601,7 +1635,7 @@ void static ThreadStakeMinter()
     LogPrintf("ThreadStakeMinter started\n");
     CWallet* pwallet = pwalletMain;
     try {
-        BitcoinMiner(pwallet, true);
+        StakeMinter(pwallet);
         boost::this_thread::interruption_point();
     } catch (std::exception& e) {
         LogPrintf("ThreadStakeMinter() exception \n");
@@ -2055,9 +2089,12 @@ bool CAddrDB::Read(CAddrMan& addr)
 }
 
 unsigned int ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000); }
+size_t TotalReceiveFloodSize() { return 1000 * (size_t)GetArg("-maxreceivebuffertotal", DEFAULT_MAX_RECEIVE_BUFFER_TOTAL); }
 unsigned int SendBufferSize() { return 1000 * GetArg("-maxsendbuffer", 1 * 1000); }
 
-CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
+CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION),
+                                                                                           addrKnown(5000, 0.001),
+                                                                                           filterInventoryKnown(5000, 0.000001)
 {
     nServices = 0;
     hSocket = hSocketIn;
@@ -2082,11 +2119,14 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nRecvQueueSize = 0;
     hashContinue = 0;
     nStartingHeight = -1;
     fGetAddr = false;
     fRelayTxes = false;
-    setInventoryKnown.max_size(SendBufferSize() / 1000);
+    fSupportsCompactBlocks = false;
+    fPreferHeaderAndIDs = false;
+    fRequestedHeaderAndIDs = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
@@ -2114,6 +2154,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 CNode::~CNode()
 {
     CloseSocket(hSocket);
+    ClearRecvMsgs();
 
     if (pfilter)
         delete pfilter;
@@ -2197,7 +2238,7 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
+    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData(CSerializeData::allocator_type(true)));
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
 
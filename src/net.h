@@ -12,7 +12,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -21,6 +20,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -64,7 +64,11 @@ static const bool DEFAULT_UPNP = false;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
+/** Default for -maxreceivebuffertotal, in KB: the receive buffers of all peers together */
+static const unsigned int DEFAULT_MAX_RECEIVE_BUFFER_TOTAL = 100 * 1000;
+
 unsigned int ReceiveFloodSize();
+size_t TotalReceiveFloodSize();
 unsigned int SendBufferSize();
 
 void AddOneShot(std::string strDest);
@@ -155,6 +159,30 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Messages of one command received, and the time spent handling them */
+struct CNetMsgStats {
+    uint64_t nCount;
+    uint64_t nBytes;
+    uint64_t nErrors;
+    //! Total time in the handler, including the wait for locks
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    //! Part of nTotalMicros spent acquiring the locks
+    int64_t nLockWaitMicros;
+
+    CNetMsgStats() : nCount(0), nBytes(0), nErrors(0), nTotalMicros(0), nMaxMicros(0), nLockWaitMicros(0) {}
+
+    void Add(uint64_t nMsgBytes, bool fError, int64_t nMicros, int64_t nLockWait)
+    {
+        nCount++;
+        nBytes += nMsgBytes;
+        nErrors += fError;
+        nTotalMicros += nMicros;
+        nMaxMicros = std::max(nMaxMicros, nMicros);
+        nLockWaitMicros += nLockWait;
+    }
+};
+
 class CNodeStats
 {
 public:
@@ -171,10 +199,15 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     uint64_t nRecvBytes;
+    size_t nRecvQueueSize;
     bool fWhitelisted;
+    bool fSupportsCompactBlocks;
+    bool fPreferHeaderAndIDs;
+    bool fRequestedHeaderAndIDs;
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    std::map<std::string, CNetMsgStats> mapRecvMsgStats;
 };
 
 
@@ -196,13 +229,17 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
-    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
+    unsigned int nQueuedBytes; // bytes counted into the receive queue sizes
+
+    // Message buffers come from the network buffer pool, see serialize_allocator
+    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn, CDataStream::allocator_type(true)), vRecv(nTypeIn, nVersionIn, CDataStream::allocator_type(true))
     {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        nQueuedBytes = 0;
     }
 
     bool complete() const
@@ -302,8 +339,12 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    size_t nRecvQueueSize; // bytes read into all vRecvMsg entries, requires cs_vRecvMsg
     uint64_t nRecvBytes;
     int nRecvVersion;
+    //! Per command, kept apart from cs_vRecvMsg which is held while messages are handled
+    CCriticalSection cs_msgStats;
+    std::map<std::string, CNetMsgStats> mapRecvMsgStats;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -330,6 +371,12 @@ public:
     // b) the peer may tell us in their version message that we should not relay tx invs
     //    until they have initialized their bloom filter.
     bool fRelayTxes;
+    // Compact blocks: the peer can take and serve them (sent sendcmpct), wants
+    // new blocks pushed as compact blocks without an inv first, and we asked it
+    // to do the same for us. Only the message handling thread writes these.
+    bool fSupportsCompactBlocks;
+    bool fPreferHeaderAndIDs;
+    bool fRequestedHeaderAndIDs;
     // Should be 'true' only if we connected to this node to actually mix funds.
     // In this case node will be released automatically via CMasternodeMan::ProcessMasternodeConnections().
     // Connecting to verify connectability/status or connecting for sending/relaying single message
@@ -365,12 +412,12 @@ public:
 
     // flood relay
     std::vector<CAddress> vAddrToSend;
-    mruset<CAddress> setAddrKnown;
+    CRollingBloomFilter addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
@@ -396,6 +443,9 @@ private:
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
 
+    // Receive queues of all nodes, see nRecvQueueSize
+    static std::atomic<size_t> nTotalRecvQueueSize;
+
     CNode(const CNode&);
     void operator=(const CNode&);
 
@@ -412,14 +462,21 @@ public:
     }
 
     // requires LOCK(cs_vRecvMsg)
-    unsigned int GetTotalRecvSize()
+    size_t GetTotalRecvSize() const
     {
-        unsigned int total = 0;
-        for (const CNetMessage& msg : vRecvMsg)
-            total += msg.vRecv.size() + 24;
-        return total;
+        return nRecvQueueSize;
     }
 
+    // Drop the messages ahead of it, requires LOCK(cs_vRecvMsg)
+    void EraseRecvMsgs(std::deque<CNetMessage>::iterator it);
+
+    // requires LOCK(cs_vRecvMsg)
+    void ClearRecvMsgs() { EraseRecvMsgs(vRecvMsg.end()); }
+
+    // Whether reading from the socket should wait until queued messages were handled,
+    // requires LOCK(cs_vRecvMsg)
+    bool IsRecvFlooded() const;
+
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes);
 
@@ -445,7 +502,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
@@ -453,7 +510,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
-        if (addr.IsValid() && !setAddrKnown.count(addr)) {
+        if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
             } else {
@@ -467,15 +524,26 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.GetKey());
         }
     }
 
+    //! Mark inv as known to the peer; false if it already was
+    bool AddInventoryKnownIfNew(const CInv& inv)
+    {
+        LOCK(cs_inventory);
+        std::vector<unsigned char> vKey = inv.GetKey();
+        if (filterInventoryKnown.contains(vKey))
+            return false;
+        filterInventoryKnown.insert(vKey);
+        return true;
+    }
+
     void PushInventory(const CInv& inv)
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(inv.GetKey()))
                 vInventoryToSend.push_back(inv);
         }
     }
@@ -735,6 +803,7 @@ public:
 
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
+    static size_t GetTotalRecvQueueSize() { return nTotalRecvQueueSize; }
 };
 
 class CExplicitNetCleanup
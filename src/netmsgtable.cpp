@@ -0,0 +1,107 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgtable.h"
+
+#include "main.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+const std::string NETMSG_OTHER = "*other*";
+
+CNetMsgTable netMsgTable;
+
+/** Records one message into the table's and the peer's statistics when it goes out of scope */
+class CNetMsgTimer
+{
+private:
+    CNetMsgTable& table;
+    CNode* pfrom;
+    const std::string& strCommand;
+    uint64_t nBytes;
+    int64_t nStart;
+    int64_t nLockWait;
+
+public:
+    bool fError;
+
+    CNetMsgTimer(CNetMsgTable& tableIn, CNode* pfromIn, const std::string& strCommandIn, uint64_t nBytesIn) : table(tableIn), pfrom(pfromIn), strCommand(strCommandIn), nBytes(nBytesIn), nStart(GetTimeMicros()), nLockWait(0), fError(true) {}
+
+    /** Call right after the locks were acquired */
+    void Locked() { nLockWait = GetTimeMicros() - nStart; }
+
+    ~CNetMsgTimer()
+    {
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        {
+            LOCK(table.cs_stats);
+            table.mapStats[strCommand].Add(nBytes, fError, nElapsed, nLockWait);
+        }
+        {
+            LOCK(pfrom->cs_msgStats);
+            pfrom->mapRecvMsgStats[strCommand].Add(nBytes, fError, nElapsed, nLockWait);
+        }
+    }
+};
+
+bool CNetMsgTable::Register(const CNetMsgHandler& handler)
+{
+    if (!mapHandlers.insert(std::make_pair(handler.command, handler)).second)
+        return error("%s : message %s has a handler already", __func__, handler.command);
+    return true;
+}
+
+void CNetMsgTable::Register(const CNetMsgHandler* handlers, size_t nCount)
+{
+    for (size_t i = 0; i < nCount; i++)
+        Register(handlers[i]);
+}
+
+void CNetMsgTable::Clear()
+{
+    mapHandlers.clear();
+}
+
+const CNetMsgHandler* CNetMsgTable::Lookup(const std::string& strCommand) const
+{
+    boost::unordered_map<std::string, CNetMsgHandler>::const_iterator it = mapHandlers.find(strCommand);
+    if (it == mapHandlers.end())
+        return NULL;
+    return &it->second;
+}
+
+bool CNetMsgTable::Dispatch(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    const CNetMsgHandler* phandler = Lookup(strCommand);
+    if (!phandler) {
+        // Kept under one key, so that made up commands cannot grow the statistics
+        CNetMsgTimer timer(*this, pfrom, NETMSG_OTHER, vRecv.size());
+        LogPrint("net", "ignoring unknown message %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
+        timer.fError = false;
+        return true;
+    }
+
+    CNetMsgTimer timer(*this, pfrom, phandler->command, vRecv.size());
+    bool fRet = false;
+    switch (phandler->locks) {
+    case NETMSG_LOCK_NONE:
+        fRet = phandler->actor(pfrom, strCommand, vRecv, nTimeReceived);
+        break;
+    case NETMSG_LOCK_MAIN: {
+        LOCK(cs_main);
+        timer.Locked();
+        fRet = phandler->actor(pfrom, strCommand, vRecv, nTimeReceived);
+        break;
+    }
+    }
+    timer.fError = !fRet;
+    return fRet;
+}
+
+void CNetMsgTable::GetStats(std::map<std::string, CNetMsgStats>& mapStatsOut) const
+{
+    LOCK(cs_stats);
+    mapStatsOut = mapStats;
+}
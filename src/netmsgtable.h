@@ -0,0 +1,71 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMSGTABLE_H
+#define BITCOIN_NETMSGTABLE_H
+
+#include "net.h"
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/unordered_map.hpp>
+
+/** Handles one P2P message; false reports the message as failed */
+typedef bool (*netmsgfn_type)(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived);
+
+/** Locks the dispatcher holds while a handler runs */
+enum NetMsgLockRequirement {
+    NETMSG_LOCK_NONE, //!< The handler takes whatever locks it needs itself
+    NETMSG_LOCK_MAIN, //!< cs_main
+};
+
+class CNetMsgHandler
+{
+public:
+    std::string command;
+    netmsgfn_type actor;
+    NetMsgLockRequirement locks;
+};
+
+/** Statistics key of the messages no handler is registered for */
+extern const std::string NETMSG_OTHER;
+
+/**
+ * P2P message dispatcher: finds the handler of a command with one hash
+ * lookup, holds the locks it declared and accounts the message to its
+ * command, both for the node as a whole and for the peer that sent it.
+ *
+ * Handlers are registered before the message handler thread starts and
+ * removed after it stopped, so lookups need no lock.
+ */
+class CNetMsgTable
+{
+private:
+    boost::unordered_map<std::string, CNetMsgHandler> mapHandlers;
+
+    mutable CCriticalSection cs_stats;
+    std::map<std::string, CNetMsgStats> mapStats;
+
+    friend class CNetMsgTimer;
+
+public:
+    /** Fails, leaving the table alone, when the command has a handler already */
+    bool Register(const CNetMsgHandler& handler);
+    void Register(const CNetMsgHandler* handlers, size_t nCount);
+    void Clear();
+
+    const CNetMsgHandler* Lookup(const std::string& strCommand) const;
+
+    /** Run the handler of strCommand; commands without one are counted and ignored */
+    bool Dispatch(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived);
+
+    void GetStats(std::map<std::string, CNetMsgStats>& mapStatsOut) const;
+};
+
+extern CNetMsgTable netMsgTable;
+
+#endif // BITCOIN_NETMSGTABLE_H
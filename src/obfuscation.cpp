@@ -9,6 +9,7 @@
 #include "init.h"
 #include "main.h"
 #include "masternodeman.h"
+#include "netmsgtable.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -377,6 +378,26 @@ void CObfuscationPool::ProcessMessageObfuscation(CNode* pfrom, std::string& strC
     }
 }
 
+static bool ProcessObfuscationMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void RegisterObfuscationMessages(CNetMsgTable& table)
+{
+    static const CNetMsgHandler vMessages[] = {
+        {"dsa", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dsq", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dsi", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dssu", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dss", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dsf", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+        {"dsc", &ProcessObfuscationMessage, NETMSG_LOCK_NONE},
+    };
+    table.Register(vMessages, ARRAYLEN(vMessages));
+}
+
 int randomizeList(int i) { return std::rand() % i; }
 
 void CObfuscationPool::Reset()
@@ -21,6 +21,7 @@ class CBitcoinAddress;
 class CObfuscationQueue;
 class CObfuscationBroadcastTx;
 class CActiveMasternode;
+class CNetMsgTable;
 
 // pool states for mixing
 #define POOL_STATUS_UNKNOWN 0              // waiting for update
@@ -56,6 +57,8 @@ extern std::string strMasterNodePrivKey;
 extern map<uint256, CObfuscationBroadcastTx> mapObfuscationBroadcastTxes;
 extern CActiveMasternode activeMasternode;
 
+void RegisterObfuscationMessages(CNetMsgTable& table);
+
 /** Holds an Obfuscation input
  */
 class CTxDSIn : public CTxIn
@@ -7,6 +7,7 @@
 #include "block.h"
 
 #include "../hash.h"
+#include "../crypto/sha256.h"
 #include "../script/standard.h"
 #include "../script/sign.h"
 #include "../tinyformat.h"
@@ -65,15 +66,18 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                        BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The pairs of a level are adjacent 64-byte blobs, so all of them can
+        // be handed to the (possibly multi-lane) double-SHA256 at once.
+        int nPairs = nSize / 2;
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        SHA256D64(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nPairs);
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree[j+nSize+nPairs] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -83,20 +87,60 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
+/** Number of nodes in the merkle tree of nLeaves transactions, as laid out in vMerkleTree. */
+static size_t MerkleTreeSize(size_t nLeaves)
+{
+    size_t nNodes = nLeaves;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2)
+        nNodes += (nSize + 1) / 2;
+    return nNodes;
+}
+
+uint256 CBlock::UpdateMerkleTreeCoinbase() const
+{
+    // The cached tree can only be patched if it was built from the same
+    // transactions, apart from the coinbase.
+    bool fCurrent = !vtx.empty() && vMerkleTree.size() == MerkleTreeSize(vtx.size());
+    for (unsigned int i = 1; fCurrent && i < vtx.size(); i++)
+        fCurrent = (vMerkleTree[i] == vtx[i].GetHash());
+    if (!fCurrent)
+        return BuildMerkleTree();
+
+    // The coinbase is the leftmost leaf, so only the left edge of each level changes.
+    vMerkleTree[0] = vtx[0].GetHash();
+    int j = 0;
+    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        const uint256& left = vMerkleTree[j];
+        const uint256& right = vMerkleTree[j+1];
+        vMerkleTree[j+nSize] = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        j += nSize;
+    }
+    return vMerkleTree.back();
+}
+
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
 {
-    if (vMerkleTree.empty())
+    return GetMerkleBranches(std::vector<int>(1, nIndex))[0];
+}
+
+std::vector<std::vector<uint256> > CBlock::GetMerkleBranches(const std::vector<int>& vIndex) const
+{
+    if (vMerkleTree.size() != MerkleTreeSize(vtx.size()))
         BuildMerkleTree();
-    std::vector<uint256> vMerkleBranch;
+    std::vector<std::vector<uint256> > vMerkleBranches(vIndex.size());
+    std::vector<int> vPos(vIndex);
     int j = 0;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        int i = std::min(nIndex^1, nSize-1);
-        vMerkleBranch.push_back(vMerkleTree[j+i]);
-        nIndex >>= 1;
+        for (unsigned int k = 0; k < vPos.size(); k++) {
+            int i = std::min(vPos[k]^1, nSize-1);
+            vMerkleBranches[k].push_back(vMerkleTree[j+i]);
+            vPos[k] >>= 1;
+        }
         j += nSize;
     }
-    return vMerkleBranch;
+    return vMerkleBranches;
 }
 
 uint256 CBlock::CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex)
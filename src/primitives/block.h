@@ -158,7 +158,14 @@ public:
     // merkle root).
     uint256 BuildMerkleTree(bool* mutated = NULL) const;
 
+    // Refresh the in-memory merkle tree after only the coinbase (vtx[0]) has
+    // changed, rehashing just the leftmost path, and return the new root.
+    // Falls back to BuildMerkleTree() if the cached tree is for other transactions.
+    uint256 UpdateMerkleTreeCoinbase() const;
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
+    // Merkle branches for several transactions, from a single walk of the tree.
+    std::vector<std::vector<uint256> > GetMerkleBranches(const std::vector<int>& vIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
     std::string ToString() const;
     void print() const;
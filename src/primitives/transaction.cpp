@@ -129,6 +129,18 @@ CTransaction& CTransaction::operator=(const CTransaction &tx) {
     return *this;
 }
 
+CTransaction& CTransaction::operator=(CTransaction&& tx) {
+    *const_cast<int*>(&nVersion) = tx.nVersion;
+    *const_cast<std::vector<CTxIn>*>(&vin) = std::move(tx.vin);
+    *const_cast<std::vector<CTxOut>*>(&vout) = std::move(tx.vout);
+    *const_cast<unsigned int*>(&nLockTime) = tx.nLockTime;
+    *const_cast<uint256*>(&hash) = tx.hash;
+    tx.vin.clear();
+    tx.vout.clear();
+    tx.UpdateHash();
+    return *this;
+}
+
 CAmount CTransaction::GetValueOut() const
 {
     CAmount nValueOut = 0;
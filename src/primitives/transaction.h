@@ -218,7 +218,11 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     CTransaction(const CMutableTransaction &tx);
 
+    CTransaction(const CTransaction& tx) = default;
+
     CTransaction& operator=(const CTransaction& tx);
+    //! Takes the inputs and outputs of tx, leaving it null
+    CTransaction& operator=(CTransaction&& tx);
 
     ADD_SERIALIZE_METHODS;
 
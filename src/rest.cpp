@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "jsonwriter.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
@@ -42,8 +43,8 @@ public:
     string message;
 };
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void TxToJSONWriter(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& writer);
+extern void blockToJSONWriter(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -104,38 +105,41 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    // The binary and hex formats are served from the stored bytes as they
+    // are; only JSON needs the parsed block. None of it needs cs_main.
     CBlock block;
-    CBlockIndex* pblockindex = NULL;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+    std::vector<char> vchBlock;
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
+        throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
-        pblockindex = mapBlockIndex[hash];
+    if (rf == RF_JSON) {
         if (!ReadBlockFromDisk(block, pblockindex))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+    } else {
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(vchBlock.begin(), vchBlock.end());
         conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        blockToJSONWriter(block, pblockindex, showTxDetails, writer);
+        strJSON += "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
         return true;
     }
 
@@ -199,10 +203,11 @@ static bool rest_tx(AcceptedConnection* conn,
     }
 
     case RF_JSON: {
-        UniValue objTx(UniValue::VOBJ);
-        TxToJSON(tx, hashBlock, objTx);
-        string strJSON = objTx.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        string strJSON;
+        CJSONWriter writer(strJSON);
+        TxToJSONWriter(tx, hashBlock, writer);
+        strJSON += "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
         return true;
     }
 
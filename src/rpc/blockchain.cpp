@@ -6,15 +6,20 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainsnapshot.h"
 #include "checkpoints.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "rpc/server.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util.h"
 
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/scoped_ptr.hpp>
+
 using namespace std;
 
 struct CUpdatedBlock
@@ -27,8 +32,22 @@ static std::condition_variable cond_blockchange;
 static CUpdatedBlock latestblock;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+extern void TxToJSONWriter(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& writer);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
+/**
+ * The chain as last published, for read-only calls that run without
+ * cs_main. Everything such a call reports should come from this one
+ * snapshot so that a reorg halfway through cannot mix two chains.
+ */
+CChainSnapshotRef GetRPCChainSnapshot()
+{
+    CChainSnapshotRef snapshot = GetChainSnapshot();
+    if (!snapshot)
+        throw JSONRPCError(RPC_IN_WARMUP, "Loading block index...");
+    return snapshot;
+}
+
 double GetDifficulty(const CBlockIndex* blockindex)
 {
     // Floating point number that is a multiple of the minimum difficulty,
@@ -60,12 +79,13 @@ double GetDifficulty(const CBlockIndex* blockindex)
 
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
 {
+    CChainSnapshotRef snapshot = GetChainSnapshot();
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (snapshot && snapshot->Contains(blockindex))
+        confirmations = snapshot->Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -89,13 +109,70 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
+    CBlockIndex* pnext = snapshot ? snapshot->Next(blockindex) : NULL;
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
 }
 
 
+/** blockToJSON() written straight into writer, with the same output */
+void blockToJSONWriter(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer)
+{
+    CChainSnapshotRef snapshot = GetChainSnapshot();
+    unsigned int nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    // Transaction details take about five times their serialized size
+    writer.Reserve(txDetails ? 5 * nSize : 68 * block.vtx.size() + 1024);
+
+    writer.BeginObject();
+    writer.Key("hash");
+    writer.Hash(block.GetHash());
+    int confirmations = -1;
+    // Only report confirmations if the block is on the main chain
+    if (snapshot && snapshot->Contains(blockindex))
+        confirmations = snapshot->Height() - blockindex->nHeight + 1;
+    writer.Key("confirmations");
+    writer.Int(confirmations);
+    writer.Key("size");
+    writer.Int(nSize);
+    writer.Key("height");
+    writer.Int(blockindex->nHeight);
+    writer.Key("version");
+    writer.Int(block.nVersion);
+    writer.Key("merkleroot");
+    writer.Hash(block.hashMerkleRoot);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (const CTransaction& tx : block.vtx) {
+        if (txDetails)
+            TxToJSONWriter(tx, uint256(0), writer);
+        else
+            writer.Hash(tx.GetHash());
+    }
+    writer.EndArray();
+    writer.Key("time");
+    writer.Int(block.GetBlockTime());
+    writer.Key("nonce");
+    writer.UInt(block.nNonce);
+    writer.Key("bits");
+    writer.String(strprintf("%08x", block.nBits));
+    writer.Key("difficulty");
+    writer.Real(GetDifficulty(blockindex));
+    writer.Key("chainwork");
+    writer.Hash(blockindex->nChainWork);
+
+    if (blockindex->pprev) {
+        writer.Key("previousblockhash");
+        writer.Hash(blockindex->pprev->GetBlockHash());
+    }
+    CBlockIndex* pnext = snapshot ? snapshot->Next(blockindex) : NULL;
+    if (pnext) {
+        writer.Key("nextblockhash");
+        writer.Hash(pnext->GetBlockHash());
+    }
+    writer.EndObject();
+}
+
 UniValue blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
@@ -121,8 +198,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetRPCChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -136,8 +212,10 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    CChainSnapshotRef snapshot = GetRPCChainSnapshot();
+    if (!snapshot->Tip())
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks");
+    return snapshot->Tip()->GetBlockHash().GetHex();
 }
 
 void RPCNotifyBlockChange(const uint256 hashBlock)
@@ -255,16 +333,36 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
-    LOCK(cs_main);
+    CChainSnapshotRef snapshot = GetRPCChainSnapshot();
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > snapshot->Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    CBlockIndex* pblockindex = (*snapshot)[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
+/** The block getblock's parameters ask for, and whether it is wanted verbose */
+static const CBlockIndex* ReadBlockForRPC(const UniValue& params, CBlock& block, bool& fVerbose)
+{
+    std::string strHash = params[0].get_str();
+    uint256 hash(strHash);
+
+    fVerbose = true;
+    if (params.size() > 1)
+        fVerbose = params[1].get_bool();
+
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -298,23 +396,10 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "\"data\"             (string) A string that is serialized, hex-encoded data for block 'hash'.\n"
             "\nExamples:\n" +
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") + HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
-    LOCK(cs_main);
-
-    std::string strHash = params[0].get_str();
-    uint256 hash(strHash);
-
-    bool fVerbose = true;
-    if (params.size() > 1)
-        fVerbose = params[1].get_bool();
-
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
+    bool fVerbose;
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    const CBlockIndex* pblockindex = ReadBlockForRPC(params, block, fVerbose);
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -326,6 +411,28 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+/** getblock, written straight into the reply */
+bool getblock_write(const UniValue& params, CJSONWriter& writer)
+{
+    // Leave the usage message to the actor
+    if (params.size() < 1 || params.size() > 2)
+        return false;
+
+    bool fVerbose;
+    CBlock block;
+    const CBlockIndex* pblockindex = ReadBlockForRPC(params, block, fVerbose);
+
+    if (!fVerbose) {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        writer.Hex(ssBlock);
+        return true;
+    }
+
+    blockToJSONWriter(block, pblockindex, false, writer);
+    return true;
+}
+
 UniValue getblockheader(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -357,12 +464,11 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -378,42 +484,115 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( verify )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "They are kept up to date as blocks are connected, so this returns immediately\n"
+            "unless verify is set.\n"
+            "\nArguments:\n"
+            "1. verify    (boolean, optional, default=false) Also count the whole set from the database and\n"
+            "             compare; this may take some time, but does not hold up the node while it runs\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"bogosize\": n,          (numeric) A database-independent metric for the set size\n"
+            "  \"muhash\": \"hash\",       (string) The MuHash of the set of unspent outputs\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
+            "  \"bytes_serialized\": n,  (numeric) With verify: the serialized size\n"
+            "  \"hash_serialized\": \"hash\",   (string) With verify: the serialized hash\n"
+            "  \"verified\": true|false  (boolean) With verify: whether the full count matched the kept statistics\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleRpc("gettxoutsetinfo", ""));
 
-    LOCK(cs_main);
+    bool fVerify = params.size() > 0 && params[0].get_bool();
 
     UniValue ret(UniValue::VOBJ);
-
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    CUTXOStats utxoStats;
+    boost::scoped_ptr<CCoinsViewDBSnapshot> pviewDB;
+    {
+        LOCK(cs_main);
+        if (fVerify) {
+            // Scan the database as of now, with the cache written out first
+            FlushStateToDisk();
+            pviewDB.reset(NewCoinsDBSnapshot());
+            if (!pviewDB || !pviewDB->GetUTXOStats(utxoStats))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the UTXO set statistics");
+        } else if (!pcoinsTip->GetUTXOStats(utxoStats))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the UTXO set statistics");
+        stats.hashBlock = pcoinsTip->GetBestBlock();
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+
+    // The digest needs a modular inverse, no need to hold cs_main for it
+    CCoinsStats kept;
+    utxoStats.GetStats(kept);
+
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)kept.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)kept.nTransactionOutputs));
+    ret.push_back(Pair("bogosize", (int64_t)kept.nBogoSize));
+    ret.push_back(Pair("muhash", kept.hashMuHash.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(kept.nTotalAmount)));
+
+    if (fVerify) {
+        if (!pviewDB->GetStats(stats))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the UTXO set");
+        bool fVerified = stats.nTransactions == kept.nTransactions &&
+                         stats.nTransactionOutputs == kept.nTransactionOutputs &&
+                         stats.nBogoSize == kept.nBogoSize &&
+                         stats.nTotalAmount == kept.nTotalAmount &&
+                         stats.hashMuHash == kept.hashMuHash;
+        if (!fVerified)
+            LogPrintf("%s : UTXO set statistics at %s do not match a full count: %d/%d transactions, %d/%d outputs, muhash %s/%s\n", __func__,
+                stats.hashBlock.ToString(), kept.nTransactions, stats.nTransactions, kept.nTransactionOutputs, stats.nTransactionOutputs,
+                kept.hashMuHash.ToString(), stats.hashMuHash.ToString());
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        ret.push_back(Pair("verified", fVerified));
     }
     return ret;
 }
 
+static UniValue TxOutToJSON(CCoinsView* pviewTip, const CBlockIndex* pindexBest, const uint256& hash, int n, bool fMempool)
+{
+    UniValue ret(UniValue::VOBJ);
+
+    CCoins coins;
+    if (fMempool) {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool view(pviewTip, mempool);
+        if (!view.GetCoins(hash, coins))
+            return NullUniValue;
+        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+    } else {
+        if (!pviewTip->GetCoins(hash, coins))
+            return NullUniValue;
+    }
+    if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull() || !pindexBest)
+        return NullUniValue;
+
+    ret.push_back(Pair("bestblock", pindexBest->GetBlockHash().GetHex()));
+    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+        ret.push_back(Pair("confirmations", 0));
+    else
+        ret.push_back(Pair("confirmations", pindexBest->nHeight - coins.nHeight + 1));
+    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+    UniValue o(UniValue::VOBJ);
+    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ret.push_back(Pair("scriptPubKey", o));
+    ret.push_back(Pair("version", coins.nVersion));
+    ret.push_back(Pair("coinbase", coins.fCoinBase));
+
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -448,9 +627,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             HelpExampleCli("listunspent", "") +
             "\nView the details\n" + HelpExampleCli("gettxout", "\"txid\" 1") +
             "\nAs a json rpc call\n" + HelpExampleRpc("gettxout", "\"txid\", 1"));
-    LOCK(cs_main);
-
-    UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
@@ -459,35 +635,16 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    // Served from the chain snapshot; when it carries no coins, because too
+    // many changed since the last flush, from the coins cache under cs_main.
+    CChainSnapshotRef snapshot = GetRPCChainSnapshot();
+    if (!snapshot->HaveCoinsView()) {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        return TxOutToJSON(pcoinsTip, it->second, hash, n, fMempool);
     }
-    if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
-
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex* pindex = it->second;
-    ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
-        ret.push_back(Pair("confirmations", 0));
-    else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
-    UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
-    ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
-
-    return ret;
+    CCoinsViewChainSnapshot view(snapshot);
+    return TxOutToJSON(&view, snapshot->Tip(), hash, n, fMempool);
 }
 
 UniValue verifychain(const UniValue& params, bool fHelp)
@@ -535,16 +692,19 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
 
-    LOCK(cs_main);
+    CChainSnapshotRef snapshot = GetRPCChainSnapshot();
+    CBlockIndex* pindexTip = snapshot->Tip();
+    if (!pindexTip)
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks");
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain", Params().NetworkIDString()));
-    obj.push_back(Pair("blocks", (int)chainActive.Height()));
-    obj.push_back(Pair("headers", pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash", chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty", (double)GetDifficulty()));
-    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
-    obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("blocks", snapshot->Height()));
+    obj.push_back(Pair("headers", snapshot->BestHeader() ? snapshot->BestHeader()->nHeight : -1));
+    obj.push_back(Pair("bestblockhash", pindexTip->GetBlockHash().GetHex()));
+    obj.push_back(Pair("difficulty", (double)GetDifficulty(pindexTip)));
+    obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(pindexTip)));
+    obj.push_back(Pair("chainwork", pindexTip->nChainWork.GetHex()));
     return obj;
 }
 
@@ -686,10 +846,10 @@ UniValue invalidateblock(const UniValue& params, bool fHelp)
 
     {
         LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
+        CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-        CBlockIndex* pblockindex = mapBlockIndex[hash];
         InvalidateBlock(state, pblockindex);
     }
 
@@ -723,10 +883,10 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 
     {
         LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
+        CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-        CBlockIndex* pblockindex = mapBlockIndex[hash];
         ReconsiderBlock(state, pblockindex);
     }
 
@@ -85,6 +85,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"sendrawtransaction", 2},
     {"gettxout", 1},
     {"gettxout", 2},
+    {"gettxoutsetinfo", 0},
     {"lockunspent", 0},
     {"lockunspent", 1},
     {"importprivkey", 2},
@@ -11,6 +11,7 @@
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "miner.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
@@ -493,6 +494,10 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"attemptspersec\": n,              (numeric) kernel hashes tried per second lately\n"
+            "  \"kernelstested\": n,               (numeric) kernel hashes tried since startup\n"
+            "  \"blocksfound\": n,                 (numeric) blocks staked since startup\n"
+            "  \"timetoblock\": n,                 (numeric) seconds from a new tip to the last block staked on it, -1 if none\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -514,6 +519,12 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    CStakeMinterStats stats = GetStakeMinterStats();
+    obj.push_back(Pair("attemptspersec", stats.dAttemptsPerSec));
+    obj.push_back(Pair("kernelstested", (uint64_t)stats.nKernelsTested));
+    obj.push_back(Pair("blocksfound", (uint64_t)stats.nBlocksFound));
+    obj.push_back(Pair("timetoblock", stats.nLastTimeToBlock < 0 ? -1.0 : stats.nLastTimeToBlock / 1000.0));
+
     return obj;
 }
 #endif // ENABLE_WALLET
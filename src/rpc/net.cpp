@@ -11,6 +11,7 @@
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmsgtable.h"
 #include "protocol.h"
 #include "sync.h"
 #include "timedata.h"
@@ -91,6 +92,7 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"lastrecv\": ttt,           (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last receive\n"
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
             "    \"bytesrecv\": n,            (numeric) The total bytes received\n"
+            "    \"recvqueue\": n,            (numeric) The bytes received but not handled yet\n"
             "    \"conntime\": ttt,           (numeric) The connection time in seconds since epoch (Jan 1 1970 GMT)\n"
             "    \"pingtime\": n,             (numeric) ping time\n"
             "    \"pingwait\": n,             (numeric) ping wait\n"
@@ -104,7 +106,18 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"compactblocks\": true|false, (boolean) Whether the peer takes and serves compact blocks\n"
+            "    \"cmpct_hb_to\": true|false, (boolean) Whether we push new blocks to the peer as compact blocks right away\n"
+            "    \"cmpct_hb_from\": true|false, (boolean) Whether we asked the peer to push new blocks to us that way\n"
+            "    \"msgsrecv\": {              (json object) Messages received from the peer, by command\n"
+            "      \"command\": {\n"
+            "        \"count\": n,              (numeric) Number of messages\n"
+            "        \"bytes\": n,              (numeric) Their payload in bytes\n"
+            "        \"time_ms\": x.xxx         (numeric) Total time spent handling them in milliseconds\n"
+            "      }, ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -131,6 +144,7 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.push_back(Pair("lastrecv", stats.nLastRecv));
         obj.push_back(Pair("bytessent", stats.nSendBytes));
         obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+        obj.push_back(Pair("recvqueue", (uint64_t)stats.nRecvQueueSize));
         obj.push_back(Pair("conntime", stats.nTimeConnected));
         obj.push_back(Pair("timeoffset", stats.nTimeOffset));
         obj.push_back(Pair("pingtime", stats.dPingTime));
@@ -154,6 +168,18 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             obj.push_back(Pair("inflight", heights));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("compactblocks", stats.fSupportsCompactBlocks));
+        obj.push_back(Pair("cmpct_hb_to", stats.fPreferHeaderAndIDs));
+        obj.push_back(Pair("cmpct_hb_from", stats.fRequestedHeaderAndIDs));
+        UniValue msgs(UniValue::VOBJ);
+        for (const PAIRTYPE(std::string, CNetMsgStats) & item : stats.mapRecvMsgStats) {
+            UniValue msg(UniValue::VOBJ);
+            msg.push_back(Pair("count", item.second.nCount));
+            msg.push_back(Pair("bytes", item.second.nBytes));
+            msg.push_back(Pair("time_ms", item.second.nTotalMicros * 0.001));
+            msgs.push_back(Pair(item.first, msg));
+        }
+        obj.push_back(Pair("msgsrecv", msgs));
 
         ret.push_back(obj);
     }
@@ -343,6 +369,7 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
+            "  \"totalrecvqueue\": n,   (numeric) Bytes received from all peers but not handled yet\n"
             "  \"timemillis\": t        (numeric) Total cpu time\n"
             "}\n"
             "\nExamples:\n" +
@@ -351,10 +378,54 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
+    obj.push_back(Pair("totalrecvqueue", (uint64_t)CNode::GetTotalRecvQueueSize()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
     return obj;
 }
 
+UniValue getnetmsginfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getnetmsginfo\n"
+            "\nReturns per-command statistics of the P2P messages received from all peers since startup.\n"
+            "Commands without a handler are counted together as \"*other*\".\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {            (string) The message command\n"
+            "    \"locks\": \"xxx\",       (string) Locks held while it is handled: \"none\" or \"cs_main\"\n"
+            "    \"count\": n,           (numeric) Number of messages\n"
+            "    \"errors\": n,          (numeric) Number of messages whose handling failed\n"
+            "    \"bytes\": n,           (numeric) Their payload in bytes\n"
+            "    \"avg_ms\": x.xxx,      (numeric) Average time per message in milliseconds\n"
+            "    \"max_ms\": x.xxx,      (numeric) Longest message in milliseconds\n"
+            "    \"lockwait_ms\": x.xxx  (numeric) Average time per message spent waiting for locks\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsginfo", "") + HelpExampleRpc("getnetmsginfo", ""));
+
+    std::map<std::string, CNetMsgStats> mapStats;
+    netMsgTable.GetStats(mapStats);
+
+    UniValue ret(UniValue::VOBJ);
+    for (const PAIRTYPE(std::string, CNetMsgStats) & item : mapStats) {
+        const CNetMsgStats& stats = item.second;
+        const CNetMsgHandler* phandler = netMsgTable.Lookup(item.first);
+        UniValue obj(UniValue::VOBJ);
+        if (phandler)
+            obj.push_back(Pair("locks", phandler->locks == NETMSG_LOCK_MAIN ? "cs_main" : "none"));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("errors", stats.nErrors));
+        obj.push_back(Pair("bytes", stats.nBytes));
+        obj.push_back(Pair("avg_ms", stats.nTotalMicros * 0.001 / stats.nCount));
+        obj.push_back(Pair("max_ms", stats.nMaxMicros * 0.001));
+        obj.push_back(Pair("lockwait_ms", stats.nLockWaitMicros * 0.001 / stats.nCount));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
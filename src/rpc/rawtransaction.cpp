@@ -7,8 +7,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "core_io.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
@@ -34,6 +36,8 @@ using namespace boost;
 using namespace boost::assign;
 using namespace std;
 
+extern CChainSnapshotRef GetRPCChainSnapshot();
+
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex)
 {
     txnouttype type;
@@ -69,11 +73,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 
     if (!hashBlock.IsNull()) {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-        if (mi != mapBlockIndex.end() && (*mi).second) {
-            CBlockIndex* pindex = (*mi).second;
-            if (chainActive.Contains(pindex)) {
-                entry.push_back(Pair("confirmations", 1 + chainActive.Height() - pindex->nHeight));
+        CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+        if (pindex) {
+            CChainSnapshotRef snapshot = GetChainSnapshot();
+            if (snapshot && snapshot->Contains(pindex)) {
+                entry.push_back(Pair("confirmations", 1 + snapshot->Height() - pindex->nHeight));
                 entry.push_back(Pair("time", pindex->GetBlockTime()));
                 entry.push_back(Pair("blocktime", pindex->GetBlockTime()));
             }
@@ -83,6 +87,34 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     }
 }
 
+/** TxToJSON() as a complete object written straight into writer, with the same output */
+void TxToJSONWriter(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& writer)
+{
+    writer.BeginObject();
+    TxToJSONWriter(tx, writer);
+
+    if (!hashBlock.IsNull()) {
+        writer.Key("blockhash");
+        writer.Hash(hashBlock);
+        CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+        if (pindex) {
+            CChainSnapshotRef snapshot = GetChainSnapshot();
+            if (snapshot && snapshot->Contains(pindex)) {
+                writer.Key("confirmations");
+                writer.Int(1 + snapshot->Height() - pindex->nHeight);
+                writer.Key("time");
+                writer.Int(pindex->GetBlockTime());
+                writer.Key("blocktime");
+                writer.Int(pindex->GetBlockTime());
+            } else {
+                writer.Key("confirmations");
+                writer.Int(0);
+            }
+        }
+    }
+    writer.EndObject();
+}
+
 UniValue getrawtransaction(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 3)
@@ -156,8 +188,6 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
-    LOCK(cs_main);
-
     bool in_active_chain = true;
     uint256 hash = ParseHashV(params[0], "parameter 1");
     CBlockIndex* blockindex = nullptr;
@@ -169,12 +199,11 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     if (!params[2].isNull()) {
         uint256 blockhash = ParseHashV(params[2], "parameter 3");
-        BlockMap::iterator it = mapBlockIndex.find(blockhash);
-        if (it == mapBlockIndex.end()) {
+        blockindex = LookupBlockIndex(blockhash);
+        if (!blockindex) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block hash not found");
         }
-        blockindex = it->second;
-        in_active_chain = chainActive.Contains(blockindex);
+        in_active_chain = GetRPCChainSnapshot()->Contains(blockindex);
     }
 
     CTransaction tx;
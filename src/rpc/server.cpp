@@ -10,6 +10,7 @@
 
 #include "base58.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -17,6 +18,9 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <atomic>
+#include <deque>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -49,6 +53,130 @@ static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work* rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static bool fRPCUseSSL = false;
+
+/**
+ * Connections with a request ready to be read, waiting for an RPC worker.
+ *
+ * The io_service threads only accept connections and wait for requests to
+ * arrive; reading, executing and answering a request happens on the workers
+ * draining this queue. A keep-alive connection goes back to waiting on the
+ * io_service between requests instead of holding on to a worker, and when
+ * more than -rpcworkqueue requests are waiting, new ones are turned away
+ * with 503 rather than piling up.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::function<void()> > queue;
+    size_t nMaxDepth;
+    bool fRunning;
+
+public:
+    //! Statistics, guarded by cs
+    size_t nPeakDepth;
+    uint64_t nRejected;
+    uint64_t nProcessed;
+
+    explicit CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true), nPeakDepth(0), nRejected(0), nProcessed(0) {}
+
+    /** Queue func for a worker; false if the queue is full or stopped. Only
+     *  turned away requests count as rejected, not optional helper work */
+    bool Enqueue(const boost::function<void()>& func, bool fRequest = true)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth) {
+            nRejected += fRequest;
+            return false;
+        }
+        queue.push_back(func);
+        nPeakDepth = std::max(nPeakDepth, queue.size());
+        cond.notify_one();
+        return true;
+    }
+
+    /** Worker thread body, returns once Interrupt() was called */
+    void Run()
+    {
+        RenameThread("roco-rpcworker");
+        while (true) {
+            boost::function<void()> func;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    return;
+                func.swap(queue.front());
+                queue.pop_front();
+            }
+            func();
+            boost::unique_lock<boost::mutex> lock(cs);
+            nProcessed++;
+        }
+    }
+
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        queue.clear();
+        cond.notify_all();
+    }
+
+    void GetStats(size_t& nDepth, size_t& nMaxDepthOut, size_t& nPeakDepthOut, uint64_t& nRejectedOut, uint64_t& nProcessedOut)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nDepth = queue.size();
+        nMaxDepthOut = nMaxDepth;
+        nPeakDepthOut = nPeakDepth;
+        nRejectedOut = nRejected;
+        nProcessedOut = nProcessed;
+    }
+};
+
+static CRPCWorkQueue* rpc_work_queue = NULL;
+static int nRPCWorkers = 0;
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+/** Records one call into mapRPCStats when it goes out of scope */
+class CRPCCallTimer
+{
+private:
+    const std::string& strMethod;
+    int64_t nStart;
+    int64_t nLockWait;
+    bool fDiscard;
+
+public:
+    bool fError;
+
+    explicit CRPCCallTimer(const std::string& strMethodIn) : strMethod(strMethodIn), nStart(GetTimeMicros()), nLockWait(0), fDiscard(false), fError(true) {}
+
+    /** Call right after the locks were acquired */
+    void Locked() { nLockWait = GetTimeMicros() - nStart; }
+
+    /** The call did not happen after all; leave the statistics alone */
+    void Discard() { fDiscard = true; }
+
+    ~CRPCCallTimer()
+    {
+        if (fDiscard)
+            return;
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        LOCK(cs_rpcStats);
+        CRPCMethodStats& stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        stats.nErrors += fError;
+        stats.nTotalMicros += nElapsed;
+        stats.nMaxMicros = std::max(stats.nMaxMicros, nElapsed);
+        stats.nLockWaitMicros += nLockWait;
+    }
+};
 
 void RPCTypeCheck(const UniValue& params,
                   const list<UniValue::VType>& typesExpected,
@@ -245,151 +373,225 @@ UniValue stop(const UniValue& params, bool fHelp)
 }
 
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns RPC work queue and per-method call statistics since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workqueue\": {\n"
+            "    \"threads\": n,         (numeric) Number of threads executing RPC calls\n"
+            "    \"depth\": n,           (numeric) Requests currently waiting for a thread\n"
+            "    \"maxdepth\": n,        (numeric) Maximum number of waiting requests (-rpcworkqueue)\n"
+            "    \"peakdepth\": n,       (numeric) Highest number of waiting requests seen\n"
+            "    \"processed\": n,       (numeric) Requests processed\n"
+            "    \"rejected\": n         (numeric) Requests turned away because the queue was full\n"
+            "  },\n"
+            "  \"methods\": {\n"
+            "    \"method\": {            (string) The method name\n"
+            "      \"calls\": n,         (numeric) Number of calls\n"
+            "      \"errors\": n,        (numeric) Number of calls that returned an error\n"
+            "      \"avg_ms\": x.xxx,    (numeric) Average time per call in milliseconds\n"
+            "      \"max_ms\": x.xxx,    (numeric) Longest call in milliseconds\n"
+            "      \"lockwait_ms\": x.xxx (numeric) Average time per call spent waiting for locks\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcinfo", "") + HelpExampleRpc("getrpcinfo", ""));
+
+    UniValue queue(UniValue::VOBJ);
+    queue.push_back(Pair("threads", nRPCWorkers));
+    if (rpc_work_queue) {
+        size_t nDepth, nMaxDepth, nPeakDepth;
+        uint64_t nRejected, nProcessed;
+        rpc_work_queue->GetStats(nDepth, nMaxDepth, nPeakDepth, nRejected, nProcessed);
+        queue.push_back(Pair("depth", (uint64_t)nDepth));
+        queue.push_back(Pair("maxdepth", (uint64_t)nMaxDepth));
+        queue.push_back(Pair("peakdepth", (uint64_t)nPeakDepth));
+        queue.push_back(Pair("processed", nProcessed));
+        queue.push_back(Pair("rejected", nRejected));
+    }
+
+    UniValue methods(UniValue::VOBJ);
+    {
+        LOCK(cs_rpcStats);
+        for (const PAIRTYPE(std::string, CRPCMethodStats) & item : mapRPCStats) {
+            const CRPCMethodStats& stats = item.second;
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("calls", stats.nCalls));
+            obj.push_back(Pair("errors", stats.nErrors));
+            obj.push_back(Pair("avg_ms", stats.nTotalMicros * 0.001 / stats.nCalls));
+            obj.push_back(Pair("max_ms", stats.nMaxMicros * 0.001));
+            obj.push_back(Pair("lockwait_ms", stats.nLockWaitMicros * 0.001 / stats.nCalls));
+            methods.push_back(Pair(item.first, obj));
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("workqueue", queue));
+    ret.push_back(Pair("methods", methods));
+    return ret;
+}
+
+
 /**
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
     {
-        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet
-        //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
+        //  category              name                      actor (function)         okSafeMode locks reqWallet readOnly
+        //  --------------------- ------------------------  -----------------------  ---------- ----- --------- --------
         /* Overall control/query calls */
-        {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
-        {"control", "help", &help, true, true, false},
-        {"control", "stop", &stop, true, true, false},
+        {"control", "getinfo", &getinfo, true, RPC_LOCK_MAIN_WALLET, false, true}, /* uses wallet if enabled */
+        {"control", "help", &help, true, RPC_LOCK_NONE, false, true},
+        {"control", "stop", &stop, true, RPC_LOCK_NONE, false, false},
+        {"control", "getrpcinfo", &getrpcinfo, true, RPC_LOCK_NONE, false, true},
 
         /* P2P networking */
-        {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
-        {"network", "addnode", &addnode, true, true, false},
-        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
-        {"network", "getconnectioncount", &getconnectioncount, true, false, false},
-        {"network", "getnettotals", &getnettotals, true, true, false},
-        {"network", "getpeerinfo", &getpeerinfo, true, false, false},
-        {"network", "ping", &ping, true, false, false},
-        {"network", "setban", &setban, true, false, false},
-        {"network", "listbanned", &listbanned, true, false, false},
-        {"network", "clearbanned", &clearbanned, true, false, false},
+        {"network", "getnetworkinfo", &getnetworkinfo, true, RPC_LOCK_MAIN, false, true},
+        {"network", "addnode", &addnode, true, RPC_LOCK_NONE, false, false},
+        {"network", "getaddednodeinfo", &getaddednodeinfo, true, RPC_LOCK_NONE, false, true},
+        {"network", "getconnectioncount", &getconnectioncount, true, RPC_LOCK_MAIN, false, true},
+        {"network", "getnettotals", &getnettotals, true, RPC_LOCK_NONE, false, true},
+        {"network", "getnetmsginfo", &getnetmsginfo, true, RPC_LOCK_NONE, false, true},
+        {"network", "getpeerinfo", &getpeerinfo, true, RPC_LOCK_MAIN, false, true},
+        {"network", "ping", &ping, true, RPC_LOCK_MAIN, false, false},
+        {"network", "setban", &setban, true, RPC_LOCK_MAIN, false, false},
+        {"network", "listbanned", &listbanned, true, RPC_LOCK_MAIN, false, true},
+        {"network", "clearbanned", &clearbanned, true, RPC_LOCK_MAIN, false, false},
 
         /* Block chain and UTXO */
-        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
-        {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
-        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
-        {"blockchain", "gettxout", &gettxout, true, false, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
-        {"blockchain", "verifychain", &verifychain, true, false, false},
-        {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
-        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
+        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getblockcount", &getblockcount, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getblock", &getblock, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getblockhash", &getblockhash, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getblockheader", &getblockheader, false, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getchaintips", &getchaintips, true, RPC_LOCK_MAIN, false, true},
+        {"blockchain", "getdifficulty", &getdifficulty, true, RPC_LOCK_MAIN, false, true},
+        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "getrawmempool", &getrawmempool, true, RPC_LOCK_MAIN, false, true},
+        {"blockchain", "gettxout", &gettxout, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, RPC_LOCK_NONE, false, true},
+        {"blockchain", "verifychain", &verifychain, true, RPC_LOCK_MAIN, false, true},
+        {"blockchain", "invalidateblock", &invalidateblock, true, RPC_LOCK_NONE, false, false},
+        {"blockchain", "reconsiderblock", &reconsiderblock, true, RPC_LOCK_NONE, false, false},
 
         /* Mining */
-        {"mining", "getblocktemplate", &getblocktemplate, true, false, false},
-        {"mining", "getmininginfo", &getmininginfo, true, false, false},
-        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false},
-        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false},
-        {"mining", "submitblock", &submitblock, true, true, false},
-        {"mining", "reservebalance", &reservebalance, true, true, false},
+        {"mining", "getblocktemplate", &getblocktemplate, true, RPC_LOCK_MAIN_WALLET, false, false},
+        {"mining", "getmininginfo", &getmininginfo, true, RPC_LOCK_MAIN, false, true},
+        {"mining", "getnetworkhashps", &getnetworkhashps, true, RPC_LOCK_MAIN, false, true},
+        {"mining", "prioritisetransaction", &prioritisetransaction, true, RPC_LOCK_MAIN, false, false},
+        {"mining", "submitblock", &submitblock, true, RPC_LOCK_NONE, false, false},
+        {"mining", "reservebalance", &reservebalance, true, RPC_LOCK_NONE, false, false},
 
 #ifdef ENABLE_WALLET
         /* Coin generation */
-        {"generating", "getgenerate", &getgenerate, true, false, false},
-        {"generating", "gethashespersec", &gethashespersec, true, false, false},
-        {"generating", "setgenerate", &setgenerate, true, true, false},
+        {"generating", "getgenerate", &getgenerate, true, RPC_LOCK_MAIN, false, true},
+        {"generating", "gethashespersec", &gethashespersec, true, RPC_LOCK_MAIN, false, true},
+        {"generating", "setgenerate", &setgenerate, true, RPC_LOCK_NONE, false, false},
 #endif
 
         /* Raw transactions */
-        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
-        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
-        {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
-        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
-        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
+        {"rawtransactions", "createrawtransaction", &createrawtransaction, true, RPC_LOCK_MAIN, false, true},
+        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, RPC_LOCK_MAIN, false, true},
+        {"rawtransactions", "decodescript", &decodescript, true, RPC_LOCK_MAIN, false, true},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, RPC_LOCK_NONE, false, true},
+        {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, RPC_LOCK_MAIN, false, false},
+        {"rawtransactions", "signrawtransaction", &signrawtransaction, false, RPC_LOCK_MAIN_WALLET, false, true}, /* uses wallet if enabled */
 
         /* Utility functions */
-        {"util", "createmultisig", &createmultisig, true, true, false},
-        {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
-        {"util", "verifymessage", &verifymessage, true, false, false},
-        {"util", "estimatefee", &estimatefee, true, true, false},
-        {"util", "estimatepriority", &estimatepriority, true, true, false},
+        {"util", "createmultisig", &createmultisig, true, RPC_LOCK_NONE, false, true},
+        {"util", "validateaddress", &validateaddress, true, RPC_LOCK_MAIN_WALLET, false, true}, /* uses wallet if enabled */
+        {"util", "verifymessage", &verifymessage, true, RPC_LOCK_MAIN, false, true},
+        {"util", "estimatefee", &estimatefee, true, RPC_LOCK_NONE, false, true},
+        {"util", "estimatepriority", &estimatepriority, true, RPC_LOCK_NONE, false, true},
 
         /* Not shown in help */
-        {"hidden", "invalidateblock", &invalidateblock, true, true, false},
-        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"hidden", "setmocktime", &setmocktime, true, false, false},
+        {"hidden", "invalidateblock", &invalidateblock, true, RPC_LOCK_NONE, false, false},
+        {"hidden", "reconsiderblock", &reconsiderblock, true, RPC_LOCK_NONE, false, false},
+        {"hidden", "setmocktime", &setmocktime, true, RPC_LOCK_MAIN, false, false},
 
         /* ROCO features */
-        {"roco", "listmasternodes", &listmasternodes, true, true, false},
-        {"roco", "getmasternodecount", &getmasternodecount, true, true, false},
-        {"roco", "masternodeconnect", &masternodeconnect, true, true, false},
-        {"roco", "masternodecurrent", &masternodecurrent, true, true, false},
-        {"roco", "masternodedebug", &masternodedebug, true, true, false},
-        {"roco", "startmasternode", &startmasternode, true, true, false},
-        {"roco", "createmasternodekey", &createmasternodekey, true, true, false},
-        {"roco", "getmasternodeoutputs", &getmasternodeoutputs, true, true, false},
-        {"roco", "listmasternodeconf", &listmasternodeconf, true, true, false},
-        {"roco", "getmasternodestatus", &getmasternodestatus, true, true, false},
-        {"roco", "getmasternodewinners", &getmasternodewinners, true, true, false},
-        {"roco", "getmasternodescores", &getmasternodescores, true, true, false},
-        {"roco", "mnsync", &mnsync, true, true, false},
-        {"roco", "spork", &spork, true, true, false},
-        {"roco", "getpoolinfo", &getpoolinfo, true, true, false},
+        {"roco", "listmasternodes", &listmasternodes, true, RPC_LOCK_NONE, false, true},
+        {"roco", "getmasternodecount", &getmasternodecount, true, RPC_LOCK_NONE, false, true},
+        {"roco", "masternodeconnect", &masternodeconnect, true, RPC_LOCK_NONE, false, false},
+        {"roco", "masternodecurrent", &masternodecurrent, true, RPC_LOCK_NONE, false, true},
+        {"roco", "masternodedebug", &masternodedebug, true, RPC_LOCK_NONE, false, true},
+        {"roco", "startmasternode", &startmasternode, true, RPC_LOCK_NONE, false, false},
+        {"roco", "createmasternodekey", &createmasternodekey, true, RPC_LOCK_NONE, false, false},
+        {"roco", "getmasternodeoutputs", &getmasternodeoutputs, true, RPC_LOCK_NONE, false, true},
+        {"roco", "listmasternodeconf", &listmasternodeconf, true, RPC_LOCK_NONE, false, true},
+        {"roco", "getmasternodestatus", &getmasternodestatus, true, RPC_LOCK_NONE, false, true},
+        {"roco", "getmasternodewinners", &getmasternodewinners, true, RPC_LOCK_NONE, false, true},
+        {"roco", "getmasternodescores", &getmasternodescores, true, RPC_LOCK_NONE, false, true},
+        {"roco", "mnsync", &mnsync, true, RPC_LOCK_NONE, false, false},
+        {"roco", "spork", &spork, true, RPC_LOCK_NONE, false, false},
+        {"roco", "getpoolinfo", &getpoolinfo, true, RPC_LOCK_NONE, false, true},
 #ifdef ENABLE_WALLET
 
         /* Wallet */
-        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
-        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
-        {"wallet", "backupwallet", &backupwallet, true, false, true},
-        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true},
-        {"wallet", "dumpwallet", &dumpwallet, true, false, true},
-        {"wallet", "bip38encrypt", &bip38encrypt, true, false, true},
-        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true},
-        {"wallet", "encryptwallet", &encryptwallet, true, false, true},
-        {"wallet", "getaccountaddress", &getaccountaddress, true, false, true},
-        {"wallet", "getaccount", &getaccount, true, false, true},
-        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, false, true},
-        {"wallet", "getbalance", &getbalance, false, false, true},
-        {"wallet", "getnewaddress", &getnewaddress, true, false, true},
-        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true},
-        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, false, true},
-        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true},
-        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
-        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
-        {"wallet", "gettransaction", &gettransaction, false, false, true},
-        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
-        {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
-        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
-        {"wallet", "listaccounts", &listaccounts, false, false, true},
-        {"wallet", "listaddressgroupings", &listaddressgroupings, false, false, true},
-        {"wallet", "listlockunspent", &listlockunspent, false, false, true},
-        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
-        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
-        {"wallet", "listsinceblock", &listsinceblock, false, false, true},
-        {"wallet", "listtransactions", &listtransactions, false, false, true},
-        {"wallet", "listunspent", &listunspent, false, false, true},
-        {"wallet", "lockunspent", &lockunspent, true, false, true},
-        {"wallet", "move", &movecmd, false, false, true},
-        {"wallet", "multisend", &multisend, false, false, true},
-        {"wallet", "sendfrom", &sendfrom, false, false, true},
-        {"wallet", "sendmany", &sendmany, false, false, true},
-        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true},
-        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true},
-        {"wallet", "setaccount", &setaccount, true, false, true},
-        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, false, true},
-        {"wallet", "settxfee", &settxfee, true, false, true},
-        {"wallet", "signmessage", &signmessage, true, false, true},
-        {"wallet", "walletlock", &walletlock, true, false, true},
-        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true},
-        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true},
+        {"wallet", "addmultisigaddress", &addmultisigaddress, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "autocombinerewards", &autocombinerewards, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "backupwallet", &backupwallet, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "dumpprivkey", &dumpprivkey, true, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "dumpwallet", &dumpwallet, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "bip38encrypt", &bip38encrypt, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "bip38decrypt", &bip38decrypt, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "encryptwallet", &encryptwallet, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "getaccountaddress", &getaccountaddress, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "getaccount", &getaccount, true, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getbalance", &getbalance, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getnewaddress", &getnewaddress, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getstakingstatus", &getstakingstatus, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "gettransaction", &gettransaction, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "getwalletinfo", &getwalletinfo, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "importprivkey", &importprivkey, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "importwallet", &importwallet, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "importaddress", &importaddress, true, RPC_LOCK_MAIN_WALLET_UNBATCHED, true, false},
+        {"wallet", "keypoolrefill", &keypoolrefill, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "listaccounts", &listaccounts, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listaddressgroupings", &listaddressgroupings, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listlockunspent", &listlockunspent, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listsinceblock", &listsinceblock, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listtransactions", &listtransactions, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "listunspent", &listunspent, false, RPC_LOCK_MAIN_WALLET, true, true},
+        {"wallet", "lockunspent", &lockunspent, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "move", &movecmd, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "multisend", &multisend, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "sendfrom", &sendfrom, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "sendmany", &sendmany, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "sendtoaddress", &sendtoaddress, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "sendtoaddressix", &sendtoaddressix, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "setaccount", &setaccount, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "settxfee", &settxfee, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "signmessage", &signmessage, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "walletlock", &walletlock, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, RPC_LOCK_MAIN_WALLET, true, false},
+        {"wallet", "walletpassphrase", &walletpassphrase, true, RPC_LOCK_MAIN_WALLET, true, false},
 #endif // ENABLE_WALLET
 };
 
+/** Commands whose results are written straight into the reply; they run without locks */
+static const struct {
+    const char* name;
+    rpcwritefn_type writer;
+} vRPCWriters[] = {
+    {"getblock", &getblock_write},
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -399,6 +601,10 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (unsigned int i = 0; i < ARRAYLEN(vRPCWriters); i++) {
+        assert(mapCommands.count(vRPCWriters[i].name) && mapCommands[vRPCWriters[i].name]->locks == RPC_LOCK_NONE);
+        mapWriters[vRPCWriters[i].name] = vRPCWriters[i].writer;
+    }
 }
 
 const CRPCCommand* CRPCTable::operator[](string name) const
@@ -488,6 +694,11 @@ public:
         _stream.close();
     }
 
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler)
+    {
+        sslStream.lowest_layer().async_read_some(asio::null_buffers(), boost::bind(handler, _1));
+    }
+
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
@@ -496,7 +707,45 @@ private:
     iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
 };
 
-void ServiceConnection(AcceptedConnection* conn);
+bool ServiceConnection(AcceptedConnection* conn);
+
+static void RPCQueueConnection(boost::shared_ptr<AcceptedConnection> conn);
+static void RPCReadableHandler(boost::shared_ptr<AcceptedConnection> conn, const boost::system::error_code& error);
+
+/** Run on a worker: answer one request, then wait for the next without holding the worker */
+static void RPCServeConnection(boost::shared_ptr<AcceptedConnection> conn)
+{
+    if (!ServiceConnection(conn.get())) {
+        conn->close();
+        return;
+    }
+    if (conn->stream().rdbuf()->in_avail() > 0) {
+        // The next request is already buffered
+        RPCQueueConnection(conn);
+        return;
+    }
+    conn->async_wait_readable(boost::bind(&RPCReadableHandler, conn, _1));
+}
+
+static void RPCReadableHandler(boost::shared_ptr<AcceptedConnection> conn, const boost::system::error_code& error)
+{
+    if (error) {
+        conn->close();
+        return;
+    }
+    RPCQueueConnection(conn);
+}
+
+static void RPCQueueConnection(boost::shared_ptr<AcceptedConnection> conn)
+{
+    if (rpc_work_queue->Enqueue(boost::bind(&RPCServeConnection, conn)))
+        return;
+    LogPrint("rpc", "RPC work queue depth exceeded, rejecting request from %s\n", conn->peer_address_to_string());
+    // Writing to an SSL stream would start the handshake on this thread
+    if (!fRPCUseSSL)
+        conn->stream() << HTTPError(HTTP_SERVICE_UNAVAILABLE, false) << std::flush;
+    conn->close();
+}
 
 //! Forward declaration required for RPCListen
 template <typename Protocol>
@@ -558,8 +807,8 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol>
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
         conn->close();
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        // Hand over to a worker once the request has arrived
+        conn->async_wait_readable(boost::bind(&RPCReadableHandler, conn, _1));
     }
 }
 
@@ -624,6 +873,7 @@ void StartRPCThreads()
     rpc_ssl_context = new ssl::context(ssl::context::sslv23);
 
     const bool fUseSSL = GetBoolArg("-rpcssl", false);
+    fRPCUseSSL = fUseSSL;
 
     if (fUseSSL) {
         rpc_ssl_context->set_options(ssl::context::no_sslv2 | ssl::context::no_sslv3);
@@ -719,9 +969,15 @@ void StartRPCThreads()
         return;
     }
 
+    // One thread runs the io_service (accepting, waiting for requests, timers),
+    // the workers execute the requests
+    nRPCWorkers = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    rpc_work_queue = new CRPCWorkQueue(std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORK_QUEUE), 1));
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < nRPCWorkers; i++)
+        rpc_worker_group->create_thread(boost::bind(&CRPCWorkQueue::Run, rpc_work_queue));
+    LogPrintf("RPC server started with %d worker threads, work queue depth %d\n", nRPCWorkers, GetArg("-rpcworkqueue", DEFAULT_RPC_WORK_QUEUE));
     fRPCRunning = true;
 }
 
@@ -762,9 +1018,14 @@ void StopRPCThreads()
     deadlineTimers.clear();
 
     rpc_io_service->stop();
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    nRPCWorkers = 0;
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -881,12 +1142,117 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/** Whether a batch entry names a read-only method */
+static bool IsReadOnlyRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->readOnly;
+}
+
+/**
+ * A run of read-only entries of a batch, executed by the thread serving the
+ * batch and by whichever RPC workers are idle. A helper queued behind other
+ * requests may only start after the batch thread ran every entry itself; it
+ * then finds nothing left and returns without touching the batch, which is
+ * why the range is shared with it rather than left on the batch's stack.
+ */
+class CRPCBatchRange
+{
+private:
+    const UniValue& vReq;
+    std::vector<UniValue>& vReply;
+    std::atomic<unsigned int> nNext;
+    const unsigned int nEnd;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! Helpers running entries, guarded by cs
+    unsigned int nRunning;
+
+    void Exec()
+    {
+        for (unsigned int i = nNext++; i < nEnd; i = nNext++)
+            vReply[i] = JSONRPCExecOne(vReq[i]);
+    }
+
+public:
+    CRPCBatchRange(const UniValue& vReqIn, std::vector<UniValue>& vReplyIn, unsigned int nBegin, unsigned int nEndIn) : vReq(vReqIn), vReply(vReplyIn), nNext(nBegin), nEnd(nEndIn), nRunning(0) {}
+
+    /** Helper body, run on an RPC worker */
+    void Help()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (nNext >= nEnd)
+                return;
+            nRunning++;
+        }
+        Exec();
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (--nRunning == 0)
+            cond.notify_all();
+    }
+
+    /** Run entries on the calling thread until none are left, then wait for the helpers that took some */
+    void Run()
+    {
+        Exec();
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nRunning > 0)
+            cond.wait(lock);
+    }
+};
+
+/**
+ * JSONRPCReply() for a single request, with the result written straight
+ * into the reply text when the method allows it.
+ */
+static string JSONRPCExecReply(const JSONRequest& jreq)
+{
+    string strReply = "{\"result\":";
+    CJSONWriter writer(strReply);
+    if (!tableRPC.executeWrite(jreq.strMethod, jreq.params, writer))
+        return JSONRPCReply(tableRPC.execute(jreq.strMethod, jreq.params), NullUniValue, jreq.id);
+    strReply += ",\"error\":null,\"id\":" + jreq.id.write() + "}\n";
+    return strReply;
+}
+
 static string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    std::vector<UniValue> vReply(vReq.size());
+    const unsigned int nMaxThreads = (unsigned int)std::max(nRPCWorkers, 1);
+
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        // Consecutive read-only calls run concurrently; anything else runs on
+        // its own, in order, so a batch still sees its own writes.
+        unsigned int nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsReadOnlyRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx < 2 || nMaxThreads < 2) {
+            vReply[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
 
+        // Idle workers help out; if none are, this thread runs them all
+        boost::shared_ptr<CRPCBatchRange> range(new CRPCBatchRange(vReq, vReply, reqIdx, nEnd));
+        for (unsigned int i = 1; i < std::min(nMaxThreads, nEnd - reqIdx); i++) {
+            if (!rpc_work_queue || !rpc_work_queue->Enqueue(boost::bind(&CRPCBatchRange::Help, range), false))
+                break;
+        }
+        range->Run();
+        reqIdx = nEnd;
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (unsigned int i = 0; i < vReply.size(); i++)
+        ret.push_back(vReply[i]);
     return ret.write() + "\n";
 }
 
@@ -932,10 +1298,7 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            strReply = JSONRPCExecReply(jreq);
 
         // array of requests
         } else if (valRequest.isArray())
@@ -954,43 +1317,46 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
+/** Read and answer one request; returns whether the connection stays open for the next one */
+bool ServiceConnection(AcceptedConnection* conn)
 {
+    if (ShutdownRequested())
+        return false;
+
     bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
+    int nProto = 0;
+    map<string, string> mapHeaders;
+    string strRequest, strMethod, strURI;
 
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+    // Read HTTP request line
+    if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
+        return false;
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
+    // Read HTTP message headers and body
+    ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
 
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
+    // HTTP Keep-Alive is false; close connection immediately
+    if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
+        fRun = false;
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API
+    if (strURI == "/") {
+        if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
+            return false;
 
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+        // Process via HTTP REST API
+    } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
+            return false;
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
+    } else {
+        conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        return false;
     }
+    return fRun && !ShutdownRequested();
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+const CRPCCommand* CRPCTable::lookup(const std::string& strMethod) const
 {
     // Find method
     const CRPCCommand* pcmd = tableRPC[strMethod];
@@ -1006,43 +1372,64 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     if (strWarning != "" && !GetBoolArg("-disablesafemode", false) &&
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
+    return pcmd;
+}
+
+bool CRPCTable::executeWrite(const std::string& strMethod, const UniValue& params, CJSONWriter& writer) const
+{
+    std::map<std::string, rpcwritefn_type>::const_iterator it = mapWriters.find(strMethod);
+    if (it == mapWriters.end())
+        return false;
+    const CRPCCommand* pcmd = lookup(strMethod);
+
+    CRPCCallTimer timer(pcmd->name);
+    try {
+        if (!it->second(params, writer)) {
+            timer.Discard();
+            return false;
+        }
+        timer.fError = false;
+        return true;
+    } catch (std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
 
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand* pcmd = lookup(strMethod);
+
+    CRPCCallTimer timer(pcmd->name);
     try {
-        // Execute
+        // Execute, blocking until the locks the command needs are ours. Always
+        // cs_main before cs_wallet, the same order the rest of the code uses.
         UniValue result;
-        {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
+        switch (pcmd->locks) {
+        case RPC_LOCK_NONE:
+            result = pcmd->actor(params, false);
+            break;
+        case RPC_LOCK_MAIN: {
+            LOCK(cs_main);
+            timer.Locked();
+            result = pcmd->actor(params, false);
+            break;
+        }
+        case RPC_LOCK_MAIN_WALLET:
+        case RPC_LOCK_MAIN_WALLET_UNBATCHED: {
 #ifdef ENABLE_WALLET
-            else if (!pwalletMain) {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            } else {
-                while (true) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (!lockMain) {
-                        MilliSleep(50);
-                        continue;
-                    }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
-                            MilliSleep(50);
-                            continue;
-                        }
-                        result = pcmd->actor(params, false);
-                        break;
-                    }
-                    break;
-                }
-            }
-#else  // ENABLE_WALLET
-            else {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            }
-#endif // !ENABLE_WALLET
+            LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+            timer.Locked();
+            bool fBatch = pwalletMain && pcmd->locks == RPC_LOCK_MAIN_WALLET && !pcmd->readOnly;
+            CDBBatch batch(fBatch ? pwalletMain->strWalletFile : "");
+#else
+            LOCK(cs_main);
+            timer.Locked();
+#endif
+            result = pcmd->actor(params, false);
+            break;
+        }
         }
+        timer.fError = false;
         return result;
     } catch (std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
@@ -23,6 +23,7 @@
 
 
 class CBlockIndex;
+class CJSONWriter;
 class CNetAddr;
 
 class AcceptedConnection
@@ -33,8 +34,15 @@ public:
     virtual std::iostream& stream() = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
+    /** Call handler on the RPC io_service once the client has sent more data */
+    virtual void async_wait_readable(const boost::function<void(const boost::system::error_code&)>& handler) = 0;
 };
 
+/** Default for -rpcthreads, the number of threads executing RPC calls */
+static const int DEFAULT_RPC_THREADS = 4;
+/** Default for -rpcworkqueue, the number of requests that may wait for a free thread */
+static const int DEFAULT_RPC_WORK_QUEUE = 16;
+
 /** Start RPC threads */
 void StartRPCThreads();
 /**
@@ -84,6 +92,22 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/**
+ * Writes the result of a command as JSON text, the same text its actor's
+ * result would write, without building it as a UniValue first. Returns false,
+ * having written nothing, to leave the call to the actor.
+ */
+typedef bool (*rpcwritefn_type)(const UniValue& params, CJSONWriter& writer);
+
+/** Locks the dispatcher holds while a command runs */
+enum RPCLockRequirement {
+    RPC_LOCK_NONE,        //!< The command takes whatever locks it needs itself
+    RPC_LOCK_MAIN,        //!< cs_main
+    RPC_LOCK_MAIN_WALLET, //!< cs_main, then the wallet lock if a wallet is loaded; the wallet writes of a
+                          //!< command that is not read-only are committed as one batch
+    RPC_LOCK_MAIN_WALLET_UNBATCHED, //!< As RPC_LOCK_MAIN_WALLET without the batch, for commands that close the
+                                    //!< wallet file or rescan the chain (which batches block by block)
+};
 
 class CRPCCommand
 {
@@ -92,8 +116,23 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
-    bool threadSafe;
+    RPCLockRequirement locks;
     bool reqWallet;
+    //! Changes no state, so it may run concurrently with other read-only calls of a batch
+    bool readOnly;
+};
+
+/** Call count and latency of one RPC method since startup */
+struct CRPCMethodStats {
+    uint64_t nCalls;
+    uint64_t nErrors;
+    //! Total time from dispatch to reply, including the wait for locks
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    //! Part of nTotalMicros spent acquiring the locks
+    int64_t nLockWaitMicros;
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0), nLockWaitMicros(0) {}
 };
 
 /**
@@ -103,6 +142,10 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    //! Commands with large results that can be written straight into the reply
+    std::map<std::string, rpcwritefn_type> mapWriters;
+
+    const CRPCCommand* lookup(const std::string& method) const;
 
 public:
     CRPCTable();
@@ -118,6 +161,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing its result into writer as JSON text when the
+     * method has a writer. Returns false, having written nothing, when the
+     * call has to go through execute() instead.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    bool executeWrite(const std::string& method, const UniValue& params, CJSONWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -157,6 +208,7 @@ extern UniValue ping(const UniValue& params, bool fHelp);
 extern UniValue addnode(const UniValue& params, bool fHelp);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp);
 extern UniValue getnettotals(const UniValue& params, bool fHelp);
+extern UniValue getnetmsginfo(const UniValue& params, bool fHelp);
 extern UniValue setban(const UniValue& params, bool fHelp);
 extern UniValue listbanned(const UniValue& params, bool fHelp);
 extern UniValue clearbanned(const UniValue& params, bool fHelp);
@@ -237,6 +289,7 @@ extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool getblock_write(const UniValue& params, CJSONWriter& writer);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getfeeinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
@@ -263,6 +316,8 @@ extern UniValue getmasternodestatus(const UniValue& params, bool fHelp);
 extern UniValue getmasternodewinners(const UniValue& params, bool fHelp);
 extern UniValue getmasternodescores(const UniValue& params, bool fHelp);
 
+extern UniValue getrpcinfo(const UniValue& params, bool fHelp); // in rpc/server.cpp
+
 extern UniValue getinfo(const UniValue& params, bool fHelp); // in rpcmisc.cpp
 extern UniValue mnsync(const UniValue& params, bool fHelp);
 extern UniValue spork(const UniValue& params, bool fHelp);
@@ -0,0 +1,136 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "spentjournal.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "random.h"
+
+CSpentOutPointJournal spentJournal;
+
+COutPointHasher::COutPointHasher() : salt(GetRandHash()) {}
+
+// requires LOCK(cs)
+CSpentOutPointJournal::CBlockSpends* CSpentOutPointJournal::Record(const CBlockIndex* pindex, const CBlock& block)
+{
+    if (pindex->nHeight < nMinHeight)
+        return NULL;
+
+    std::pair<boost::unordered_map<const CBlockIndex*, CBlockSpends>::iterator, bool> ret = mapBlocks.insert(std::make_pair(pindex, CBlockSpends()));
+    CBlockSpends& spends = ret.first->second;
+    if (!ret.second)
+        return &spends;
+
+    spends.nHeight = pindex->nHeight;
+    spends.fConnected = false;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& in : tx.vin)
+            spends.setSpent.insert(in.prevout);
+    }
+    mapHeightBuckets[pindex->nHeight].push_back(pindex);
+    return &spends;
+}
+
+bool CSpentOutPointJournal::AddBlock(const CBlockIndex* pindex, const CBlock& block)
+{
+    LOCK(cs);
+    return Record(pindex, block) != NULL;
+}
+
+bool CSpentOutPointJournal::HaveBlock(const CBlockIndex* pindex) const
+{
+    LOCK(cs);
+    return mapBlocks.count(pindex) > 0;
+}
+
+bool CSpentOutPointJournal::IsSpentBy(const CBlockIndex* pindex, const COutPoint& out) const
+{
+    LOCK(cs);
+    boost::unordered_map<const CBlockIndex*, CBlockSpends>::const_iterator it = mapBlocks.find(pindex);
+    return it != mapBlocks.end() && it->second.setSpent.count(out) > 0;
+}
+
+bool CSpentOutPointJournal::BlockSpends(const CBlock& block, const COutPoint& out)
+{
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& in : tx.vin) {
+            if (in.prevout == out)
+                return true;
+        }
+    }
+    return false;
+}
+
+void CSpentOutPointJournal::ConnectBlock(const CBlockIndex* pindex, const CBlock& block)
+{
+    LOCK(cs);
+    CBlockSpends* pspends = Record(pindex, block);
+    if (!pspends || pspends->fConnected)
+        return;
+    pspends->fConnected = true;
+    for (const COutPoint& out : pspends->setSpent)
+        mapActiveSpent[out] = pspends->nHeight;
+}
+
+void CSpentOutPointJournal::DisconnectBlock(const CBlockIndex* pindex)
+{
+    LOCK(cs);
+    boost::unordered_map<const CBlockIndex*, CBlockSpends>::iterator it = mapBlocks.find(pindex);
+    if (it == mapBlocks.end() || !it->second.fConnected)
+        return;
+    it->second.fConnected = false;
+    for (const COutPoint& out : it->second.setSpent)
+        mapActiveSpent.erase(out);
+}
+
+bool CSpentOutPointJournal::GetActiveSpendHeight(const COutPoint& out, int& nHeight) const
+{
+    LOCK(cs);
+    boost::unordered_map<COutPoint, int, COutPointHasher>::const_iterator it = mapActiveSpent.find(out);
+    if (it == mapActiveSpent.end())
+        return false;
+    nHeight = it->second;
+    return true;
+}
+
+void CSpentOutPointJournal::Prune(int nMinHeightIn)
+{
+    LOCK(cs);
+    if (nMinHeightIn <= nMinHeight)
+        return;
+    nMinHeight = nMinHeightIn;
+
+    std::map<int, std::vector<const CBlockIndex*> >::iterator bucket = mapHeightBuckets.begin();
+    while (bucket != mapHeightBuckets.end() && bucket->first < nMinHeight) {
+        for (const CBlockIndex* pindex : bucket->second) {
+            boost::unordered_map<const CBlockIndex*, CBlockSpends>::iterator it = mapBlocks.find(pindex);
+            if (it->second.fConnected) {
+                for (const COutPoint& out : it->second.setSpent)
+                    mapActiveSpent.erase(out);
+            }
+            mapBlocks.erase(it);
+        }
+        mapHeightBuckets.erase(bucket++);
+    }
+}
+
+void CSpentOutPointJournal::Clear()
+{
+    LOCK(cs);
+    mapBlocks.clear();
+    mapHeightBuckets.clear();
+    mapActiveSpent.clear();
+    nMinHeight = 0;
+}
+
+size_t CSpentOutPointJournal::GetBlockCount() const
+{
+    LOCK(cs);
+    return mapBlocks.size();
+}
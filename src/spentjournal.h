@@ -0,0 +1,92 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTJOURNAL_H
+#define BITCOIN_SPENTJOURNAL_H
+
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+class CBlock;
+class CBlockIndex;
+
+class COutPointHasher
+{
+private:
+    uint256 salt;
+
+public:
+    COutPointHasher();
+
+    size_t operator()(const COutPoint& out) const
+    {
+        return out.hash.GetHash(salt) + out.n;
+    }
+};
+
+/**
+ * Outpoints spent by each of the recent blocks, on the active chain or on a
+ * fork of it, so that a coinstake extending a fork can be checked against
+ * the blocks since the split without reading them back from disk.
+ *
+ * Blocks are kept in buckets by height and forgotten a bucket at a time
+ * once they are deeper than the maximum reorganization depth.
+ */
+class CSpentOutPointJournal
+{
+public:
+    typedef boost::unordered_set<COutPoint, COutPointHasher> spentset_type;
+
+private:
+    struct CBlockSpends {
+        int nHeight;
+        bool fConnected;
+        spentset_type setSpent;
+    };
+
+    mutable CCriticalSection cs;
+    boost::unordered_map<const CBlockIndex*, CBlockSpends> mapBlocks;
+    std::map<int, std::vector<const CBlockIndex*> > mapHeightBuckets;
+    //! Outpoints spent on the active chain, to the height of the spending block
+    boost::unordered_map<COutPoint, int, COutPointHasher> mapActiveSpent;
+    int nMinHeight;
+
+    CBlockSpends* Record(const CBlockIndex* pindex, const CBlock& block);
+
+public:
+    CSpentOutPointJournal() : nMinHeight(0) {}
+
+    /** Record the outpoints a stored block spends. Blocks below the pruned height are
+     *  not recorded and false is returned; callers must then check the block itself */
+    bool AddBlock(const CBlockIndex* pindex, const CBlock& block);
+    bool HaveBlock(const CBlockIndex* pindex) const;
+    /** Whether the recorded block spends the outpoint */
+    bool IsSpentBy(const CBlockIndex* pindex, const COutPoint& out) const;
+    /** Whether any non coinbase transaction of the block spends the outpoint */
+    static bool BlockSpends(const CBlock& block, const COutPoint& out);
+
+    /** The block joined the active chain; records it first when needed */
+    void ConnectBlock(const CBlockIndex* pindex, const CBlock& block);
+    /** The block left the active chain, it stays recorded as a fork block */
+    void DisconnectBlock(const CBlockIndex* pindex);
+    /** Height of the active chain block that spent the outpoint, if it is recorded */
+    bool GetActiveSpendHeight(const COutPoint& out, int& nHeight) const;
+
+    /** Forget the blocks below nMinHeightIn, and do not record them again */
+    void Prune(int nMinHeightIn);
+    void Clear();
+    size_t GetBlockCount() const;
+};
+
+extern CSpentOutPointJournal spentJournal;
+
+#endif // BITCOIN_SPENTJOURNAL_H
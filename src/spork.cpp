@@ -9,6 +9,7 @@
 #include "key.h"
 #include "main.h"
 #include "net.h"
+#include "netmsgtable.h"
 #include "protocol.h"
 #include "sync.h"
 #include "sporkdb.h"
@@ -108,6 +109,21 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
     }
 }
 
+static bool ProcessSporkMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    ProcessSpork(pfrom, strCommand, vRecv);
+    return true;
+}
+
+void RegisterSporkMessages(CNetMsgTable& table)
+{
+    static const CNetMsgHandler vMessages[] = {
+        {"spork", &ProcessSporkMessage, NETMSG_LOCK_NONE},
+        {"getsporks", &ProcessSporkMessage, NETMSG_LOCK_NONE},
+    };
+    table.Register(vMessages, ARRAYLEN(vMessages));
+}
+
 
 // grab the value of the spork on the network, or the default
 int64_t GetSporkValue(int nSporkID)
@@ -55,6 +55,7 @@ using namespace boost;
 
 class CSporkMessage;
 class CSporkManager;
+class CNetMsgTable;
 
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
@@ -62,6 +63,7 @@ extern CSporkManager sporkManager;
 
 void LoadSporksFromDB();
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+void RegisterSporkMessages(CNetMsgTable& table);
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
 void ReprocessBlocks(int nBlocks);
@@ -5,6 +5,8 @@
 #include "util.h"
 
 #include "allocators.h"
+#include "streams.h"
+#include "version.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -116,4 +118,53 @@ BOOST_AUTO_TEST_CASE(test_LockedPageManagerBase)
     BOOST_CHECK((last_unlock_len & (test_page_size-1)) == 0); // always unlock entire pages
 }
 
+BOOST_AUTO_TEST_CASE(test_NetBufferPool)
+{
+    CNetBufferPool& pool = CNetBufferPool::Instance();
+    const CSerializeData::allocator_type netAlloc(true);
+
+    // A freed buffer is handed out again for the next one of its size class
+    const char* pBuffer;
+    {
+        CSerializeData data(netAlloc);
+        data.reserve(1000);
+        pBuffer = &data[0];
+    }
+    size_t nCached = pool.GetCachedBytes();
+    BOOST_CHECK(nCached >= 1024);
+    {
+        CSerializeData data(netAlloc);
+        data.reserve(700);
+        BOOST_CHECK(&data[0] == pBuffer);
+        BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached - 1024);
+    }
+    BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached);
+
+    // Buffers beyond the largest size class are not kept
+    {
+        CSerializeData data(netAlloc);
+        data.reserve(((size_t)1 << CNetBufferPool::MAX_CLASS_BITS) + 1);
+    }
+    BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached);
+
+    // Moves keep the pool, copies are cleared again when freed
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION, netAlloc);
+    ss << std::string("pooled") << (uint32_t)42;
+    CDataStream ssCopy = ss;
+    BOOST_CHECK(ss.get_allocator().fNetBuffer);
+    BOOST_CHECK(!ssCopy.get_allocator().fNetBuffer);
+
+    CSerializeData data(netAlloc);
+    ss.GetAndClear(data);
+    CSerializeData moved(std::move(data));
+    BOOST_CHECK(moved.get_allocator().fNetBuffer);
+    BOOST_CHECK(moved == CSerializeData(ssCopy.begin(), ssCopy.end()));
+
+    std::string str;
+    uint32_t n;
+    ssCopy >> str >> n;
+    BOOST_CHECK_EQUAL(str, "pooled");
+    BOOST_CHECK_EQUAL(n, 42U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+CBlock BuildBlock()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(4);
+    block.vtx[0] = tx;
+    for (int i = 1; i < 4; i++) {
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].prevout.n = i;
+        block.vtx[i] = tx;
+    }
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+    block.nTime = 1577836800;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+void AddToPool(CTxMemPool& pool, const CTransaction& tx)
+{
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, 0, 0.0, 1));
+}
+
+CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs result;
+    stream >> result;
+    return result;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+BOOST_AUTO_TEST_CASE(reconstruct_from_pool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock();
+    AddToPool(pool, block.vtx[2]);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock, std::vector<const CTransaction*>()) == READ_STATUS_OK);
+    // The coinbase comes along, one is in the pool, two are left to fetch
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(3));
+
+    CBlock rebuilt;
+    std::vector<CTransaction> vtxMissing(1, block.vtx[1]);
+    BOOST_CHECK(partialBlock.FillBlock(rebuilt, vtxMissing) == READ_STATUS_INVALID);
+    vtxMissing.push_back(block.vtx[3]);
+    vtxMissing.push_back(block.vtx[3]);
+    BOOST_CHECK(partialBlock.FillBlock(rebuilt, vtxMissing) == READ_STATUS_INVALID);
+
+    // Transactions that do not add up to the merkle root are not the block's
+    vtxMissing.pop_back();
+    std::swap(vtxMissing[0], vtxMissing[1]);
+    BOOST_CHECK(partialBlock.FillBlock(rebuilt, vtxMissing) == READ_STATUS_FAILED);
+
+    std::swap(vtxMissing[0], vtxMissing[1]);
+    BOOST_CHECK(partialBlock.FillBlock(rebuilt, vtxMissing) == READ_STATUS_OK);
+    BOOST_CHECK(rebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(rebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_from_extra_txn)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock();
+    AddToPool(pool, block.vtx[1]);
+
+    std::vector<const CTransaction*> vExtraTxn;
+    vExtraTxn.push_back(&block.vtx[2]);
+    vExtraTxn.push_back(&block.vtx[3]);
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(RoundTrip(CBlockHeaderAndShortTxIDs(block)), vExtraTxn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+
+    CBlock rebuilt;
+    BOOST_CHECK(partialBlock.FillBlock(rebuilt, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(rebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(rebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(short_ids_differ_per_nonce)
+{
+    CBlock block = BuildBlock();
+    CBlockHeaderAndShortTxIDs a(block), b(block);
+    uint256 txid = block.vtx[1].GetHash();
+    BOOST_CHECK(a.GetShortID(txid) != b.GetShortID(txid));
+    BOOST_CHECK_EQUAL(a.GetShortID(txid) >> 48, 0);
+    BOOST_CHECK_EQUAL(RoundTrip(a).GetShortID(txid), a.GetShortID(txid));
+}
+
+BOOST_AUTO_TEST_CASE(block_transactions_request_serialization)
+{
+    BlockTransactionsRequest req;
+    req.blockhash = GetRandHash();
+    req.indexes.push_back(0);
+    req.indexes.push_back(1);
+    req.indexes.push_back(3);
+    req.indexes.push_back(4000);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    // Hash, count and three single byte differences ahead of the last one
+    BOOST_CHECK_EQUAL(stream.size(), 32 + 1 + 3 + 3);
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK(req2.blockhash == req.blockhash);
+    BOOST_CHECK(req2.indexes == req.indexes);
+
+    BlockTransactions resp(req);
+    BOOST_CHECK(resp.blockhash == req.blockhash);
+    BOOST_CHECK_EQUAL(resp.txn.size(), req.indexes.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "streams.h"
+
+#include <cstdio>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockimport_tests)
+
+BOOST_AUTO_TEST_CASE(pipeline_preserves_file_order)
+{
+    static const int nBlocks = 500;
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file != NULL);
+
+    std::vector<uint256> vHashes;
+    std::vector<unsigned int> vPos;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block;
+        block.nTime = i;
+        block.nNonce = i;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1 + i % 5);
+        block.vtx.push_back(tx);
+
+        // Interleave some junk the scanner has to skip over
+        if (i % 7 == 0)
+            fwrite("junk", 1, 4, file);
+
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << block;
+        unsigned int nSize = ss.size();
+        fwrite(Params().MessageStart(), 1, MESSAGE_START_SIZE, file);
+        fwrite(&nSize, sizeof(nSize), 1, file);
+        vPos.push_back(ftell(file));
+        fwrite(&ss[0], 1, ss.size(), file);
+        vHashes.push_back(block.GetHash());
+    }
+    // A truncated trailing record is dropped
+    unsigned int nTruncated = 1000;
+    fwrite(Params().MessageStart(), 1, MESSAGE_START_SIZE, file);
+    fwrite(&nTruncated, sizeof(nTruncated), 1, file);
+    rewind(file);
+
+    CBlockImportPipeline pipeline(file, 4);
+    CImportedBlock imported;
+    int n = 0;
+    while (pipeline.Next(imported)) {
+        BOOST_REQUIRE(n < nBlocks);
+        BOOST_CHECK(imported.fDeserialized);
+        BOOST_CHECK(imported.hash == vHashes[n]);
+        BOOST_CHECK_EQUAL(imported.nPos, vPos[n]);
+        // No proof of work, so the context-free checks fail
+        BOOST_CHECK(!imported.fChecked);
+        n++;
+    }
+    BOOST_CHECK_EQUAL(n, nBlocks);
+    BOOST_CHECK_EQUAL(pipeline.nCheckFailed, (uint64_t)nBlocks);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
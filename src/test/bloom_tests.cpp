@@ -8,6 +8,8 @@
 #include "clientversion.h"
 #include "key.h"
 #include "merkleblock.h"
+#include "protocol.h"
+#include "random.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
@@ -459,4 +461,43 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256("0x02981fa052f0481dbc5868f4fc2166035a10f27a03cfd2de67326471df5bc041"), 0)));
 }
 
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    // Last 100 entries, 1% false positives
+    CRollingBloomFilter rb(100, 0.01);
+
+    // Four times as many as it keeps
+    std::vector<uint256> data;
+    for (int i = 0; i < 400; i++) {
+        data.push_back(GetRandHash());
+        rb.insert(data.back());
+    }
+
+    // The last 100 are always there
+    for (int i = 300; i < 400; i++)
+        BOOST_CHECK(rb.contains(data[i]));
+
+    // The oldest are gone, but for false positives
+    unsigned int nHits = 0;
+    for (int i = 0; i < 200; i++)
+        nHits += rb.contains(data[i]);
+    BOOST_CHECK(nHits < 20);
+
+    // About 100 false positives in 10000 keys it never saw
+    nHits = 0;
+    for (int i = 0; i < 10000; i++)
+        nHits += rb.contains(GetRandHash());
+    BOOST_CHECK(nHits < 175);
+
+    rb.reset();
+    for (int i = 0; i < 400; i++)
+        BOOST_CHECK(!rb.contains(data[i]));
+
+    // Keys other than hashes
+    std::vector<unsigned char> vKey = CInv(MSG_TX, data[0]).GetKey();
+    rb.insert(vKey);
+    BOOST_CHECK(rb.contains(vKey));
+    BOOST_CHECK(!rb.contains(CInv(MSG_DSTX, data[0]).GetKey()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachefile.h"
+
+#include "util.h"
+
+#include <cstdio>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+const std::string strMagic = "CacheFileTest";
+
+boost::filesystem::path WriteTestFile(int nFormat)
+{
+    std::vector<std::pair<int, std::string> > vItems;
+    for (int i = 0; i < 1500; i++)
+        vItems.push_back(std::make_pair(i, std::string(i % 40, 'a' + i % 26)));
+
+    boost::filesystem::path path = GetDataDir() / "cachefile_test.dat";
+    CCacheFileWriter writer(strMagic, nFormat);
+    writer.WriteSection(vItems);
+    writer.WriteObject(std::string("tail"));
+    BOOST_CHECK(writer.Commit(path));
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "cachefile_test.dat.new"));
+    return path;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(cachefile_tests)
+
+BOOST_AUTO_TEST_CASE(cachefile_roundtrip)
+{
+    boost::filesystem::path path = WriteTestFile(1);
+
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        CCacheFileReader reader(nThreads);
+        BOOST_CHECK_EQUAL(reader.Open(path, strMagic, 1), CCacheFileReader::Ok);
+        std::vector<std::pair<int, std::string> > vItems;
+        BOOST_CHECK_EQUAL(reader.ReadSection(vItems), CCacheFileReader::Ok);
+        BOOST_REQUIRE_EQUAL(vItems.size(), 1500U);
+        for (int i = 0; i < 1500; i++) {
+            BOOST_CHECK_EQUAL(vItems[i].first, i);
+            BOOST_CHECK(vItems[i].second == std::string(i % 40, 'a' + i % 26));
+        }
+        std::string strTail;
+        BOOST_CHECK_EQUAL(reader.ReadObject(strTail), CCacheFileReader::Ok);
+        BOOST_CHECK_EQUAL(strTail, "tail");
+        BOOST_CHECK(reader.AtEnd());
+    }
+
+    CCacheFileReader reader(1);
+    BOOST_CHECK_EQUAL(reader.Open(path, "OtherMagic", 1), CCacheFileReader::IncorrectMagicMessage);
+    CCacheFileReader reader2(1);
+    BOOST_CHECK_EQUAL(reader2.Open(path, strMagic, 2), CCacheFileReader::IncorrectFormat);
+
+    boost::filesystem::remove(path);
+    CCacheFileReader reader3(1);
+    BOOST_CHECK_EQUAL(reader3.Open(path, strMagic, 1), CCacheFileReader::FileError);
+}
+
+BOOST_AUTO_TEST_CASE(cachefile_corrupt_chunk)
+{
+    boost::filesystem::path path = WriteTestFile(1);
+
+    // Flip a byte in the middle of the first section
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, boost::filesystem::file_size(path) / 2, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, -1, SEEK_CUR);
+    fputc(ch ^ 0x20, file);
+    fclose(file);
+
+    CCacheFileReader reader(4);
+    BOOST_CHECK_EQUAL(reader.Open(path, strMagic, 1), CCacheFileReader::Ok);
+    std::vector<std::pair<int, std::string> > vItems;
+    BOOST_CHECK_EQUAL(reader.ReadSection(vItems), CCacheFileReader::IncorrectHash);
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,256 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainsnapshot.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "txdb.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+/** A run of linked block index entries; hashes are made up */
+struct CFakeBranch {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    CFakeBranch(CBlockIndex* pindexFork, int nLength, unsigned int nSalt) : vHashes(nLength), vIndex(nLength)
+    {
+        for (int i = 0; i < nLength; i++) {
+            vHashes[i] = uint256((uint64_t)nSalt << 32 | (unsigned int)i);
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i ? &vIndex[i - 1] : pindexFork;
+            vIndex[i].nHeight = vIndex[i].pprev ? vIndex[i].pprev->nHeight + 1 : 0;
+        }
+    }
+
+    CBlockIndex* Tip() { return &vIndex.back(); }
+};
+
+/** Every height leads to the entry with that height, and each links to the one below */
+bool IsConsistent(const CChainSnapshot& snapshot)
+{
+    if (snapshot.Tip() == NULL || snapshot.Tip()->nHeight != snapshot.Height())
+        return false;
+    for (int nHeight = snapshot.Height(); nHeight > 0; nHeight -= 97) {
+        const CBlockIndex* pindex = snapshot[nHeight];
+        if (pindex->nHeight != nHeight || pindex->pprev != snapshot[nHeight - 1] || snapshot.Next(pindex->pprev) != pindex)
+            return false;
+    }
+    return true;
+}
+
+void ReadSnapshots(std::atomic<bool>* pfStop, std::atomic<unsigned int>* pnBad, std::atomic<unsigned int>* pnReads)
+{
+    while (!*pfStop) {
+        CChainSnapshotRef snapshot = GetChainSnapshot();
+        if (!snapshot || !IsConsistent(*snapshot))
+            (*pnBad)++;
+        (*pnReads)++;
+    }
+}
+
+/** Put the real chain back for the tests that follow */
+void RestoreChainSnapshot()
+{
+    LOCK(cs_main);
+    ChainSnapshotCoinsFlushed();
+    PublishChainSnapshot(chainActive, pindexBestHeader);
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(chainsnapshot_tests)
+
+BOOST_AUTO_TEST_CASE(height_index)
+{
+    const int nLength = 3 * CHAIN_SNAPSHOT_CHUNK_SIZE + 10;
+    CFakeBranch main(NULL, nLength, 1);
+    CChain chain;
+    chain.SetTip(main.Tip());
+    {
+        LOCK(cs_main);
+        PublishChainSnapshot(chain, main.Tip());
+    }
+    CChainSnapshotRef snapshot1 = GetChainSnapshot();
+    BOOST_REQUIRE(snapshot1);
+    BOOST_CHECK_EQUAL(snapshot1->Height(), nLength - 1);
+    BOOST_CHECK(snapshot1->Tip() == main.Tip());
+    BOOST_CHECK(snapshot1->BestHeader() == main.Tip());
+    for (int i = 0; i < nLength; i++)
+        BOOST_CHECK(snapshot1->Contains(&main.vIndex[i]));
+    BOOST_CHECK((*snapshot1)[nLength] == NULL);
+    BOOST_CHECK((*snapshot1)[-1] == NULL);
+    BOOST_CHECK(snapshot1->Next(main.Tip()) == NULL);
+    BOOST_CHECK(IsConsistent(*snapshot1));
+
+    // Reorg onto a branch forking off in the second chunk
+    const int nFork = CHAIN_SNAPSHOT_CHUNK_SIZE + 5;
+    CFakeBranch fork(&main.vIndex[nFork], 2 * CHAIN_SNAPSHOT_CHUNK_SIZE, 2);
+    chain.SetTip(fork.Tip());
+    {
+        LOCK(cs_main);
+        PublishChainSnapshot(chain, fork.Tip());
+    }
+    CChainSnapshotRef snapshot2 = GetChainSnapshot();
+    BOOST_CHECK_EQUAL(snapshot2->Height(), nFork + 2 * CHAIN_SNAPSHOT_CHUNK_SIZE);
+    BOOST_CHECK(snapshot2->Contains(&main.vIndex[nFork]));
+    BOOST_CHECK(!snapshot2->Contains(&main.vIndex[nFork + 1]));
+    BOOST_CHECK(snapshot2->Next(&main.vIndex[nFork]) == &fork.vIndex[0]);
+    BOOST_CHECK(IsConsistent(*snapshot2));
+
+    // The earlier snapshot still shows the chain as it was
+    BOOST_CHECK(snapshot1->Tip() == main.Tip());
+    BOOST_CHECK(snapshot1->Contains(&main.vIndex[nFork + 1]));
+    BOOST_CHECK(IsConsistent(*snapshot1));
+
+    // And back to a shorter chain
+    chain.SetTip(&main.vIndex[10]);
+    {
+        LOCK(cs_main);
+        PublishChainSnapshot(chain, fork.Tip());
+    }
+    CChainSnapshotRef snapshot3 = GetChainSnapshot();
+    BOOST_CHECK_EQUAL(snapshot3->Height(), 10);
+    BOOST_CHECK(!snapshot3->Contains(&fork.vIndex[0]));
+    BOOST_CHECK(IsConsistent(*snapshot3));
+
+    RestoreChainSnapshot();
+}
+
+BOOST_AUTO_TEST_CASE(readers_during_reorgs)
+{
+    const int nLength = 2 * CHAIN_SNAPSHOT_CHUNK_SIZE;
+    CFakeBranch main(NULL, nLength, 3);
+    std::vector<CFakeBranch*> vForks;
+    for (int i = 0; i < 8; i++)
+        vForks.push_back(new CFakeBranch(&main.vIndex[nLength - 1 - GetRand(nLength / 2)], 1 + GetRand(200), 4 + i));
+
+    std::atomic<bool> fStop(false);
+    std::atomic<unsigned int> nBad(0);
+    std::atomic<unsigned int> nReads(0);
+    CChain chain;
+    chain.SetTip(main.Tip());
+    {
+        LOCK(cs_main);
+        PublishChainSnapshot(chain, main.Tip());
+    }
+    boost::thread_group readers;
+    for (int i = 0; i < 4; i++)
+        readers.create_thread(boost::bind(&ReadSnapshots, &fStop, &nBad, &nReads));
+
+    // Switch between the branches while the readers keep looking
+    for (int i = 0; i < 500; i++) {
+        CFakeBranch* branch = vForks[GetRand(vForks.size())];
+        LOCK(cs_main);
+        chain.SetTip(i % 3 == 0 ? main.Tip() : branch->Tip());
+        PublishChainSnapshot(chain, branch->Tip());
+    }
+    fStop = true;
+    readers.join_all();
+
+    BOOST_CHECK_EQUAL(nBad, 0U);
+    BOOST_CHECK(nReads > 0);
+
+    RestoreChainSnapshot();
+    for (CFakeBranch* branch : vForks)
+        delete branch;
+}
+
+BOOST_AUTO_TEST_CASE(coin_layers)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 5;
+    mtx.vout[1].nValue = 7;
+    CTransaction tx(mtx);
+    CBlock block1;
+    block1.vtx.push_back(tx);
+
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(1);
+    mtxSpend.vin[0].prevout = COutPoint(tx.GetHash(), 0);
+    mtxSpend.vout.resize(1);
+    mtxSpend.vout[0].nValue = 3;
+    CTransaction txSpend(mtxSpend);
+    CBlock block2;
+    block2.vtx.push_back(txSpend);
+
+    CCoins coins;
+    {
+        LOCK(cs_main);
+        ChainSnapshotCoinsFlushed();
+        CCoinsViewCache view(pcoinsTip);
+        *view.ModifyCoins(tx.GetHash()) = CCoins(tx, 1);
+        ChainSnapshotBlockApplied(block1, view);
+        PublishChainSnapshot(chainActive, pindexBestHeader);
+    }
+    CChainSnapshotRef snapshot1 = GetChainSnapshot();
+    BOOST_REQUIRE(snapshot1->HaveCoinsView());
+    BOOST_REQUIRE(snapshot1->GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 2U);
+    BOOST_CHECK(!snapshot1->GetCoins(mtx.vin[0].prevout.hash, coins));
+
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        *view.ModifyCoins(tx.GetHash()) = CCoins(tx, 1);
+        view.ModifyCoins(tx.GetHash())->Spend(0);
+        *view.ModifyCoins(txSpend.GetHash()) = CCoins(txSpend, 2);
+        ChainSnapshotBlockApplied(block2, view);
+        PublishChainSnapshot(chainActive, pindexBestHeader);
+    }
+    CChainSnapshotRef snapshot2 = GetChainSnapshot();
+    BOOST_REQUIRE(snapshot2->GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK(coins.vout[0].IsNull());
+    BOOST_CHECK(!coins.vout[1].IsNull());
+    BOOST_CHECK(snapshot2->GetCoins(txSpend.GetHash(), coins));
+
+    // The first snapshot is unaffected by the second block
+    BOOST_REQUIRE(snapshot1->GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK(!coins.vout[0].IsNull());
+    BOOST_CHECK(!snapshot1->GetCoins(txSpend.GetHash(), coins));
+
+    // After a flush the layers are gone and the database has nothing of this
+    RestoreChainSnapshot();
+    BOOST_CHECK(!GetChainSnapshot()->GetCoins(tx.GetHash(), coins));
+}
+
+BOOST_AUTO_TEST_CASE(db_snapshot_outlives_view)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 5;
+    CTransaction tx(mtx);
+
+    CCoinsViewDB* pdb = new CCoinsViewDB(1 << 20, true);
+    {
+        CCoinsViewCache cache(pdb);
+        *cache.ModifyCoins(tx.GetHash()) = CCoins(tx, 1);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_REQUIRE(cache.Flush());
+    }
+    boost::scoped_ptr<CCoinsViewDBSnapshot> psnapshot(pdb->NewSnapshot());
+    uint256 hashBest = pdb->GetBestBlock();
+
+    // The database stays open for the snapshot after its view is deleted, as on shutdown or reindex
+    delete pdb;
+    CCoins coins;
+    BOOST_CHECK(psnapshot->GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 1U);
+    BOOST_CHECK(psnapshot->GetBestBlock() == hashBest);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
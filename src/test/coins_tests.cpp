@@ -17,6 +17,7 @@ class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
     std::map<uint256, CCoins> map_;
+    CUTXOStats stats_;
 
 public:
     bool GetCoins(const uint256& txid, CCoins& coins) const
@@ -41,7 +42,7 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -53,11 +54,34 @@ public:
         }
         mapCoins.clear();
         hashBestBlock_ = hashBlock;
+        stats_ += statsDelta;
         return true;
     }
 
     bool GetStats(CCoinsStats& stats) const { return false; }
+
+    bool GetUTXOStats(CUTXOStats& stats) const
+    {
+        stats = stats_;
+        return true;
+    }
 };
+
+CUTXOStats StatsFromScratch(const std::map<uint256, CCoins>& result)
+{
+    CUTXOStats stats;
+    for (std::map<uint256, CCoins>::const_iterator it = result.begin(); it != result.end(); it++)
+        stats.AddCoins(it->first, it->second);
+    return stats;
+}
+
+void CheckStatsCounters(const CUTXOStats& stats, const CUTXOStats& expected)
+{
+    BOOST_CHECK_EQUAL(stats.nTransactions, expected.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+}
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -106,6 +130,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             CCoins& coins = result[txid];
             CCoinsModifier entry = stack.back()->ModifyCoins(txid);
             BOOST_CHECK(coins == *entry);
+            stack.back()->StatsDelta().RemoveCoins(txid, coins);
             if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
                 if (coins.IsPruned()) {
                     added_an_entry = true;
@@ -121,6 +146,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 entry->Clear();
                 removed_an_entry = true;
             }
+            stack.back()->StatsDelta().AddCoins(txid, coins);
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
@@ -135,6 +161,9 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                     missed_an_entry = true;
                 }
             }
+            CUTXOStats stats;
+            BOOST_CHECK(stack.back()->GetUTXOStats(stats));
+            CheckStatsCounters(stats, StatsFromScratch(result));
         }
 
         if (insecure_rand() % 100 == 0) {
@@ -159,6 +188,16 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         }
     }
 
+    // The statistics passed down the stack describe the same set as a count
+    // from scratch, down to the digest.
+    CUTXOStats stats;
+    BOOST_CHECK(stack.back()->GetUTXOStats(stats));
+    CCoinsStats expected, actual;
+    StatsFromScratch(result).GetStats(expected);
+    stats.GetStats(actual);
+    BOOST_CHECK_EQUAL(actual.nTransactions, expected.nTransactions);
+    BOOST_CHECK(actual.hashMuHash == expected.hashMuHash);
+
     // Clean up the stack.
     while (stack.size() > 0) {
         delete stack.back();
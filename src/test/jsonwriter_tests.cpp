@@ -0,0 +1,203 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include "chainparams.h"
+#include "core_io.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "utilstrencodings.h"
+
+#include <limits>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails);
+extern void blockToJSONWriter(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONWriter& writer);
+
+namespace
+{
+std::string WriteTx(const CTransaction& tx)
+{
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginObject();
+    TxToJSONWriter(tx, writer);
+    writer.EndObject();
+    return str;
+}
+
+std::string TxToUnivString(const CTransaction& tx)
+{
+    UniValue entry(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), entry);
+    return entry.write();
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(jsonwriter_tests)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_values)
+{
+    std::string strAll;
+    for (int i = 0; i < 256; i++)
+        strAll += (char)i;
+
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginObject();
+    writer.Key("all");
+    writer.String(strAll);
+    writer.Key("key \"quoted\"\n");
+    writer.String("");
+    writer.Key("ints");
+    writer.BeginArray();
+    writer.Int(0);
+    writer.Int(-1);
+    writer.Int(std::numeric_limits<int64_t>::min());
+    writer.Int(std::numeric_limits<int64_t>::max());
+    writer.UInt(std::numeric_limits<uint64_t>::max());
+    writer.EndArray();
+    writer.Key("reals");
+    writer.BeginArray();
+    writer.Real(0);
+    writer.Real(1.0 / 3);
+    writer.Real(123456789.123456789);
+    writer.Real(1e-20);
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.Key("nested");
+    writer.BeginArray();
+    writer.BeginArray();
+    writer.EndArray();
+    writer.BeginObject();
+    writer.Key("a");
+    writer.Null();
+    writer.Key("b");
+    writer.Bool(true);
+    writer.EndObject();
+    writer.Bool(false);
+    writer.EndArray();
+    writer.EndObject();
+
+    UniValue ints(UniValue::VARR);
+    ints.push_back((int64_t)0);
+    ints.push_back((int64_t)-1);
+    ints.push_back(std::numeric_limits<int64_t>::min());
+    ints.push_back(std::numeric_limits<int64_t>::max());
+    ints.push_back(std::numeric_limits<uint64_t>::max());
+    UniValue reals(UniValue::VARR);
+    reals.push_back(UniValue(0.0));
+    reals.push_back(UniValue(1.0 / 3));
+    reals.push_back(UniValue(123456789.123456789));
+    reals.push_back(UniValue(1e-20));
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("a", NullUniValue));
+    inner.push_back(Pair("b", true));
+    UniValue nested(UniValue::VARR);
+    nested.push_back(UniValue(UniValue::VARR));
+    nested.push_back(inner);
+    nested.push_back(UniValue(false));
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("all", strAll));
+    obj.push_back(Pair("key \"quoted\"\n", ""));
+    obj.push_back(Pair("ints", ints));
+    obj.push_back(Pair("reals", reals));
+    obj.push_back(Pair("empty", UniValue(UniValue::VOBJ)));
+    obj.push_back(Pair("nested", nested));
+
+    BOOST_CHECK_EQUAL(str, obj.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_hex)
+{
+    std::vector<unsigned char> vch;
+    for (int i = 0; i < 256; i++)
+        vch.push_back(i);
+    uint256 hash = GetRandHash();
+
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginArray();
+    writer.Hex(vch);
+    writer.Hex(std::vector<unsigned char>());
+    writer.Hash(hash);
+    writer.EndArray();
+
+    BOOST_CHECK_EQUAL(str, "[\"" + HexStr(vch) + "\",\"\",\"" + hash.GetHex() + "\"]");
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_transactions)
+{
+    CPubKey pubkey(ParseHex("0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798"));
+    CPubKey pubkey2(ParseHex("04678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5f"));
+    std::vector<CPubKey> vKeys;
+    vKeys.push_back(pubkey);
+    vKeys.push_back(pubkey2);
+
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    mtx.nLockTime = 0xfffffffe;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 7);
+    mtx.vin[0].scriptSig << std::vector<unsigned char>(72, 0x30) << ToByteVector(pubkey);
+    mtx.vin[1].prevout = COutPoint(GetRandHash(), 0xffffffff);
+    mtx.vin[1].nSequence = 5;
+    mtx.vout.resize(6);
+    mtx.vout[0].nValue = 0;
+    mtx.vout[1].nValue = 1;
+    mtx.vout[1].scriptPubKey = GetScriptForDestination(pubkey.GetID());
+    mtx.vout[2].nValue = 21000000 * COIN + 12345678;
+    mtx.vout[2].scriptPubKey = GetScriptForDestination(CScriptID(mtx.vout[1].scriptPubKey));
+    mtx.vout[3].nValue = 50 * COIN;
+    mtx.vout[3].scriptPubKey = GetScriptForMultisig(1, vKeys);
+    mtx.vout[4].nValue = COIN / 10;
+    mtx.vout[4].scriptPubKey << OP_RETURN << std::vector<unsigned char>(40, 'x');
+    mtx.vout[5].nValue = 3;
+    mtx.vout[5].scriptPubKey = CScript() << OP_1 << OP_IF << std::vector<unsigned char>(3, '"');
+    CTransaction tx(mtx);
+    BOOST_CHECK_EQUAL(WriteTx(tx), TxToUnivString(tx));
+
+    CMutableTransaction mtxCoinbase;
+    mtxCoinbase.vin.resize(1);
+    mtxCoinbase.vin[0].scriptSig = CScript() << 1234 << OP_0;
+    mtxCoinbase.vout.resize(1);
+    mtxCoinbase.vout[0].nValue = 250 * COIN;
+    mtxCoinbase.vout[0].scriptPubKey = CScript() << ToByteVector(pubkey) << OP_CHECKSIG;
+    CTransaction txCoinbase(mtxCoinbase);
+    BOOST_CHECK_EQUAL(WriteTx(txCoinbase), TxToUnivString(txCoinbase));
+
+    BOOST_CHECK_EQUAL(WriteTx(CTransaction()), TxToUnivString(CTransaction()));
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_block)
+{
+    const CBlock& block = Params().GenesisBlock();
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Genesis();
+    }
+    BOOST_REQUIRE(pindex);
+
+    for (int i = 0; i < 2; i++) {
+        std::string str;
+        CJSONWriter writer(str);
+        blockToJSONWriter(block, pindex, i, writer);
+        BOOST_CHECK_EQUAL(str, blockToJSON(block, pindex, i).write());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+BOOST_AUTO_TEST_CASE(find_stake_kernel)
+{
+    std::vector<CStakeCandidate> vCandidates;
+    for (int i = 0; i < 3; i++) {
+        CStakeCandidate candidate;
+        candidate.prevout = COutPoint(GetRandHash(), i);
+        candidate.nValue = 1000 * COIN;
+        candidate.nTimeBlockFrom = 1500000000 + 100 * i;
+        candidate.nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        vCandidates.push_back(candidate);
+    }
+
+    size_t nCandidate;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+    uint64_t nHashes = 0;
+
+    // No hash meets a zero target: every timestamp not older than the
+    // block of its output is hashed once
+    BOOST_CHECK(!FindStakeKernel(vCandidates, 0, 1500000150, 1500000249, nCandidate, nTimeTx, hashProofOfStake, nHashes));
+    BOOST_CHECK_EQUAL(nHashes, 100U + 100U + 50U);
+
+    // A target about one in 64 hashes meets; the first hit in candidate
+    // order, latest time first, is taken
+    unsigned int nBits = uint256(~uint256(0) >> 36).GetCompact();
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    size_t nExpectedCandidate = 0;
+    unsigned int nExpectedTime = 0;
+    uint64_t nExpectedHashes = 0;
+    for (size_t i = 0; i < vCandidates.size() && !nExpectedTime; i++) {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << vCandidates[i].nStakeModifier;
+        for (unsigned int nTime = 1500000249; nTime >= std::max(1500000150U, vCandidates[i].nTimeBlockFrom); nTime--) {
+            nExpectedHashes++;
+            uint256 hash = stakeHash(nTime, ss, vCandidates[i].prevout.n, vCandidates[i].prevout.hash, vCandidates[i].nTimeBlockFrom);
+            if (stakeTargetHit(hash, vCandidates[i].nValue, bnTargetPerCoinDay)) {
+                nExpectedCandidate = i;
+                nExpectedTime = nTime;
+                break;
+            }
+        }
+    }
+
+    nHashes = 0;
+    BOOST_CHECK_EQUAL(FindStakeKernel(vCandidates, nBits, 1500000150, 1500000249, nCandidate, nTimeTx, hashProofOfStake, nHashes), nExpectedTime != 0);
+    BOOST_CHECK_EQUAL(nHashes, nExpectedHashes);
+    if (nExpectedTime) {
+        BOOST_CHECK_EQUAL(nCandidate, nExpectedCandidate);
+        BOOST_CHECK_EQUAL(nTimeTx, nExpectedTime);
+        BOOST_CHECK(stakeTargetHit(hashProofOfStake, vCandidates[nCandidate].nValue, bnTargetPerCoinDay));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "main.h"
+#include "mappedfile.h"
+#include "streams.h"
+#include "util.h"
+
+#include <cstdio>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(mappedfile_tests)
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)0x01020304 << std::string("roco");
+    std::vector<char> vch(ss.begin(), ss.end());
+
+    CSpanReader reader(&vch[0], &vch[0] + vch.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "roco");
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(cache_remaps_grown_file)
+{
+    boost::filesystem::path path = GetDataDir() / "mappedfile_test.dat";
+    FILE* file = fopen(path.string().c_str(), "wb");
+    BOOST_REQUIRE(file != NULL);
+    std::vector<char> vch(1000, 'a');
+    fwrite(&vch[0], 1, vch.size(), file);
+    fflush(file);
+
+    CMappedFileCache cache(2);
+    MappedFileRef mapping = cache.Get(path, 1000);
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(mapping->size(), 1000U);
+    BOOST_CHECK(cache.Get(path, 500) == mapping);
+
+    // Grow the file; a read past the old end gets a fresh mapping, while the
+    // old one stays usable for whoever still holds it
+    fwrite(&vch[0], 1, vch.size(), file);
+    fclose(file);
+    MappedFileRef mappingGrown = cache.Get(path, 2000);
+    BOOST_REQUIRE(mappingGrown);
+    BOOST_CHECK_EQUAL(mappingGrown->size(), 2000U);
+    BOOST_CHECK(mapping->begin()[999] == 'a');
+    BOOST_CHECK(!cache.Get(path, 2001));
+
+    mapping.reset();
+    mappingGrown.reset();
+    cache.Clear();
+    boost::filesystem::remove(path);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(read_block_from_mapped_file)
+{
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    BOOST_REQUIRE(pindexGenesis != NULL);
+
+    // Twice, the second time from the cached mapping
+    for (int i = 0; i < 2; i++) {
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindexGenesis));
+        BOOST_CHECK(block.GetHash() == Params().HashGenesisBlock());
+        BOOST_CHECK(block.BuildMerkleTree() == block.hashMerkleRoot);
+    }
+
+    // The raw bytes are exactly the block's network serialization
+    std::vector<char> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindexGenesis));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << Params().GenesisBlock();
+    BOOST_CHECK(std::vector<char>(ss.begin(), ss.end()) == vchBlock);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
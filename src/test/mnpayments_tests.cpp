@@ -0,0 +1,153 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+
+#include "random.h"
+#include "util.h"
+
+#include <cstdio>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+CScript PayeeScript(unsigned char n)
+{
+    return CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+/** A vote for payee at nHeight; signatures are only checked on receipt, never here */
+CMasternodePaymentWinner Vote(int nHeight, const CScript& payee)
+{
+    CMasternodePaymentWinner winner(CTxIn(COutPoint(GetRandHash(), 0)));
+    winner.nBlockHeight = nHeight;
+    winner.AddPayee(payee, CMasternode::LevelValue::MIN);
+    winner.vchSig.assign(65, (unsigned char)nHeight);
+    return winner;
+}
+
+/** Flip one byte of the file at nPos, counted from the end when negative */
+void CorruptFile(const boost::filesystem::path& path, long nPos)
+{
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, nPos, nPos < 0 ? SEEK_END : SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, -1, SEEK_CUR);
+    fputc(ch ^ 0x20, file);
+    fclose(file);
+}
+} // anon namespace
+
+// The test chain is only the genesis block: votes can be added for any
+// height up to 100, and those more than 1000 blocks below it are expired.
+BOOST_AUTO_TEST_SUITE(mnpayments_tests)
+
+BOOST_AUTO_TEST_CASE(mnpayments_votes_by_height_and_payee)
+{
+    CMasternodePayments payments;
+    CScript payeeA = PayeeScript(1), payeeB = PayeeScript(2);
+
+    CMasternodePaymentWinner vote1 = Vote(50, payeeA), vote2 = Vote(50, payeeA), vote3 = Vote(50, payeeB), vote4 = Vote(60, payeeA);
+    BOOST_CHECK(payments.AddWinningMasternode(vote1));
+    BOOST_CHECK(payments.AddWinningMasternode(vote2));
+    BOOST_CHECK(payments.AddWinningMasternode(vote3));
+    BOOST_CHECK(payments.AddWinningMasternode(vote4));
+    BOOST_CHECK(!payments.AddWinningMasternode(vote1));
+
+    BOOST_CHECK_EQUAL(payments.GetVotesAtHeight(50).size(), 3U);
+    BOOST_CHECK_EQUAL(payments.GetVotesAtHeight(60).size(), 1U);
+    BOOST_CHECK(payments.GetVotesAtHeight(60)[0] == vote4.GetHash());
+    BOOST_CHECK(payments.GetVotesAtHeight(70).empty());
+
+    std::set<int> setHeightsA = payments.GetPayeeHeights(payeeA);
+    BOOST_CHECK_EQUAL(setHeightsA.size(), 2U);
+    BOOST_CHECK(setHeightsA.count(50) && setHeightsA.count(60));
+    BOOST_CHECK_EQUAL(payments.GetPayeeHeights(payeeB).size(), 1U);
+    BOOST_CHECK(payments.GetPayeeHeights(PayeeScript(3)).empty());
+
+    // The payee with the most votes wins the block
+    CScript payee;
+    BOOST_CHECK(payments.GetBlockPayee(50, CMasternode::LevelValue::MIN, payee));
+    BOOST_CHECK(payee == payeeA);
+    BOOST_CHECK(!payments.GetBlockPayee(70, CMasternode::LevelValue::MIN, payee));
+
+    CMasternodePaymentWinner winner;
+    BOOST_CHECK(payments.GetVote(vote3.GetHash(), winner));
+    BOOST_CHECK(winner.payee == payeeB);
+    BOOST_CHECK_EQUAL(winner.nBlockHeight, 50);
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_clean_both_indexes)
+{
+    CMasternodePayments payments;
+    CScript payeeA = PayeeScript(1), payeeB = PayeeScript(2);
+
+    CMasternodePaymentWinner voteOldA = Vote(-1500, payeeA), voteOldB = Vote(-1500, payeeB), voteNewA = Vote(50, payeeA);
+    BOOST_CHECK(payments.AddWinningMasternode(voteOldA));
+    BOOST_CHECK(payments.AddWinningMasternode(voteOldB));
+    BOOST_CHECK(payments.AddWinningMasternode(voteNewA));
+
+    payments.CleanPaymentList();
+
+    BOOST_CHECK(payments.GetVotesAtHeight(-1500).empty());
+    BOOST_CHECK(!payments.HasVote(voteOldA.GetHash()));
+    BOOST_CHECK(!payments.HasVote(voteOldB.GetHash()));
+    BOOST_CHECK(!payments.mapMasternodeBlocks.count(-1500));
+
+    // A payee left with no votes is dropped, the others keep their recent heights
+    BOOST_CHECK(payments.GetPayeeHeights(payeeB).empty());
+    std::set<int> setHeightsA = payments.GetPayeeHeights(payeeA);
+    BOOST_CHECK_EQUAL(setHeightsA.size(), 1U);
+    BOOST_CHECK(setHeightsA.count(50));
+    BOOST_CHECK(payments.HasVote(voteNewA.GetHash()));
+    BOOST_CHECK_EQUAL(payments.GetVotesAtHeight(50).size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_file_roundtrip)
+{
+    CMasternodePayments payments;
+    std::vector<CMasternodePaymentWinner> vVotes;
+    for (int i = 0; i < 40; i++) {
+        vVotes.push_back(Vote(i % 10, PayeeScript(i % 3)));
+        BOOST_CHECK(payments.AddWinningMasternode(vVotes.back()));
+    }
+
+    boost::filesystem::path path = GetDataDir() / "mnpayments.dat";
+    CMasternodePaymentDB paymentdb;
+    BOOST_REQUIRE(paymentdb.Write(payments));
+
+    CMasternodePayments loaded;
+    BOOST_CHECK_EQUAL(paymentdb.Read(loaded, true), CMasternodePaymentDB::Ok);
+    for (const CMasternodePaymentWinner& vote : vVotes) {
+        CMasternodePaymentWinner winner;
+        BOOST_REQUIRE(loaded.GetVote(vote.GetHash(), winner));
+        BOOST_CHECK_EQUAL(winner.nBlockHeight, vote.nBlockHeight);
+        BOOST_CHECK(winner.payee == vote.payee);
+        BOOST_CHECK(winner.vchSig == vote.vchSig);
+    }
+    for (int nHeight = 0; nHeight < 10; nHeight++)
+        BOOST_CHECK_EQUAL(loaded.GetVotesAtHeight(nHeight).size(), 4U);
+    for (unsigned char n = 0; n < 3; n++)
+        BOOST_CHECK(loaded.GetPayeeHeights(PayeeScript(n)) == payments.GetPayeeHeights(PayeeScript(n)));
+
+    // The first byte of the magic message, after its length
+    CorruptFile(path, 1);
+    CMasternodePayments badMagic;
+    BOOST_CHECK_EQUAL(paymentdb.Read(badMagic, true), CMasternodePaymentDB::IncorrectMagicMessage);
+    BOOST_CHECK(badMagic.GetVotesAtHeight(0).empty());
+
+    // The last vote byte, right before the checksum of its chunk
+    BOOST_REQUIRE(paymentdb.Write(payments));
+    CorruptFile(path, -33);
+    CMasternodePayments badHash;
+    BOOST_CHECK_EQUAL(paymentdb.Read(badHash, true), CMasternodePaymentDB::IncorrectHash);
+    BOOST_CHECK(badHash.GetVotesAtHeight(0).empty());
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
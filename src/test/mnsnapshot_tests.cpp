@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-snapshot.h"
+
+#include "key.h"
+#include "masternode.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+std::vector<CMasternodeBroadcast> SignedBroadcasts(int nCount)
+{
+    std::vector<CMasternodeBroadcast> vMnb;
+    for (int i = 0; i < nCount; i++) {
+        CKey keyCollateral, keyMasternode;
+        keyCollateral.MakeNewKey(true);
+        keyMasternode.MakeNewKey(true);
+        CTxIn vin(COutPoint(GetRandHash(), i));
+        CMasternodeBroadcast mnb(CService("10.1.0.1", 32323 + i), vin, keyCollateral.GetPubKey(), keyMasternode.GetPubKey(), 70017);
+        mnb.lastPing.vin = vin;
+        mnb.lastPing.blockHash = uint256(i % 3);
+        mnb.lastPing.sigTime = 1500000000 + i;
+        mnb.lastPing.vchSig.assign(65, i);
+        BOOST_CHECK(mnb.Sign(keyCollateral));
+        vMnb.push_back(mnb);
+    }
+    return vMnb;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(mnsnapshot_tests)
+
+BOOST_AUTO_TEST_CASE(mnsnapshot_roundtrip)
+{
+    std::vector<CMasternodeBroadcast> vMnb = SignedBroadcasts(5);
+    // An entry without a ping of its own
+    vMnb[2].lastPing = CMasternodePing();
+
+    CMasternodeListSnapshot snapshot;
+    snapshot.Pack(vMnb);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << snapshot;
+    CMasternodeListSnapshot snapshot2;
+    ss >> snapshot2;
+
+    std::vector<CMasternodeBroadcast> vOut;
+    std::string strError;
+    BOOST_CHECK(snapshot2.Unpack(vOut, strError));
+    BOOST_CHECK_EQUAL(vOut.size(), vMnb.size());
+    for (size_t i = 0; i < vOut.size(); i++) {
+        BOOST_CHECK(vOut[i].vin == vMnb[i].vin);
+        BOOST_CHECK(vOut[i].addr == vMnb[i].addr);
+        BOOST_CHECK(vOut[i].pubKeyCollateralAddress == vMnb[i].pubKeyCollateralAddress);
+        BOOST_CHECK(vOut[i].pubKeyMasternode == vMnb[i].pubKeyMasternode);
+        BOOST_CHECK(vOut[i].sig == vMnb[i].sig);
+        BOOST_CHECK_EQUAL(vOut[i].sigTime, vMnb[i].sigTime);
+        BOOST_CHECK_EQUAL(vOut[i].protocolVersion, vMnb[i].protocolVersion);
+        BOOST_CHECK(vOut[i].GetHash() == vMnb[i].GetHash());
+        BOOST_CHECK(vOut[i].lastPing == vMnb[i].lastPing);
+        BOOST_CHECK_EQUAL(vOut[i].lastPing.sigTime, vMnb[i].lastPing.sigTime);
+        BOOST_CHECK(vOut[i].lastPing.vchSig == vMnb[i].lastPing.vchSig);
+    }
+
+    // Packed smaller than the entries sent one by one
+    CDataStream ssItems(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CMasternodeBroadcast& mnb : vMnb)
+        ssItems << mnb;
+    BOOST_CHECK(snapshot.vchEntries.size() < ssItems.size());
+
+    // Any change to the entries breaks the list hash
+    snapshot2.vchEntries[10] ^= 1;
+    BOOST_CHECK(!snapshot2.Unpack(vOut, strError));
+    BOOST_CHECK_EQUAL(strError, "list hash mismatch");
+    BOOST_CHECK(vOut.empty());
+
+    snapshot.nFormat = MNLIST_SNAPSHOT_FORMAT + 1;
+    BOOST_CHECK(!snapshot.Unpack(vOut, strError));
+}
+
+BOOST_AUTO_TEST_CASE(mnsnapshot_signatures)
+{
+    std::vector<CMasternodeBroadcast> vMnb = SignedBroadcasts(200);
+    vMnb[7].sigTime++;
+    vMnb[150].sig[5] ^= 1;
+
+    std::vector<char> vValid;
+    CheckMasternodeBroadcastSignatures(vMnb, vValid, 4);
+    BOOST_CHECK_EQUAL(vValid.size(), vMnb.size());
+    for (size_t i = 0; i < vValid.size(); i++)
+        BOOST_CHECK_EQUAL(vValid[i] != 0, i != 7 && i != 150);
+
+    CheckMasternodeBroadcastSignatures(vMnb, vValid, 1);
+    BOOST_CHECK(vValid[0] && !vValid[7]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
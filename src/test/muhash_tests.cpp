@@ -0,0 +1,157 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "coins.h"
+#include "random.h"
+#include "streams.h"
+#include "uint256.h"
+#include "version.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+uint256 Digest(const MuHash3072& muhash)
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+MuHash3072 FromElements(const std::vector<uint256>& vElements)
+{
+    MuHash3072 muhash;
+    for (unsigned int i = 0; i < vElements.size(); i++)
+        muhash.Insert(vElements[i].begin(), vElements[i].size());
+    return muhash;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(muhash_tests)
+
+BOOST_AUTO_TEST_CASE(num3072_inverse)
+{
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (unsigned int i = 0; i < sizeof(data); i++)
+        data[i] = insecure_rand();
+    Num3072 x(data);
+    Num3072 y(x);
+    y.Multiply(x.GetInverse());
+
+    unsigned char out[Num3072::BYTE_SIZE];
+    y.ToBytes(out);
+    BOOST_CHECK_EQUAL(out[0], 1);
+    for (unsigned int i = 1; i < sizeof(out); i++)
+        BOOST_CHECK_EQUAL(out[i], 0);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_semantics)
+{
+    std::vector<uint256> vElements;
+    for (int i = 0; i < 8; i++)
+        vElements.push_back(GetRandHash());
+
+    // Order does not matter
+    std::vector<uint256> vReversed(vElements.rbegin(), vElements.rend());
+    uint256 hashSet = Digest(FromElements(vElements));
+    BOOST_CHECK(hashSet == Digest(FromElements(vReversed)));
+    BOOST_CHECK(hashSet != Digest(MuHash3072()));
+
+    // Removing what was inserted leaves the set as it was, in any order
+    MuHash3072 muhash = FromElements(vElements);
+    uint256 extra = GetRandHash();
+    muhash.Remove(vElements[3].begin(), 32);
+    muhash.Insert(extra.begin(), 32);
+    muhash.Insert(vElements[3].begin(), 32);
+    BOOST_CHECK(Digest(muhash) != hashSet);
+    muhash.Remove(extra.begin(), 32);
+    BOOST_CHECK(Digest(muhash) == hashSet);
+
+    MuHash3072 empty;
+    empty.Insert(extra.begin(), 32).Remove(extra.begin(), 32);
+    BOOST_CHECK(Digest(empty) == Digest(MuHash3072()));
+
+    // Combining change sets is the same as applying them one by one
+    std::vector<uint256> vFirst(vElements.begin(), vElements.begin() + 5);
+    MuHash3072 change;
+    change.Remove(vElements[0].begin(), 32);
+    for (unsigned int i = 5; i < vElements.size(); i++)
+        change.Insert(vElements[i].begin(), 32);
+    change.Insert(vElements[0].begin(), 32);
+    MuHash3072 combined = FromElements(vFirst);
+    combined *= change;
+    BOOST_CHECK(Digest(combined) == hashSet);
+    combined /= change;
+    BOOST_CHECK(Digest(combined) == Digest(FromElements(vFirst)));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_state)
+{
+    MuHash3072 muhash;
+    for (int i = 0; i < 4; i++) {
+        uint256 element = GetRandHash();
+        muhash.Insert(element.begin(), 32);
+        if (i % 2)
+            muhash.Remove(element.begin(), 32);
+    }
+
+    unsigned char state[MuHash3072::SERIALIZED_SIZE];
+    muhash.GetState(state);
+    MuHash3072 restored;
+    restored.SetState(state);
+    BOOST_CHECK(Digest(restored) == Digest(muhash));
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_serialization)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(3);
+    mtx.vout[0].nValue = 5 * COIN;
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtx.vout[1].nValue = 0;
+    mtx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    mtx.vout[2].nValue = COIN / 2;
+    mtx.vout[2].scriptPubKey = CScript() << OP_TRUE << OP_TRUE;
+    CTransaction tx(mtx);
+    CCoins coins(tx, 100);
+
+    CUTXOStats stats;
+    stats.AddCoins(tx.GetHash(), coins);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1);
+    // The OP_RETURN output never makes it into the set
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 2);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 5 * COIN + COIN / 2);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, 2 * (32 + 4 + 4 + 8 + 2) + 1 + 2);
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << stats;
+    CUTXOStats stats2;
+    ss >> stats2;
+    CCoinsStats result, result2;
+    stats.GetStats(result);
+    stats2.GetStats(result2);
+    BOOST_CHECK_EQUAL(result2.nTransactions, result.nTransactions);
+    BOOST_CHECK_EQUAL(result2.nTransactionOutputs, result.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(result2.nBogoSize, result.nBogoSize);
+    BOOST_CHECK_EQUAL(result2.nTotalAmount, result.nTotalAmount);
+    BOOST_CHECK(result2.hashMuHash == result.hashMuHash);
+
+    // Spending everything brings the statistics back to the empty set
+    stats2.RemoveCoins(tx.GetHash(), coins);
+    CCoinsStats empty, emptyExpected;
+    stats2.GetStats(empty);
+    CUTXOStats().GetStats(emptyExpected);
+    BOOST_CHECK_EQUAL(empty.nTransactions, 0);
+    BOOST_CHECK_EQUAL(empty.nTransactionOutputs, 0);
+    BOOST_CHECK_EQUAL(empty.nBogoSize, 0);
+    BOOST_CHECK_EQUAL(empty.nTotalAmount, 0);
+    BOOST_CHECK(empty.hashMuHash == emptyExpected.hashMuHash);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
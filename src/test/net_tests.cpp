@@ -0,0 +1,58 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+
+#include "chainparams.h"
+#include "protocol.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+CDataStream MessageHeader(unsigned int nMessageSize)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader("ping", nMessageSize);
+    return ss;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(net_recv_queue_size)
+{
+    CAddress addr(CService("10.0.0.2", 32323));
+    CNode node(INVALID_SOCKET, addr, "", true);
+    size_t nTotalBefore = CNode::GetTotalRecvQueueSize();
+    LOCK(node.cs_vRecvMsg);
+
+    // A header and part of the data are queued, then dropped
+    CDataStream ss = MessageHeader(100);
+    ss << std::vector<char>(39, 'x');
+    BOOST_CHECK(node.ReceiveMsgBytes(&ss[0], ss.size()));
+    BOOST_CHECK_EQUAL(node.GetTotalRecvSize(), ss.size());
+    BOOST_CHECK_EQUAL(CNode::GetTotalRecvQueueSize(), nTotalBefore + ss.size());
+    node.ClearRecvMsgs();
+    BOOST_CHECK_EQUAL(node.GetTotalRecvSize(), 0U);
+    BOOST_CHECK_EQUAL(CNode::GetTotalRecvQueueSize(), nTotalBefore);
+
+    // A header announcing an oversized message is rejected once read
+    ss = MessageHeader(MAX_PROTOCOL_MESSAGE_LENGTH + 1);
+    BOOST_CHECK(!node.ReceiveMsgBytes(&ss[0], ss.size()));
+    node.ClearRecvMsgs();
+    BOOST_CHECK_EQUAL(node.GetTotalRecvSize(), 0U);
+    BOOST_CHECK_EQUAL(CNode::GetTotalRecvQueueSize(), nTotalBefore);
+
+    // A header beyond MAX_SIZE fails to parse, in two reads
+    ss = MessageHeader(MAX_SIZE + 1);
+    BOOST_CHECK(node.ReceiveMsgBytes(&ss[0], 10));
+    BOOST_CHECK(!node.ReceiveMsgBytes(&ss[10], ss.size() - 10));
+    node.ClearRecvMsgs();
+    BOOST_CHECK_EQUAL(node.GetTotalRecvSize(), 0U);
+    BOOST_CHECK_EQUAL(CNode::GetTotalRecvQueueSize(), nTotalBefore);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
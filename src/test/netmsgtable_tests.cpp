@@ -0,0 +1,99 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgtable.h"
+
+#include "main.h"
+#include "version.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+int nPingCalls = 0;
+
+bool CountPing(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    nPingCalls++;
+    return true;
+}
+
+bool HoldsMain(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+{
+    AssertLockHeld(cs_main);
+    return false;
+}
+
+CNetMsgStats PeerStats(CNode& node, const std::string& strCommand)
+{
+    CNodeStats stats;
+    node.copyStats(stats);
+    return stats.mapRecvMsgStats[strCommand];
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(netmsgtable_tests)
+
+BOOST_AUTO_TEST_CASE(netmsgtable_register)
+{
+    CNetMsgTable table;
+    CNetMsgHandler ping = {"ping", &CountPing, NETMSG_LOCK_NONE};
+    CNetMsgHandler other = {"ping", &HoldsMain, NETMSG_LOCK_MAIN};
+    BOOST_CHECK(table.Register(ping));
+    // The first handler of a command stays
+    BOOST_CHECK(!table.Register(other));
+    BOOST_CHECK(table.Lookup("ping")->actor == &CountPing);
+    BOOST_CHECK(table.Lookup("pong") == NULL);
+
+    table.Clear();
+    BOOST_CHECK(table.Lookup("ping") == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(netmsgtable_dispatch)
+{
+    CNetMsgTable table;
+    CNetMsgHandler handlers[] = {
+        {"ping", &CountPing, NETMSG_LOCK_NONE},
+        {"filterclear", &HoldsMain, NETMSG_LOCK_MAIN},
+    };
+    table.Register(handlers, ARRAYLEN(handlers));
+
+    CAddress addr(CService("10.0.0.1", 32323));
+    CNode node(INVALID_SOCKET, addr, "", true);
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    vRecv << (uint64_t)42;
+
+    nPingCalls = 0;
+    std::string strCommand = "ping";
+    BOOST_CHECK(table.Dispatch(&node, strCommand, vRecv, 0));
+    BOOST_CHECK(table.Dispatch(&node, strCommand, vRecv, 0));
+    BOOST_CHECK_EQUAL(nPingCalls, 2);
+
+    strCommand = "filterclear";
+    BOOST_CHECK(!table.Dispatch(&node, strCommand, vRecv, 0));
+
+    // Unknown commands are ignored, all under one key
+    strCommand = "nosuchcmd";
+    BOOST_CHECK(table.Dispatch(&node, strCommand, vRecv, 0));
+    strCommand = "another";
+    BOOST_CHECK(table.Dispatch(&node, strCommand, vRecv, 0));
+
+    std::map<std::string, CNetMsgStats> mapStats;
+    table.GetStats(mapStats);
+    BOOST_CHECK_EQUAL(mapStats.size(), 3U);
+    BOOST_CHECK_EQUAL(mapStats["ping"].nCount, 2U);
+    BOOST_CHECK_EQUAL(mapStats["ping"].nBytes, 16U);
+    BOOST_CHECK_EQUAL(mapStats["ping"].nErrors, 0U);
+    BOOST_CHECK_EQUAL(mapStats["filterclear"].nErrors, 1U);
+    BOOST_CHECK_EQUAL(mapStats[NETMSG_OTHER].nCount, 2U);
+    BOOST_CHECK(mapStats["ping"].nMaxMicros <= mapStats["ping"].nTotalMicros);
+
+    BOOST_CHECK_EQUAL(PeerStats(node, "ping").nCount, 2U);
+    BOOST_CHECK_EQUAL(PeerStats(node, "filterclear").nCount, 1U);
+    BOOST_CHECK_EQUAL(PeerStats(node, NETMSG_OTHER).nBytes, 16U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
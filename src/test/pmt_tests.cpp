@@ -104,4 +104,50 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_coinbase_update_and_branches)
+{
+    static const unsigned int nTxCounts[] = {1, 2, 3, 7, 17, 56, 513};
+
+    for (int n = 0; n < 7; n++) {
+        unsigned int nTx = nTxCounts[n];
+
+        CBlock block;
+        for (unsigned int j=0; j<nTx; j++) {
+            CMutableTransaction tx;
+            tx.nLockTime = rand();
+            block.vtx.push_back(CTransaction(tx));
+        }
+        block.BuildMerkleTree();
+
+        // replacing the coinbase only rehashes the left edge, but must give the full rebuild's root
+        CMutableTransaction txCoinbase(block.vtx[0]);
+        txCoinbase.nLockTime++;
+        block.vtx[0] = txCoinbase;
+        uint256 merkleRoot = block.UpdateMerkleTreeCoinbase();
+        CBlock blockRebuilt(block);
+        BOOST_CHECK(merkleRoot == blockRebuilt.BuildMerkleTree());
+        BOOST_CHECK(block.vMerkleTree == blockRebuilt.vMerkleTree);
+
+        // a changed non-coinbase transaction makes the cached tree unusable for patching
+        if (nTx > 1) {
+            CMutableTransaction txLast(block.vtx[nTx-1]);
+            txLast.nLockTime++;
+            block.vtx[nTx-1] = txLast;
+            merkleRoot = block.UpdateMerkleTreeCoinbase();
+            BOOST_CHECK(merkleRoot == CBlock(block).BuildMerkleTree());
+        }
+
+        // every branch from a single batched walk connects its txid to the root
+        std::vector<int> vIndex;
+        for (unsigned int j=0; j<nTx; j++)
+            vIndex.push_back(j);
+        std::vector<std::vector<uint256> > vBranches = block.GetMerkleBranches(vIndex);
+        BOOST_CHECK(vBranches.size() == nTx);
+        for (unsigned int j=0; j<nTx; j++) {
+            BOOST_CHECK(vBranches[j] == block.GetMerkleBranch(j));
+            BOOST_CHECK(CBlock::CheckMerkleBranch(block.vtx[j].GetHash(), vBranches[j], j) == merkleRoot);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
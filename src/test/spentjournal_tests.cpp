@@ -0,0 +1,127 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "spentjournal.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** A block whose only non coinbase transaction spends the given outpoint */
+CBlock BlockSpending(const COutPoint& out)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = out;
+    tx.vout.resize(1);
+    block.vtx.push_back(tx);
+    return block;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(spentjournal_tests)
+
+BOOST_AUTO_TEST_CASE(spentjournal_fork_and_active)
+{
+    CSpentOutPointJournal journal;
+    CBlockIndex tip, fork;
+    tip.nHeight = 10;
+    fork.nHeight = 10;
+    COutPoint a(GetRandHash(), 0), b(GetRandHash(), 1);
+
+    journal.AddBlock(&fork, BlockSpending(a));
+    BOOST_CHECK(journal.HaveBlock(&fork));
+    BOOST_CHECK(journal.IsSpentBy(&fork, a));
+    BOOST_CHECK(!journal.IsSpentBy(&fork, b));
+    BOOST_CHECK(!journal.IsSpentBy(&tip, a));
+
+    // Fork blocks do not count as active chain spends
+    int nHeight = 0;
+    BOOST_CHECK(!journal.GetActiveSpendHeight(a, nHeight));
+
+    journal.ConnectBlock(&tip, BlockSpending(b));
+    BOOST_CHECK(journal.GetActiveSpendHeight(b, nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 10);
+
+    // A disconnected block stays journaled for the fork it is on now
+    journal.DisconnectBlock(&tip);
+    BOOST_CHECK(!journal.GetActiveSpendHeight(b, nHeight));
+    BOOST_CHECK(journal.IsSpentBy(&tip, b));
+
+    journal.ConnectBlock(&fork, BlockSpending(b));
+    BOOST_CHECK(journal.GetActiveSpendHeight(a, nHeight));
+    BOOST_CHECK_EQUAL(journal.GetBlockCount(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(spentjournal_prune)
+{
+    CSpentOutPointJournal journal;
+    CBlockIndex index[5];
+    std::vector<COutPoint> vOut;
+    for (int i = 0; i < 5; i++) {
+        index[i].nHeight = i;
+        vOut.push_back(COutPoint(GetRandHash(), i));
+        journal.ConnectBlock(&index[i], BlockSpending(vOut[i]));
+    }
+
+    journal.Prune(3);
+    BOOST_CHECK_EQUAL(journal.GetBlockCount(), 2U);
+    BOOST_CHECK(!journal.HaveBlock(&index[2]));
+    BOOST_CHECK(journal.HaveBlock(&index[3]));
+    int nHeight;
+    BOOST_CHECK(!journal.GetActiveSpendHeight(vOut[2], nHeight));
+    BOOST_CHECK(journal.GetActiveSpendHeight(vOut[3], nHeight));
+
+    // Pruned heights are not recorded again, and pruning never goes back
+    journal.AddBlock(&index[1], BlockSpending(vOut[1]));
+    BOOST_CHECK(!journal.HaveBlock(&index[1]));
+    journal.Prune(1);
+    journal.AddBlock(&index[2], BlockSpending(vOut[2]));
+    BOOST_CHECK(!journal.HaveBlock(&index[2]));
+
+    journal.Clear();
+    BOOST_CHECK_EQUAL(journal.GetBlockCount(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(spentjournal_fork_below_prune)
+{
+    CSpentOutPointJournal journal;
+    CBlockIndex tip, fork;
+    tip.nHeight = 20;
+    fork.nHeight = 5;
+    COutPoint a(GetRandHash(), 0), b(GetRandHash(), 1);
+
+    journal.ConnectBlock(&tip, BlockSpending(b));
+    journal.Prune(10);
+
+    // A fork block below the pruned height is not journaled, its spends must be checked on the block
+    CBlock block = BlockSpending(a);
+    BOOST_CHECK(!journal.AddBlock(&fork, block));
+    BOOST_CHECK(!journal.HaveBlock(&fork));
+    BOOST_CHECK(!journal.IsSpentBy(&fork, a));
+    BOOST_CHECK(CSpentOutPointJournal::BlockSpends(block, a));
+    BOOST_CHECK(!CSpentOutPointJournal::BlockSpends(block, b));
+
+    // The coinbase null prevout is never a spend
+    COutPoint null;
+    null.SetNull();
+    BOOST_CHECK(!CSpentOutPointJournal::BlockSpends(block, null));
+
+    fork.nHeight = 10;
+    BOOST_CHECK(journal.AddBlock(&fork, block));
+    BOOST_CHECK(journal.IsSpentBy(&fork, a));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,277 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet.h"
+#include "walletdb.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/**
+ * Fake blocks an hour apart, each generating a stake modifier, ending at
+ * nTimeTip. While in scope they are indexed, and the branch is made the
+ * active chain on creation.
+ */
+struct CStakeBranch {
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    CStakeBranch(CBlockIndex* pindexFork, int nLength, unsigned int nSalt, int64_t nTimeTip) : vHashes(nLength), vIndex(nLength)
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < nLength; i++) {
+            vHashes[i] = uint256((uint64_t)nSalt << 32 | (unsigned int)i);
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i ? &vIndex[i - 1] : pindexFork;
+            vIndex[i].nHeight = vIndex[i].pprev->nHeight + 1;
+            vIndex[i].nTime = nTimeTip - (nLength - 1 - i) * 60 * 60;
+            vIndex[i].nFlags |= CBlockIndex::BLOCK_STAKE_MODIFIER;
+            mapBlockIndex[vHashes[i]] = &vIndex[i];
+        }
+        chainActive.SetTip(Tip());
+    }
+
+    ~CStakeBranch()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(chainActive.Genesis());
+        for (const uint256& hash : vHashes)
+            mapBlockIndex.erase(hash);
+    }
+
+    CBlockIndex* Tip() { return &vIndex.back(); }
+
+    //! The block nDepth confirmations deep while this branch is active
+    CBlockIndex* AtDepth(int nDepth) { return &vIndex[vIndex.size() - nDepth]; }
+};
+
+/** A file backed wallet with one key, at a mocked time the test moves forward */
+struct StakeableSetup {
+    int64_t nTime;
+    std::string strFile;
+    CWallet wallet;
+    CScript scriptPubKey;
+
+    StakeableSetup() : nTime(GetTime()), strFile(NewWalletFile()), wallet(strFile)
+    {
+        SetMockTime(nTime);
+        CKey key;
+        key.MakeNewKey(true);
+        BOOST_REQUIRE(wallet.AddKeyPubKey(key, key.GetPubKey()));
+        scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+
+    ~StakeableSetup()
+    {
+        SetMockTime(0);
+    }
+
+    static std::string NewWalletFile()
+    {
+        static int nWallets = 0;
+        std::string strName = strprintf("stakeable%d.dat", nWallets++);
+        CWalletDB(strName, "cr+");
+        return strName;
+    }
+
+    /** Pays us nValue in each output; a null prevout makes a coinbase */
+    CMutableTransaction Payment(const COutPoint& prevout, CAmount nValue, int nOutputs = 1)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        for (int i = 0; i < nOutputs; i++)
+            tx.vout.push_back(CTxOut(nValue, scriptPubKey));
+        return tx;
+    }
+
+    CMutableTransaction Coinstake(const COutPoint& prevout, CAmount nValue)
+    {
+        CMutableTransaction tx = Payment(prevout, nValue);
+        tx.vout.insert(tx.vout.begin(), CTxOut(0, CScript()));
+        return tx;
+    }
+
+    /** Adds tx to the wallet as mined in the block of that hash */
+    COutPoint AddTx(const CMutableTransaction& tx, const uint256& hashBlock)
+    {
+        CWalletTx wtx(&wallet, tx);
+        wtx.hashBlock = hashBlock;
+        wtx.nIndex = 0;
+        // The fake blocks have no transactions to check a merkle branch against
+        wtx.fMerkleVerified = true;
+        BOOST_CHECK(wallet.AddToWallet(wtx));
+        return COutPoint(wtx.GetHash(), tx.vout.size() - 1);
+    }
+
+    COutPoint AddTx(const CMutableTransaction& tx, const CBlockIndex* pindex)
+    {
+        return AddTx(tx, pindex->GetBlockHash());
+    }
+
+    std::set<COutPoint> Candidates()
+    {
+        std::vector<CStakeCandidate> vCandidates;
+        wallet.GetStakeCandidates(vCandidates);
+        std::set<COutPoint> setOutpoints;
+        for (const CStakeCandidate& candidate : vCandidates)
+            setOutpoints.insert(candidate.prevout);
+        return setOutpoints;
+    }
+};
+
+COutPoint RandomOutPoint()
+{
+    return COutPoint(GetRandHash(), 0);
+}
+} // anon namespace
+
+BOOST_FIXTURE_TEST_SUITE(stakeable_tests, StakeableSetup)
+
+BOOST_AUTO_TEST_CASE(stakeable_maturity)
+{
+    const int nMaturity = Params().COINBASE_MATURITY();
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+
+    COutPoint payment10 = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(10));
+    COutPoint payment9 = AddTx(Payment(RandomOutPoint(), 2 * COIN), branch.AtDepth(9));
+    COutPoint coinbaseMature = AddTx(Payment(COutPoint(), 3 * COIN), branch.AtDepth(nMaturity + 1));
+    COutPoint coinbaseImmature = AddTx(Payment(COutPoint(), 4 * COIN), branch.AtDepth(nMaturity));
+    COutPoint coinstakeMature = AddTx(Coinstake(RandomOutPoint(), 5 * COIN), branch.AtDepth(nMaturity + 1));
+    COutPoint coinstakeImmature = AddTx(Coinstake(RandomOutPoint(), 6 * COIN), branch.AtDepth(nMaturity));
+
+    // Too young until nStakeMinAge has passed since they were received
+    BOOST_CHECK(Candidates().empty());
+    BOOST_CHECK(!wallet.MintableCoins());
+
+    SetMockTime(nTime + nStakeMinAge);
+    std::set<COutPoint> setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 3U);
+    BOOST_CHECK(setCandidates.count(payment10));
+    BOOST_CHECK(!setCandidates.count(payment9));
+    BOOST_CHECK(setCandidates.count(coinbaseMature));
+    BOOST_CHECK(!setCandidates.count(coinbaseImmature));
+    BOOST_CHECK(setCandidates.count(coinstakeMature));
+    BOOST_CHECK(!setCandidates.count(coinstakeImmature));
+    BOOST_CHECK(wallet.MintableCoins());
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_block_leaves_chain)
+{
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+    COutPoint kept = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(50));
+    COutPoint reorged = AddTx(Payment(RandomOutPoint(), 2 * COIN), branch.AtDepth(20));
+
+    SetMockTime(nTime + nStakeMinAge);
+    BOOST_CHECK_EQUAL(Candidates().size(), 2U);
+
+    // A longer branch forking between the two blocks takes over
+    CStakeBranch fork(branch.AtDepth(30), 40, 2, nTime);
+    std::set<COutPoint> setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 1U);
+    BOOST_CHECK(setCandidates.count(kept));
+    BOOST_CHECK(!setCandidates.count(reorged));
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(branch.Tip());
+    }
+    BOOST_CHECK(Candidates().count(reorged));
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_orphaned_coinstake)
+{
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+    COutPoint coin = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(50));
+    // Its block was disconnected, so it is neither on the chain nor in the mempool
+    COutPoint coinstake = AddTx(Coinstake(coin, 2 * COIN), GetRandHash());
+
+    SetMockTime(nTime + nStakeMinAge);
+    std::set<COutPoint> setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 1U);
+    BOOST_CHECK(setCandidates.count(coin));
+    BOOST_CHECK(!setCandidates.count(coinstake));
+    BOOST_CHECK(wallet.MintableCoins());
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_deep_spend_drops_entry)
+{
+    const int nMaturity = Params().COINBASE_MATURITY();
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+    COutPoint spentDeep = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(90));
+    COutPoint spentShallow = AddTx(Payment(RandomOutPoint(), 2 * COIN), branch.AtDepth(80));
+    COutPoint unspent = AddTx(Payment(RandomOutPoint(), 3 * COIN), branch.AtDepth(70));
+    // Too shallow to stake, but keeps the balance high enough that the spent
+    // outputs are looked at rather than skipped for the target amount
+    AddTx(Payment(RandomOutPoint(), 100 * COIN), branch.AtDepth(5));
+
+    CMutableTransaction spendDeep = Payment(spentDeep, 1 * COIN);
+    spendDeep.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    AddTx(spendDeep, branch.AtDepth(nMaturity + 1));
+    CMutableTransaction spendShallow = Payment(spentShallow, 2 * COIN);
+    spendShallow.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    AddTx(spendShallow, branch.AtDepth(nMaturity));
+
+    SetMockTime(nTime + nStakeMinAge);
+    std::set<COutPoint> setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 1U);
+    BOOST_CHECK(setCandidates.count(unspent));
+
+    // Without the spends, only the output spent within a reorg's reach comes back
+    wallet.EraseFromWallet(CTransaction(spendDeep).GetHash());
+    wallet.EraseFromWallet(CTransaction(spendShallow).GetHash());
+    wallet.MarkDirty();
+    setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 2U);
+    BOOST_CHECK(setCandidates.count(unspent));
+    BOOST_CHECK(setCandidates.count(spentShallow));
+    BOOST_CHECK(!setCandidates.count(spentDeep));
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_locked_coins)
+{
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+    COutPoint coin = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(50));
+
+    SetMockTime(nTime + nStakeMinAge);
+    BOOST_CHECK(wallet.MintableCoins());
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.LockCoin(coin);
+    }
+    BOOST_CHECK(Candidates().empty());
+    BOOST_CHECK(!wallet.MintableCoins());
+
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.UnlockCoin(coin);
+    }
+    BOOST_CHECK(Candidates().count(coin));
+    BOOST_CHECK(wallet.MintableCoins());
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_erase_from_wallet)
+{
+    CStakeBranch branch(chainActive.Tip(), 100, 1, nTime);
+    COutPoint kept = AddTx(Payment(RandomOutPoint(), 1 * COIN), branch.AtDepth(50));
+    CMutableTransaction tx = Payment(RandomOutPoint(), 2 * COIN, 3);
+    AddTx(tx, branch.AtDepth(40));
+
+    SetMockTime(nTime + nStakeMinAge);
+    BOOST_CHECK_EQUAL(Candidates().size(), 4U);
+
+    wallet.EraseFromWallet(CTransaction(tx).GetHash());
+    std::set<COutPoint> setCandidates = Candidates();
+    BOOST_CHECK_EQUAL(setCandidates.size(), 1U);
+    BOOST_CHECK(setCandidates.count(kept));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
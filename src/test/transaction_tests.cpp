@@ -315,6 +315,27 @@ BOOST_AUTO_TEST_CASE(test_Get)
     BOOST_CHECK(!AreInputsStandard(t1, coins));
 }
 
+BOOST_AUTO_TEST_CASE(test_MoveAssign)
+{
+    CMutableTransaction t;
+    t.nLockTime = 100;
+    t.vin.resize(2);
+    t.vin[1].prevout.n = 1;
+    t.vout.resize(1);
+    t.vout[0].nValue = 90*CENT;
+    CTransaction txFrom(t), txTo;
+
+    txTo = std::move(txFrom);
+    BOOST_CHECK(txTo == CTransaction(t));
+    BOOST_CHECK_EQUAL(txTo.vin.size(), 2U);
+    BOOST_CHECK_EQUAL(txTo.vout[0].nValue, 90*CENT);
+    BOOST_CHECK_EQUAL(txTo.nLockTime, 100U);
+
+    // What is left behind is null, with a hash to match
+    BOOST_CHECK(txFrom.IsNull());
+    BOOST_CHECK(txFrom.GetHash() == CTransaction(CMutableTransaction(txFrom)).GetHash());
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard)
 {
     LOCK(cs_main);
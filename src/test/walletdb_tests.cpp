@@ -0,0 +1,141 @@
+// Copyright (c) 2018-2020 The ROIyalCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet.h"
+#include "walletdb.h"
+
+#include "main.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+bool HasPool(const std::string& strFile, int64_t nPool)
+{
+    CWalletDB walletdb(strFile);
+    CKeyPool keypool;
+    return walletdb.ReadPool(nPool, keypool);
+}
+
+void CheckNotInBatch(const std::string& strFile, bool* pfResult)
+{
+    *pfResult = bitdb.GetBatchTxn(strFile) == NULL;
+}
+
+CWalletTx SpendingTx(const COutPoint& prevout, int nOrderPos)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nOrderPos + 1;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CWalletTx wtx(NULL, tx);
+    wtx.nOrderPos = nOrderPos;
+    return wtx;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(walletdb_tests)
+
+BOOST_AUTO_TEST_CASE(walletdb_batch)
+{
+    const std::string strFile = "walletdb_batch.dat";
+    CKeyPool keypool;
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        BOOST_CHECK(bitdb.GetBatchTxn(strFile) == NULL);
+    }
+
+    {
+        CDBBatch batch(strFile);
+        BOOST_CHECK(bitdb.GetBatchTxn(strFile) != NULL);
+
+        // Other threads don't join it
+        bool fNotInBatch = false;
+        boost::thread thread(boost::bind(&CheckNotInBatch, strFile, &fNotInBatch));
+        thread.join();
+        BOOST_CHECK(fNotInBatch);
+
+        // Our handles do, and see each other's writes
+        BOOST_CHECK(CWalletDB(strFile).WritePool(1, keypool));
+        BOOST_CHECK(HasPool(strFile, 1));
+        {
+            CDBBatch batchNested(strFile);
+            BOOST_CHECK(CWalletDB(strFile).WritePool(2, keypool));
+        }
+        BOOST_CHECK(bitdb.GetBatchTxn(strFile) != NULL);
+
+        // Explicit transactions nest in the batch and abort on their own
+        CWalletDB walletdb(strFile);
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WritePool(3, keypool));
+        BOOST_CHECK(walletdb.TxnAbort());
+        BOOST_CHECK(!HasPool(strFile, 3));
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WritePool(4, keypool));
+        BOOST_CHECK(walletdb.TxnCommit());
+
+        // Cursors read through the batch
+        CAccountingEntry entry;
+        entry.strAccount = "batch";
+        entry.nCreditDebit = 5;
+        BOOST_CHECK(walletdb.WriteAccountingEntry(entry));
+        std::list<CAccountingEntry> acentries;
+        walletdb.ListAccountCreditDebit("batch", acentries);
+        BOOST_CHECK_EQUAL(acentries.size(), 1U);
+    }
+
+    BOOST_CHECK(bitdb.GetBatchTxn(strFile) == NULL);
+    BOOST_CHECK(HasPool(strFile, 1));
+    BOOST_CHECK(HasPool(strFile, 2));
+    BOOST_CHECK(!HasPool(strFile, 3));
+    BOOST_CHECK(HasPool(strFile, 4));
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_load_txs)
+{
+    const std::string strFile = "walletdb_load.dat";
+    CWalletDB(strFile, "cr+");
+    std::vector<CWalletTx> vWtx;
+    {
+        CDBBatch batch(strFile);
+        CWalletDB walletdb(strFile);
+        for (int i = 0; i < 1000; i++) {
+            vWtx.push_back(SpendingTx(COutPoint(GetRandHash(), i), i));
+            BOOST_CHECK(walletdb.WriteTx(vWtx.back().GetHash(), vWtx.back()));
+        }
+
+        // Two spends of one outpoint share the metadata of the older
+        vWtx[10].mapValue["comment"] = "older";
+        BOOST_CHECK(walletdb.WriteTx(vWtx[10].GetHash(), vWtx[10]));
+        vWtx.push_back(SpendingTx(vWtx[10].vin[0].prevout, 2000));
+        BOOST_CHECK(walletdb.WriteTx(vWtx.back().GetHash(), vWtx.back()));
+
+        // A record under the wrong hash is dropped
+        BOOST_CHECK(walletdb.WriteTx(GetRandHash(), vWtx[20]));
+    }
+
+    int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    nScriptCheckThreads = 4;
+    CWallet wallet(strFile);
+    BOOST_CHECK(CWalletDB(strFile).LoadWallet(&wallet) == DB_NONCRITICAL_ERROR);
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+    mapArgs.erase("-rescan");
+
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), vWtx.size());
+    for (const CWalletTx& wtx : vWtx) {
+        BOOST_REQUIRE(wallet.mapWallet.count(wtx.GetHash()));
+        BOOST_CHECK_EQUAL(wallet.mapWallet[wtx.GetHash()].nOrderPos, wtx.nOrderPos);
+    }
+    BOOST_CHECK_EQUAL(wallet.wtxOrdered.size(), vWtx.size());
+    BOOST_CHECK_EQUAL(wallet.mapWallet[vWtx.back().GetHash()].mapValue["comment"], "older");
+    BOOST_CHECK(wallet.mapWallet[vWtx[11].GetHash()].mapValue.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -30,29 +30,157 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+void static BatchWriteUTXOStats(CLevelDBBatch& batch, const uint256& hash, const CUTXOStats& stats)
 {
+    batch.Write('S', make_pair(hash, stats));
+}
+
+/**
+ * Walk all coins the cursor sees: the legacy serialized hash and size for
+ * stats, and the incremental statistics from scratch for utxoStats.
+ */
+bool static ScanCoins(leveldb::Iterator* pcursor, const uint256& hashBlock, CCoinsStats& stats, CUTXOStats& utxoStats)
+{
+    pcursor->SeekToFirst();
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = hashBlock;
+    ss << stats.hashBlock;
+    CAmount nTotalAmount = 0;
+    utxoStats.SetNull();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType == 'c') {
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CCoins coins;
+                ssValue >> coins;
+                uint256 txhash;
+                ssKey >> txhash;
+                ss << txhash;
+                ss << VARINT(coins.nVersion);
+                ss << (coins.fCoinBase ? 'c' : 'n');
+                ss << VARINT(coins.nHeight);
+                stats.nTransactions++;
+                for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                    const CTxOut& out = coins.vout[i];
+                    if (!out.IsNull()) {
+                        stats.nTransactionOutputs++;
+                        ss << VARINT(i + 1);
+                        ss << out;
+                        nTotalAmount += out.nValue;
+                    }
+                }
+                stats.nSerializedSize += 32 + slValue.size();
+                ss << VARINT(0);
+                utxoStats.AddCoins(txhash, coins);
+            }
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    stats.hashSerialized = ss.GetHash();
+    stats.nTotalAmount = nTotalAmount;
+    return true;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(new CLevelDBWrapper(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe))
+{
+    LoadUTXOStats();
+}
+
+void CCoinsViewDB::LoadUTXOStats()
+{
+    uint256 hashBestChain = GetBestBlock();
+    if (hashBestChain == uint256(0)) {
+        // Empty database, nothing to count yet
+        utxoStats.SetNull();
+        return;
+    }
+
+    pair<uint256, CUTXOStats> stored;
+    try {
+        if (db->Read('S', stored) && stored.first == hashBestChain) {
+            utxoStats = stored.second;
+            return;
+        }
+    } catch (std::exception& e) {
+        LogPrintf("%s : stored UTXO set statistics unreadable - %s\n", __func__, e.what());
+    }
+
+    // Written by a version that did not maintain them, or left behind by
+    // one: count once, then keep them up to date from here on
+    LogPrintf("Computing UTXO set statistics at %s...\n", hashBestChain.ToString());
+    int64_t nStart = GetTimeMillis();
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db->NewIterator());
+    CCoinsStats stats;
+    if (!ScanCoins(pcursor.get(), hashBestChain, stats, utxoStats)) {
+        utxoStats.SetNull();
+        return;
+    }
+    CLevelDBBatch batch;
+    BatchWriteUTXOStats(batch, hashBestChain, utxoStats);
+    db->WriteBatch(batch);
+    LogPrintf("UTXO set statistics: %d transactions, %d outputs, %dms\n", utxoStats.nTransactions, utxoStats.nTransactionOutputs, GetTimeMillis() - nStart);
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    return db->Read(make_pair('c', txid), coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(make_pair('c', txid));
+    return db->Exists(make_pair('c', txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain))
+    if (!db->Read('B', hashBestChain))
+        return uint256(0);
+    return hashBestChain;
+}
+
+CCoinsViewDBSnapshot* CCoinsViewDB::NewSnapshot() const
+{
+    return new CCoinsViewDBSnapshot(db);
+}
+
+CCoinsViewDBSnapshot::CCoinsViewDBSnapshot(const boost::shared_ptr<const CLevelDBWrapper>& dbIn) : db(dbIn), psnapshot(dbIn->GetSnapshot())
+{
+}
+
+CCoinsViewDBSnapshot::~CCoinsViewDBSnapshot()
+{
+    db->ReleaseSnapshot(psnapshot);
+}
+
+bool CCoinsViewDBSnapshot::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    return db->Read(make_pair('c', txid), coins, psnapshot);
+}
+
+bool CCoinsViewDBSnapshot::HaveCoins(const uint256& txid) const
+{
+    return db->Exists(make_pair('c', txid), psnapshot);
+}
+
+uint256 CCoinsViewDBSnapshot::GetBestBlock() const
+{
+    uint256 hashBestChain;
+    if (!db->Read('B', hashBestChain, psnapshot))
         return uint256(0);
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta)
 {
     CLevelDBBatch batch;
     size_t count = 0;
@@ -66,11 +194,24 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (hashBlock != uint256(0))
+    CUTXOStats utxoStatsNew(utxoStats);
+    utxoStatsNew += statsDelta;
+    if (hashBlock != uint256(0)) {
         BatchWriteHashBestChain(batch, hashBlock);
+        BatchWriteUTXOStats(batch, hashBlock, utxoStatsNew);
+    }
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db->WriteBatch(batch))
+        return false;
+    utxoStats = utxoStatsNew;
+    return true;
+}
+
+bool CCoinsViewDB::GetUTXOStats(CUTXOStats& stats) const
+{
+    stats = utxoStats;
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -118,55 +259,31 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db->NewIterator());
+    CUTXOStats utxoStatsScanned;
+    if (!ScanCoins(pcursor.get(), GetBestBlock(), stats, utxoStatsScanned))
+        return false;
+    utxoStatsScanned.GetStats(stats);
+    stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    return true;
+}
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
-            pcursor->Next();
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        }
-    }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+bool CCoinsViewDBSnapshot::GetStats(CCoinsStats& stats) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db->NewIterator(psnapshot));
+    CUTXOStats utxoStatsScanned;
+    if (!ScanCoins(pcursor.get(), GetBestBlock(), stats, utxoStatsScanned))
+        return false;
+    utxoStatsScanned.GetStats(stats);
+    return true;
+}
+
+bool CCoinsViewDBSnapshot::GetUTXOStats(CUTXOStats& stats) const
+{
+    pair<uint256, CUTXOStats> stored;
+    if (!db->Read('S', stored, psnapshot) || stored.first != GetBestBlock())
+        return false;
+    stats = stored.second;
     return true;
 }
 
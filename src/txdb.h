@@ -16,7 +16,10 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
 class CCoins;
+class CCoinsViewDBSnapshot;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -30,7 +33,12 @@ static const int64_t nMinDbCache = 4;
 class CCoinsViewDB : public CCoinsView
 {
 protected:
-    CLevelDBWrapper db;
+    //! Shared with the snapshots taken of it, which may outlive this view
+    boost::shared_ptr<CLevelDBWrapper> db;
+    //! Statistics of the set as of the best block, stored under 'S'
+    CUTXOStats utxoStats;
+
+    void LoadUTXOStats();
 
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
@@ -38,8 +46,35 @@ public:
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CUTXOStats& statsDelta);
+    bool GetStats(CCoinsStats& stats) const;
+    bool GetUTXOStats(CUTXOStats& stats) const;
+
+    /** Snapshot of the current database state, safe to read from any thread. It keeps
+     *  the database open until it is deleted, even after this view is gone */
+    CCoinsViewDBSnapshot* NewSnapshot() const;
+};
+
+/** Read-only view of the coin database frozen at the moment it was created */
+class CCoinsViewDBSnapshot : public CCoinsView
+{
+private:
+    boost::shared_ptr<const CLevelDBWrapper> db;
+    const leveldb::Snapshot* psnapshot;
+
+    CCoinsViewDBSnapshot(const CCoinsViewDBSnapshot&);
+    void operator=(const CCoinsViewDBSnapshot&);
+
+public:
+    explicit CCoinsViewDBSnapshot(const boost::shared_ptr<const CLevelDBWrapper>& dbIn);
+    ~CCoinsViewDBSnapshot();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    /** Full scan of the snapshot, with the stored statistics it should match */
     bool GetStats(CCoinsStats& stats) const;
+    bool GetUTXOStats(CUTXOStats& stats) const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -12,7 +12,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70014;
+static const int PROTOCOL_VERSION = 70017;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -30,4 +30,13 @@ static const int CADDR_TIME_VERSION = 31402;
 //! BIP 0031, pong message, is enabled for all versions AFTER this one
 static const int BIP0031_VERSION = 60000;
 
+//! getheaders answers with headers (not invs) and headers-first block download, starting with this version
+static const int HEADERS_FIRST_VERSION = 70015;
+
+//! sendcmpct, cmpctblock, getblocktxn and blocktxn (compact block relay), starting with this version
+static const int COMPACT_BLOCKS_VERSION = 70016;
+
+//! getmnlist and mnlist (masternode list snapshots), starting with this version
+static const int MNLIST_SNAPSHOT_VERSION = 70017;
+
 #endif // BITCOIN_VERSION_H
@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "hash.h"
 #include "protocol.h"
+#include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
@@ -278,7 +279,8 @@ CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activ
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    // The transaction's commit, or the batch's, checkpoints
+    if (GetTxn())
         return;
 
     // Flush database activity from memory pool to disk log
@@ -306,6 +308,46 @@ void CDB::Close()
     }
 }
 
+CDBBatch::CDBBatch(const std::string& strFilename) : CDB(strFilename), fOuter(false)
+{
+    if (!pdb)
+        return;
+
+    LOCK(bitdb.cs_db);
+    // Within a batch of our own we just join it. Another thread's batch on
+    // the file can't be joined: our writes then commit one by one.
+    if (bitdb.mapBatchTxn.count(strFile))
+        return;
+    DbTxn* ptxn = bitdb.TxnBegin();
+    if (!ptxn)
+        return;
+    CDBEnv::CBatchTxn& batch = bitdb.mapBatchTxn[strFile];
+    batch.ptxn = ptxn;
+    batch.threadId = boost::this_thread::get_id();
+    fOuter = true;
+}
+
+CDBBatch::~CDBBatch()
+{
+    if (!fOuter)
+        return;
+
+    DbTxn* ptxn;
+    {
+        LOCK(bitdb.cs_db);
+        ptxn = bitdb.mapBatchTxn[strFile].ptxn;
+        bitdb.mapBatchTxn.erase(strFile);
+    }
+    int ret = ptxn->commit(0);
+    if (ret != 0) {
+        // Every write of the batch is lost, while the caller's memory still has them
+        LogPrintf("CDBBatch : Error %d committing batch to %s\n", ret, strFile);
+        uiInterface.ThreadSafeMessageBox(strprintf(_("Error: Failed to write to %s, recent changes were lost. Restart to reload it from disk."), strFile),
+            "", CClientUIInterface::MSG_ERROR);
+    }
+    // ~CDB then closes the handle, checkpointing once for the whole batch
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -17,6 +17,7 @@
 #include <vector>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <db_cxx.h>
 
@@ -47,6 +48,13 @@ public:
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
 
+    //! The open CDBBatch transaction on a file and the thread that began it
+    struct CBatchTxn {
+        DbTxn* ptxn;
+        boost::thread::id threadId;
+    };
+    std::map<std::string, CBatchTxn> mapBatchTxn;
+
     CDBEnv();
     ~CDBEnv();
     void MakeMock();
@@ -80,14 +88,24 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
-    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC)
+    DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC, DbTxn* pparent = NULL)
     {
         DbTxn* ptxn = NULL;
-        int ret = dbenv.txn_begin(NULL, &ptxn, flags);
+        int ret = dbenv.txn_begin(pparent, &ptxn, flags);
         if (!ptxn || ret != 0)
             return NULL;
         return ptxn;
     }
+
+    /** The batch transaction on strFile if the calling thread began it */
+    DbTxn* GetBatchTxn(const std::string& strFile)
+    {
+        LOCK(cs_db);
+        std::map<std::string, CBatchTxn>::const_iterator mi = mapBatchTxn.find(strFile);
+        if (mi == mapBatchTxn.end() || mi->second.threadId != boost::this_thread::get_id())
+            return NULL;
+        return mi->second.ptxn;
+    }
 };
 
 extern CDBEnv bitdb;
@@ -114,6 +132,14 @@ private:
     void operator=(const CDB&);
 
 protected:
+    //! The transaction reads and writes go through: our own, else the batch we are in
+    DbTxn* GetTxn()
+    {
+        if (activeTxn)
+            return activeTxn;
+        return bitdb.GetBatchTxn(strFile);
+    }
+
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
@@ -129,7 +155,7 @@ protected:
         // Read
         Dbt datValue;
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
+        int ret = pdb->get(GetTxn(), &datKey, &datValue, 0);
         memset(datKey.get_data(), 0, datKey.get_size());
         if (datValue.get_data() == NULL)
             return false;
@@ -169,7 +195,7 @@ protected:
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
-        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        int ret = pdb->put(GetTxn(), &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
 
         // Clear memory in case it was a private key
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -192,7 +218,7 @@ protected:
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
-        int ret = pdb->del(activeTxn, &datKey, 0);
+        int ret = pdb->del(GetTxn(), &datKey, 0);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -212,7 +238,7 @@ protected:
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
-        int ret = pdb->exists(activeTxn, &datKey, 0);
+        int ret = pdb->exists(GetTxn(), &datKey, 0);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -224,7 +250,7 @@ protected:
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
+        int ret = pdb->cursor(GetTxn(), &pcursor, 0);
         if (ret != 0)
             return NULL;
         return pcursor;
@@ -272,7 +298,8 @@ public:
     {
         if (!pdb || activeTxn)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
+        // Inside a batch this is a child transaction, committed with the batch
+        DbTxn* ptxn = bitdb.TxnBegin(DB_TXN_WRITE_NOSYNC, bitdb.GetBatchTxn(strFile));
         if (!ptxn)
             return false;
         activeTxn = ptxn;
@@ -311,4 +338,28 @@ public:
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
 };
 
+
+/**
+ * Groups the reads and writes made on a database file by the calling thread,
+ * until the object goes out of scope, into one transaction: its CDB handles
+ * join the batch instead of committing and checkpointing every write on
+ * their own. Batches nest; only the outermost one commits. The batch's pages
+ * stay locked until then, so hold it only under the lock that guards the
+ * file's users (cs_wallet for the wallet), and never across Rewrite or
+ * BackupWallet, which wait for the file to be closed.
+ *
+ * The commit happens in the destructor, so its failure can't be returned:
+ * it is logged and reported to the user as an error, since none of the
+ * batch's writes made it to disk.
+ */
+class CDBBatch : public CDB
+{
+private:
+    bool fOuter;
+
+public:
+    explicit CDBBatch(const std::string& strFilename);
+    ~CDBBatch();
+};
+
 #endif // BITCOIN_DB_H
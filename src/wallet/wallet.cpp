@@ -64,6 +64,13 @@ struct CompareValueOnly {
     }
 };
 
+struct CompareOutPointSpend {
+    bool operator()(const pair<COutPoint, uint256>& t1, const pair<COutPoint, uint256>& t2) const
+    {
+        return t1.first < t2.first;
+    }
+};
+
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
@@ -457,6 +464,38 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::LoadWalletTxs(std::vector<CWalletTx>& vWtx)
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<std::pair<COutPoint, uint256> > vSpends;
+    for (CWalletTx& wtxIn : vWtx) {
+        uint256 hash = wtxIn.GetHash();
+        CWalletTx& wtx = mapWallet[hash];
+        wtx = std::move(wtxIn);
+        wtx.BindWallet(this);
+        wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+        if (!wtx.IsCoinBase()) {
+            for (const CTxIn& txin : wtx.vin)
+                vSpends.push_back(make_pair(txin.prevout, hash));
+        }
+    }
+
+    // Insert the spends in order, then sync the metadata of each outpoint
+    // spent more than once a single time instead of on every insert. A
+    // stable sort keeps conflicting spends in the order AddToSpends saw them.
+    std::stable_sort(vSpends.begin(), vSpends.end(), CompareOutPointSpend());
+    for (const PAIRTYPE(COutPoint, uint256)& spend : vSpends)
+        mapTxSpends.insert(mapTxSpends.end(), spend);
+    for (size_t i = 0; i < vSpends.size();) {
+        size_t j = i + 1;
+        while (j < vSpends.size() && vSpends[j].first == vSpends[i].first)
+            j++;
+        if (j - i > 1)
+            SyncMetaData(mapTxSpends.equal_range(vSpends[i].first));
+        i = j;
+    }
+}
+
 bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -661,6 +700,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        // The keys may not be loaded yet, LoadWallet indexes the stakeable coins
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -706,6 +746,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        UpdateStakeableCoins(wtx);
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -725,7 +767,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
  * pblock is optional, but should be provided if the transaction is known to be in a block.
  * If fUpdate is true, existing transactions will be updated.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, int nIndexHint)
 {
     {
         AssertLockHeld(cs_wallet);
@@ -735,7 +777,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
             CWalletTx wtx(this, tx);
             // Get merkle branch if transaction was found in a block
             if (pblock)
-                wtx.SetMerkleBranch(*pblock);
+                wtx.SetMerkleBranch(*pblock, nIndexHint);
             return AddToWallet(wtx);
         }
     }
@@ -757,14 +799,25 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+void CWallet::SyncTransactions(const std::vector<CTransaction>& vtx, const CBlock* pblock)
+{
+    LOCK2(cs_main, cs_wallet);
+    // One database transaction for the whole block
+    CDBBatch batch(fFileBacked ? strWalletFile : "");
+    for (const CTransaction& tx : vtx)
+        SyncTransaction(tx, pblock);
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            mapStakeableCoins.erase(mapStakeableCoins.lower_bound(COutPoint(hash, 0)), mapStakeableCoins.upper_bound(COutPoint(hash, std::numeric_limits<uint32_t>::max())));
+        }
     }
     return;
 }
@@ -1098,8 +1151,9 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 
             CBlock block;
             ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+            CDBBatch batch(fFileBacked ? strWalletFile : "");
+            for (unsigned int i = 0; i < block.vtx.size(); i++) {
+                if (AddToWalletIfInvolvingMe(block.vtx[i], &block, fUpdate, i))
                     ret++;
             }
             pindex = chainActive.Next(pindex);
@@ -1568,34 +1622,6 @@ bool less_then_denom(const COutput& out1, const COutput& out2)
     return (!found1 && found2);
 }
 
-bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const
-{
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
-    CAmount nAmountSelected = 0;
-
-    for (const COutput& out : vCoins) {
-        //make sure not to outrun target amount
-        if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
-            continue;
-
-	 int64_t nTxTime = out.tx->GetTxTime();
-
-        //check for min age
-        if (GetAdjustedTime() - nTxTime < nStakeMinAge)
-            continue;
-
-        //check that it is matured
-        if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
-            continue;
-
-        //add to our stake set
-        setCoins.insert(make_pair(out.tx, out.i));
-        nAmountSelected += out.tx->vout[out.i].nValue;
-    }
-    return true;
-}
-
 bool CWallet::MintableCoins()
 {
     CAmount nBalance = GetBalance();
@@ -1604,18 +1630,35 @@ bool CWallet::MintableCoins()
     if (nBalance <= nReserveBalance)
         return false;
 
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true);
-
-    for (const COutput& out : vCoins) {
-	int64_t nTxTime = out.tx->GetTxTime();
-	if (GetAdjustedTime() - nTxTime > nStakeMinAge)
+    LOCK2(cs_main, cs_wallet);
+    for (PAIRTYPE(const COutPoint, CStakeableCoin)& item : mapStakeableCoins) {
+        if (IsStakeableCoinMature(item.second) && !IsLockedCoin(item.first.hash, item.first.n) &&
+            !IsSpent(item.first.hash, item.first.n))
             return true;
     }
 
     return false;
 }
 
+// requires LOCK2(cs_main, cs_wallet)
+bool CWallet::IsStakeableCoinMature(CStakeableCoin& coin) const
+{
+    if (!coin.pindexFrom) {
+        BlockMap::iterator mi = mapBlockIndex.find(coin.hashBlock);
+        if (mi == mapBlockIndex.end())
+            return false;
+        coin.pindexFrom = mi->second;
+    }
+
+    //check that it is matured
+    int nMinDepth = coin.fMaturing ? std::max(Params().COINBASE_MATURITY() + 1, 10) : 10;
+    if (!chainActive.Contains(coin.pindexFrom) || chainActive.Height() - coin.pindexFrom->nHeight + 1 < nMinDepth)
+        return false;
+
+    //check for min age
+    return GetAdjustedTime() - coin.nTxTime >= nStakeMinAge;
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
@@ -2292,8 +2335,100 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, strFailReason, coinControl, coin_type, useIX, nFeePay);
 }
 
+void CWallet::UpdateStakeableCoins(const CWalletTx& wtx)
+{
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        const COutPoint outpoint(hash, i);
+        if (wtx.hashBlock == 0 || wtx.vout[i].nValue <= 0 || !(IsMine(wtx.vout[i]) & ISMINE_SPENDABLE)) {
+            mapStakeableCoins.erase(outpoint);
+            continue;
+        }
+
+        CStakeableCoin& coin = mapStakeableCoins[outpoint];
+        if (coin.hashBlock != wtx.hashBlock) {
+            coin.hashBlock = wtx.hashBlock;
+            coin.pindexFrom = NULL;
+            coin.pindexModifier = NULL;
+        }
+        coin.nValue = wtx.vout[i].nValue;
+        coin.nTxTime = wtx.GetTxTime();
+        coin.fMaturing = wtx.IsCoinBase() || wtx.IsCoinStake();
+    }
+}
+
+void CWallet::GetStakeCandidates(std::vector<CStakeCandidate>& vCandidates)
+{
+    vCandidates.clear();
+
+    CAmount nBalance = GetBalance();
+    if (mapArgs.count("-reservebalance") && !ParseMoney(mapArgs["-reservebalance"], nReserveBalance)) {
+        error("GetStakeCandidates : invalid reserve balance amount");
+        return;
+    }
+    if (nBalance <= nReserveBalance)
+        return;
+    CAmount nTargetAmount = nBalance - nReserveBalance;
+    CAmount nAmountSelected = 0;
+
+    LOCK2(cs_main, cs_wallet);
+    std::map<COutPoint, CStakeableCoin>::iterator it = mapStakeableCoins.begin();
+    while (it != mapStakeableCoins.end()) {
+        const COutPoint& outpoint = it->first;
+        CStakeableCoin& coin = it->second;
+
+        //make sure not to outrun target amount
+        if (nAmountSelected + coin.nValue > nTargetAmount || IsLockedCoin(outpoint.hash, outpoint.n)) {
+            ++it;
+            continue;
+        }
+
+        if (!IsStakeableCoinMature(coin)) {
+            ++it;
+            continue;
+        }
+
+        // An orphaned coinstake gives its input back, so only spends deeper
+        // than any reorg remove an output for good
+        int nSpentDepth = -1;
+        std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+        for (TxSpends::const_iterator sit = range.first; sit != range.second; ++sit) {
+            std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(sit->second);
+            if (mit != mapWallet.end())
+                nSpentDepth = std::max(nSpentDepth, mit->second.GetDepthInMainChain(false));
+        }
+        if (nSpentDepth > Params().COINBASE_MATURITY()) {
+            mapStakeableCoins.erase(it++);
+            continue;
+        }
+        if (nSpentDepth >= 0) {
+            ++it;
+            continue;
+        }
+
+        if (!coin.pindexModifier || !chainActive.Contains(coin.pindexModifier)) {
+            int nStakeModifierHeight = 0;
+            int64_t nStakeModifierTime = 0;
+            coin.pindexModifier = GetKernelStakeModifierBlock(coin.pindexFrom, nStakeModifierHeight, nStakeModifierTime);
+            if (!coin.pindexModifier) {
+                ++it;
+                continue;
+            }
+        }
+
+        CStakeCandidate candidate;
+        candidate.prevout = outpoint;
+        candidate.nValue = coin.nValue;
+        candidate.nTimeBlockFrom = coin.pindexFrom->GetBlockTime();
+        candidate.nStakeModifier = coin.pindexModifier->nStakeModifier;
+        vCandidates.push_back(candidate);
+        nAmountSelected += coin.nValue;
+        ++it;
+    }
+}
+
 // ppcoin: create coin stake transaction
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime)
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, const COutPoint& prevoutKernel, unsigned int nTimeTx, CMutableTransaction& txNew)
 {
     // The following split & combine thresholds are important to security
     // Should not be adjusted if you don't understand the consequences
@@ -2307,127 +2442,73 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     scriptEmpty.clear();
     txNew.vout.push_back(CTxOut(0, scriptEmpty));
 
-    // Choose coins to use
+    LOCK2(cs_main, cs_wallet);
     CAmount nBalance = GetBalance();
-
-    if (mapArgs.count("-reservebalance") && !ParseMoney(mapArgs["-reservebalance"], nReserveBalance))
-        return error("CreateCoinStake : invalid reserve balance amount");
-
     if (nBalance <= nReserveBalance)
         return false;
 
-    // presstab HyperStake - Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
-    static std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
-    static int nLastStakeSetUpdate = 0;
-
-    if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
-        setStakeCoins.clear();
-        if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
-            return false;
-
-        nLastStakeSetUpdate = GetTime();
-    }
-
-    if (setStakeCoins.empty())
-        return false;
-
-    vector<const CWalletTx*> vwtxPrev;
+    // The kernel was searched for without locks, so its output may be gone
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(prevoutKernel.hash);
+    if (mi == mapWallet.end() || prevoutKernel.n >= mi->second.vout.size())
+        return error("CreateCoinStake : kernel output not in wallet");
+    const CWalletTx* pcoin = &mi->second;
+    if (IsSpent(prevoutKernel.hash, prevoutKernel.n) || pcoin->GetDepthInMainChain() < 1)
+        return error("CreateCoinStake : kernel output no longer available");
+
+    // Nor may it still be mature and old enough, if the chain changed since
+    std::map<COutPoint, CStakeableCoin>::iterator sit = mapStakeableCoins.find(prevoutKernel);
+    if (sit == mapStakeableCoins.end())
+        return error("CreateCoinStake : kernel output not stakeable");
+    if (!IsStakeableCoinMature(sit->second) || sit->second.pindexFrom->GetBlockTime() + nStakeMinAge > nTimeTx)
+        return error("CreateCoinStake : kernel output not mature");
 
     CAmount nCredit = 0;
-    CScript scriptPubKeyKernel;
-
-    //prevent staking a time that won't be accepted
-    if (GetAdjustedTime() <= chainActive.Tip()->nTime)
-        MilliSleep(10000);
-
-    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    CScript scriptPubKeyOut;
+    CScript scriptPubKeyKernel = pcoin->vout[prevoutKernel.n].scriptPubKey;
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        return error("CreateCoinStake : failed to parse kernel");
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+    if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+        return false; // only support pay to public key and pay to address
+    }
+    if (whichType == TX_PUBKEYHASH) // pay to address type
+    {
+        //convert to pay to public key type
+        CKey key;
+        if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
+            if (fDebug && GetBoolArg("-printcoinstake", false))
+                LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+            return false; // unable to find corresponding public key
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
-
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
-
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
-                if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
-            }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
+        scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+    } else
+        scriptPubKeyOut = scriptPubKeyKernel;
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+    txNew.vin.push_back(CTxIn(prevoutKernel.hash, prevoutKernel.n));
+    nCredit += pcoin->vout[prevoutKernel.n].nValue;
+    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+    //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+    const CBlockIndex* pIndex0 = chainActive.Tip();
+    uint64_t nTotalSize = pcoin->vout[prevoutKernel.n].nValue + GetBlockValue(pIndex0->nHeight);
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
+    //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+    if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+    if (fDebug && GetBoolArg("-printcoinstake", false))
+        LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
-    }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
     // Calculate reward
-    const CBlockIndex* pIndex0 = chainActive.Tip();
-
     nCredit += GetBlockValue(pIndex0->nHeight + 1);
 
     //Masternode payment
@@ -2445,14 +2526,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     }
 
     // Sign
-    int nIn = 0;
-    for(const CWalletTx* pcoin : vwtxPrev) {
-        if (!SignSignature(*this, *pcoin, txNew, nIn++))
-            return error("CreateCoinStake : failed to sign coinstake");
-    }
+    if (!SignSignature(*this, *pcoin, txNew, 0))
+        return error("CreateCoinStake : failed to sign coinstake");
 
     // Successfully generated coinstake
-    nLastStakeSetUpdate = 0; //this will trigger stake set to repopulate next round
     return true;
 }
 
@@ -2685,6 +2762,12 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    {
+        LOCK(cs_wallet);
+        for (const PAIRTYPE(uint256, CWalletTx)& item : mapWallet)
+            UpdateStakeableCoins(item.second);
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -3471,18 +3554,21 @@ CWalletKey::CWalletKey(int64_t nExpires)
     nTimeExpires = nExpires;
 }
 
-int CMerkleTx::SetMerkleBranch(const CBlock& block)
+int CMerkleTx::SetMerkleBranch(const CBlock& block, int nIndexHint)
 {
     AssertLockHeld(cs_main);
-    CBlock blockTmp;
 
     // Update the tx's hashBlock
     hashBlock = block.GetHash();
 
     // Locate the transaction
-    for (nIndex = 0; nIndex < (int)block.vtx.size(); nIndex++)
-        if (block.vtx[nIndex] == *(CTransaction*)this)
-            break;
+    if (nIndexHint >= 0 && nIndexHint < (int)block.vtx.size() && block.vtx[nIndexHint] == *(CTransaction*)this) {
+        nIndex = nIndexHint;
+    } else {
+        for (nIndex = 0; nIndex < (int)block.vtx.size(); nIndex++)
+            if (block.vtx[nIndex] == *(CTransaction*)this)
+                break;
+    }
     if (nIndex == (int)block.vtx.size()) {
         vMerkleBranch.clear();
         nIndex = -1;
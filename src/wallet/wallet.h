@@ -57,11 +57,13 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 
 class CAccountingEntry;
+class CBlockIndex;
 class CCoinControl;
 class COutput;
 class CReserveKey;
 class CScript;
 class CWalletTx;
+struct CStakeCandidate;
 
 /** (client) version numbers for particular wallet features */
 enum WalletFeature {
@@ -82,6 +84,20 @@ enum AvailableCoinsType {
     STAKABLE_COINS = 6                      // UTXO's that are valid for staking
 };
 
+/** An output of the wallet that stakes once deep and old enough */
+struct CStakeableCoin {
+    CAmount nValue;
+    int64_t nTxTime;
+    //! Of a coinbase or coinstake, so it has to mature first
+    bool fMaturing;
+    uint256 hashBlock;
+    //! Looked up under cs_main the first time they are needed
+    const CBlockIndex* pindexFrom;
+    const CBlockIndex* pindexModifier;
+
+    CStakeableCoin() : nValue(0), nTxTime(0), fMaturing(false), hashBlock(0), pindexFrom(NULL), pindexModifier(NULL) {}
+};
+
 struct CompactTallyItem {
     CBitcoinAddress address;
     CAmount nAmount;
@@ -163,9 +179,21 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Our outputs in transactions that made it into a block, kept up to date
+     * as transactions are added so the stake minter never scans mapWallet.
+     * Depth, age and spends change with the chain and are checked when the
+     * candidates are picked; outputs spent deeper than any reorg are dropped.
+     */
+    std::map<COutPoint, CStakeableCoin> mapStakeableCoins;
+    void UpdateStakeableCoins(const CWalletTx& wtx);
+    //! On the active chain, deep enough and old enough to stake with; needs cs_main
+    bool IsStakeableCoinMature(CStakeableCoin& coin) const;
+
 public:
     bool MintableCoins();
-    bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
+    //! The coins to stake with, with what their kernels hash; needs cs_main
+    void GetStakeCandidates(std::vector<CStakeCandidate>& vCandidates);
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
     bool SelectCoinsDarkDenominated(CAmount nTargetValue, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet) const;
@@ -200,7 +228,6 @@ public:
     unsigned int nHashDrift;
     unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
-    int nStakeSetUpdateTime;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -250,7 +277,6 @@ public:
         nHashDrift = 180;
         nStakeSplitThreshold = 500;
         nHashInterval = 22;
-        nStakeSetUpdateTime = 300;
 
         //MultiSend
         vMultiSend.clear();
@@ -390,8 +416,11 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
+    //! Move in the transactions read by LoadWallet, indexing what they spend once all are in
+    void LoadWalletTxs(std::vector<CWalletTx>& vWtx);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    void SyncTransactions(const std::vector<CTransaction>& vtx, const CBlock* pblock);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, int nIndexHint = -1);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
@@ -423,7 +452,7 @@ public:
     int GenerateObfuscationOutputs(int nTotalValue, std::vector<CTxOut>& vout);
     bool CreateCollateralTransaction(CMutableTransaction& txCollateral, std::string& strReason);
     bool ConvertList(std::vector<CTxIn> vCoins, std::vector<int64_t>& vecAmounts);
-    bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CMutableTransaction& txNew, unsigned int& nTxNewTime);
+    bool CreateCoinStake(const CKeyStore& keystore, const COutPoint& prevoutKernel, unsigned int nTimeTx, CMutableTransaction& txNew);
     bool MultiSend();
     void AutoCombineDust();
 
@@ -679,7 +708,9 @@ public:
         READWRITE(nIndex);
     }
 
-    int SetMerkleBranch(const CBlock& block);
+    // nIndexHint, if known, is the position of the transaction in block and
+    // saves searching the block for it.
+    int SetMerkleBranch(const CBlock& block, int nIndexHint = -1);
 
 
     /**
@@ -16,6 +16,9 @@
 #include "utiltime.h"
 #include "wallet.h"
 
+#include <atomic>
+
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -417,6 +420,76 @@ public:
     }
 };
 
+/** Decode and check the transaction of a "tx" record; fUpgraded when it needs writing back */
+static bool ReadWalletTx(const uint256& hash, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgraded, string& strErr)
+{
+    fUpgraded = false;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
+        if (!ssValue.empty()) {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        } else {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+/** Whether ssKey is the key of a "tx" record, and of which transaction */
+static bool IsTxRecordKey(const CDataStream& ssKey, uint256& hash)
+{
+    try {
+        CDataStream ssType(ssKey);
+        string strType;
+        ssType >> strType;
+        if (strType != "tx")
+            return false;
+        ssType >> hash;
+        return true;
+    } catch (...) {
+        // Left for ReadKeyValue to report
+        return false;
+    }
+}
+
+/** A "tx" record read by LoadWallet, left for DecodeWalletTxs */
+struct CWalletTxRecord {
+    uint256 hash;
+    CDataStream ssValue;
+    bool fValid;
+    bool fUpgraded;
+    string strErr;
+
+    CWalletTxRecord(const uint256& hashIn, CDataStream&& ssValueIn) : hash(hashIn), ssValue(std::move(ssValueIn)), fValid(false), fUpgraded(false) {}
+};
+
+static void DecodeWalletTxs(vector<CWalletTxRecord>* pvRecords, vector<CWalletTx>* pvWtx, std::atomic<size_t>* pnNext)
+{
+    size_t i;
+    while ((i = (*pnNext)++) < pvRecords->size()) {
+        CWalletTxRecord& record = (*pvRecords)[i];
+        try {
+            record.fValid = ReadWalletTx(record.hash, record.ssValue, (*pvWtx)[i], record.fUpgraded, record.strErr);
+        } catch (...) {
+            record.fValid = false;
+        }
+        // Only the decoded transaction is kept
+        record.ssValue = CDataStream(SER_DISK, CLIENT_VERSION);
+    }
+}
+
 bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, string& strType, string& strErr)
 {
     try {
@@ -436,27 +509,11 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             uint256 hash;
             ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgraded;
+            if (!ReadWalletTx(hash, ssValue, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
-                if (!ssValue.empty()) {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                        wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                } else {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
+            if (fUpgraded)
                 wss.vWalletUpgrade.push_back(hash);
-            }
-
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
@@ -674,6 +731,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
+    vector<CWalletTxRecord> vRecords;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -705,6 +763,14 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            // Transactions make up most of a wallet; they are decoded on
+            // several threads once the cursor is through
+            uint256 hash;
+            if (IsTxRecordKey(ssKey, hash)) {
+                vRecords.push_back(CWalletTxRecord(hash, std::move(ssValue)));
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
@@ -724,6 +790,39 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // Not worth a thread for fewer than 256 transactions
+        int nThreads = std::min(std::max(nScriptCheckThreads, 1), (int)(vRecords.size() / 256));
+        vector<CWalletTx> vWtx(vRecords.size());
+        std::atomic<size_t> nNext(0);
+        boost::thread_group helpers;
+        for (int i = 1; i < nThreads; i++)
+            helpers.create_thread(boost::bind(&DecodeWalletTxs, &vRecords, &vWtx, &nNext));
+        DecodeWalletTxs(&vRecords, &vWtx, &nNext);
+        helpers.join_all();
+
+        // Drop the records that failed, in place
+        size_t nValid = 0;
+        for (size_t i = 0; i < vRecords.size(); i++) {
+            const CWalletTxRecord& record = vRecords[i];
+            if (!record.strErr.empty())
+                LogPrintf("%s\n", record.strErr);
+            if (!record.fValid) {
+                // Rescan if there is a bad transaction record:
+                fNoncriticalErrors = true;
+                SoftSetBoolArg("-rescan", true);
+                continue;
+            }
+            if (record.fUpgraded)
+                wss.vWalletUpgrade.push_back(record.hash);
+            if (vWtx[i].nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            if (nValid != i)
+                vWtx[nValid] = std::move(vWtx[i]);
+            nValid++;
+        }
+        vWtx.resize(nValid);
+        pwallet->LoadWalletTxs(vWtx);
     } catch (boost::thread_interrupted) {
         throw;
     } catch (...) {